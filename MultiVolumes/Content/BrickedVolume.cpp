@@ -0,0 +1,245 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <fstream>
+#include "BrickedVolume.h"
+
+using namespace std;
+
+BrickedVolume::BrickedVolume() :
+	m_header()
+{
+}
+
+BrickedVolume::~BrickedVolume()
+{
+}
+
+bool BrickedVolume::Build(const VolumeGrid& grid, const BuildDesc& desc)
+{
+	if (grid.GetNumVoxels() == 0 || desc.BrickSize == 0) return false;
+
+	const auto brickSize = desc.BrickSize;
+	m_header = {};
+	m_header.Magic = Magic;
+	m_header.Version = Version;
+	m_header.Width = grid.Width;
+	m_header.Height = grid.Height;
+	m_header.Depth = grid.Depth;
+	m_header.BrickSize = brickSize;
+	m_header.NumBricksX = (grid.Width + brickSize - 1) / brickSize;
+	m_header.NumBricksY = (grid.Height + brickSize - 1) / brickSize;
+	m_header.NumBricksZ = (grid.Depth + brickSize - 1) / brickSize;
+
+	m_brickTable.resize(GetNumBricks());
+	m_brickPool.clear();
+
+	const auto brickVoxelCount = GetBrickVoxelCount();
+	vector<float> brick(brickVoxelCount);
+	auto brickIdx = 0u;
+	for (auto bz = 0u; bz < m_header.NumBricksZ; ++bz)
+		for (auto by = 0u; by < m_header.NumBricksY; ++by)
+			for (auto bx = 0u; bx < m_header.NumBricksX; ++bx)
+			{
+				// Gather the brick; voxels beyond the volume edge replicate the border
+				auto minValue = FLT_MAX, maxValue = -FLT_MAX;
+				auto sum = 0.0;
+				auto n = 0u;
+				for (auto z = 0u; z < brickSize; ++z)
+					for (auto y = 0u; y < brickSize; ++y)
+						for (auto x = 0u; x < brickSize; ++x)
+						{
+							const auto value = grid.Fetch(bx * brickSize + x, by * brickSize + y, bz * brickSize + z);
+							minValue = (min)(value, minValue);
+							maxValue = (max)(value, maxValue);
+							sum += value;
+							brick[n++] = value;
+						}
+
+				auto& entry = m_brickTable[brickIdx++];
+				if (maxValue <= desc.EmptyThreshold)
+				{
+					entry.Type = BRICK_EMPTY;
+					entry.Value = 0;
+				}
+				else if (maxValue - minValue <= desc.ConstantTolerance)
+				{
+					const auto value = static_cast<float>(sum / brickVoxelCount);
+					entry.Type = BRICK_CONSTANT;
+					memcpy(&entry.Value, &value, sizeof(float));
+				}
+				else
+				{
+					entry.Type = BRICK_DATA;
+					entry.Value = m_header.NumDataBricks++;
+					for (const auto& value : brick) m_brickPool.emplace_back(FloatToHalf(value));
+				}
+			}
+
+	return true;
+}
+
+bool BrickedVolume::Read(istream& stream)
+{
+	stream.read(reinterpret_cast<char*>(&m_header), sizeof(Header));
+	if (!stream.good() || m_header.Magic != Magic || m_header.Version != Version) return false;
+	if (!validate()) return false;
+
+	m_brickTable.resize(GetNumBricks());
+	stream.read(reinterpret_cast<char*>(m_brickTable.data()), sizeof(BrickEntry) * m_brickTable.size());
+
+	m_brickPool.resize(static_cast<size_t>(m_header.NumDataBricks) * GetBrickVoxelCount());
+	stream.read(reinterpret_cast<char*>(m_brickPool.data()), GetBrickPoolByteSize());
+	if (!stream.good()) return false;
+
+	return validateBrickTable();
+}
+
+bool BrickedVolume::Read(const char* fileName)
+{
+	ifstream file(fileName, ios::binary);
+
+	return file.is_open() && Read(file);
+}
+
+bool BrickedVolume::Write(ostream& stream) const
+{
+	if (!validate()) return false;
+
+	stream.write(reinterpret_cast<const char*>(&m_header), sizeof(Header));
+	stream.write(reinterpret_cast<const char*>(m_brickTable.data()), sizeof(BrickEntry) * m_brickTable.size());
+	stream.write(reinterpret_cast<const char*>(m_brickPool.data()), GetBrickPoolByteSize());
+
+	return stream.good();
+}
+
+bool BrickedVolume::Write(const char* fileName) const
+{
+	ofstream file(fileName, ios::binary);
+
+	return file.is_open() && Write(file);
+}
+
+bool BrickedVolume::Read(const void* pData, size_t size)
+{
+	const auto pBytes = static_cast<const uint8_t*>(pData);
+	if (size < sizeof(Header)) return false;
+
+	memcpy(&m_header, pBytes, sizeof(Header));
+	if (m_header.Magic != Magic || m_header.Version != Version) return false;
+	if (!validate() || size < GetFileByteSize()) return false;
+
+	const auto pBrickTable = reinterpret_cast<const BrickEntry*>(pBytes + sizeof(Header));
+	m_brickTable.assign(pBrickTable, pBrickTable + GetNumBricks());
+
+	const auto pBrickPool = reinterpret_cast<const uint16_t*>(pBrickTable + GetNumBricks());
+	m_brickPool.assign(pBrickPool, pBrickPool + static_cast<size_t>(m_header.NumDataBricks) * GetBrickVoxelCount());
+
+	return validateBrickTable();
+}
+
+void BrickedVolume::Expand(VolumeGrid& grid) const
+{
+	grid.Resize(m_header.Width, m_header.Height, m_header.Depth);
+	for (auto z = 0u; z < m_header.Depth; ++z)
+		for (auto y = 0u; y < m_header.Height; ++y)
+			for (auto x = 0u; x < m_header.Width; ++x)
+				grid.At(x, y, z) = Fetch(x, y, z);
+}
+
+float BrickedVolume::Fetch(uint32_t x, uint32_t y, uint32_t z) const
+{
+	x = (min)(x, m_header.Width - 1);
+	y = (min)(y, m_header.Height - 1);
+	z = (min)(z, m_header.Depth - 1);
+
+	const auto brickSize = m_header.BrickSize;
+	const auto brickIdx = ((z / brickSize) * m_header.NumBricksY + y / brickSize) * m_header.NumBricksX + x / brickSize;
+	const auto& entry = m_brickTable[brickIdx];
+
+	switch (entry.Type)
+	{
+	case BRICK_CONSTANT:
+	{
+		float value;
+		memcpy(&value, &entry.Value, sizeof(float));
+
+		return value;
+	}
+	case BRICK_DATA:
+	{
+		const auto localIdx = ((z % brickSize) * brickSize + y % brickSize) * brickSize + x % brickSize;
+
+		return HalfToFloat(m_brickPool[static_cast<size_t>(entry.Value) * GetBrickVoxelCount() + localIdx]);
+	}
+	default:
+		return 0.0f;
+	}
+}
+
+const BrickedVolume::Header& BrickedVolume::GetHeader() const
+{
+	return m_header;
+}
+
+const BrickedVolume::BrickEntry* BrickedVolume::GetBrickTable() const
+{
+	return m_brickTable.data();
+}
+
+const uint16_t* BrickedVolume::GetBrickPool() const
+{
+	return m_brickPool.data();
+}
+
+uint32_t BrickedVolume::GetNumBricks() const
+{
+	return m_header.NumBricksX * m_header.NumBricksY * m_header.NumBricksZ;
+}
+
+uint32_t BrickedVolume::GetNumBricks(BrickType type) const
+{
+	return static_cast<uint32_t>(count_if(m_brickTable.cbegin(), m_brickTable.cend(),
+		[type](const BrickEntry& entry) { return entry.Type == type; }));
+}
+
+uint32_t BrickedVolume::GetBrickVoxelCount() const
+{
+	return m_header.BrickSize * m_header.BrickSize * m_header.BrickSize;
+}
+
+size_t BrickedVolume::GetBrickPoolByteSize() const
+{
+	return sizeof(uint16_t) * GetBrickVoxelCount() * m_header.NumDataBricks;
+}
+
+size_t BrickedVolume::GetFileByteSize() const
+{
+	return sizeof(Header) + sizeof(BrickEntry) * GetNumBricks() + GetBrickPoolByteSize();
+}
+
+bool BrickedVolume::validate() const
+{
+	const auto& h = m_header;
+	if (!h.Width || !h.Height || !h.Depth || !h.BrickSize || h.BrickSize > 64) return false;
+	if (h.NumBricksX != (h.Width + h.BrickSize - 1) / h.BrickSize) return false;
+	if (h.NumBricksY != (h.Height + h.BrickSize - 1) / h.BrickSize) return false;
+	if (h.NumBricksZ != (h.Depth + h.BrickSize - 1) / h.BrickSize) return false;
+
+	return h.NumDataBricks <= GetNumBricks();
+}
+
+bool BrickedVolume::validateBrickTable() const
+{
+	// Reject tables that point outside the pool
+	for (const auto& entry : m_brickTable)
+	{
+		if (entry.Type > BRICK_DATA) return false;
+		if (entry.Type == BRICK_DATA && entry.Value >= m_header.NumDataBricks) return false;
+	}
+
+	return true;
+}
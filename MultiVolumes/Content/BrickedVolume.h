@@ -0,0 +1,85 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <iosfwd>
+#include "VolumeGrid.h"
+
+//--------------------------------------------------------------------------------------
+// Bricked sparse volume container (.vbk)
+// File layout: Header | BrickEntry[NumBricks] | R16_FLOAT pool of NumDataBricks bricks.
+// Empty and constant bricks are resolved from the brick table alone, so only the data
+// bricks occupy the pool.
+//--------------------------------------------------------------------------------------
+class BrickedVolume
+{
+public:
+	enum BrickType : uint32_t
+	{
+		BRICK_EMPTY,
+		BRICK_CONSTANT,
+		BRICK_DATA
+	};
+
+	struct Header
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t Width;
+		uint32_t Height;
+		uint32_t Depth;
+		uint32_t BrickSize;
+		uint32_t NumBricksX;
+		uint32_t NumBricksY;
+		uint32_t NumBricksZ;
+		uint32_t NumDataBricks;
+	};
+
+	struct BrickEntry
+	{
+		uint32_t Type;
+		uint32_t Value;	// Pool brick index for BRICK_DATA, float bits for BRICK_CONSTANT
+	};
+
+	struct BuildDesc
+	{
+		uint32_t BrickSize = 8;
+		float EmptyThreshold = 0.0f;	// Bricks with max density <= threshold are empty
+		float ConstantTolerance = 0.0f;	// Bricks with max - min <= tolerance are constant
+	};
+
+	static const uint32_t Magic = 0x4b42564d;	// "MVBK"
+	static const uint32_t Version = 1;
+
+	BrickedVolume();
+	virtual ~BrickedVolume();
+
+	bool Build(const VolumeGrid& grid, const BuildDesc& desc);
+	bool Read(std::istream& stream);
+	bool Read(const char* fileName);
+	bool Read(const void* pData, size_t size);
+	bool Write(std::ostream& stream) const;
+	bool Write(const char* fileName) const;
+
+	void Expand(VolumeGrid& grid) const;
+	float Fetch(uint32_t x, uint32_t y, uint32_t z) const;
+
+	const Header& GetHeader() const;
+	const BrickEntry* GetBrickTable() const;
+	const uint16_t* GetBrickPool() const;
+	uint32_t GetNumBricks() const;
+	uint32_t GetNumBricks(BrickType type) const;
+	uint32_t GetBrickVoxelCount() const;
+	size_t GetBrickPoolByteSize() const;
+	size_t GetFileByteSize() const;
+
+protected:
+	bool validate() const;
+	bool validateBrickTable() const;
+
+	Header m_header;
+	std::vector<BrickEntry> m_brickTable;
+	std::vector<uint16_t> m_brickPool;
+};
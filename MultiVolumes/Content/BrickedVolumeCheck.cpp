@@ -0,0 +1,56 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "BrickedVolume.h"
+#include "DDSVolume.h"
+#include "ToolCheck.h"
+
+using namespace std;
+
+// Round-trips a converted asset against its source; returns non-zero when the error
+// exceeds the R16_FLOAT quantization of the data bricks plus the build tolerances.
+int Verify(int argc, char* argv[])
+{
+	vector<const char*> files;
+	if (!ToolArgs().Parse(argc, argv, &files, 2, 2)) return EXIT_FAILURE;
+
+	VolumeGrid source, expanded;
+	BrickedVolume volume;
+	if (!DDSVolume::Read(files[0], source) || !volume.Read(files[1]))
+	{
+		fprintf(stderr, "Failed to read %s or %s\n", files[0], files[1]);
+
+		return EXIT_FAILURE;
+	}
+
+	volume.Expand(expanded);
+	if (expanded.Width != source.Width || expanded.Height != source.Height || expanded.Depth != source.Depth)
+	{
+		fprintf(stderr, "Dimension mismatch\n");
+
+		return EXIT_FAILURE;
+	}
+
+	auto maxError = 0.0f, maxRelError = 0.0f;
+	for (size_t i = 0; i < source.GetNumVoxels(); ++i)
+	{
+		const auto error = fabsf(expanded.Voxels[i] - source.Voxels[i]);
+		maxError = (max)(error, maxError);
+		maxRelError = (max)(error / (max)(fabsf(source.Voxels[i]), 1.0f), maxRelError);
+	}
+
+	PrintBrickStats(volume, 0);
+	printf("Max abs error: %g, max relative error: %g\n", maxError, maxRelError);
+
+	// Half precision has an 11-bit significand; beyond it, lossy build tolerances or a
+	// corrupt file
+	CheckReport report;
+	report.Expect("Within half precision", maxRelError <= 1.0f / 1024.0f);
+
+	return report.Finish();
+}
@@ -0,0 +1,348 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include "CompressedVolume.h"
+#include "ParallelFor.h"
+
+using namespace std;
+
+// Squared error of the best palette fit of a block (values in [0, 255])
+static float fitBlock(const float values[16], const float palette[8], uint8_t indices[16])
+{
+	auto error = 0.0f;
+	for (auto i = 0u; i < 16; ++i)
+	{
+		auto bestError = FLT_MAX;
+		for (uint8_t j = 0; j < 8; ++j)
+		{
+			const auto d = values[i] - palette[j];
+			if (d * d < bestError)
+			{
+				bestError = d * d;
+				indices[i] = j;
+			}
+		}
+		error += bestError;
+	}
+
+	return error;
+}
+
+static uint8_t toEndpoint(float value)
+{
+	return static_cast<uint8_t>((min)((max)(value + 0.5f, 0.0f), 255.0f));
+}
+
+CompressedVolume::CompressedVolume() :
+	m_header()
+{
+}
+
+CompressedVolume::~CompressedVolume()
+{
+}
+
+bool CompressedVolume::Encode(const VolumeGrid& grid, uint32_t numThreads)
+{
+	if (grid.GetNumVoxels() == 0) return false;
+
+	auto maxValue = 0.0f;
+	for (const auto& value : grid.Voxels) maxValue = (max)(value, maxValue);
+
+	m_header = {};
+	m_header.Magic = Magic;
+	m_header.Version = Version;
+	m_header.Width = grid.Width;
+	m_header.Height = grid.Height;
+	m_header.Depth = grid.Depth;
+	m_header.NumBlocksX = (grid.Width + BlockSize - 1) / BlockSize;
+	m_header.NumBlocksY = (grid.Height + BlockSize - 1) / BlockSize;
+	m_header.Scale = maxValue > 0.0f ? maxValue : 1.0f;
+
+	m_blocks.resize(GetBlockDataByteSize());
+
+	// Slices are independent BC4 surfaces
+	const auto normScale = 255.0f / m_header.Scale;
+	ParallelFor(m_header.Depth, [&](uint32_t z)
+	{
+		auto pBlock = &m_blocks[GetSlicePitch() * z];
+		float values[16];
+		for (auto by = 0u; by < m_header.NumBlocksY; ++by)
+		{
+			for (auto bx = 0u; bx < m_header.NumBlocksX; ++bx)
+			{
+				// Texels beyond the volume edge replicate the border
+				for (auto y = 0u; y < BlockSize; ++y)
+					for (auto x = 0u; x < BlockSize; ++x)
+					{
+						const auto value = grid.Fetch(bx * BlockSize + x, by * BlockSize + y, z) * normScale;
+						values[BlockSize * y + x] = (min)((max)(value, 0.0f), 255.0f);
+					}
+
+				encodeBlock(values, pBlock);
+				pBlock += BlockByteSize;
+			}
+		}
+	}, numThreads);
+
+	return true;
+}
+
+void CompressedVolume::Decode(VolumeGrid& grid, uint32_t numThreads) const
+{
+	grid.Resize(m_header.Width, m_header.Height, m_header.Depth);
+
+	const auto scale = m_header.Scale / 255.0f;
+	ParallelFor(m_header.Depth, [&](uint32_t z)
+	{
+		auto pBlock = &m_blocks[GetSlicePitch() * z];
+		float values[16];
+		for (auto by = 0u; by < m_header.NumBlocksY; ++by)
+		{
+			for (auto bx = 0u; bx < m_header.NumBlocksX; ++bx)
+			{
+				decodeBlock(pBlock, values);
+				pBlock += BlockByteSize;
+
+				const auto w = (min)(BlockSize, m_header.Width - bx * BlockSize);
+				const auto h = (min)(BlockSize, m_header.Height - by * BlockSize);
+				for (auto y = 0u; y < h; ++y)
+					for (auto x = 0u; x < w; ++x)
+						grid.At(bx * BlockSize + x, by * BlockSize + y, z) = values[BlockSize * y + x] * scale;
+			}
+		}
+	}, numThreads);
+}
+
+bool CompressedVolume::Read(istream& stream)
+{
+	stream.read(reinterpret_cast<char*>(&m_header), sizeof(Header));
+	if (!stream.good() || m_header.Magic != Magic || m_header.Version != Version) return false;
+	if (!validate()) return false;
+
+	m_blocks.resize(GetBlockDataByteSize());
+	stream.read(reinterpret_cast<char*>(m_blocks.data()), m_blocks.size());
+
+	return stream.good();
+}
+
+bool CompressedVolume::Read(const char* fileName)
+{
+	ifstream file(fileName, ios::binary);
+
+	return file.is_open() && Read(file);
+}
+
+bool CompressedVolume::Read(const void* pData, size_t size)
+{
+	const auto pBytes = static_cast<const uint8_t*>(pData);
+	if (size < sizeof(Header)) return false;
+
+	memcpy(&m_header, pBytes, sizeof(Header));
+	if (m_header.Magic != Magic || m_header.Version != Version) return false;
+	if (!validate() || size < GetFileByteSize()) return false;
+
+	m_blocks.assign(pBytes + sizeof(Header), pBytes + GetFileByteSize());
+
+	return true;
+}
+
+bool CompressedVolume::Write(ostream& stream) const
+{
+	if (!validate()) return false;
+
+	stream.write(reinterpret_cast<const char*>(&m_header), sizeof(Header));
+	stream.write(reinterpret_cast<const char*>(m_blocks.data()), m_blocks.size());
+
+	return stream.good();
+}
+
+bool CompressedVolume::Write(const char* fileName) const
+{
+	ofstream file(fileName, ios::binary);
+
+	return file.is_open() && Write(file);
+}
+
+float CompressedVolume::Fetch(uint32_t x, uint32_t y, uint32_t z) const
+{
+	x = (min)(x, m_header.Width - 1);
+	y = (min)(y, m_header.Height - 1);
+	z = (min)(z, m_header.Depth - 1);
+
+	const auto pBlock = &m_blocks[GetSlicePitch() * z + GetRowPitch() * (y / BlockSize) + BlockByteSize * (x / BlockSize)];
+	float values[16];
+	decodeBlock(pBlock, values);
+
+	return values[BlockSize * (y % BlockSize) + x % BlockSize] * m_header.Scale / 255.0f;
+}
+
+const CompressedVolume::Header& CompressedVolume::GetHeader() const
+{
+	return m_header;
+}
+
+const uint8_t* CompressedVolume::GetBlocks() const
+{
+	return m_blocks.data();
+}
+
+uint32_t CompressedVolume::GetPaddedWidth() const
+{
+	return m_header.NumBlocksX * BlockSize;
+}
+
+uint32_t CompressedVolume::GetPaddedHeight() const
+{
+	return m_header.NumBlocksY * BlockSize;
+}
+
+size_t CompressedVolume::GetRowPitch() const
+{
+	return static_cast<size_t>(BlockByteSize) * m_header.NumBlocksX;
+}
+
+size_t CompressedVolume::GetSlicePitch() const
+{
+	return GetRowPitch() * m_header.NumBlocksY;
+}
+
+size_t CompressedVolume::GetBlockDataByteSize() const
+{
+	return GetSlicePitch() * m_header.Depth;
+}
+
+size_t CompressedVolume::GetFileByteSize() const
+{
+	return sizeof(Header) + GetBlockDataByteSize();
+}
+
+CompressedVolume::Metrics CompressedVolume::Compare(const VolumeGrid& reference, const VolumeGrid& grid)
+{
+	Metrics metrics = {};
+	if (reference.GetNumVoxels() == 0 || reference.GetNumVoxels() != grid.GetNumVoxels()) return metrics;
+
+	auto sumSq = 0.0;
+	for (size_t i = 0; i < reference.Voxels.size(); ++i)
+	{
+		const auto error = fabs(grid.Voxels[i] - reference.Voxels[i]);
+		metrics.MaxError = (max)(error, metrics.MaxError);
+		metrics.Peak = (max)(fabs(reference.Voxels[i]), metrics.Peak);
+		sumSq += static_cast<double>(error) * error;
+	}
+
+	const auto mse = sumSq / reference.Voxels.size();
+	const double peak = metrics.Peak > 0.0f ? metrics.Peak : 1.0;
+	metrics.RMSE = sqrt(mse);
+	metrics.PSNR = mse > 0.0 ? 10.0 * log10(peak * peak / mse) : numeric_limits<double>::infinity();
+
+	return metrics;
+}
+
+bool CompressedVolume::validate() const
+{
+	const auto& h = m_header;
+	if (!h.Width || !h.Height || !h.Depth || !(h.Scale > 0.0f)) return false;
+	if (h.NumBlocksX != (h.Width + BlockSize - 1) / BlockSize) return false;
+
+	return h.NumBlocksY == (h.Height + BlockSize - 1) / BlockSize;
+}
+
+void CompressedVolume::encodeBlock(const float values[16], uint8_t* pBlock)
+{
+	auto minValue = 255.0f, maxValue = 0.0f;		// All values
+	auto minInner = 255.0f, maxInner = 0.0f;		// Values not snapped to the explicit 0 and 255
+	for (auto i = 0u; i < 16; ++i)
+	{
+		minValue = (min)(values[i], minValue);
+		maxValue = (max)(values[i], maxValue);
+		if (values[i] >= 0.5f && values[i] < 254.5f)
+		{
+			minInner = (min)(values[i], minInner);
+			maxInner = (max)(values[i], maxInner);
+		}
+	}
+
+	uint8_t indices[16] = {};
+	auto r0 = toEndpoint(maxValue), r1 = toEndpoint(minValue);
+	if (r0 == r1)
+	{
+		// Uniform block: any index decodes r0
+		pBlock[0] = pBlock[1] = r0;
+		memset(pBlock + 2, 0, BlockByteSize - 2);
+
+		return;
+	}
+
+	// Try both modes around their natural endpoints, and keep the best fit:
+	// r0 > r1 interpolates 8 levels; r0 <= r1 interpolates 6 levels plus explicit 0 and 255.
+	auto bestError = FLT_MAX;
+	float palette[8];
+	uint8_t candidate[16];
+	const auto search = [&](int hi, int lo, bool eightLevels)
+	{
+		for (auto d0 = -1; d0 <= 1; ++d0)
+			for (auto d1 = -1; d1 <= 1; ++d1)
+			{
+				const auto e0 = hi + d0, e1 = lo + d1;
+				if (e0 < 0 || e0 > 255 || e1 < 0 || e1 > 255) continue;
+				if (eightLevels ? e0 <= e1 : e1 > e0) continue;
+
+				const auto c0 = static_cast<uint8_t>(eightLevels ? e0 : e1);
+				const auto c1 = static_cast<uint8_t>(eightLevels ? e1 : e0);
+				getPalette(c0, c1, palette);
+				const auto error = fitBlock(values, palette, candidate);
+				if (error < bestError)
+				{
+					bestError = error;
+					r0 = c0;
+					r1 = c1;
+					memcpy(indices, candidate, sizeof(indices));
+				}
+			}
+	};
+
+	search(toEndpoint(maxValue), toEndpoint(minValue), true);
+	if (minInner <= maxInner) search(toEndpoint(maxInner), toEndpoint(minInner), false);
+	else search(0, 0, false);
+
+	// 3-bit indices, texel 0 in the lowest bits
+	uint64_t bits = 0;
+	for (auto i = 0u; i < 16; ++i) bits |= static_cast<uint64_t>(indices[i]) << (3 * i);
+	pBlock[0] = r0;
+	pBlock[1] = r1;
+	for (auto i = 0u; i < 6; ++i) pBlock[2 + i] = static_cast<uint8_t>(bits >> (8 * i));
+}
+
+void CompressedVolume::decodeBlock(const uint8_t* pBlock, float values[16])
+{
+	float palette[8];
+	getPalette(pBlock[0], pBlock[1], palette);
+
+	uint64_t bits = 0;
+	for (auto i = 0u; i < 6; ++i) bits |= static_cast<uint64_t>(pBlock[2 + i]) << (8 * i);
+	for (auto i = 0u; i < 16; ++i) values[i] = palette[(bits >> (3 * i)) & 0x7];
+}
+
+void CompressedVolume::getPalette(uint8_t r0, uint8_t r1, float palette[8])
+{
+	palette[0] = r0;
+	palette[1] = r1;
+	if (r0 > r1)
+	{
+		for (auto i = 1u; i < 7; ++i) palette[i + 1] = ((7 - i) * r0 + i * r1) / 7.0f;
+	}
+	else
+	{
+		for (auto i = 1u; i < 5; ++i) palette[i + 1] = ((5 - i) * r0 + i * r1) / 5.0f;
+		palette[6] = 0.0f;
+		palette[7] = 255.0f;
+	}
+}
@@ -0,0 +1,79 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <iosfwd>
+#include "VolumeGrid.h"
+
+//--------------------------------------------------------------------------------------
+// Block-compressed volume container (.vbc)
+// File layout: Header | BC4_UNORM blocks, slice by slice. Every z-slice is a 2D BC4
+// surface of 4x4 blocks (8 bytes each), which is exactly the subresource layout of a
+// BC4_UNORM Texture3D, so the blocks are uploaded and sampled as they are. Densities
+// are stored normalized by Scale; the width and height are padded to whole blocks by
+// replicating the border.
+//--------------------------------------------------------------------------------------
+class CompressedVolume
+{
+public:
+	struct Header
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t Width;
+		uint32_t Height;
+		uint32_t Depth;
+		uint32_t NumBlocksX;
+		uint32_t NumBlocksY;
+		float Scale;	// Density = unorm * Scale
+	};
+
+	struct Metrics
+	{
+		double PSNR;	// Against the peak density of the reference
+		double RMSE;
+		float MaxError;
+		float Peak;
+	};
+
+	static const uint32_t Magic = 0x4342564d;	// "MVBC"
+	static const uint32_t Version = 1;
+	static const uint32_t BlockSize = 4;
+	static const uint32_t BlockByteSize = 8;
+
+	CompressedVolume();
+	virtual ~CompressedVolume();
+
+	bool Encode(const VolumeGrid& grid, uint32_t numThreads = 0);
+	void Decode(VolumeGrid& grid, uint32_t numThreads = 0) const;
+	bool Read(std::istream& stream);
+	bool Read(const char* fileName);
+	bool Read(const void* pData, size_t size);
+	bool Write(std::ostream& stream) const;
+	bool Write(const char* fileName) const;
+
+	float Fetch(uint32_t x, uint32_t y, uint32_t z) const;
+
+	const Header& GetHeader() const;
+	const uint8_t* GetBlocks() const;
+	uint32_t GetPaddedWidth() const;
+	uint32_t GetPaddedHeight() const;
+	size_t GetRowPitch() const;
+	size_t GetSlicePitch() const;
+	size_t GetBlockDataByteSize() const;
+	size_t GetFileByteSize() const;
+
+	static Metrics Compare(const VolumeGrid& reference, const VolumeGrid& grid);
+
+protected:
+	bool validate() const;
+
+	static void encodeBlock(const float values[16], uint8_t* pBlock);
+	static void decodeBlock(const uint8_t* pBlock, float values[16]);
+	static void getPalette(uint8_t r0, uint8_t r1, float palette[8]);
+
+	Header m_header;
+	std::vector<uint8_t> m_blocks;
+};
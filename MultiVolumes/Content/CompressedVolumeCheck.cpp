@@ -0,0 +1,49 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "CompressedVolume.h"
+#include "DDSVolume.h"
+#include "ToolCheck.h"
+
+using namespace std;
+
+// Decodes a compressed asset and checks its PSNR against the source
+int VerifyBC(int argc, char* argv[])
+{
+	auto minPSNR = 40.0;
+	auto numThreads = 0u;
+	ToolArgs args;
+	args.Add("-minPSNR", minPSNR);
+	args.Add("-threads", numThreads);
+	vector<const char*> files;
+	if (!args.Parse(argc, argv, &files, 2, 2)) return EXIT_FAILURE;
+
+	VolumeGrid source, decoded;
+	CompressedVolume volume;
+	if (!DDSVolume::Read(files[0], source) || !volume.Read(files[1]))
+	{
+		fprintf(stderr, "Failed to read %s or %s\n", files[0], files[1]);
+
+		return EXIT_FAILURE;
+	}
+
+	volume.Decode(decoded, numThreads);
+	if (decoded.Width != source.Width || decoded.Height != source.Height || decoded.Depth != source.Depth)
+	{
+		fprintf(stderr, "Dimension mismatch\n");
+
+		return EXIT_FAILURE;
+	}
+
+	const auto metrics = CompressedVolume::Compare(source, decoded);
+	PrintCompressionStats(volume, metrics);
+
+	CheckReport report;
+	report.Expect("PSNR at the threshold or above", metrics.PSNR >= minPSNR);
+
+	return report.Finish();
+}
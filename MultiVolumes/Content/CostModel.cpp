@@ -0,0 +1,293 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "CostModel.h"
+
+using namespace std;
+
+#define ALL_FACES_VISIBLE	0x3f
+
+static const uint32_t g_numTerms = 4;	// The 3 weights and the frame overhead
+static const uint32_t g_minMeasurements = 8;
+
+// Names of the weights in profile files, in the order of Weights
+static const char* const g_weightNames[] = { "cubeMarch", "cubeGather", "rayCast", "frameOverhead" };
+
+static void getTerms(const CostModel::Work& work, double terms[g_numTerms])
+{
+	terms[0] = work.TexelSamples;
+	terms[1] = work.GatherPixels;
+	terms[2] = work.PixelSamples;
+	terms[3] = 1.0;
+}
+
+// Solves the normal equations of the terms in the mask in place, by Gaussian elimination
+// with partial pivoting; false if singular
+static bool solve(double a[g_numTerms][g_numTerms], double b[g_numTerms], uint32_t mask)
+{
+	uint32_t terms[g_numTerms], n = 0;
+	for (auto i = 0u; i < g_numTerms; ++i) if (mask & (1 << i)) terms[n++] = i;
+
+	for (auto k = 0u; k < n; ++k)
+	{
+		auto pivot = k;
+		for (auto i = k + 1; i < n; ++i)
+			if (fabs(a[terms[i]][terms[k]]) > fabs(a[terms[pivot]][terms[k]])) pivot = i;
+		if (fabs(a[terms[pivot]][terms[k]]) < 1.0e-12) return false;
+		swap(terms[k], terms[pivot]);
+
+		for (auto i = k + 1; i < n; ++i)
+		{
+			const auto f = a[terms[i]][terms[k]] / a[terms[k]][terms[k]];
+			for (auto j = k; j < n; ++j) a[terms[i]][terms[j]] -= f * a[terms[k]][terms[j]];
+			b[terms[i]] -= f * b[terms[k]];
+		}
+	}
+
+	// Back substitution; row terms[k] pivots on column terms[k]
+	double x[g_numTerms] = {};
+	for (auto k = n; k-- > 0;)
+	{
+		auto sum = b[terms[k]];
+		for (auto j = k + 1; j < n; ++j) sum -= a[terms[k]][terms[j]] * x[terms[j]];
+		x[terms[k]] = sum / a[terms[k]][terms[k]];
+	}
+	for (auto i = 0u; i < g_numTerms; ++i) b[i] = x[i];
+
+	return true;
+}
+
+CostModel::CostModel() :
+	m_weights(GetDefaultWeights())
+{
+}
+
+CostModel::~CostModel()
+{
+}
+
+bool CostModel::Load(const char* fileName)
+{
+	ifstream file(fileName);
+	if (!file.is_open()) return false;
+
+	auto weights = m_weights;
+	const auto pWeights = &weights.CubeMarch;
+	string line;
+	while (getline(file, line))
+	{
+		istringstream stream(line);
+		string name;
+		if (!(stream >> name) || name[0] == '#') continue;
+
+		auto i = 0u;
+		while (i < g_numTerms && name != g_weightNames[i]) ++i;
+		if (i >= g_numTerms || !(stream >> pWeights[i]) || !(pWeights[i] >= 0.0f)) return false;
+	}
+	m_weights = weights;
+
+	return true;
+}
+
+bool CostModel::Save(const char* fileName) const
+{
+	ofstream file(fileName);
+	if (!file.is_open()) return false;
+
+	file << "# MultiVolumes path costs: nanoseconds per unit, milliseconds per frame\n";
+	file.precision(9);
+	const auto pWeights = &m_weights.CubeMarch;
+	for (auto i = 0u; i < g_numTerms; ++i) file << g_weightNames[i] << " " << pWeights[i] << "\n";
+
+	return file.good();
+}
+
+bool CostModel::Calibrate(const Measurement* pMeasurements, uint32_t numMeasurements)
+{
+	if (numMeasurements < g_minMeasurements) return false;
+
+	// Normal equations in milliseconds per unit, with the terms scaled to their max
+	double scales[g_numTerms] = {}, ata[g_numTerms][g_numTerms] = {}, atb[g_numTerms] = {};
+	for (auto m = 0u; m < numMeasurements; ++m)
+	{
+		double terms[g_numTerms];
+		getTerms(pMeasurements[m].FrameWork, terms);
+		for (auto i = 0u; i < g_numTerms; ++i) scales[i] = (max)(scales[i], fabs(terms[i]));
+	}
+
+	for (auto m = 0u; m < numMeasurements; ++m)
+	{
+		double terms[g_numTerms];
+		getTerms(pMeasurements[m].FrameWork, terms);
+		for (auto i = 0u; i < g_numTerms; ++i)
+		{
+			terms[i] = scales[i] > 0.0 ? terms[i] / scales[i] : 0.0;
+			atb[i] += terms[i] * pMeasurements[m].Milliseconds;
+		}
+		for (auto i = 0u; i < g_numTerms; ++i)
+			for (auto j = 0u; j < g_numTerms; ++j) ata[i][j] += terms[i] * terms[j];
+	}
+
+	// Non-negative least squares over the subsets of the terms that occur; those that never
+	// occur keep their weights
+	auto usedMask = 0u;
+	for (auto i = 0u; i < g_numTerms; ++i) if (scales[i] > 0.0) usedMask |= 1 << i;
+
+	double bestX[g_numTerms] = {};
+	auto bestResidual = DBL_MAX;
+	for (auto mask = usedMask;; mask = (mask - 1) & usedMask)
+	{
+		double a[g_numTerms][g_numTerms], x[g_numTerms];
+		memcpy(a, ata, sizeof(a));
+		memcpy(x, atb, sizeof(x));
+		auto isValid = mask == 0 || solve(a, x, mask);
+		for (auto i = 0u; i < g_numTerms && isValid; ++i)
+		{
+			if (!(mask & (1 << i))) x[i] = 0.0;
+			isValid = x[i] >= 0.0;
+		}
+
+		if (isValid)
+		{
+			auto residual = 0.0;
+			for (auto m = 0u; m < numMeasurements; ++m)
+			{
+				double terms[g_numTerms];
+				getTerms(pMeasurements[m].FrameWork, terms);
+				auto predicted = 0.0;
+				for (auto i = 0u; i < g_numTerms; ++i)
+					if (scales[i] > 0.0) predicted += x[i] * terms[i] / scales[i];
+				const auto error = predicted - pMeasurements[m].Milliseconds;
+				residual += error * error;
+			}
+
+			if (residual < bestResidual)
+			{
+				bestResidual = residual;
+				memcpy(bestX, x, sizeof(bestX));
+			}
+		}
+
+		if (mask == 0) break;
+	}
+
+	// Nanoseconds per unit for the weights, milliseconds for the overhead
+	auto pWeights = &m_weights.CubeMarch;
+	for (auto i = 0u; i < g_numTerms; ++i)
+	{
+		if (!(usedMask & (1 << i))) continue;
+		const auto unitScale = i + 1 < g_numTerms ? 1.0e6 : 1.0;
+		pWeights[i] = static_cast<float>(bestX[i] / scales[i] * unitScale);
+	}
+
+	return true;
+}
+
+void CostModel::SetWeights(const Weights& weights)
+{
+	m_weights = weights;
+}
+
+const CostModel::Weights& CostModel::GetWeights() const
+{
+	return m_weights;
+}
+
+double CostModel::Predict(const Work& work) const
+{
+	const auto ns = static_cast<double>(m_weights.CubeMarch) * work.TexelSamples +
+		static_cast<double>(m_weights.CubeGather) * work.GatherPixels +
+		static_cast<double>(m_weights.RayCast) * work.PixelSamples;
+
+	return ns * 1.0e-6 + m_weights.FrameOverhead;
+}
+
+CostModel::Weights CostModel::GetDefaultWeights()
+{
+	// Equal costs per sample on both paths, at a nominal 10 G samples per second
+	Weights weights;
+	weights.CubeMarch = 0.1f;
+	weights.CubeGather = 0.0f;
+	weights.RayCast = 0.1f;
+	weights.FrameOverhead = 0.0f;
+
+	return weights;
+}
+
+bool CostModel::UseCubeMap(const Weights& weights, uint32_t faceMask, float cubeMapPix,
+	float coverage, uint32_t smpCount)
+{
+	// As UseCubeMap() of VolumeCull.hlsli, operation by operation
+	const auto samples = static_cast<float>(smpCount);
+	const auto cubeMapCost = (weights.CubeMarch * samples) * cubeMapPix + weights.CubeGather * coverage;
+	const auto directCost = (weights.RayCast * samples) * coverage;
+
+	return (faceMask & ALL_FACES_VISIBLE) != ALL_FACES_VISIBLE && cubeMapCost <= directCost;
+}
+
+void CostModel::AddWork(Work& work, uint32_t cubeMapFaces, uint32_t cubeMapSize, uint32_t mipLevel,
+	float coverage, float cubeMapCoverage, uint32_t smpCount)
+{
+	// Texels of the cube-map faces, as EstimateCubeMapVisiblePixels()
+	auto numFaces = 0u;
+	for (auto i = 0u; i < 6; ++i) numFaces += (cubeMapFaces >> i) & 1;
+	const auto edgeLength = mipLevel < 32 ? cubeMapSize >> mipLevel : 0;
+	const auto cubeMapPix = static_cast<double>(edgeLength) * edgeLength * numFaces;
+
+	// The rest of the covered pixels are ray cast directly
+	work.TexelSamples += cubeMapPix * smpCount;
+	work.GatherPixels += cubeMapCoverage;
+	work.PixelSamples += static_cast<double>((max)(coverage - cubeMapCoverage, 0.0f)) * smpCount;
+}
+
+bool CostModel::LoadMeasurements(const char* fileName, vector<Measurement>& measurements)
+{
+	ifstream file(fileName);
+	if (!file.is_open()) return false;
+
+	string line;
+	while (getline(file, line))
+	{
+		istringstream stream(line);
+		Measurement measurement;
+		auto& work = measurement.FrameWork;
+		string first;
+		if (!(stream >> first) || first[0] == '#') continue;
+
+		stream.clear();
+		stream.str(line);
+		if (!(stream >> work.TexelSamples >> work.GatherPixels >> work.PixelSamples >> measurement.Milliseconds))
+			return false;
+		measurements.push_back(measurement);
+	}
+
+	return true;
+}
+
+bool CostModel::SaveMeasurements(const char* fileName, const Measurement* pMeasurements,
+	uint32_t numMeasurements, const CostModel* pModel)
+{
+	ofstream file(fileName);
+	if (!file.is_open()) return false;
+
+	file << "# Texel samples, gather pixels, pixel samples, measured ms" << (pModel ? ", predicted ms\n" : "\n");
+	file.precision(9);
+	for (auto m = 0u; m < numMeasurements; ++m)
+	{
+		const auto& work = pMeasurements[m].FrameWork;
+		file << work.TexelSamples << " " << work.GatherPixels << " " << work.PixelSamples << " " <<
+			pMeasurements[m].Milliseconds;
+		if (pModel) file << " " << pModel->Predict(work);
+		file << "\n";
+	}
+
+	return file.good();
+}
@@ -0,0 +1,75 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// Cost model of the two rendering paths of a volume, in nanoseconds:
+//   cube map: CubeMarch * cube-map texels * samples + CubeGather * covered pixels
+//   direct:   RayCast * covered pixels * samples
+// i.e. ray marching the visible cube-map texels and gathering them per pixel (CubeCast),
+// against ray casting every covered pixel (RayCast). The culling takes the cheaper path
+// per visible face, by the texels and projected pixels of that face, and always the
+// direct one with the eye inside the cube. The default weights reduce to
+// the comparison of cube-map texels and pixels. Calibrate() fits the weights and a
+// per-frame overhead to GPU-timed frames by non-negative least squares. Profile files
+// hold one "<weight> <value>" line per weight; lines starting with '#' are skipped.
+//--------------------------------------------------------------------------------------
+class CostModel
+{
+public:
+	struct Weights
+	{
+		float CubeMarch;	// Per cube-map texel sample
+		float CubeGather;	// Per pixel covered by a cube-map volume
+		float RayCast;		// Per pixel sample of direct ray casting
+		float FrameOverhead;	// Per frame, not part of the decision
+	};
+
+	// The work of a frame on each path, summed over the visible volumes
+	struct Work
+	{
+		double TexelSamples;
+		double GatherPixels;
+		double PixelSamples;
+	};
+
+	struct Measurement
+	{
+		Work FrameWork;
+		double Milliseconds;
+	};
+
+	CostModel();
+	virtual ~CostModel();
+
+	bool Load(const char* fileName);	// Unlisted weights keep their values
+	bool Save(const char* fileName) const;
+	bool Calibrate(const Measurement* pMeasurements, uint32_t numMeasurements);	// False if too few
+
+	void SetWeights(const Weights& weights);
+	const Weights& GetWeights() const;
+	double Predict(const Work& work) const;	// In milliseconds
+
+	static Weights GetDefaultWeights();
+	static bool UseCubeMap(const Weights& weights, uint32_t faceMask, float cubeMapPix,
+		float coverage, uint32_t smpCount);
+
+	// Adds a visible volume, with its faces ray marched in cube-map space and their projected
+	// pixels; the rest of its coverage goes to direct ray casting
+	static void AddWork(Work& work, uint32_t cubeMapFaces, uint32_t cubeMapSize, uint32_t mipLevel,
+		float coverage, float cubeMapCoverage, uint32_t smpCount);
+
+	// Reads and writes "<texel samples> <gather pixels> <pixel samples> <ms>" lines, to which
+	// the predicted milliseconds of a model are appended as a report
+	static bool LoadMeasurements(const char* fileName, std::vector<Measurement>& measurements);
+	static bool SaveMeasurements(const char* fileName, const Measurement* pMeasurements,
+		uint32_t numMeasurements, const CostModel* pModel = nullptr);
+
+protected:
+	Weights m_weights;
+};
@@ -0,0 +1,234 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "CostModel.h"
+#include "ToolCheck.h"
+
+using namespace std;
+
+// Checks the path decisions and the work split of the cost model against the costs in
+// double, the calibration against frames timed by known weights, and the file round trips;
+// with measured frames, prints their fit instead
+int CostCheck(int argc, char* argv[])
+{
+	const char* measurementFile = nullptr;
+	const char* reportFile = nullptr;
+	auto seed = 1u;
+	ToolArgs args;
+	args.Add("-measurements", [&measurementFile](const char* arg) { measurementFile = arg; });
+	args.Add("-report", [&reportFile](const char* arg) { reportFile = arg; });
+	args.Add("-seed", seed);
+	if (!args.Parse(argc, argv)) return EXIT_FAILURE;
+
+	auto state = seed;
+	const auto random = [&state]()
+	{
+		state = state * 1664525u + 1013904223u;
+
+		return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+	};
+
+	// Measured frames: print the fit and its predicted against the measured costs
+	if (measurementFile)
+	{
+		vector<CostModel::Measurement> measurements;
+		if (!CostModel::LoadMeasurements(measurementFile, measurements))
+		{
+			fprintf(stderr, "Failed to read %s\n", measurementFile);
+
+			return EXIT_FAILURE;
+		}
+
+		const auto numMeasurements = static_cast<uint32_t>(measurements.size());
+		CostModel model;
+		if (!model.Calibrate(measurements.data(), numMeasurements))
+		{
+			fprintf(stderr, "Too few measurements: %u\n", numMeasurements);
+
+			return EXIT_FAILURE;
+		}
+
+		const auto& weights = model.GetWeights();
+		printf("Weights: cube march %.4f ns, cube gather %.4f ns, ray cast %.4f ns, overhead %.4f ms\n",
+			weights.CubeMarch, weights.CubeGather, weights.RayCast, weights.FrameOverhead);
+
+		auto sumSq = 0.0, sumMs = 0.0, maxError = 0.0;
+		for (const auto& measurement : measurements)
+		{
+			const auto error = model.Predict(measurement.FrameWork) - measurement.Milliseconds;
+			sumSq += error * error;
+			sumMs += measurement.Milliseconds;
+			maxError = (max)(maxError, fabs(error));
+		}
+		printf("%u frames: %.4f ms mean measured, %.4f ms RMS error, %.4f ms max error\n", numMeasurements,
+			sumMs / numMeasurements, sqrt(sumSq / numMeasurements), maxError);
+
+		if (reportFile && !CostModel::SaveMeasurements(reportFile, measurements.data(), numMeasurements, &model))
+		{
+			fprintf(stderr, "Failed to write %s\n", reportFile);
+
+			return EXIT_FAILURE;
+		}
+
+		return EXIT_SUCCESS;
+	}
+
+	uint64_t numErrors = 0;
+
+	// Decisions: the cheaper path by the costs in double, where the gap exceeds the rounding,
+	// and the texel-vs-pixel rule under the default weights
+	const auto defaultWeights = CostModel::GetDefaultWeights();
+	const auto numDecisions = 100000u;
+	auto numCubeMap = 0u;
+	for (auto n = 0u; n < numDecisions; ++n)
+	{
+		CostModel::Weights weights;
+		weights.CubeMarch = random();
+		weights.CubeGather = random() < 0.2f ? 0.0f : random() * 4.0f;
+		weights.RayCast = random();
+		weights.FrameOverhead = random();
+
+		const auto faceMask = random() < 0.1f ? 0x3fu : static_cast<uint32_t>(random() * 64.0f);
+		const auto cubeMapPix = floorf(powf(2.0f, random() * 18.0f));
+		const auto coverage = powf(2.0f, random() * 21.0f);
+		const auto smpCount = 1 + static_cast<uint32_t>(random() * 256.0f);
+
+		const auto useCubeMap = CostModel::UseCubeMap(weights, faceMask, cubeMapPix, coverage, smpCount);
+		const auto cubeMapCost = static_cast<double>(weights.CubeMarch) * smpCount * cubeMapPix +
+			static_cast<double>(weights.CubeGather) * coverage;
+		const auto directCost = static_cast<double>(weights.RayCast) * smpCount * coverage;
+		if (faceMask == 0x3f) numErrors += useCubeMap ? 1 : 0;
+		else if (fabs(cubeMapCost - directCost) > 1.0e-5 * (max)(cubeMapCost, directCost) &&
+			useCubeMap != (cubeMapCost <= directCost)) ++numErrors;
+
+		const auto useCubeMapByDefault = CostModel::UseCubeMap(defaultWeights, faceMask, cubeMapPix, coverage, smpCount);
+		if (faceMask == 0x3f) numErrors += useCubeMapByDefault ? 1 : 0;
+		else if (fabs(cubeMapPix - coverage) > 1.0e-5f * (max)(cubeMapPix, coverage) &&
+			useCubeMapByDefault != (cubeMapPix <= coverage)) ++numErrors;
+		numCubeMap += useCubeMap ? 1 : 0;
+
+		// The cube-map faces and their pixels go to the cube-map path, the rest to direct
+		CostModel::Work work = {};
+		const auto edgeLength = 1u << static_cast<uint32_t>(random() * 8.0f);
+		const auto cubeMapFaces = faceMask & static_cast<uint32_t>(random() * 64.0f);
+		const auto cubeMapCoverage = cubeMapFaces ? coverage * random() : 0.0f;
+		CostModel::AddWork(work, cubeMapFaces, edgeLength << 2, 2, coverage, cubeMapCoverage, smpCount);
+		auto numFaces = 0u;
+		for (auto i = 0u; i < 6; ++i) numFaces += (cubeMapFaces >> i) & 1;
+		const auto texels = static_cast<double>(edgeLength * edgeLength) * numFaces;
+		if (work.TexelSamples != texels * smpCount || work.GatherPixels != cubeMapCoverage ||
+			work.PixelSamples != static_cast<double>((max)(coverage - cubeMapCoverage, 0.0f)) * smpCount)
+			++numErrors;
+	}
+	printf("Decisions: %u, %.1f%% cube map\n", numDecisions, 100.0 * numCubeMap / numDecisions);
+
+	// Calibration: frames of random work on the forced paths and on both, timed by known
+	// weights with 1% of noise; the fit should recover the weights
+	const auto numSets = 50u;
+	const auto numFrames = 240u;
+	vector<CostModel::Measurement> measurements(numFrames);
+	auto maxWeightError = 0.0, maxRMSError = 0.0;
+	for (auto s = 0u; s < numSets; ++s)
+	{
+		CostModel truth;
+		CostModel::Weights weights;
+		weights.CubeMarch = 0.02f + random() * 0.5f;
+		weights.CubeGather = s % 5 == 0 ? 0.0f : random() * 2.0f;
+		weights.RayCast = 0.02f + random() * 0.5f;
+		weights.FrameOverhead = s % 7 == 0 ? 0.0f : 0.1f + random();
+		truth.SetWeights(weights);
+
+		for (auto f = 0u; f < numFrames; ++f)
+		{
+			auto& work = measurements[f].FrameWork;
+			work = {};
+			if (f % 3 != 1)
+			{
+				work.TexelSamples = random() * 2.0e7;
+				work.GatherPixels = random() * 4.0e6;
+			}
+			if (f % 3 != 0) work.PixelSamples = random() * 2.0e8;
+			measurements[f].Milliseconds = truth.Predict(work) * (0.99 + 0.02 * random());
+		}
+
+		CostModel model;
+		if (!model.Calibrate(measurements.data(), numFrames))
+		{
+			++numErrors;
+			continue;
+		}
+
+		// Each weight within 5% of its own value or of the largest time share of a term
+		const auto& fitted = model.GetWeights();
+		const auto pTruth = &weights.CubeMarch;
+		const auto pFitted = &fitted.CubeMarch;
+		const double maxWork[] = { 2.0e7, 4.0e6, 2.0e8, 1.0e6 };
+		for (auto i = 0u; i < 4; ++i)
+		{
+			const auto error = fabs(pFitted[i] - pTruth[i]) * maxWork[i] * 1.0e-6;
+			const auto tolerance = 0.05 * (max)(weights.CubeMarch * maxWork[0], weights.RayCast * maxWork[2]) * 1.0e-6;
+			maxWeightError = (max)(maxWeightError, error / tolerance);
+			if (!(pFitted[i] >= 0.0f) || error > tolerance) ++numErrors;
+		}
+
+		auto sumSq = 0.0, sumMs = 0.0;
+		for (const auto& measurement : measurements)
+		{
+			const auto error = model.Predict(measurement.FrameWork) - measurement.Milliseconds;
+			sumSq += error * error;
+			sumMs += measurement.Milliseconds;
+		}
+		const auto rmsError = sqrt(sumSq / numFrames) / (sumMs / numFrames);
+		maxRMSError = (max)(maxRMSError, rmsError);
+		if (rmsError > 0.01) ++numErrors;
+	}
+	printf("Calibration: %u sets of %u frames, %.1f%% max relative RMS error, %.2f of the weight tolerance\n",
+		numSets, numFrames, 100.0 * maxRMSError, maxWeightError);
+
+	// Too few frames keep the weights, as do the terms without work
+	{
+		CostModel model;
+		const CostModel::Weights weights = { 0.5f, 0.25f, 0.125f, 1.0f };
+		model.SetWeights(weights);
+		if (model.Calibrate(measurements.data(), 7) || memcmp(&model.GetWeights(), &weights, sizeof(weights)) != 0)
+			++numErrors;
+
+		for (auto& measurement : measurements) measurement.FrameWork.GatherPixels = 0.0;
+		if (!model.Calibrate(measurements.data(), numFrames) || model.GetWeights().CubeGather != weights.CubeGather)
+			++numErrors;
+	}
+
+	// Round trips of the profile and of the measurements
+	{
+		const char* const fileName = "volumetool_cost.txt";
+		CostModel model, loaded;
+		CostModel::Weights weights = { 0.123456789f, 1.5e-3f, 7.0f, 0.25f };
+		model.SetWeights(weights);
+		if (!model.Save(fileName) || !loaded.Load(fileName) ||
+			memcmp(&loaded.GetWeights(), &weights, sizeof(weights)) != 0) ++numErrors;
+
+		vector<CostModel::Measurement> loadedMeasurements;
+		if (!CostModel::SaveMeasurements(fileName, measurements.data(), numFrames, &model) ||
+			!CostModel::LoadMeasurements(fileName, loadedMeasurements) || loadedMeasurements.size() != numFrames)
+			++numErrors;
+		else for (auto f = 0u; f < numFrames; ++f)
+		{
+			const auto& a = measurements[f], &b = loadedMeasurements[f];
+			if (fabs(a.Milliseconds - b.Milliseconds) > 1.0e-8 * a.Milliseconds ||
+				fabs(a.FrameWork.PixelSamples - b.FrameWork.PixelSamples) > 1.0e-8 * a.FrameWork.PixelSamples) ++numErrors;
+		}
+		remove(fileName);
+	}
+
+	CheckReport report;
+	report.ExpectNone("Errors", numErrors);
+
+	return report.Finish();
+}
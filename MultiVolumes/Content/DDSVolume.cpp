@@ -0,0 +1,230 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <fstream>
+#include "DDSVolume.h"
+
+using namespace std;
+
+#define DDS_MAGIC				0x20534444	// "DDS "
+#define DDS_FOURCC_DX10			0x30315844	// "DX10"
+#define DDS_HEADER_SIZE			124
+#define DDS_HEADER_DX10_SIZE	20
+
+#define DDSD_CAPS				0x1
+#define DDSD_HEIGHT				0x2
+#define DDSD_WIDTH				0x4
+#define DDSD_PITCH				0x8
+#define DDSD_PIXELFORMAT		0x1000
+#define DDSD_DEPTH				0x800000
+#define DDPF_FOURCC				0x4
+#define DDPF_LUMINANCE			0x20000
+#define DDSCAPS_TEXTURE			0x1000
+#define DDSCAPS2_VOLUME			0x200000
+
+#define D3DFMT_R16F				111
+#define D3DFMT_R32F				114
+#define DIMENSION_TEXTURE3D		4
+
+static inline uint32_t readU32(const uint8_t* p, uint32_t offset)
+{
+	uint32_t value;
+	memcpy(&value, p + offset, sizeof(uint32_t));
+
+	return value;
+}
+
+static inline void writeU32(uint8_t* p, uint32_t offset, uint32_t value)
+{
+	memcpy(p + offset, &value, sizeof(uint32_t));
+}
+
+bool DDSVolume::ParseHeader(const void* pData, size_t size, Info& info)
+{
+	const auto pBytes = static_cast<const uint8_t*>(pData);
+	if (size < 4 + DDS_HEADER_SIZE || readU32(pBytes, 0) != DDS_MAGIC) return false;
+
+	// DDS_HEADER follows the magic number
+	const auto pHeader = pBytes + 4;
+	if (readU32(pHeader, 0) != DDS_HEADER_SIZE || readU32(pHeader, 72) != 32) return false;
+
+	const auto flags = readU32(pHeader, 4);
+	const auto pfFlags = readU32(pHeader, 76);
+	const auto fourCC = readU32(pHeader, 80);
+	const auto bitCount = readU32(pHeader, 84);
+	const auto caps2 = readU32(pHeader, 108);
+
+	info.Height = readU32(pHeader, 8);
+	info.Width = readU32(pHeader, 12);
+	info.Depth = (flags & DDSD_DEPTH) ? readU32(pHeader, 20) : 1;
+	info.NumMips = (max)(readU32(pHeader, 24), 1u);
+	info.VoxelFormat = FORMAT_UNKNOWN;
+	info.DataOffset = 4 + DDS_HEADER_SIZE;
+
+	if ((pfFlags & DDPF_FOURCC) && fourCC == DDS_FOURCC_DX10)
+	{
+		if (size < 4 + DDS_HEADER_SIZE + DDS_HEADER_DX10_SIZE) return false;
+
+		const auto pHeaderDX10 = pHeader + DDS_HEADER_SIZE;
+		if (readU32(pHeaderDX10, 4) != DIMENSION_TEXTURE3D) return false;
+		if (readU32(pHeaderDX10, 12) > 1) return false; // 3D textures cannot be arrays
+
+		info.VoxelFormat = static_cast<Format>(readU32(pHeaderDX10, 0));
+		info.DataOffset += DDS_HEADER_DX10_SIZE;
+	}
+	else
+	{
+		if (!(caps2 & DDSCAPS2_VOLUME)) return false;
+
+		if (pfFlags & DDPF_FOURCC)
+			info.VoxelFormat = fourCC == D3DFMT_R32F ? FORMAT_R32_FLOAT : (fourCC == D3DFMT_R16F ? FORMAT_R16_FLOAT : FORMAT_UNKNOWN);
+		else if (pfFlags & DDPF_LUMINANCE)
+			info.VoxelFormat = bitCount == 8 ? FORMAT_R8_UNORM : (bitCount == 16 ? FORMAT_R16_UNORM : FORMAT_UNKNOWN);
+	}
+
+	if (!GetBytesPerVoxel(info.VoxelFormat)) return false;
+
+	return info.Width > 0 && info.Height > 0 && info.Depth > 0;
+}
+
+const void* DDSVolume::ParseInPlace(const void* pFileData, size_t fileSize, Info& info)
+{
+	if (!ParseHeader(pFileData, fileSize, info)) return nullptr;
+	if (fileSize < info.DataOffset || fileSize - info.DataOffset < GetTopMipByteSize(info)) return nullptr;
+
+	return static_cast<const uint8_t*>(pFileData) + info.DataOffset;
+}
+
+uint32_t DDSVolume::GetBytesPerVoxel(Format format)
+{
+	switch (format)
+	{
+	case FORMAT_R32_FLOAT:
+		return 4;
+	case FORMAT_R16_FLOAT:
+	case FORMAT_R16_UNORM:
+		return 2;
+	case FORMAT_R8_UNORM:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+size_t DDSVolume::GetTopMipByteSize(const Info& info)
+{
+	return static_cast<size_t>(info.Width) * info.Height * info.Depth * GetBytesPerVoxel(info.VoxelFormat);
+}
+
+bool DDSVolume::Read(istream& stream, VolumeGrid& grid, Info* pInfo)
+{
+	uint8_t header[MaxHeaderSize];
+	stream.read(reinterpret_cast<char*>(header), sizeof(header));
+	const auto headerSize = static_cast<size_t>(stream.gcount());
+
+	Info info;
+	if (!ParseHeader(header, headerSize, info)) return false;
+	if (pInfo) *pInfo = info;
+
+	// Only the top-level mip is loaded
+	const auto numVoxels = static_cast<size_t>(info.Width) * info.Height * info.Depth;
+	const auto byteSize = GetTopMipByteSize(info);
+	vector<uint8_t> data(byteSize);
+	stream.clear();
+	stream.seekg(info.DataOffset, ios::beg);
+	stream.read(reinterpret_cast<char*>(data.data()), byteSize);
+	if (static_cast<size_t>(stream.gcount()) != byteSize) return false;
+
+	grid.Resize(info.Width, info.Height, info.Depth);
+	DecodeVoxels(data.data(), info.VoxelFormat, numVoxels, grid.Voxels.data());
+
+	return true;
+}
+
+bool DDSVolume::Read(const char* fileName, VolumeGrid& grid, Info* pInfo)
+{
+	ifstream file(fileName, ios::binary);
+
+	return file.is_open() && Read(file, grid, pInfo);
+}
+
+bool DDSVolume::WriteHeader(ostream& stream, uint32_t width, uint32_t height, uint32_t depth, Format format)
+{
+	const auto bytesPerVoxel = GetBytesPerVoxel(format);
+	if (width == 0 || height == 0 || depth == 0 || bytesPerVoxel == 0) return false;
+
+	// Always written with the DX10 header
+	uint8_t header[MaxHeaderSize] = {};
+	writeU32(header, 0, DDS_MAGIC);
+
+	const auto pHeader = header + 4;
+	writeU32(pHeader, 0, DDS_HEADER_SIZE);
+	writeU32(pHeader, 4, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PITCH | DDSD_PIXELFORMAT | DDSD_DEPTH);
+	writeU32(pHeader, 8, height);
+	writeU32(pHeader, 12, width);
+	writeU32(pHeader, 16, width * bytesPerVoxel);
+	writeU32(pHeader, 20, depth);
+	writeU32(pHeader, 24, 1);
+	writeU32(pHeader, 72, 32);
+	writeU32(pHeader, 76, DDPF_FOURCC);
+	writeU32(pHeader, 80, DDS_FOURCC_DX10);
+	writeU32(pHeader, 104, DDSCAPS_TEXTURE);
+	writeU32(pHeader, 108, DDSCAPS2_VOLUME);
+
+	const auto pHeaderDX10 = pHeader + DDS_HEADER_SIZE;
+	writeU32(pHeaderDX10, 0, format);
+	writeU32(pHeaderDX10, 4, DIMENSION_TEXTURE3D);
+	writeU32(pHeaderDX10, 12, 1);
+
+	stream.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+	return stream.good();
+}
+
+bool DDSVolume::Write(ostream& stream, const VolumeGrid& grid)
+{
+	// Always written as R32_FLOAT
+	if (grid.GetNumVoxels() == 0 || !WriteHeader(stream, grid.Width, grid.Height, grid.Depth)) return false;
+	stream.write(reinterpret_cast<const char*>(grid.Voxels.data()), sizeof(float) * grid.GetNumVoxels());
+
+	return stream.good();
+}
+
+bool DDSVolume::Write(const char* fileName, const VolumeGrid& grid)
+{
+	ofstream file(fileName, ios::binary);
+
+	return file.is_open() && Write(file, grid);
+}
+
+void DDSVolume::DecodeVoxels(const void* pSrc, Format format, size_t numVoxels, float* pDst)
+{
+	switch (format)
+	{
+	case FORMAT_R32_FLOAT:
+		memcpy(pDst, pSrc, sizeof(float) * numVoxels);
+		break;
+	case FORMAT_R16_FLOAT:
+	{
+		const auto pHalves = static_cast<const uint16_t*>(pSrc);
+		for (size_t i = 0; i < numVoxels; ++i) pDst[i] = HalfToFloat(pHalves[i]);
+		break;
+	}
+	case FORMAT_R16_UNORM:
+	{
+		const auto pUnorms = static_cast<const uint16_t*>(pSrc);
+		for (size_t i = 0; i < numVoxels; ++i) pDst[i] = pUnorms[i] / 65535.0f;
+		break;
+	}
+	case FORMAT_R8_UNORM:
+	{
+		const auto pUnorms = static_cast<const uint8_t*>(pSrc);
+		for (size_t i = 0; i < numVoxels; ++i) pDst[i] = pUnorms[i] / 255.0f;
+		break;
+	}
+	default:
+		memset(pDst, 0, sizeof(float) * numVoxels);
+	}
+}
@@ -0,0 +1,55 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <iosfwd>
+#include "VolumeGrid.h"
+
+//--------------------------------------------------------------------------------------
+// Minimal portable reader/writer for single-channel 3D DDS volumes
+//--------------------------------------------------------------------------------------
+class DDSVolume
+{
+public:
+	// Values match DXGI_FORMAT
+	enum Format : uint32_t
+	{
+		FORMAT_UNKNOWN = 0,
+		FORMAT_R32_FLOAT = 41,
+		FORMAT_R16_FLOAT = 54,
+		FORMAT_R16_UNORM = 56,
+		FORMAT_R8_UNORM = 61
+	};
+
+	struct Info
+	{
+		uint32_t Width;
+		uint32_t Height;
+		uint32_t Depth;
+		uint32_t NumMips;
+		Format VoxelFormat;
+		uint32_t DataOffset;	// Byte offset of the top-level mip from the start of the file
+	};
+
+	static const uint32_t MaxHeaderSize = 4 + 124 + 20;
+
+	// Parses and validates the header bytes; the data is not touched
+	static bool ParseHeader(const void* pData, size_t size, Info& info);
+	// Parses the header of a fully mapped file and validates that the top-level mip is
+	// present; returns a pointer to its voxels inside the mapping, or nullptr
+	static const void* ParseInPlace(const void* pFileData, size_t fileSize, Info& info);
+	static uint32_t GetBytesPerVoxel(Format format);
+	static size_t GetTopMipByteSize(const Info& info);
+
+	static bool Read(std::istream& stream, VolumeGrid& grid, Info* pInfo = nullptr);
+	static bool Read(const char* fileName, VolumeGrid& grid, Info* pInfo = nullptr);
+	// Header of a single-mip volume whose voxels the caller streams right after it
+	static bool WriteHeader(std::ostream& stream, uint32_t width, uint32_t height, uint32_t depth,
+		Format format = FORMAT_R32_FLOAT);
+	static bool Write(std::ostream& stream, const VolumeGrid& grid);
+	static bool Write(const char* fileName, const VolumeGrid& grid);
+
+	static void DecodeVoxels(const void* pSrc, Format format, size_t numVoxels, float* pDst);
+};
@@ -0,0 +1,197 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include "DeepShadowMap.h"
+
+using namespace std;
+
+const uint32_t DeepShadowMap::NumKnots;
+const uint32_t DeepShadowMap::EmptyKnot;
+
+static inline float saturate(float x)
+{
+	return (min)((max)(x, 0.0f), 1.0f);
+}
+
+// The function of the decoded knots at depth, as Lookup()
+static float evaluate(const DeepShadowMap::Knot* pKnots, uint32_t numKnots, float depth)
+{
+	if (numKnots == 0 || depth <= pKnots[0].Depth) return 1.0f;
+
+	for (auto i = 1u; i < numKnots; ++i)
+	{
+		const auto& prev = pKnots[i - 1];
+		const auto& knot = pKnots[i];
+		if (depth > knot.Depth) continue;
+
+		const auto t = saturate((depth - prev.Depth) / (max)(knot.Depth - prev.Depth, 1.0e-7f));
+
+		return prev.Transmittance + (knot.Transmittance - prev.Transmittance) * t;
+	}
+
+	return pKnots[numKnots - 1].Transmittance;
+}
+
+DeepShadowMap::DeepShadowMap() :
+	m_size(0)
+{
+}
+
+DeepShadowMap::~DeepShadowMap()
+{
+}
+
+void DeepShadowMap::Init(uint32_t size)
+{
+	m_size = size;
+	Clear();
+}
+
+void DeepShadowMap::Clear()
+{
+	m_knots.assign(static_cast<size_t>(m_size) * m_size * NumKnots, EmptyKnot);
+}
+
+void DeepShadowMap::InsertSpan(uint32_t x, uint32_t y, float nearDepth, float farDepth, float transm)
+{
+	if (x < m_size && y < m_size) InsertSpan(&m_knots[(static_cast<size_t>(m_size) * y + x) * NumKnots], nearDepth, farDepth, transm);
+}
+
+float DeepShadowMap::Lookup(uint32_t x, uint32_t y, float depth) const
+{
+	return x < m_size && y < m_size ? Lookup(&m_knots[(static_cast<size_t>(m_size) * y + x) * NumKnots], depth) : 1.0f;
+}
+
+bool DeepShadowMap::GetTexel(const float viewProj[16], const float pos[3], uint32_t& x, uint32_t& y, float& depth) const
+{
+	float clip[4];
+	for (uint8_t j = 0; j < 4; ++j)
+		clip[j] = pos[0] * viewProj[j] + pos[1] * viewProj[4 + j] + pos[2] * viewProj[8 + j] + viewProj[12 + j];
+	if (!(clip[3] > 0.0f)) return false;
+
+	// As ShadowTest() of RayMarch.hlsli
+	const auto u = (clip[0] / clip[3]) * 0.5f + 0.5f;
+	const auto v = 0.5f - (clip[1] / clip[3]) * 0.5f;
+	depth = clip[2] / clip[3];
+	if (!(u >= 0.0f && u < 1.0f && v >= 0.0f && v < 1.0f)) return false;
+
+	x = (min)(static_cast<uint32_t>(u * m_size), m_size - 1);
+	y = (min)(static_cast<uint32_t>(v * m_size), m_size - 1);
+
+	return true;
+}
+
+uint32_t DeepShadowMap::GetSize() const
+{
+	return m_size;
+}
+
+uint32_t DeepShadowMap::GetNumKnots(uint32_t x, uint32_t y) const
+{
+	if (x >= m_size || y >= m_size) return 0;
+
+	const auto pKnots = &m_knots[(static_cast<size_t>(m_size) * y + x) * NumKnots];
+	auto numKnots = 0u;
+	while (numKnots < NumKnots && pKnots[numKnots] != EmptyKnot) ++numKnots;
+
+	return numKnots;
+}
+
+const uint32_t* DeepShadowMap::GetKnots() const
+{
+	return m_knots.data();
+}
+
+void DeepShadowMap::InsertSpan(uint32_t knots[NumKnots], float nearDepth, float farDepth, float transm)
+{
+	if (!(transm < 1.0f)) return;
+	nearDepth = saturate(nearDepth);
+	farDepth = (max)(saturate(farDepth), nearDepth);
+	transm = (max)(transm, 0.0f);
+
+	Knot oldKnots[NumKnots];
+	auto numOld = 0u;
+	while (numOld < NumKnots && knots[numOld] != EmptyKnot)
+	{
+		oldKnots[numOld] = DecodeKnot(knots[numOld]);
+		++numOld;
+	}
+
+	// The knots of both, in depth order, the old first on a tie, each with the product of
+	// the old function and the span
+	const auto getSpan = [&](float depth)
+	{
+		const auto t = farDepth > nearDepth ? saturate((depth - nearDepth) / (farDepth - nearDepth)) : (depth < farDepth ? 0.0f : 1.0f);
+
+		return 1.0f + (transm - 1.0f) * t;
+	};
+
+	const float spanDepths[] = { nearDepth, farDepth };
+	Knot merged[NumKnots + 2];
+	auto numMerged = 0u;
+	for (auto i = 0u, j = 0u; i < numOld || j < 2;)
+	{
+		const auto depth = j >= 2 || (i < numOld && oldKnots[i].Depth <= spanDepths[j]) ? oldKnots[i++].Depth : spanDepths[j++];
+		merged[numMerged++] = { depth, evaluate(oldKnots, numOld, depth) * getSpan(depth) };
+	}
+
+	// Keep the first and the last knots, and remove the interior ones of the least area
+	// between the function with and without them
+	while (numMerged > NumKnots)
+	{
+		auto minArea = 0.0f;
+		auto removed = 1u;
+		for (auto i = 1u; i + 1 < numMerged; ++i)
+		{
+			const auto& prev = merged[i - 1];
+			const auto& next = merged[i + 1];
+			const auto width = next.Depth - prev.Depth;
+			const auto t = width > 0.0f ? (merged[i].Depth - prev.Depth) / width : 0.0f;
+			const auto interp = prev.Transmittance + (next.Transmittance - prev.Transmittance) * t;
+			const auto area = 0.5f * fabsf(merged[i].Transmittance - interp) * width;
+			if (i == 1 || area < minArea)
+			{
+				minArea = area;
+				removed = i;
+			}
+		}
+
+		for (auto i = removed; i + 1 < numMerged; ++i) merged[i] = merged[i + 1];
+		--numMerged;
+	}
+
+	for (auto i = 0u; i < NumKnots; ++i) knots[i] = i < numMerged ? EncodeKnot(merged[i]) : EmptyKnot;
+}
+
+float DeepShadowMap::Lookup(const uint32_t knots[NumKnots], float depth)
+{
+	Knot decoded[NumKnots];
+	auto numKnots = 0u;
+	while (numKnots < NumKnots && knots[numKnots] != EmptyKnot)
+	{
+		decoded[numKnots] = DecodeKnot(knots[numKnots]);
+		++numKnots;
+	}
+
+	return evaluate(decoded, numKnots, depth);
+}
+
+uint32_t DeepShadowMap::EncodeKnot(const Knot& knot)
+{
+	const auto depth = static_cast<uint32_t>(saturate(knot.Depth) * 65535.0f + 0.5f);
+	const auto transm = static_cast<uint32_t>(saturate(knot.Transmittance) * 65535.0f + 0.5f);
+
+	return depth | (transm << 16);
+}
+
+DeepShadowMap::Knot DeepShadowMap::DecodeKnot(uint32_t knot)
+{
+	Knot decoded;
+	decoded.Depth = (knot & 0xffff) / 65535.0f;
+	decoded.Transmittance = (knot >> 16) / 65535.0f;
+
+	return decoded;
+}
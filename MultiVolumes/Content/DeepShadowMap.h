@@ -0,0 +1,59 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// Transmittance of the light through the volumes, per texel of the shadow view, as a
+// function of the depth in it, i.e. a deep shadow map. Each texel keeps up to NumKnots
+// knots of a piecewise-linear function: 1 before the first knot, and the transmittance of
+// the last beyond it. Each volume that the light ray of a texel passes is inserted as a
+// span, from its near depth toward the light to its far depth, over which the function
+// falls by the transmittance of the volume along the ray. Beyond NumKnots, the interior
+// knot of the least area change is removed, one at a time. Knots pack a 16-bit depth and
+// a 16-bit transmittance into a uint, as CSDeepShadow.hlsl stores them, and this is its
+// reference. It has no graphics API dependency.
+//--------------------------------------------------------------------------------------
+class DeepShadowMap
+{
+public:
+	static const uint32_t NumKnots = 8;
+	static const uint32_t EmptyKnot = 0xffffffff;	// Depth 1 and transmittance 1
+
+	struct Knot
+	{
+		float Depth;
+		float Transmittance;
+	};
+
+	DeepShadowMap();
+	virtual ~DeepShadowMap();
+
+	void Init(uint32_t size);
+	void Clear();
+
+	// Depths in [0, 1] of the shadow view, nearDepth toward the light
+	void InsertSpan(uint32_t x, uint32_t y, float nearDepth, float farDepth, float transm);
+	float Lookup(uint32_t x, uint32_t y, float depth) const;
+
+	// The texel and depth of a world position, by the nearest texel; viewProj is row-major
+	// for row vectors, as XMFLOAT4X4 with D3D depth; false outside the map
+	bool GetTexel(const float viewProj[16], const float pos[3], uint32_t& x, uint32_t& y, float& depth) const;
+
+	uint32_t GetSize() const;
+	uint32_t GetNumKnots(uint32_t x, uint32_t y) const;
+	const uint32_t* GetKnots() const;	// NumKnots per texel, in row order
+
+	static void InsertSpan(uint32_t knots[NumKnots], float nearDepth, float farDepth, float transm);
+	static float Lookup(const uint32_t knots[NumKnots], float depth);
+	static uint32_t EncodeKnot(const Knot& knot);
+	static Knot DecodeKnot(uint32_t knot);
+
+protected:
+	uint32_t m_size;
+	std::vector<uint32_t> m_knots;
+};
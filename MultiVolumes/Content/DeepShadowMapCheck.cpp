@@ -0,0 +1,366 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "DeepShadowMap.h"
+#include "ProceduralVolume.h"
+#include "VolumeBVH.h"
+#include "ToolCheck.h"
+
+using namespace std;
+
+// Orthographic shadow view looking from eye at the origin, as ObjectRenderer builds it;
+// axes receive the x, y and z axes of the view in world space
+static Matrix4 getShadowViewProj(const float eye[3], float size, float zNear, float zFar, float axes[3][3])
+{
+	const float up[] = { 0.0f, 1.0f, 0.0f };
+	const auto normalize = [](float v[3])
+	{
+		const auto len = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		for (auto i = 0u; i < 3; ++i) v[i] /= len;
+	};
+
+	auto& xAxis = axes[0];
+	auto& yAxis = axes[1];
+	auto& zAxis = axes[2];
+	for (auto i = 0u; i < 3; ++i) zAxis[i] = -eye[i];
+	normalize(zAxis);
+	xAxis[0] = up[1] * zAxis[2] - up[2] * zAxis[1];
+	xAxis[1] = up[2] * zAxis[0] - up[0] * zAxis[2];
+	xAxis[2] = up[0] * zAxis[1] - up[1] * zAxis[0];
+	normalize(xAxis);
+	yAxis[0] = zAxis[1] * xAxis[2] - zAxis[2] * xAxis[1];
+	yAxis[1] = zAxis[2] * xAxis[0] - zAxis[0] * xAxis[2];
+	yAxis[2] = zAxis[0] * xAxis[1] - zAxis[1] * xAxis[0];
+
+	Matrix4 view = {};
+	for (auto i = 0u; i < 3; ++i)
+	{
+		for (auto j = 0u; j < 3; ++j) view.m[j][i] = axes[i][j];
+		view.m[3][i] = -(axes[i][0] * eye[0] + axes[i][1] * eye[1] + axes[i][2] * eye[2]);
+	}
+	view.m[3][3] = 1.0f;
+
+	Matrix4 proj = {};
+	proj.m[0][0] = 2.0f / size;
+	proj.m[1][1] = 2.0f / size;
+	proj.m[2][2] = 1.0f / (zFar - zNear);
+	proj.m[3][2] = zNear / (zNear - zFar);
+	proj.m[3][3] = 1.0f;
+
+	return Multiply(view, proj);
+}
+
+// Transmittance of a world-space ray through a volume, from its entry, as the light rays
+// of CSRayMarchL.hlsl
+static float castWorldLightRay(const VolumeGrid& grid, const float worldI[12], const float origin[3],
+	const float dir[3], uint32_t numSamples)
+{
+	float localOrigin[3], localDir[3];
+	for (auto i = 0u; i < 3; ++i)
+	{
+		localOrigin[i] = worldI[4 * i] * origin[0] + worldI[4 * i + 1] * origin[1] + worldI[4 * i + 2] * origin[2] + worldI[4 * i + 3];
+		localDir[i] = worldI[4 * i] * dir[0] + worldI[4 * i + 1] * dir[1] + worldI[4 * i + 2] * dir[2];
+	}
+	const auto len = sqrtf(localDir[0] * localDir[0] + localDir[1] * localDir[1] + localDir[2] * localDir[2]);
+	for (auto& d : localDir) d /= len;
+
+	return ComputeRayOrigin(localOrigin, localDir) ? CastLightRay(grid, localOrigin, localDir, numSamples, 0) : 1.0f;
+}
+
+static bool isInsideVolume(const float worldI[12], const float pos[3])
+{
+	for (auto i = 0u; i < 3; ++i)
+		if (fabsf(worldI[4 * i] * pos[0] + worldI[4 * i + 1] * pos[1] + worldI[4 * i + 2] * pos[2] + worldI[4 * i + 3]) >= 1.0f)
+			return false;
+
+	return true;
+}
+
+// Builds the deep shadow map of scattered volumes as CSDeepShadow.hlsl, and compares its
+// lookups where the light rays of random light-map voxels leave their volumes with
+// marching the other volumes; the knots must be exact for disjoint spans and never rise,
+// the lookups must stay within the span ramps of the marched light rays of their texels,
+// and the error of the receivers clear of the other volumes within the silhouette share
+int DeepShadowCheck(int argc, char* argv[])
+{
+	uint32_t numVolumes = 64, numReceivers = 4096, numSamples = 96, seed = 1;
+	uint32_t mapSizes[] = { 128, 256, 512 }, numSizes = 3;
+	ToolArgs args;
+	args.Add("-volumes", numVolumes, 1);
+	args.Add("-receivers", numReceivers);
+	args.Add("-samples", numSamples, 1);
+	args.Add("-size", [&](const char* arg)
+	{
+		mapSizes[0] = (max)(static_cast<uint32_t>(stoul(arg)), 1u);
+		numSizes = 1;
+	});
+	args.Add("-seed", seed);
+	if (!args.Parse(argc, argv)) return EXIT_FAILURE;
+
+	auto state = seed ^ 0xd5ad;
+	const auto random = [&state]()
+	{
+		state = state * 1664525u + 1013904223u;
+
+		return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+	};
+
+	uint64_t numErrors = 0;
+
+	// Disjoint spans are exact, up to the 16-bit knots, and the functions never rise
+	auto maxSpanError = 0.0f, maxCompressedError = 0.0f;
+	for (auto t = 0u; t < 1000; ++t)
+	{
+		const auto numSpans = t % 2 ? DeepShadowMap::NumKnots / 2 : DeepShadowMap::NumKnots;
+		float bounds[2 * DeepShadowMap::NumKnots], transms[DeepShadowMap::NumKnots];
+		for (auto s = 0u; s < numSpans; ++s)
+		{
+			const auto cell = 1.0f / numSpans;
+			bounds[2 * s] = cell * (s + 0.05f + 0.4f * random());
+			bounds[2 * s + 1] = bounds[2 * s] + cell * (0.1f + 0.4f * random());
+			transms[s] = 0.2f + 0.8f * random();
+		}
+
+		uint32_t knots[DeepShadowMap::NumKnots];
+		fill(knots, knots + DeepShadowMap::NumKnots, DeepShadowMap::EmptyKnot);
+		for (auto s = numSpans; s-- > 0;)	// Back to front, as some rays meet them
+		{
+			const auto k = (s * 7 + t) % numSpans;
+			DeepShadowMap::InsertSpan(knots, bounds[2 * k], bounds[2 * k + 1], transms[k]);
+		}
+
+		auto prev = 1.0f;
+		for (auto d = 0u; d <= 1024; ++d)
+		{
+			const auto depth = d / 1024.0f;
+			auto expected = 1.0f;
+			for (auto s = 0u; s < numSpans; ++s)
+			{
+				const auto u = (min)((max)((depth - bounds[2 * s]) / (bounds[2 * s + 1] - bounds[2 * s]), 0.0f), 1.0f);
+				expected *= 1.0f + (transms[s] - 1.0f) * u;
+			}
+
+			const auto transm = DeepShadowMap::Lookup(knots, depth);
+			auto& maxError = numSpans > DeepShadowMap::NumKnots / 2 ? maxCompressedError : maxSpanError;
+			maxError = (max)(maxError, fabsf(transm - expected));
+			if (transm > prev + 1.0e-6f) ++numErrors;
+			prev = transm;
+		}
+	}
+	if (maxSpanError > 2.0e-3f) ++numErrors;
+
+	// Volumes of a shared cloud, lit from the default direction of MultiRayCaster
+	ProceduralVolume generator;
+	ProceduralVolume::Desc desc;
+	desc.Width = desc.Height = desc.Depth = 32;
+	desc.Seed = seed;
+	generator.Init(desc);
+	VolumeGrid grid;
+	generator.Generate(grid);
+
+	vector<Matrix4> worlds;
+	vector<float> worldIs, sampleScales;
+	const auto extent = ScatterVolumes(numVolumes, seed, worlds, worldIs, sampleScales);
+	vector<float> worlds3x4(12 * numVolumes);
+	for (auto i = 0u; i < numVolumes; ++i) GetWorld3x4(worlds[i], &worlds3x4[12 * i]);
+
+	float lightDir[] = { 1.0f, 1.0f, -1.0f };
+	for (auto& d : lightDir) d /= sqrtf(3.0f);
+	const float eye[] = { lightDir[0] * extent, lightDir[1] * extent, lightDir[2] * extent };
+	const auto size = 1.5f * extent, zNear = 1.0f, zFar = 2.0f * extent;
+	float axes[3][3];
+	const auto shadowVP = getShadowViewProj(eye, size, zNear, zFar, axes);
+
+	// Receivers: random voxels with density, and the exits of their light rays
+	struct Receiver
+	{
+		uint32_t Volume;
+		float Exit[3];
+		float Transm;	// Of the other volumes, by marching them
+		bool Overlapped;	// The exit is inside another volume
+	};
+
+	vector<Receiver> receivers;
+	receivers.reserve(numReceivers);
+	for (auto attempts = 0u; receivers.size() < numReceivers && attempts < 64 * numReceivers; ++attempts)
+	{
+		Receiver receiver;
+		receiver.Volume = (min)(static_cast<uint32_t>(random() * numVolumes), numVolumes - 1);
+		const float local[] = { random() * 2.0f - 1.0f, random() * 2.0f - 1.0f, random() * 2.0f - 1.0f };
+		if (grid.Sample(local[0] * 0.5f + 0.5f, local[1] * 0.5f + 0.5f, local[2] * 0.5f + 0.5f) *
+			g_gridDensityScale < g_zeroThreshold) continue;
+
+		const auto pWorld = &worlds3x4[12 * receiver.Volume];
+		const auto pWorldI = &worldIs[12 * receiver.Volume];
+		float localDir[3];
+		for (auto i = 0u; i < 3; ++i) localDir[i] = pWorldI[4 * i] * lightDir[0] + pWorldI[4 * i + 1] * lightDir[1] + pWorldI[4 * i + 2] * lightDir[2];
+		auto tExit = FLT_MAX;
+		for (auto i = 0u; i < 3; ++i)
+			if (localDir[i] != 0.0f) tExit = (min)(tExit, ((localDir[i] > 0.0f ? 1.0f : -1.0f) - local[i]) / localDir[i]);
+
+		float exit[3];
+		for (auto i = 0u; i < 3; ++i) exit[i] = local[i] + localDir[i] * tExit;
+		for (auto i = 0u; i < 3; ++i)
+			receiver.Exit[i] = pWorld[4 * i] * exit[0] + pWorld[4 * i + 1] * exit[1] + pWorld[4 * i + 2] * exit[2] + pWorld[4 * i + 3];
+
+		receiver.Transm = 1.0f;
+		receiver.Overlapped = false;
+		for (auto n = 0u; n < numVolumes; ++n)
+		{
+			if (n == receiver.Volume) continue;
+			receiver.Transm *= castWorldLightRay(grid, &worldIs[12 * n], receiver.Exit, lightDir, numSamples);
+
+			receiver.Overlapped = receiver.Overlapped || isInsideVolume(&worldIs[12 * n], receiver.Exit);
+		}
+		receivers.push_back(receiver);
+	}
+
+	printf("%u volumes, %zu receivers, %u knots per texel; knot error %.5f for disjoint spans, %.4f compressed\n",
+		numVolumes, receivers.size(), DeepShadowMap::NumKnots, maxSpanError, maxCompressedError);
+	printf("Volumes marched per light-map voxel: %u before, 1 and a lookup after\n", numVolumes);
+
+	// Mean half width of the volumes, the scale of their silhouettes
+	auto halfWidth = 0.0;
+	for (auto i = 0u; i < numVolumes; ++i)
+		for (auto j = 0u; j < 3; ++j)
+			halfWidth += sqrt(worlds[i].m[j][0] * worlds[i].m[j][0] + worlds[i].m[j][1] * worlds[i].m[j][1] +
+				worlds[i].m[j][2] * worlds[i].m[j][2]) / (3.0 * numVolumes);
+
+	const auto bias = 0.0027f;	// As DEEP_SHADOW_BIAS of CSRayMarchL.hlsl
+	for (auto s = 0u; s < numSizes; ++s)
+	{
+		const auto mapSize = mapSizes[s];
+		DeepShadowMap map;
+		map.Init(mapSize);
+
+		const auto start = chrono::steady_clock::now();
+		uint64_t numSpans = 0;
+		for (auto y = 0u; y < mapSize; ++y)
+		{
+			for (auto x = 0u; x < mapSize; ++x)
+			{
+				// From the far plane toward the light; t in [0, 1] runs the depth from 1 to 0
+				const auto u = ((x + 0.5f) / mapSize * 2.0f - 1.0f) * size * 0.5f;
+				const auto v = (1.0f - (y + 0.5f) / mapSize * 2.0f) * size * 0.5f;
+				float origin[3], dir[3];
+				for (auto i = 0u; i < 3; ++i)
+				{
+					origin[i] = eye[i] + axes[0][i] * u + axes[1][i] * v + axes[2][i] * zFar;
+					dir[i] = -axes[2][i] * (zFar - zNear);
+				}
+
+				for (auto n = 0u; n < numVolumes; ++n)
+				{
+					float tNear, tFar;
+					if (!VolumeBVH::IntersectVolume(&worldIs[12 * n], origin, dir, 1.0f, tNear, tFar) || tNear >= tFar) continue;
+
+					float entry[3];
+					for (auto i = 0u; i < 3; ++i) entry[i] = origin[i] + dir[i] * tNear;
+					map.InsertSpan(x, y, 1.0f - tFar, 1.0f - tNear, castWorldLightRay(grid, &worldIs[12 * n], entry, lightDir, numSamples));
+					++numSpans;
+				}
+			}
+		}
+		const auto buildTime = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+		// Never rising along any texel
+		for (auto y = 0u; y < mapSize; ++y)
+		{
+			for (auto x = 0u; x < mapSize; ++x)
+			{
+				auto prev = 1.0f;
+				for (auto d = 0u; d <= 64; ++d)
+				{
+					const auto transm = map.Lookup(x, y, d / 64.0f);
+					if (transm > prev + 1.0e-6f) ++numErrors;
+					prev = transm;
+				}
+			}
+		}
+
+		// Against the marched transmittance at each receiver, which the texel only samples, and
+		// at the lookup point on the light ray of the texel, which the map must match up to the
+		// knots. Within a volume, its span ramps linearly from 1 to its transmittance, while the
+		// marched transmittance to the point follows the density; both lie in [transmittance, 1],
+		// so the error is bounded by the sum of 1 - the transmittance of the volumes holding the
+		// point, and the knots add at most that of disjoint spans
+		auto sumError = 0.0, sumSqError = 0.0;
+		auto maxError = 0.0f, maxExcess = 0.0f;
+		double sumErrors[2] = {}, sumRampBound = 0.0;
+		uint64_t numLarge = 0, numOutside = 0, numFull = 0, numReceivers[2] = {};
+		for (const auto& receiver : receivers)
+		{
+			uint32_t x, y;
+			float depth;
+			auto transm = 1.0f;
+			if (map.GetTexel(&shadowVP.m[0][0], receiver.Exit, x, y, depth))
+			{
+				transm = map.Lookup(x, y, depth - bias);
+
+				const auto u = ((x + 0.5f) / mapSize * 2.0f - 1.0f) * size * 0.5f;
+				const auto v = (1.0f - (y + 0.5f) / mapSize * 2.0f) * size * 0.5f;
+				const auto z = zFar - (zFar - zNear) * (1.0f - (depth - bias));
+				float point[3];
+				for (auto i = 0u; i < 3; ++i) point[i] = eye[i] + axes[0][i] * u + axes[1][i] * v + axes[2][i] * z;
+
+				auto expected = 1.0f, rampBound = 0.0f;
+				for (auto n = 0u; n < numVolumes; ++n)
+				{
+					const auto pWorldI = &worldIs[12 * n];
+					expected *= castWorldLightRay(grid, pWorldI, point, lightDir, numSamples);
+					if (!isInsideVolume(pWorldI, point)) continue;
+
+					float behind[3];
+					for (auto i = 0u; i < 3; ++i) behind[i] = point[i] - lightDir[i] * 4.0f * extent;
+					rampBound += 1.0f - castWorldLightRay(grid, pWorldI, behind, lightDir, numSamples);
+				}
+
+				if (map.GetNumKnots(x, y) < DeepShadowMap::NumKnots)
+					maxExcess = (max)(maxExcess, fabsf(transm - expected) - rampBound);
+				else ++numFull;
+				if (receiver.Overlapped) sumRampBound += rampBound;
+			}
+			else ++numOutside;
+
+			const auto error = fabsf(transm - receiver.Transm);
+			sumError += error;
+			sumSqError += error * error;
+			maxError = (max)(maxError, error);
+			numLarge += error > 0.1f ? 1 : 0;
+			sumErrors[receiver.Overlapped] += error;
+			++numReceivers[receiver.Overlapped];
+		}
+
+		// Receivers clear of the other volumes only differ from their texels where the light rays
+		// of the two straddle a silhouette, i.e. within a texel of it, whose share is that of the
+		// texel to the volumes; 1 to 2.5% of it over 16 to 1024 volumes
+		const auto numReceived = (max)(receivers.size(), static_cast<size_t>(1));
+		const auto numClear = (max)(numReceivers[0], static_cast<uint64_t>(1));
+		const auto numInside = (max)(numReceivers[1], static_cast<uint64_t>(1));
+		const auto maxClearError = 0.05 * size / mapSize / halfWidth;
+		printf("%ux%u: %.2f spans per texel, built in %.1f ms; transmittance error mean %.4f, RMS %.4f, max %.3f, "
+			"%.2f%% above 0.1, %llu outside\n", mapSize, mapSize, static_cast<double>(numSpans) / (mapSize * mapSize),
+			buildTime, sumError / numReceived, sqrt(sumSqError / numReceived), maxError, 100.0 * numLarge / numReceived,
+			static_cast<unsigned long long>(numOutside));
+		printf("  mean error %.4f for %llu receivers clear of the other volumes (limit %.4f), %.4f for %llu inside one, "
+			"whose span ramps bound it by %.4f on average\n", sumErrors[0] / numClear, static_cast<unsigned long long>(numReceivers[0]),
+			maxClearError, sumErrors[1] / numInside, static_cast<unsigned long long>(numReceivers[1]), sumRampBound / numInside);
+		printf("  at the lookup points of the texels: max error %.5f beyond the ramp bound, %llu full texels skipped\n",
+			maxExcess, static_cast<unsigned long long>(numFull));
+		if (sumErrors[0] / numClear > maxClearError) ++numErrors;
+		if (maxExcess > 2.0e-3f) ++numErrors;
+	}
+
+	CheckReport report;
+	report.ExpectNone("Errors", numErrors);
+
+	return report.Finish();
+}
@@ -0,0 +1,178 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include "HiZPyramid.h"
+
+using namespace std;
+
+HiZPyramid::HiZPyramid() :
+	m_width(0),
+	m_height(0)
+{
+}
+
+HiZPyramid::~HiZPyramid()
+{
+}
+
+void HiZPyramid::Build(const float* pDepths, uint32_t width, uint32_t height)
+{
+	m_width = width;
+	m_height = height;
+
+	// Full mip chain of a texture of half the size, as Texture::CalculateMipLevels()
+	const auto width0 = (max)(width / 2, 1u);
+	const auto height0 = (max)(height / 2, 1u);
+	auto numLevels = 1u;
+	while (((max)(width0, height0) >> numLevels) > 0) ++numLevels;
+
+	m_levels.resize(numLevels);
+	m_levelWidths.resize(numLevels);
+	m_levelHeights.resize(numLevels);
+
+	auto pSrc = pDepths;
+	auto srcWidth = width;
+	auto srcHeight = height;
+	for (auto l = 0u; l < numLevels; ++l)
+	{
+		const auto dstWidth = (max)(width0 >> l, 1u);
+		const auto dstHeight = (max)(height0 >> l, 1u);
+		auto& level = m_levels[l];
+		level.resize(dstWidth * dstHeight);
+
+		// Farthest of the 2x2 source texels, 3 wide at the last texel of an odd source
+		for (auto y = 0u; y < dstHeight; ++y)
+		{
+			const auto y0 = y * 2;
+			const auto y1 = y + 1 == dstHeight ? srcHeight - 1 : y0 + 1;
+			for (auto x = 0u; x < dstWidth; ++x)
+			{
+				const auto x0 = x * 2;
+				const auto x1 = x + 1 == dstWidth ? srcWidth - 1 : x0 + 1;
+				auto depth = 0.0f;
+				for (auto j = y0; j <= y1; ++j)
+					for (auto i = x0; i <= x1; ++i)
+						depth = (max)(depth, pSrc[srcWidth * j + i]);
+				level[dstWidth * y + x] = depth;
+			}
+		}
+
+		m_levelWidths[l] = dstWidth;
+		m_levelHeights[l] = dstHeight;
+		pSrc = level.data();
+		srcWidth = dstWidth;
+		srcHeight = dstHeight;
+	}
+}
+
+bool HiZPyramid::IsOccluded(const float rect[4], float minDepth) const
+{
+	if (m_levels.empty()) return false;
+
+	// Clamp to the viewport, since the pixels outside are never seen
+	uint32_t pixelRect[4];
+	for (auto c = 0u; c < 4; ++c)
+	{
+		const auto size = (c & 1) ? m_height : m_width;
+		const auto v = (min)((max)(rect[c], 0.0f), static_cast<float>(size - 1));
+		pixelRect[c] = static_cast<uint32_t>(v);
+	}
+
+	// Coarsest enough that the rectangle spans at most 2x2 texels
+	const auto level = (min)(GetLevel(pixelRect), GetNumLevels() - 1);
+	const auto shift = level + 1;
+	const auto levelWidth = m_levelWidths[level];
+	const auto levelHeight = m_levelHeights[level];
+	const auto x0 = (min)(pixelRect[0] >> shift, levelWidth - 1);
+	const auto y0 = (min)(pixelRect[1] >> shift, levelHeight - 1);
+	const auto x1 = (min)(pixelRect[2] >> shift, levelWidth - 1);
+	const auto y1 = (min)(pixelRect[3] >> shift, levelHeight - 1);
+
+	auto maxDepth = 0.0f;
+	for (auto y = y0; y <= y1; ++y)
+		for (auto x = x0; x <= x1; ++x)
+			maxDepth = (max)(maxDepth, m_levels[level][levelWidth * y + x]);
+
+	return minDepth > maxDepth;
+}
+
+bool HiZPyramid::IsVolumeOccluded(const float worldViewProj[16]) const
+{
+	float rect[4], minDepth;
+
+	return GetVolumeRect(worldViewProj, m_width, m_height, rect, minDepth) && IsOccluded(rect, minDepth);
+}
+
+bool HiZPyramid::GetVolumeRect(const float worldViewProj[16], uint32_t width, uint32_t height,
+	float rect[4], float& minDepth)
+{
+	const auto m = worldViewProj;
+
+	rect[0] = rect[1] = FLT_MAX;
+	rect[2] = rect[3] = -FLT_MAX;
+	minDepth = 1.0f;
+	for (auto i = 0u; i < 8; ++i)
+	{
+		const auto px = (i & 1) ? 1.0f : -1.0f;
+		const auto py = ((i >> 1) & 1) ? 1.0f : -1.0f;
+		const auto pz = (i >> 2) ? 1.0f : -1.0f;
+		const auto pw = 1.0f;
+
+		auto x = ((px * m[0] + py * m[4]) + pz * m[8]) + pw * m[12];
+		auto y = ((px * m[1] + py * m[5]) + pz * m[9]) + pw * m[13];
+		auto z = ((px * m[2] + py * m[6]) + pz * m[10]) + pw * m[14];
+		const auto w = ((px * m[3] + py * m[7]) + pz * m[11]) + pw * m[15];
+		x = x / w;
+		y = y / w;
+		z = z / w;
+		x = x * 0.5f + 0.5f;
+		y = y * 0.5f + 0.5f;
+		y = 1.0f - y;
+		x *= width;
+		y *= height;
+
+		// Also rejects w = 0 with its NaN
+		if (!(z >= 0.0f && z <= 1.0f)) return false;
+
+		rect[0] = (min)(rect[0], x);
+		rect[1] = (min)(rect[1], y);
+		rect[2] = (max)(rect[2], x);
+		rect[3] = (max)(rect[3], y);
+		minDepth = (min)(minDepth, z);
+	}
+
+	return true;
+}
+
+float HiZPyramid::GetFarthestDepth(uint32_t level, uint32_t x, uint32_t y) const
+{
+	return m_levels[level][m_levelWidths[level] * y + x];
+}
+
+uint32_t HiZPyramid::GetNumLevels() const
+{
+	return static_cast<uint32_t>(m_levels.size());
+}
+
+uint32_t HiZPyramid::GetLevelWidth(uint32_t level) const
+{
+	return m_levelWidths[level];
+}
+
+uint32_t HiZPyramid::GetLevelHeight(uint32_t level) const
+{
+	return m_levelHeights[level];
+}
+
+uint32_t HiZPyramid::GetLevel(const uint32_t pixelRect[4])
+{
+	// Texels of level l are 2^(l + 1) pixels wide, so an extent below that crosses at most one edge
+	const auto extent = (max)(pixelRect[2] - pixelRect[0], pixelRect[3] - pixelRect[1]);
+	auto level = 0u;
+	while (extent >> (level + 1)) ++level;
+
+	return level;
+}
@@ -0,0 +1,51 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// CPU reference of the hierarchical-Z pyramid that CSBuildHiZ builds from the depth map,
+// and of the conservative occlusion test of VolumeCull. Level 0 is half the depth map in
+// each dimension, rounded down as D3D mips; each texel holds the farthest depth under it,
+// and the last texel of a row or column also covers the odd pixel left over. A pixel p
+// thus falls in texel min(p >> (l + 1), size - 1) of level l.
+//--------------------------------------------------------------------------------------
+class HiZPyramid
+{
+public:
+	HiZPyramid();
+	virtual ~HiZPyramid();
+
+	void Build(const float* pDepths, uint32_t width, uint32_t height);	// Row-major depth map
+
+	// rect is [minX, minY, maxX, maxY] in pixels; true if the pyramid proves that every
+	// pixel of the rectangle is nearer than minDepth. It reads at most 2x2 texels
+	bool IsOccluded(const float rect[4], float minDepth) const;
+
+	// The [-1, 1] cube of a volume; never occluded once a vertex leaves the depth range,
+	// e.g. behind the camera
+	bool IsVolumeOccluded(const float worldViewProj[16]) const;
+
+	float GetFarthestDepth(uint32_t level, uint32_t x, uint32_t y) const;
+	uint32_t GetNumLevels() const;
+	uint32_t GetLevelWidth(uint32_t level) const;
+	uint32_t GetLevelHeight(uint32_t level) const;
+
+	// Screen rectangle in pixels and nearest depth of the cube of a volume, projected as
+	// VolumeCuller::CullVolume() does; false once a vertex leaves the depth range [0, 1]
+	static bool GetVolumeRect(const float worldViewProj[16], uint32_t width, uint32_t height,
+		float rect[4], float& minDepth);
+	static uint32_t GetLevel(const uint32_t pixelRect[4]);	// Before clamping to the levels available
+
+protected:
+	uint32_t m_width;
+	uint32_t m_height;
+
+	std::vector<std::vector<float>> m_levels;
+	std::vector<uint32_t> m_levelWidths;
+	std::vector<uint32_t> m_levelHeights;
+};
@@ -0,0 +1,189 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "HiZPyramid.h"
+#include "SharedConsts.h"
+#include "ToolCheck.h"
+
+using namespace std;
+
+struct HiZCheckResult
+{
+	uint64_t NumOccluded;
+	uint64_t NumRectOccluded;
+	uint64_t NumMismatches;
+};
+
+// Random spheres in front of a camera at the origin looking down +z give the depth map of
+// the opaque geometry, which the pyramid must reduce exactly; every volume the pyramid
+// occludes must be behind the depth of all pixels of its screen rectangle
+static HiZCheckResult checkHiZ(uint32_t width, uint32_t height, uint32_t numVolumes, uint32_t numViews, uint32_t seed)
+{
+	auto state = seed;
+	const auto random = [&state]()
+	{
+		state = state * 1664525u + 1013904223u;
+
+		return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+	};
+
+	const auto fovY = 3.14159265f / 4.0f;
+	const auto aspect = static_cast<float>(width) / static_cast<float>(height);
+	const float eye[] = { 0.0f, 0.0f, 0.0f };
+	const float at[] = { 0.0f, 0.0f, 1.0f };
+	const auto viewProj = GetViewProj(eye, at, fovY, aspect, g_zNear, g_zFar);
+	const auto tanHalfFovY = tanf(fovY * 0.5f);
+	const auto range = g_zFar / (g_zFar - g_zNear);
+
+	HiZCheckResult result = {};
+	vector<float> depths(width * height);
+	auto buildSeconds = 0.0, testSeconds = 0.0;
+	HiZPyramid pyramid;
+	for (auto v = 0u; v < numViews; ++v)
+	{
+		// Occluders, as the depths of the nearest sphere hits along the pixel centers
+		float spheres[16][4];
+		for (auto& sphere : spheres)
+		{
+			sphere[2] = 10.0f + random() * 40.0f;
+			sphere[0] = (random() - 0.5f) * sphere[2] * tanHalfFovY * aspect * 2.0f;
+			sphere[1] = (random() - 0.5f) * sphere[2] * tanHalfFovY * 2.0f;
+			sphere[3] = 1.0f + random() * 8.0f;
+		}
+
+		for (auto y = 0u; y < height; ++y)
+		{
+			for (auto x = 0u; x < width; ++x)
+			{
+				const float dir[] =
+				{
+					((x + 0.5f) / width * 2.0f - 1.0f) * tanHalfFovY * aspect,
+					(1.0f - (y + 0.5f) / height * 2.0f) * tanHalfFovY,
+					1.0f
+				};
+
+				auto tMin = FLT_MAX;
+				for (const auto& sphere : spheres)
+				{
+					const auto a = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+					const auto b = dir[0] * sphere[0] + dir[1] * sphere[1] + dir[2] * sphere[2];
+					const auto c = sphere[0] * sphere[0] + sphere[1] * sphere[1] + sphere[2] * sphere[2] - sphere[3] * sphere[3];
+					const auto d = b * b - a * c;
+					if (d >= 0.0f) tMin = (min)(tMin, (b - sqrtf(d)) / a);
+				}
+
+				// t is the view depth, since dir.z is 1
+				depths[width * y + x] = tMin < FLT_MAX ? range * (1.0f - g_zNear / tMin) : 1.0f;
+			}
+		}
+
+		auto start = chrono::steady_clock::now();
+		pyramid.Build(depths.data(), width, height);
+		buildSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		// Each texel must be the farthest depth of the pixels mapped to it
+		for (auto l = 0u; l < pyramid.GetNumLevels(); ++l)
+		{
+			const auto levelWidth = pyramid.GetLevelWidth(l);
+			const auto levelHeight = pyramid.GetLevelHeight(l);
+			vector<float> farthest(levelWidth * levelHeight, 0.0f);
+			for (auto y = 0u; y < height; ++y)
+			{
+				const auto j = (min)(y >> (l + 1), levelHeight - 1);
+				for (auto x = 0u; x < width; ++x)
+				{
+					auto& depth = farthest[levelWidth * j + (min)(x >> (l + 1), levelWidth - 1)];
+					depth = (max)(depth, depths[width * y + x]);
+				}
+			}
+
+			for (auto j = 0u; j < levelHeight; ++j)
+				for (auto i = 0u; i < levelWidth; ++i)
+					if (pyramid.GetFarthestDepth(l, i, j) != farthest[levelWidth * j + i]) ++result.NumMismatches;
+		}
+
+		// Volumes in and around the spheres, some of them straddling the near plane
+		vector<Matrix4> worldViewProjs(numVolumes);
+		for (auto& worldViewProj : worldViewProjs)
+		{
+			const auto z = random() * 80.0f - 2.0f;
+			const auto spread = (max)(z, 1.0f) * tanHalfFovY;
+			const float pos[] = { (random() - 0.5f) * spread * aspect * 2.0f, (random() - 0.5f) * spread * 2.0f, z };
+			float rotation[] = { random() - 0.5f, random() - 0.5f, random() - 0.5f, random() - 0.5f };
+			const auto len = sqrtf(rotation[0] * rotation[0] + rotation[1] * rotation[1] +
+				rotation[2] * rotation[2] + rotation[3] * rotation[3]);
+			for (auto& q : rotation) q /= len;
+
+			float worldI[12];
+			worldViewProj = Multiply(GetVolumeWorld(0.5f + random() * 6.0f, pos, rotation, worldI), viewProj);
+		}
+
+		vector<uint8_t> isOccluded(numVolumes);
+		start = chrono::steady_clock::now();
+		for (auto i = 0u; i < numVolumes; ++i) isOccluded[i] = pyramid.IsVolumeOccluded(worldViewProjs[i].m[0]);
+		testSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			// Per-pixel test of the clamped screen rectangle
+			float rect[4], minDepth;
+			auto isRectOccluded = HiZPyramid::GetVolumeRect(worldViewProjs[i].m[0], width, height, rect, minDepth);
+			if (isRectOccluded)
+			{
+				uint32_t pixelRect[4];
+				for (auto c = 0u; c < 4; ++c)
+				{
+					const auto size = (c & 1) ? height : width;
+					pixelRect[c] = static_cast<uint32_t>((min)((max)(rect[c], 0.0f), static_cast<float>(size - 1)));
+				}
+
+				for (auto y = pixelRect[1]; y <= pixelRect[3] && isRectOccluded; ++y)
+					for (auto x = pixelRect[0]; x <= pixelRect[2] && isRectOccluded; ++x)
+						isRectOccluded = minDepth > depths[width * y + x];
+			}
+
+			if (isOccluded[i] && !isRectOccluded) ++result.NumMismatches;
+			result.NumOccluded += isOccluded[i];
+			result.NumRectOccluded += isRectOccluded;
+		}
+	}
+
+	printf("%ux%u, %u levels: build %.3f ms, test %.1f ns per volume, occluded %.1f%% (%.1f%% per pixel)\n",
+		width, height, pyramid.GetNumLevels(), buildSeconds * 1000.0 / numViews,
+		testSeconds * 1.0e9 / (static_cast<double>(numVolumes) * numViews),
+		100.0 * result.NumOccluded / (static_cast<double>(numVolumes) * numViews),
+		100.0 * result.NumRectOccluded / (static_cast<double>(numVolumes) * numViews));
+
+	return result;
+}
+
+int HiZCheck(int argc, char* argv[])
+{
+	auto numVolumes = 10000u;
+	auto numViews = 4u;
+	auto seed = 1u;
+	ToolArgs args;
+	args.Add("-volumes", numVolumes, 1);
+	args.Add("-views", numViews, 1);
+	args.Add("-seed", seed);
+	if (!args.Parse(argc, argv)) return EXIT_FAILURE;
+
+	// Odd sizes leave a column and a row over at some levels
+	const uint32_t sizes[][2] = { { 1920, 1080 }, { 1001, 563 } };
+	uint64_t numMismatches = 0;
+	for (const auto& size : sizes)
+		numMismatches += checkHiZ(size[0], size[1], numVolumes, numViews, seed).NumMismatches;
+
+	CheckReport report;
+	report.ExpectNone("Mismatches", numMismatches);
+
+	return report.Finish();
+}
@@ -0,0 +1,275 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include "LightClusterer.h"
+
+using namespace std;
+
+static const float g_defaultCutoff = 1.0f / 128.0f;
+static const uint32_t g_defaultMaxLights = 16;
+static const uint32_t g_maxGridSize = 256;	// Cells per axis
+
+static float getMaxChannel(const LightClusterer::Light& light)
+{
+	return (max)((max)(light.Radiance[0], light.Radiance[1]), light.Radiance[2]);
+}
+
+LightClusterer::LightClusterer() :
+	m_cutoff(g_defaultCutoff),
+	m_maxLightsPerVolume(g_defaultMaxLights),
+	m_numDropped(0),
+	m_gridMin(),
+	m_cellSize(1.0f),
+	m_gridSize()
+{
+}
+
+LightClusterer::~LightClusterer()
+{
+}
+
+void LightClusterer::SetCutoff(float cutoff)
+{
+	m_cutoff = (max)(cutoff, 0.0f);
+}
+
+void LightClusterer::SetMaxLightsPerVolume(uint32_t maxLights)
+{
+	m_maxLightsPerVolume = maxLights;
+}
+
+uint32_t LightClusterer::Cluster(const Volume* pVolumes, uint32_t numVolumes, const Light* pLights, uint32_t numLights)
+{
+	buildGrid(pVolumes, numVolumes);
+	m_stamps.assign(numVolumes, 0);
+	m_pairVolumes.clear();
+	m_pairLights.clear();
+
+	// The volume-light pairs, in light order
+	for (auto j = 0u; j < numLights && numVolumes > 0; ++j)
+	{
+		const auto& light = pLights[j];
+		if (!light.IsPoint)
+		{
+			if (getMaxChannel(light) < m_cutoff) continue;
+			for (auto i = 0u; i < numVolumes; ++i)
+			{
+				m_pairVolumes.emplace_back(i);
+				m_pairLights.emplace_back(j);
+			}
+
+			continue;
+		}
+
+		const auto range = GetRange(light, m_cutoff);
+		if (range <= 0.0f) continue;
+
+		uint32_t cellMin[3], cellMax[3];
+		getCellRange(light.Position, range, cellMin, cellMax);
+		for (auto z = cellMin[2]; z <= cellMax[2]; ++z)
+		{
+			for (auto y = cellMin[1]; y <= cellMax[1]; ++y)
+			{
+				for (auto x = cellMin[0]; x <= cellMax[0]; ++x)
+				{
+					const auto cell = (m_gridSize[1] * z + y) * m_gridSize[0] + x;
+					for (auto k = m_cellOffsets[cell]; k < m_cellOffsets[cell + 1]; ++k)
+					{
+						const auto i = m_cellVolumes[k];
+						if (m_stamps[i] == j + 1) continue;
+						m_stamps[i] = j + 1;
+
+						if (GetIrradiance(light, pVolumes[i]) >= m_cutoff)
+						{
+							m_pairVolumes.emplace_back(i);
+							m_pairLights.emplace_back(j);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// Lists by volume, stable so that each keeps the light order
+	m_offsets.assign(numVolumes + 1, 0);
+	for (const auto& i : m_pairVolumes) ++m_offsets[i + 1];
+	for (auto i = 0u; i < numVolumes; ++i) m_offsets[i + 1] += m_offsets[i];
+	m_lightList.resize(m_pairLights.size());
+	{
+		auto cursors = vector<uint32_t>(m_offsets.cbegin(), m_offsets.cend() - 1);
+		for (size_t k = 0; k < m_pairLights.size(); ++k) m_lightList[cursors[m_pairVolumes[k]]++] = m_pairLights[k];
+	}
+
+	// The strongest lights of the lists over the max, back in light order, packed
+	m_numDropped = 0;
+	auto numListed = 0u;
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		const auto first = m_lightList.begin() + m_offsets[i];
+		const auto last = m_lightList.begin() + m_offsets[i + 1];
+		auto numLights = static_cast<uint32_t>(last - first);
+		if (numLights > m_maxLightsPerVolume)
+		{
+			const auto& volume = pVolumes[i];
+			nth_element(first, first + m_maxLightsPerVolume, last, [&](uint32_t a, uint32_t b)
+			{
+				const auto irradianceA = GetIrradiance(pLights[a], volume);
+				const auto irradianceB = GetIrradiance(pLights[b], volume);
+
+				return irradianceA != irradianceB ? irradianceA > irradianceB : a < b;
+			});
+			sort(first, first + m_maxLightsPerVolume);
+			m_numDropped += numLights - m_maxLightsPerVolume;
+			numLights = m_maxLightsPerVolume;
+		}
+
+		copy(first, first + numLights, m_lightList.begin() + numListed);
+		m_offsets[i] = numListed;
+		numListed += numLights;
+	}
+	m_offsets[numVolumes] = numListed;
+	m_lightList.resize(numListed);
+
+	return numListed;
+}
+
+uint32_t LightClusterer::GetNumLights(uint32_t i) const
+{
+	return i + 1 < m_offsets.size() ? m_offsets[i + 1] - m_offsets[i] : 0;
+}
+
+const uint32_t* LightClusterer::GetLights(uint32_t i) const
+{
+	return i + 1 < m_offsets.size() ? m_lightList.data() + m_offsets[i] : nullptr;
+}
+
+uint32_t LightClusterer::GetNumDropped() const
+{
+	return m_numDropped;
+}
+
+float LightClusterer::GetCutoff() const
+{
+	return m_cutoff;
+}
+
+uint32_t LightClusterer::GetMaxLightsPerVolume() const
+{
+	return m_maxLightsPerVolume;
+}
+
+float LightClusterer::GetIrradiance(const Light& light, const Volume& volume)
+{
+	const auto radiance = getMaxChannel(light);
+	if (!light.IsPoint) return radiance;
+
+	auto dist = 0.0f;
+	for (uint8_t j = 0; j < 3; ++j)
+	{
+		const auto d = light.Position[j] - volume.Center[j];
+		dist += d * d;
+	}
+	dist = (max)(sqrtf(dist) - volume.Radius, 0.0f);
+
+	return radiance / (max)(dist * dist, 1.0f);
+}
+
+float LightClusterer::GetRange(const Light& light, float cutoff)
+{
+	const auto radiance = getMaxChannel(light);
+	if (radiance < cutoff) return 0.0f;
+
+	// Within distance 1 the falloff is clamped, so radiance >= cutoff reaches at least that far
+	return cutoff > 0.0f ? (max)(sqrtf(radiance / cutoff), 1.0f) : FLT_MAX;
+}
+
+void LightClusterer::buildGrid(const Volume* pVolumes, uint32_t numVolumes)
+{
+	// Bounds of the bounding spheres, and cells of about the mean diameter, or fewer than
+	// the volumes in a sparse scene
+	float boundMin[] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float boundMax[] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	auto sumRadius = 0.0;
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		const auto& volume = pVolumes[i];
+		for (uint8_t j = 0; j < 3; ++j)
+		{
+			boundMin[j] = (min)(boundMin[j], volume.Center[j] - volume.Radius);
+			boundMax[j] = (max)(boundMax[j], volume.Center[j] + volume.Radius);
+		}
+		sumRadius += volume.Radius;
+	}
+
+	auto boundVolume = 1.0;
+	auto maxExtent = 0.0f;
+	for (uint8_t j = 0; j < 3; ++j)
+	{
+		const auto extent = numVolumes > 0 ? boundMax[j] - boundMin[j] : 0.0f;
+		boundVolume *= (max)(extent, 1.0e-3f);
+		maxExtent = (max)(maxExtent, extent);
+		m_gridMin[j] = numVolumes > 0 ? boundMin[j] : 0.0f;
+	}
+
+	const auto meanDiameter = numVolumes > 0 ? static_cast<float>(2.0 * sumRadius / numVolumes) : 1.0f;
+	const auto sparseSize = static_cast<float>(cbrt(boundVolume / (max)(numVolumes, 1u)));
+	m_cellSize = (max)((max)(meanDiameter, sparseSize), maxExtent / g_maxGridSize);
+	m_cellSize = m_cellSize > 0.0f ? m_cellSize : 1.0f;
+	for (uint8_t j = 0; j < 3; ++j)
+	{
+		const auto extent = numVolumes > 0 ? boundMax[j] - boundMin[j] : 0.0f;
+		m_gridSize[j] = (min)(static_cast<uint32_t>(extent / m_cellSize) + 1, g_maxGridSize);
+	}
+
+	// Each volume in the cells that the box of its bounding sphere overlaps
+	const auto numCells = m_gridSize[0] * m_gridSize[1] * m_gridSize[2];
+	m_cellOffsets.assign(numCells + 1, 0);
+	for (auto pass = 0u; pass < 2; ++pass)
+	{
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			uint32_t cellMin[3], cellMax[3];
+			getCellRange(pVolumes[i].Center, pVolumes[i].Radius, cellMin, cellMax);
+			for (auto z = cellMin[2]; z <= cellMax[2]; ++z)
+			{
+				for (auto y = cellMin[1]; y <= cellMax[1]; ++y)
+				{
+					for (auto x = cellMin[0]; x <= cellMax[0]; ++x)
+					{
+						const auto cell = (m_gridSize[1] * z + y) * m_gridSize[0] + x;
+						if (pass == 0) ++m_cellOffsets[cell + 1];
+						else m_cellVolumes[m_cellOffsets[cell]++] = i;
+					}
+				}
+			}
+		}
+
+		if (pass == 0)
+		{
+			for (auto c = 0u; c < numCells; ++c) m_cellOffsets[c + 1] += m_cellOffsets[c];
+			m_cellVolumes.resize(m_cellOffsets[numCells]);
+		}
+		else
+		{
+			// The fill advanced each offset to the next cell's
+			for (auto c = numCells; c > 0; --c) m_cellOffsets[c] = m_cellOffsets[c - 1];
+			m_cellOffsets[0] = 0;
+		}
+	}
+}
+
+void LightClusterer::getCellRange(const float center[3], float radius, uint32_t cellMin[3], uint32_t cellMax[3]) const
+{
+	for (uint8_t j = 0; j < 3; ++j)
+	{
+		const auto lo = (center[j] - radius - m_gridMin[j]) / m_cellSize;
+		const auto hi = (center[j] + radius - m_gridMin[j]) / m_cellSize;
+		const auto maxCell = static_cast<float>(m_gridSize[j] - 1);
+		cellMin[j] = static_cast<uint32_t>((min)((max)(lo, 0.0f), maxCell));
+		cellMax[j] = static_cast<uint32_t>((min)((max)(hi, 0.0f), maxCell));
+	}
+}
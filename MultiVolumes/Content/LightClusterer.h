@@ -0,0 +1,76 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// Lists the lights that reach each volume, so that a light pass loops over the lights of
+// a volume rather than all of them. A directional light reaches every volume, and a point
+// light, whose irradiance falls off by 1 / max(d^2, 1), the volumes where its brightest
+// channel is not below the cutoff at the nearest point of the bounding sphere. Point
+// lights query a uniform grid over the bounding spheres, within the range where they fall
+// to the cutoff, so the clustering scales with the lights and the volumes they reach
+// rather than with their product. Past the max lights of a volume, the weakest at its
+// bounding sphere are dropped, ties to the later light. Each list is in light order. It
+// has no graphics API dependency.
+//--------------------------------------------------------------------------------------
+class LightClusterer
+{
+public:
+	struct Volume
+	{
+		float Center[3];	// Of the bounding sphere, in world space
+		float Radius;
+	};
+
+	struct Light
+	{
+		float Position[3];	// Toward the light if directional
+		float Radiance[3];	// Color times intensity; at distance 1 for a point light
+		bool IsPoint;
+	};
+
+	LightClusterer();
+	virtual ~LightClusterer();
+
+	void SetCutoff(float cutoff);	// Irradiance below which a light is left out
+	void SetMaxLightsPerVolume(uint32_t maxLights);
+
+	// Lists the lights of every volume; returns the total of the lists
+	uint32_t Cluster(const Volume* pVolumes, uint32_t numVolumes, const Light* pLights, uint32_t numLights);
+
+	uint32_t GetNumLights(uint32_t i) const;
+	const uint32_t* GetLights(uint32_t i) const;	// GetNumLights(i) light indices
+	uint32_t GetNumDropped() const;					// Past the max lights of the volumes, in the last Cluster()
+	float GetCutoff() const;
+	uint32_t GetMaxLightsPerVolume() const;
+
+	// Irradiance of the brightest channel at the nearest point of the bounding sphere
+	static float GetIrradiance(const Light& light, const Volume& volume);
+
+	// Distance from a point light within which it is not below cutoff; 0 if it never is
+	static float GetRange(const Light& light, float cutoff);
+
+protected:
+	void buildGrid(const Volume* pVolumes, uint32_t numVolumes);
+	void getCellRange(const float center[3], float radius, uint32_t cellMin[3], uint32_t cellMax[3]) const;
+
+	float m_cutoff;
+	uint32_t m_maxLightsPerVolume;
+	uint32_t m_numDropped;
+	std::vector<uint32_t> m_offsets;	// First of the list of each volume, then the total
+	std::vector<uint32_t> m_lightList;
+
+	float m_gridMin[3];
+	float m_cellSize;
+	uint32_t m_gridSize[3];
+	std::vector<uint32_t> m_cellOffsets;	// First of the volumes of each cell, then the total
+	std::vector<uint32_t> m_cellVolumes;	// Each volume in every cell its bounding sphere's box overlaps
+	std::vector<uint32_t> m_stamps;			// Last light that tested each volume, plus 1
+	std::vector<uint32_t> m_pairVolumes;	// Of the volume-light pairs, in light order
+	std::vector<uint32_t> m_pairLights;
+};
@@ -0,0 +1,187 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "LightClusterer.h"
+#include "ToolCheck.h"
+
+using namespace std;
+
+// Scattered volumes and lights, a directional one in 16 up to 4, with the point lights
+// reaching 20 to 60 units, about one to three volume spacings
+static float scatterLights(uint32_t numVolumes, uint32_t numLights, float cutoff, uint32_t seed,
+	vector<LightClusterer::Volume>& volumes, vector<LightClusterer::Light>& lights)
+{
+	vector<Matrix4> worlds;
+	vector<float> worldIs, sampleScales;
+	const auto extent = ScatterVolumes(numVolumes, seed, worlds, worldIs, sampleScales);
+
+	volumes.resize(numVolumes);
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		auto& volume = volumes[i];
+		volume.Radius = 0.0f;
+		for (auto j = 0u; j < 3; ++j)
+		{
+			volume.Center[j] = worlds[i].m[3][j];
+			for (auto k = 0u; k < 3; ++k) volume.Radius += worlds[i].m[j][k] * worlds[i].m[j][k];
+		}
+		volume.Radius = sqrtf(volume.Radius);
+	}
+
+	auto state = seed ^ 0x2c1b3c6du;
+	const auto random = [&state]()
+	{
+		state = state * 1664525u + 1013904223u;
+
+		return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+	};
+
+	lights.resize(numLights);
+	for (auto j = 0u; j < numLights; ++j)
+	{
+		auto& light = lights[j];
+		light.IsPoint = j % 16 != 15 || j >= 64;
+		const auto range = 20.0f + 40.0f * random();
+		const auto radiance = light.IsPoint ? range * range * cutoff : 1.0f + random();
+		const float color[] = { 0.5f + 0.5f * random(), 0.5f + 0.5f * random(), 0.5f + 0.5f * random() };
+		const float pos[] = { (random() - 0.5f) * extent, (random() - 0.5f) * 40.0f, (random() - 0.5f) * extent };
+		for (auto k = 0u; k < 3; ++k)
+		{
+			light.Position[k] = light.IsPoint ? pos[k] : (k == 1 ? 1.0f : random() - 0.5f);
+			light.Radiance[k] = radiance * color[k];
+		}
+	}
+
+	return extent;
+}
+
+// Clusters scattered point and directional lights over scattered volumes, and checks the
+// lists against testing every light on every volume, then with a max per volume, that the
+// strongest are kept. Times both over growing scenes, and reports the lights per volume
+// that the light pass loops over
+int LightCheck(int argc, char* argv[])
+{
+	uint32_t numVolumes = 64, numLights = 64, maxLights = 4, seed = 1;
+	auto cutoff = 1.0f / 128.0f;
+	ToolArgs args;
+	args.Add("-volumes", numVolumes, 1);
+	args.Add("-lights", numLights);
+	args.Add("-max", maxLights);
+	args.Add("-cutoff", [&cutoff](const char* arg) { cutoff = (max)(stof(arg), 1.0e-6f); });
+	args.Add("-seed", seed);
+	if (!args.Parse(argc, argv)) return EXIT_FAILURE;
+
+	uint64_t numErrors = 0;
+	vector<LightClusterer::Volume> volumes;
+	vector<LightClusterer::Light> lights;
+	vector<uint32_t> reference;
+
+	// The lights of each volume, in light order, by testing them all
+	const auto clusterAll = [&](vector<uint32_t>& offsets)
+	{
+		const auto numVolumes = static_cast<uint32_t>(volumes.size());
+		offsets.assign(numVolumes + 1, 0);
+		reference.clear();
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			for (auto j = 0u; j < lights.size(); ++j)
+				if (LightClusterer::GetIrradiance(lights[j], volumes[i]) >= cutoff) reference.emplace_back(j);
+			offsets[i + 1] = static_cast<uint32_t>(reference.size());
+		}
+	};
+
+	// The lists without a max, then with one
+	{
+		scatterLights(numVolumes, numLights, cutoff, seed, volumes, lights);
+		vector<uint32_t> offsets;
+		clusterAll(offsets);
+
+		LightClusterer clusterer;
+		clusterer.SetCutoff(cutoff);
+		clusterer.SetMaxLightsPerVolume(UINT32_MAX);
+		if (clusterer.Cluster(volumes.data(), numVolumes, lights.data(), numLights) != reference.size()) ++numErrors;
+		if (clusterer.GetNumDropped() != 0) ++numErrors;
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			const auto n = clusterer.GetNumLights(i);
+			if (n != offsets[i + 1] - offsets[i] || !equal(clusterer.GetLights(i), clusterer.GetLights(i) + n,
+				&reference[offsets[i]])) ++numErrors;
+		}
+
+		clusterer.SetMaxLightsPerVolume(maxLights);
+		clusterer.Cluster(volumes.data(), numVolumes, lights.data(), numLights);
+		auto numDropped = 0u;
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			const auto numReached = offsets[i + 1] - offsets[i];
+			const auto n = clusterer.GetNumLights(i);
+			const auto pLights = clusterer.GetLights(i);
+			if (n != (min)(numReached, maxLights)) ++numErrors;
+			numDropped += numReached - n;
+
+			// In light order, and none left out stronger than one kept
+			auto minKept = FLT_MAX;
+			for (auto k = 0u; k < n; ++k)
+			{
+				if (k > 0 && pLights[k] <= pLights[k - 1]) ++numErrors;
+				if (find(&reference[offsets[i]], &reference[offsets[i + 1]], pLights[k]) == &reference[offsets[i + 1]]) ++numErrors;
+				minKept = (min)(minKept, LightClusterer::GetIrradiance(lights[pLights[k]], volumes[i]));
+			}
+			for (auto k = offsets[i]; k < offsets[i + 1]; ++k)
+				if (find(pLights, pLights + n, reference[k]) == pLights + n &&
+					LightClusterer::GetIrradiance(lights[reference[k]], volumes[i]) > minKept) ++numErrors;
+		}
+		if (clusterer.GetNumDropped() != numDropped) ++numErrors;
+
+		printf("%u volumes, %u lights, cutoff %g: %.2f lights per volume, %u over the max of %u dropped\n",
+			numVolumes, numLights, cutoff, static_cast<double>(reference.size()) / numVolumes, numDropped, maxLights);
+	}
+
+	// Scaling, against testing every light on every volume
+	printf("%8s %8s %14s %14s %18s\n", "Volumes", "Lights", "Clustered (ms)", "All pairs (ms)", "Lights per volume");
+	const uint32_t volumeCounts[] = { 64, 256, 1024, 4096 };
+	const uint32_t lightCounts[] = { 16, 64, 256, 1024 };
+	for (const auto& v : volumeCounts)
+	{
+		for (const auto& l : lightCounts)
+		{
+			scatterLights(v, l, cutoff, seed + v + l, volumes, lights);
+			LightClusterer clusterer;
+			clusterer.SetCutoff(cutoff);
+			clusterer.SetMaxLightsPerVolume(UINT32_MAX);
+
+			const auto numIterations = (max)((1u << 22) / (v * l), 1u);
+			auto start = chrono::steady_clock::now();
+			for (auto n = 0u; n < numIterations; ++n) clusterer.Cluster(volumes.data(), v, lights.data(), l);
+			const auto clusterTime = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / numIterations;
+
+			vector<uint32_t> offsets;
+			start = chrono::steady_clock::now();
+			for (auto n = 0u; n < numIterations; ++n) clusterAll(offsets);
+			const auto allPairsTime = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / numIterations;
+
+			for (auto i = 0u; i < v; ++i)
+			{
+				const auto n = clusterer.GetNumLights(i);
+				if (n != offsets[i + 1] - offsets[i] || !equal(clusterer.GetLights(i), clusterer.GetLights(i) + n,
+					&reference[offsets[i]])) ++numErrors;
+			}
+
+			printf("%8u %8u %14.4f %14.4f %11.2f of %4u\n", v, l, clusterTime, allPairsTime,
+				static_cast<double>(reference.size()) / v, l);
+		}
+	}
+
+	CheckReport report;
+	report.ExpectNone("Errors", numErrors);
+
+	return report.Finish();
+}
@@ -0,0 +1,237 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include "LightMapAllocator.h"
+
+using namespace std;
+
+static const float g_defaultPixelsPerVoxel = 4.0f;
+
+// Halvings from the max size to the size
+static int32_t getTier(uint32_t size, uint32_t maxSize)
+{
+	auto tier = 0;
+	while (maxSize > size)
+	{
+		maxSize >>= 1;
+		++tier;
+	}
+
+	return tier;
+}
+
+LightMapAllocator::LightMapAllocator() :
+	m_maxSize(0),
+	m_minSize(0),
+	m_retireFrames(0),
+	m_releaseFrames(0),
+	m_frame(0),
+	m_pixelsPerVoxel(g_defaultPixelsPerVoxel)
+{
+}
+
+LightMapAllocator::~LightMapAllocator()
+{
+}
+
+void LightMapAllocator::Init(uint32_t numVolumes, uint32_t maxSize, uint32_t minSize,
+	uint32_t retireFrames, uint32_t releaseFrames)
+{
+	m_maxSize = (max)(maxSize, 1u);
+	m_minSize = GetTargetSize(0.0f, m_pixelsPerVoxel, (max)(minSize, 1u), m_maxSize);
+	m_retireFrames = retireFrames;
+	m_releaseFrames = releaseFrames;
+	m_frame = 0;
+
+	m_maps.assign(numVolumes, { m_minSize, 0, MAP_USED });
+	m_volumeMaps.resize(numVolumes);
+	for (auto i = 0u; i < numVolumes; ++i) m_volumeMaps[i] = i;
+	m_changes.clear();
+	m_releasedMaps.clear();
+}
+
+void LightMapAllocator::SetPixelsPerVoxel(float pixelsPerVoxel)
+{
+	m_pixelsPerVoxel = (max)(pixelsPerVoxel, 1.0e-3f);
+}
+
+const vector<LightMapAllocator::Change>& LightMapAllocator::Update(const float* pCoverages, uint32_t maxChanges)
+{
+	++m_frame;
+	m_changes.clear();
+	m_releasedMaps.clear();
+
+	// Retired maps are free after the frames in flight, and released after idling
+	for (auto k = 0u; k < m_maps.size(); ++k)
+	{
+		auto& map = m_maps[k];
+		if (map.State == MAP_RETIRED && m_frame - map.Frame >= m_retireFrames)
+		{
+			map.State = MAP_FREE;
+			map.Frame = m_frame;
+		}
+		else if (map.State == MAP_FREE && m_frame - map.Frame >= m_releaseFrames)
+		{
+			map.State = MAP_RELEASED;
+			m_releasedMaps.emplace_back(k);
+		}
+	}
+
+	// Grow to the target at once; shrink once twice the coverage would still be smaller
+	const auto numVolumes = static_cast<uint32_t>(m_volumeMaps.size());
+	m_candidates.clear();
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		const auto coverage = (max)(pCoverages[i], 0.0f);
+		const auto size = m_maps[m_volumeMaps[i]].Size;
+		const auto target = GetTargetSize(coverage, m_pixelsPerVoxel, m_minSize, m_maxSize);
+		if (target > size || (target < size && GetTargetSize(2.0f * coverage, m_pixelsPerVoxel, m_minSize, m_maxSize) < size))
+			m_candidates.push_back({ getTier(target, m_maxSize) - getTier(size, m_maxSize), coverage, i, target });
+	}
+
+	// Growing first, then by the larger change, the larger coverage growing and the smaller
+	// shrinking, and the lower volume
+	const auto numChanges = (min)(maxChanges, static_cast<uint32_t>(m_candidates.size()));
+	partial_sort(m_candidates.begin(), m_candidates.begin() + numChanges, m_candidates.end(),
+		[](const Candidate& a, const Candidate& b)
+	{
+		if ((a.Steps < 0) != (b.Steps < 0)) return a.Steps < 0;
+		if (a.Steps != b.Steps) return abs(a.Steps) > abs(b.Steps);
+		if (a.Coverage != b.Coverage) return a.Steps < 0 ? a.Coverage > b.Coverage : a.Coverage < b.Coverage;
+
+		return a.Volume < b.Volume;
+	});
+
+	m_changes.resize(numChanges);
+	for (auto k = 0u; k < numChanges; ++k)
+	{
+		const auto& candidate = m_candidates[k];
+		auto& change = m_changes[k];
+		change.Volume = candidate.Volume;
+		change.OldMap = m_volumeMaps[candidate.Volume];
+		change.Map = allocate(candidate.Size, change.IsNewMap);
+
+		auto& oldMap = m_maps[change.OldMap];
+		oldMap.State = MAP_RETIRED;
+		oldMap.Frame = m_frame;
+		m_volumeMaps[candidate.Volume] = change.Map;
+	}
+
+	return m_changes;
+}
+
+const vector<LightMapAllocator::Change>& LightMapAllocator::GetChanges() const
+{
+	return m_changes;
+}
+
+const vector<uint32_t>& LightMapAllocator::GetReleasedMaps() const
+{
+	return m_releasedMaps;
+}
+
+uint32_t LightMapAllocator::GetMap(uint32_t i) const
+{
+	return m_volumeMaps[i];
+}
+
+uint32_t LightMapAllocator::GetSize(uint32_t i) const
+{
+	return m_maps[m_volumeMaps[i]].Size;
+}
+
+uint32_t LightMapAllocator::GetMapSize(uint32_t map) const
+{
+	return map < m_maps.size() && m_maps[map].State != MAP_RELEASED ? m_maps[map].Size : 0;
+}
+
+uint32_t LightMapAllocator::GetNumMaps() const
+{
+	return static_cast<uint32_t>(m_maps.size());
+}
+
+uint32_t LightMapAllocator::GetFrame() const
+{
+	return m_frame;
+}
+
+uint32_t LightMapAllocator::GetMaxSize() const
+{
+	return m_maxSize;
+}
+
+uint32_t LightMapAllocator::GetMinSize() const
+{
+	return m_minSize;
+}
+
+uint64_t LightMapAllocator::GetByteSize() const
+{
+	uint64_t byteSize = 0;
+	for (const auto& map : m_maps) byteSize += map.State != MAP_RELEASED ? GetMapByteSize(map.Size) : 0;
+
+	return byteSize;
+}
+
+uint64_t LightMapAllocator::GetUsedByteSize() const
+{
+	uint64_t byteSize = 0;
+	for (const auto& map : m_volumeMaps) byteSize += GetMapByteSize(m_maps[map].Size);
+
+	return byteSize;
+}
+
+float LightMapAllocator::GetPixelsPerVoxel() const
+{
+	return m_pixelsPerVoxel;
+}
+
+uint32_t LightMapAllocator::GetTargetSize(float coverage, float pixelsPerVoxel, uint32_t minSize, uint32_t maxSize)
+{
+	// The voxels across the projected extent, of about the square root of the coverage
+	const auto voxels = sqrtf((max)(coverage, 0.0f)) / pixelsPerVoxel;
+
+	// The smallest size of the max halved down to the min that holds them
+	auto size = maxSize;
+	while (size / 2 >= minSize && size / 2 >= voxels && size > 1) size /= 2;
+
+	return size;
+}
+
+uint64_t LightMapAllocator::GetMapByteSize(uint32_t size)
+{
+	return 4ull * size * size * size;
+}
+
+uint32_t LightMapAllocator::allocate(uint32_t size, bool& isNewMap)
+{
+	// A free map of the size first, then a released number, then a new one
+	auto released = UINT32_MAX;
+	for (auto k = 0u; k < m_maps.size(); ++k)
+	{
+		auto& map = m_maps[k];
+		if (map.State == MAP_FREE && map.Size == size)
+		{
+			map.State = MAP_USED;
+			isNewMap = false;
+
+			return k;
+		}
+
+		if (map.State == MAP_RELEASED && released == UINT32_MAX) released = k;
+	}
+
+	isNewMap = true;
+	if (released == UINT32_MAX)
+	{
+		released = static_cast<uint32_t>(m_maps.size());
+		m_maps.emplace_back();
+	}
+	m_maps[released] = { size, m_frame, MAP_USED };
+
+	return released;
+}
@@ -0,0 +1,96 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// Picks the light-map size of each volume from its screen coverage, one voxel per
+// pixels-per-voxel pixels across its projected extent, rounded up to a size of the max
+// halved down to the min. A volume grows to its size at once, and shrinks once twice its
+// coverage would still round to a smaller size, so that it does not flip back and forth.
+// Up to a max of changes a frame, growing first, by the larger change. The maps come from
+// a pool by size: a map that a volume leaves is retired for the frames in flight, then
+// free for another volume of its size, and released if no volume takes it for a while.
+// Maps are numbered; a released number is reused for a new map. It has no graphics API
+// dependency.
+//--------------------------------------------------------------------------------------
+class LightMapAllocator
+{
+public:
+	struct Change
+	{
+		uint32_t Volume;
+		uint32_t Map;		// The map it takes
+		uint32_t OldMap;	// Retired
+		bool IsNewMap;		// Rather than a free map of the pool
+	};
+
+	LightMapAllocator();
+	virtual ~LightMapAllocator();
+
+	// Every volume starts with a map of the min size
+	void Init(uint32_t numVolumes, uint32_t maxSize, uint32_t minSize = 16,
+		uint32_t retireFrames = 3, uint32_t releaseFrames = 64);
+	void SetPixelsPerVoxel(float pixelsPerVoxel);
+
+	// Resizes the light maps of the volumes that their coverages call for; returns the changes
+	const std::vector<Change>& Update(const float* pCoverages, uint32_t maxChanges);
+
+	const std::vector<Change>& GetChanges() const;
+	const std::vector<uint32_t>& GetReleasedMaps() const;	// Of the last Update()
+	uint32_t GetMap(uint32_t i) const;			// Of volume i
+	uint32_t GetSize(uint32_t i) const;			// Of the map of volume i
+	uint32_t GetMapSize(uint32_t map) const;	// 0 once released
+	uint32_t GetNumMaps() const;				// Numbers so far, released ones included
+	uint32_t GetFrame() const;					// Updates so far
+	uint32_t GetMaxSize() const;
+	uint32_t GetMinSize() const;
+	uint64_t GetByteSize() const;				// Of the maps not released
+	uint64_t GetUsedByteSize() const;			// Of the maps of the volumes
+	float GetPixelsPerVoxel() const;
+
+	static uint32_t GetTargetSize(float coverage, float pixelsPerVoxel, uint32_t minSize, uint32_t maxSize);
+	static uint64_t GetMapByteSize(uint32_t size);	// R11G11B10, 4 bytes per voxel
+
+protected:
+	enum MapState : uint8_t
+	{
+		MAP_USED,
+		MAP_RETIRED,
+		MAP_FREE,
+		MAP_RELEASED
+	};
+
+	struct Map
+	{
+		uint32_t Size;
+		uint32_t Frame;	// Since it was retired or freed
+		MapState State;
+	};
+
+	struct Candidate
+	{
+		int32_t Steps;	// Halvings from the current size to the target, negative to grow
+		float Coverage;
+		uint32_t Volume;
+		uint32_t Size;
+	};
+
+	uint32_t allocate(uint32_t size, bool& isNewMap);
+
+	std::vector<Map> m_maps;
+	std::vector<uint32_t> m_volumeMaps;
+	std::vector<Change> m_changes;
+	std::vector<Candidate> m_candidates;
+	std::vector<uint32_t> m_releasedMaps;
+	uint32_t m_maxSize;
+	uint32_t m_minSize;
+	uint32_t m_retireFrames;
+	uint32_t m_releaseFrames;
+	uint32_t m_frame;
+	float m_pixelsPerVoxel;
+};
@@ -0,0 +1,187 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "CostModel.h"
+#include "LightMapAllocator.h"
+#include "SharedConsts.h"
+#include "VolumeCuller.h"
+#include "ToolCheck.h"
+
+using namespace std;
+
+// Sizes the light maps of scattered volumes by their coverages along a camera path, and
+// checks them against the target sizes, that no two volumes share a map, and that a map is
+// not taken again while retired. Reports the light-map memory against one map of the
+// previous fixed size per volume
+int LightResCheck(int argc, char* argv[])
+{
+	auto numVolumes = 64u;
+	auto numFrames = 512u;
+	auto numUpdates = 1u;
+	auto maxSize = 128u;
+	auto seed = 1u;
+	ToolArgs args;
+	args.Add("-volumes", numVolumes, 1);
+	args.Add("-frames", numFrames, 1);
+	args.Add("-updates", numUpdates, 1);
+	args.Add("-size", maxSize, 16);
+	args.Add("-seed", seed);
+	if (!args.Parse(argc, argv)) return EXIT_FAILURE;
+
+	const auto fixedSize = 96u;		// Of every light map before
+	const auto minSize = 16u;
+	const auto retireFrames = 3u;	// The frames in flight of the renderer
+	const auto releaseFrames = 64u;
+	uint64_t numErrors = 0;
+
+	// Target sizes round the voxels across the projected extent up to a size of the tiers
+	for (auto k = 0u; k <= 64; ++k)
+	{
+		const auto coverage = k * k * 1000.0f;
+		const auto voxels = sqrtf(coverage) / 4.0f;
+		const auto size = LightMapAllocator::GetTargetSize(coverage, 4.0f, minSize, maxSize);
+		if ((size < voxels && size != maxSize) || (size / 2 >= voxels && size / 2 >= minSize) ||
+			maxSize % size != 0 || size < minSize) ++numErrors;
+	}
+
+	vector<Matrix4> worlds;
+	vector<float> worldIs, sampleScales;
+	const auto extent = ScatterVolumes(numVolumes, seed, worlds, worldIs, sampleScales);
+
+	VolumeDesc desc = {};
+	desc.NumMips = NUM_CUBE_MIP;
+	desc.CubeMapSize = 128;
+
+	VolumeCuller::FrameDesc frame = {};
+	frame.PathCosts = CostModel::GetDefaultWeights();
+	frame.Viewport[0] = 1920.0f;
+	frame.Viewport[1] = 1080.0f;
+	frame.NumSamples = 256;
+
+	LightMapAllocator allocator;
+	allocator.Init(numVolumes, maxSize, minSize, retireFrames, releaseFrames);
+
+	// The state of the pool as the changes tell it
+	vector<uint32_t> volumeMaps(numVolumes), owners(numVolumes), retiredFrames(numVolumes, 0);
+	vector<uint8_t> isReleased(numVolumes, 0);
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		volumeMaps[i] = allocator.GetMap(i);
+		owners[volumeMaps[i]] = i;
+	}
+
+	vector<float> coverages(numVolumes);
+	vector<uint64_t> sizeCounts(32, 0);
+	uint64_t usedBytes = 0, pooledBytes = 0, peakUsedBytes = 0, peakPooledBytes = 0;
+	uint64_t numResizes = 0, numNewMaps = 0, numReleased = 0;
+	uint32_t maxResizes = 0, numCappedFrames = 0;
+	for (auto f = 1u; f <= numFrames; ++f)
+	{
+		// A ring through the field, looking ahead and dipping toward the volumes it passes
+		const auto angle = 6.2831853f * f / numFrames;
+		const float eye[] = { 0.3f * extent * cosf(angle), 10.0f * cosf(3.0f * angle), 0.3f * extent * sinf(angle) };
+		const float at[] = { eye[0] - sinf(angle), eye[1] - 0.2f, eye[2] + cosf(angle) };
+		const auto viewProj = GetViewProj(eye, at, 3.14159265f / 4.0f, frame.Viewport[0] / frame.Viewport[1], g_zNear, g_zFar);
+		copy(eye, eye + 3, frame.EyePt);
+		VolumeCuller::GetFrustumCorners(viewProj.m[0], frame.FrustumCorners);
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			const auto worldViewProj = Multiply(worlds[i], viewProj);
+			VolumeInfo info;
+			if (!VolumeCuller::CullVolume(frame, worldViewProj.m[0], &worldIs[12 * i], desc, 1.0f, info, coverages[i]))
+				coverages[i] = 0.0f;
+		}
+
+		const auto maxChanges = f > 1 ? numUpdates : numVolumes;
+		const auto& changes = allocator.Update(coverages.data(), maxChanges);
+
+		// Released maps are neither held nor retired within the frames in flight
+		for (const auto& map : allocator.GetReleasedMaps())
+		{
+			if (map >= owners.size() || owners[map] != UINT32_MAX || isReleased[map] ||
+				f - retiredFrames[map] < retireFrames + releaseFrames) ++numErrors;
+			if (map < isReleased.size()) isReleased[map] = 1;
+			++numReleased;
+		}
+
+		for (const auto& change : changes)
+		{
+			if (change.Volume >= numVolumes || change.OldMap != volumeMaps[change.Volume]) ++numErrors;
+			if (change.Map >= owners.size())
+			{
+				// A new number follows the last one
+				if (change.Map != owners.size() || !change.IsNewMap) ++numErrors;
+				owners.resize(change.Map + 1, UINT32_MAX);
+				retiredFrames.resize(change.Map + 1, 0);
+				isReleased.resize(change.Map + 1, 0);
+			}
+			else if (owners[change.Map] != UINT32_MAX || (change.IsNewMap ? !isReleased[change.Map] :
+				isReleased[change.Map] || f - retiredFrames[change.Map] < retireFrames)) ++numErrors;
+
+			owners[change.OldMap] = UINT32_MAX;
+			retiredFrames[change.OldMap] = f;
+			owners[change.Map] = change.Volume;
+			isReleased[change.Map] = 0;
+			volumeMaps[change.Volume] = change.Map;
+			numNewMaps += change.IsNewMap ? 1 : 0;
+		}
+
+		// Every volume at its size, short of the cap; growing at once, shrinking with hysteresis
+		const auto isCapped = changes.size() >= maxChanges;
+		numCappedFrames += isCapped ? 1 : 0;
+		uint64_t frameUsedBytes = 0, framePooledBytes = 0;
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			const auto size = allocator.GetSize(i);
+			const auto target = LightMapAllocator::GetTargetSize(coverages[i], allocator.GetPixelsPerVoxel(), minSize, maxSize);
+			const auto shrinkTarget = LightMapAllocator::GetTargetSize(2.0f * coverages[i], allocator.GetPixelsPerVoxel(), minSize, maxSize);
+			if (allocator.GetMap(i) != volumeMaps[i] || owners[volumeMaps[i]] != i) ++numErrors;
+			if (!isCapped && (size < target || (size > target && shrinkTarget < size))) ++numErrors;
+
+			auto tier = 0u;
+			while ((size << tier) < maxSize) ++tier;
+			++sizeCounts[tier];
+			frameUsedBytes += LightMapAllocator::GetMapByteSize(size);
+		}
+		for (auto map = 0u; map < owners.size(); ++map)
+			if (!isReleased[map]) framePooledBytes += LightMapAllocator::GetMapByteSize(allocator.GetMapSize(map));
+		if (frameUsedBytes != allocator.GetUsedByteSize() || framePooledBytes != allocator.GetByteSize()) ++numErrors;
+
+		usedBytes += frameUsedBytes;
+		pooledBytes += framePooledBytes;
+		peakUsedBytes = (max)(peakUsedBytes, frameUsedBytes);
+		peakPooledBytes = (max)(peakPooledBytes, framePooledBytes);
+		if (f > 1)
+		{
+			numResizes += changes.size();
+			maxResizes = (max)(maxResizes, static_cast<uint32_t>(changes.size()));
+		}
+	}
+
+	const auto toMB = [](double bytes) { return bytes / (1024.0 * 1024.0); };
+	const auto fixedBytes = numVolumes * LightMapAllocator::GetMapByteSize(fixedSize);
+	const auto maxBytes = numVolumes * LightMapAllocator::GetMapByteSize(maxSize);
+	printf("%u volumes, %u frames, sizes %u to %u, up to %u resizes a frame\n", numVolumes, numFrames, minSize, maxSize, numUpdates);
+	printf("Volume-frames per size:");
+	for (auto tier = 0u; (maxSize >> tier) >= minSize; ++tier)
+		printf(" %u^3 %.1f%%", maxSize >> tier, 100.0 * sizeCounts[tier] / (static_cast<double>(numVolumes) * numFrames));
+	printf("\n");
+	printf("Resizes: %.3f per frame, max %u; capped frames %u; %llu maps created, %llu released\n",
+		static_cast<double>(numResizes) / (max)(numFrames - 1, 1u), maxResizes, numCappedFrames,
+		static_cast<unsigned long long>(numNewMaps), static_cast<unsigned long long>(numReleased));
+	printf("Before: %u x %u^3 = %.1f MB (%u x %u^3 = %.1f MB)\n", numVolumes, fixedSize, toMB(static_cast<double>(fixedBytes)),
+		numVolumes, maxSize, toMB(static_cast<double>(maxBytes)));
+	printf("After: %.1f MB in use on average, %.1f MB peak; %.1f MB with the pool on average, %.1f MB peak\n",
+		toMB(static_cast<double>(usedBytes) / numFrames), toMB(static_cast<double>(peakUsedBytes)),
+		toMB(static_cast<double>(pooledBytes) / numFrames), toMB(static_cast<double>(peakPooledBytes)));
+	CheckReport report;
+	report.ExpectNone("Errors", numErrors);
+
+	return report.Finish();
+}
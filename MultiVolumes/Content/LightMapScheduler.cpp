@@ -0,0 +1,163 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include "LightMapScheduler.h"
+
+using namespace std;
+
+static const float g_defaultMinChange = 1.0f / 16.0f;
+
+LightMapScheduler::LightMapScheduler() :
+	m_frame(0),
+	m_minChange(g_defaultMinChange)
+{
+}
+
+LightMapScheduler::~LightMapScheduler()
+{
+}
+
+void LightMapScheduler::Reset(uint32_t numVolumes)
+{
+	m_litStates.assign(numVolumes, LitState());
+	m_updateFrames.assign(numVolumes, 0);
+	m_isUpdated.assign(numVolumes, 0);
+	m_schedule.clear();
+}
+
+void LightMapScheduler::Invalidate(uint32_t i)
+{
+	if (i < m_isUpdated.size()) m_isUpdated[i] = 0;
+}
+
+void LightMapScheduler::SetMinChange(float minChange)
+{
+	m_minChange = (max)(minChange, 0.0f);
+}
+
+const vector<uint32_t>& LightMapScheduler::Schedule(const Volume* pVolumes, uint32_t numVolumes,
+	const Light& light, uint32_t maxUpdates)
+{
+	if (m_isUpdated.size() != numVolumes) Reset(numVolumes);
+	++m_frame;
+
+	m_candidates.resize(numVolumes);
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		const auto& volume = pVolumes[i];
+		auto& candidate = m_candidates[i];
+		candidate.Volume = i;
+		candidate.IsNew = !m_isUpdated[i];
+		candidate.Priority = candidate.IsNew ? (max)(volume.Coverage, 0.0f) + 1.0 :
+			GetPriority(GetStaleness(i), volume.Coverage, GetLightChange(i, volume, light), m_minChange);
+	}
+
+	// The light maps never updated first, then by priority, the lower volume on a tie
+	const auto numUpdates = (min)(maxUpdates, numVolumes);
+	partial_sort(m_candidates.begin(), m_candidates.begin() + numUpdates, m_candidates.end(),
+		[](const Candidate& a, const Candidate& b)
+	{
+		if (a.IsNew != b.IsNew) return a.IsNew;
+		if (a.Priority != b.Priority) return a.Priority > b.Priority;
+
+		return a.Volume < b.Volume;
+	});
+
+	m_schedule.resize(numUpdates);
+	for (auto k = 0u; k < numUpdates; ++k)
+	{
+		const auto i = m_candidates[k].Volume;
+		getLitState(pVolumes[i], light, m_litStates[i]);
+		m_updateFrames[i] = m_frame;
+		m_isUpdated[i] = 1;
+		m_schedule[k] = i;
+	}
+
+	return m_schedule;
+}
+
+const vector<uint32_t>& LightMapScheduler::GetSchedule() const
+{
+	return m_schedule;
+}
+
+uint32_t LightMapScheduler::GetFrame() const
+{
+	return m_frame;
+}
+
+uint32_t LightMapScheduler::GetStaleness(uint32_t i) const
+{
+	return i < m_isUpdated.size() && m_isUpdated[i] ? m_frame - m_updateFrames[i] : UINT32_MAX;
+}
+
+float LightMapScheduler::GetLightChange(uint32_t i, const Volume& volume, const Light& light) const
+{
+	if (i >= m_isUpdated.size() || !m_isUpdated[i]) return FLT_MAX;
+
+	LitState state;
+	getLitState(volume, light, state);
+	const auto& last = m_litStates[i];
+
+	// Chord between the light directions, in [0, 2]
+	auto dirChange = 0.0f;
+	for (auto j = 0u; j < 3; ++j)
+	{
+		const auto d = state.LightDir[j] - last.LightDir[j];
+		dirChange += d * d;
+	}
+
+	// Relative change of the radiance
+	auto radianceChange = 0.0f, radiance = 0.0f, lastRadiance = 0.0f;
+	for (auto j = 0u; j < 3; ++j)
+	{
+		radianceChange += fabsf(state.Radiance[j] - last.Radiance[j]);
+		radiance += fabsf(state.Radiance[j]);
+		lastRadiance += fabsf(last.Radiance[j]);
+	}
+	const auto maxRadiance = (max)(radiance, lastRadiance);
+	radianceChange = maxRadiance > 0.0f ? radianceChange / maxRadiance : 0.0f;
+
+	// Displacement in radii
+	auto moveChange = 0.0f;
+	for (auto j = 0u; j < 3; ++j)
+	{
+		const auto d = state.Center[j] - last.Center[j];
+		moveChange += d * d;
+	}
+	moveChange = sqrtf(moveChange) / (max)(volume.Radius, FLT_MIN);
+
+	return sqrtf(dirChange) + radianceChange + moveChange;
+}
+
+float LightMapScheduler::GetMinChange() const
+{
+	return m_minChange;
+}
+
+double LightMapScheduler::GetPriority(uint32_t staleness, float coverage, float lightChange, float minChange)
+{
+	return static_cast<double>(staleness) * ((max)(coverage, 0.0f) + 1.0) * (static_cast<double>(lightChange) + minChange);
+}
+
+void LightMapScheduler::getLitState(const Volume& volume, const Light& light, LitState& state)
+{
+	// Direction toward the light from the volume center
+	auto length = 0.0f;
+	for (auto j = 0u; j < 3; ++j)
+	{
+		state.LightDir[j] = light.IsPoint ? light.Position[j] - volume.Center[j] : light.Position[j];
+		length += state.LightDir[j] * state.LightDir[j];
+	}
+	length = sqrtf(length);
+	for (auto j = 0u; j < 3; ++j)
+	{
+		state.LightDir[j] = length > 0.0f ? state.LightDir[j] / length : 0.0f;
+		state.Radiance[j] = light.Radiance[j];
+		state.Center[j] = volume.Center[j];
+	}
+}
@@ -0,0 +1,83 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// Picks the light maps to refresh each frame, up to a number of updates, by the priority
+//   staleness * (coverage + 1) * (lighting change + min change)
+// Staleness counts the frames since the last update of a light map, and coverage is the
+// projected pixels of its volume, so that a volume off screen still refreshes once nothing
+// else needs to. The lighting change sums the chord between the light directions seen from
+// the volume now and at its last update, the relative change of the light radiance, and
+// the displacement of the volume in radii. Its floor refreshes every light map eventually,
+// e.g. for the shadows of the other volumes. Light maps never updated go first, by
+// coverage, and ties go to the lower volume, so a schedule is deterministic. It has no
+// graphics API dependency.
+//--------------------------------------------------------------------------------------
+class LightMapScheduler
+{
+public:
+	struct Volume
+	{
+		float Coverage;		// Projected pixels, from VolumeCuller; 0 when culled
+		float Center[3];	// In world space
+		float Radius;
+	};
+
+	struct Light
+	{
+		float Position[3];	// Toward the light if directional
+		float Radiance[3];	// Color times intensity
+		bool IsPoint;
+	};
+
+	LightMapScheduler();
+	virtual ~LightMapScheduler();
+
+	void Reset(uint32_t numVolumes);	// Every light map is then never updated
+	void Invalidate(uint32_t i);		// Light map i is then never updated, e.g. once resized
+	void SetMinChange(float minChange);
+
+	// Returns the volumes whose light maps to update this frame, by decreasing priority, and
+	// takes them as updated
+	const std::vector<uint32_t>& Schedule(const Volume* pVolumes, uint32_t numVolumes,
+		const Light& light, uint32_t maxUpdates);
+
+	const std::vector<uint32_t>& GetSchedule() const;
+	uint32_t GetFrame() const;						// Schedules so far
+	uint32_t GetStaleness(uint32_t i) const;		// Frames since the last update; UINT32_MAX if never
+	float GetLightChange(uint32_t i, const Volume& volume, const Light& light) const;
+	float GetMinChange() const;
+
+	static double GetPriority(uint32_t staleness, float coverage, float lightChange, float minChange);
+
+protected:
+	struct LitState
+	{
+		float LightDir[3];
+		float Radiance[3];
+		float Center[3];
+	};
+
+	struct Candidate
+	{
+		double Priority;
+		uint32_t Volume;
+		bool IsNew;
+	};
+
+	static void getLitState(const Volume& volume, const Light& light, LitState& state);
+
+	std::vector<LitState> m_litStates;
+	std::vector<uint32_t> m_updateFrames;
+	std::vector<uint8_t> m_isUpdated;
+	std::vector<Candidate> m_candidates;
+	std::vector<uint32_t> m_schedule;
+	uint32_t m_frame;
+	float m_minChange;
+};
@@ -0,0 +1,204 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include "CostModel.h"
+#include "LightMapScheduler.h"
+#include "SharedConsts.h"
+#include "VolumeCuller.h"
+#include "ToolCheck.h"
+
+using namespace std;
+
+// Schedules the light maps of a culled scene under a light that turns now and then, checking
+// each schedule against a brute-force ranking, and compares how fast the lighting changes
+// reach the visible volumes with the round-robin refresh of the visible ones
+int LightMapCheck(int argc, char* argv[])
+{
+	auto numVolumes = 64u;
+	auto numFrames = 512u;
+	auto numUpdates = 1u;
+	auto seed = 1u;
+	ToolArgs args;
+	args.Add("-volumes", numVolumes, 1);
+	args.Add("-frames", numFrames, 1);
+	args.Add("-updates", numUpdates, 1);
+	args.Add("-seed", seed);
+	if (!args.Parse(argc, argv)) return EXIT_FAILURE;
+
+	auto state = seed ^ 0x165667b1u;
+	const auto random = [&state]()
+	{
+		state = state * 1664525u + 1013904223u;
+
+		return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+	};
+
+	uint64_t numErrors = 0;
+
+	// Equal coverages under a fixed light take turns, in volume order when the updates divide
+	// the volumes, and none waits a full turn
+	{
+		LightMapScheduler scheduler;
+		vector<LightMapScheduler::Volume> volumes(numVolumes);
+		for (auto i = 0u; i < numVolumes; ++i) volumes[i] = { 100.0f, { 10.0f * i, 0.0f, 0.0f }, 1.0f };
+		const LightMapScheduler::Light light = { { 1.0f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f }, false };
+		const auto turnLength = (numVolumes + numUpdates - 1) / numUpdates;
+		for (auto f = 0u; f < 4 * numVolumes; ++f)
+		{
+			const auto& schedule = scheduler.Schedule(volumes.data(), numVolumes, light, numUpdates);
+			for (auto k = 0u; k < schedule.size(); ++k)
+				if (numVolumes % numUpdates == 0 && schedule[k] != (f * numUpdates + k) % numVolumes) ++numErrors;
+			for (auto i = 0u; i < numVolumes; ++i)
+			{
+				const auto staleness = scheduler.GetStaleness(i);
+				if (staleness != UINT32_MAX ? staleness >= turnLength : f >= turnLength) ++numErrors;
+			}
+		}
+	}
+
+	// A culled scene from a fixed view
+	vector<Matrix4> worlds;
+	vector<float> worldIs, sampleScales;
+	const auto extent = ScatterVolumes(numVolumes, seed, worlds, worldIs, sampleScales);
+
+	VolumeDesc desc = {};
+	desc.NumMips = NUM_CUBE_MIP;
+	desc.CubeMapSize = 128;
+
+	VolumeCuller::FrameDesc frame = {};
+	frame.PathCosts = CostModel::GetDefaultWeights();
+	frame.Viewport[0] = 1920.0f;
+	frame.Viewport[1] = 1080.0f;
+	frame.NumSamples = 256;
+	const float eye[] = { 0.0f, 10.0f, -extent * 0.6f };
+	const float at[] = { 0.0f, 0.0f, 0.0f };
+	const auto viewProj = GetViewProj(eye, at, 3.14159265f / 4.0f, frame.Viewport[0] / frame.Viewport[1], g_zNear, g_zFar);
+	copy(eye, eye + 3, frame.EyePt);
+	VolumeCuller::GetFrustumCorners(viewProj.m[0], frame.FrustumCorners);
+
+	vector<LightMapScheduler::Volume> volumes(numVolumes);
+	vector<uint32_t> visibleVolumes;
+	auto totalCoverage = 0.0;
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		const auto worldViewProj = Multiply(worlds[i], viewProj);
+		VolumeInfo info;
+		auto& volume = volumes[i];
+		if (VolumeCuller::CullVolume(frame, worldViewProj.m[0], &worldIs[12 * i], desc, 1.0f, info, volume.Coverage))
+		{
+			visibleVolumes.push_back(i);
+			totalCoverage += volume.Coverage;
+		}
+
+		volume.Radius = 0.0f;
+		for (auto j = 0u; j < 3; ++j)
+		{
+			volume.Center[j] = worlds[i].m[3][j];
+			for (auto k = 0u; k < 3; ++k) volume.Radius += worlds[i].m[j][k] * worlds[i].m[j][k];
+		}
+		volume.Radius = sqrtf(volume.Radius);
+	}
+
+	// Frames until half and 90% of the covered pixels are refreshed after each turn of the
+	// light, for the scheduler and for the round robin; those not reached before the next
+	// turn count the whole period
+	const auto changePeriod = (max)(numFrames / 8, 1u);
+	LightMapScheduler scheduler, schedulerAgain;
+	LightMapScheduler::Light light = { { 1.0f, 1.0f, -1.0f }, { 1.0f, 0.7f, 0.3f }, false };
+	vector<uint32_t> lastUpdates[2];
+	lastUpdates[0].assign(numVolumes, 0);
+	lastUpdates[1].assign(numVolumes, 0);
+	vector<pair<double, uint32_t>> ranking;
+	const double fractions[] = { 0.5, 0.9 };
+	uint64_t numChanges = 0, framesTo[2][2] = {};
+	double weightedStaleness[2] = {};
+	uint32_t changeFrame = 0;
+	bool isReached[2][2] = {};
+	const auto addUnreached = [&](uint32_t f)
+	{
+		for (auto p = 0u; p < 2; ++p)
+			for (auto j = 0u; j < 2; ++j)
+				if (numChanges > 0 && !isReached[p][j]) framesTo[p][j] += f - changeFrame;
+	};
+
+	for (auto f = 1u; f <= numFrames; ++f)
+	{
+		if (f % changePeriod == 1 || changePeriod == 1)
+		{
+			addUnreached(f);
+			const auto angle = random() * 6.2831853f;
+			light.Position[0] = cosf(angle);
+			light.Position[2] = sinf(angle);
+			light.Position[1] = 0.5f + random();
+			changeFrame = f;
+			memset(isReached, 0, sizeof(isReached));
+			++numChanges;
+		}
+
+		// Brute-force ranking: never updated first by coverage, then by priority, then by volume
+		ranking.clear();
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			const auto staleness = scheduler.GetStaleness(i);
+			const auto priority = staleness == UINT32_MAX ? 1.0e300 * (volumes[i].Coverage + 1.0) :
+				LightMapScheduler::GetPriority(staleness + 1, volumes[i].Coverage,
+				scheduler.GetLightChange(i, volumes[i], light), scheduler.GetMinChange());
+			ranking.emplace_back(-priority, i);
+		}
+		sort(ranking.begin(), ranking.end());
+
+		const auto& schedule = scheduler.Schedule(volumes.data(), numVolumes, light, numUpdates);
+		const auto& scheduleAgain = schedulerAgain.Schedule(volumes.data(), numVolumes, light, numUpdates);
+		if (schedule.size() != (min)(numUpdates, numVolumes) || schedule != scheduleAgain) ++numErrors;
+		for (auto k = 0u; k < schedule.size(); ++k)
+		{
+			if (schedule[k] != ranking[k].second) ++numErrors;
+			if (scheduler.GetStaleness(schedule[k]) != 0) ++numErrors;
+			lastUpdates[0][schedule[k]] = f;
+		}
+
+		// Round robin over the visible volumes, as the shader did with one update
+		for (auto k = 0u; k < numUpdates && !visibleVolumes.empty(); ++k)
+			lastUpdates[1][visibleVolumes[((f - 1) * numUpdates + k) % visibleVolumes.size()]] = f;
+
+		for (auto p = 0u; p < 2; ++p)
+		{
+			auto refreshed = 0.0, staleness = 0.0;
+			for (const auto& i : visibleVolumes)
+			{
+				const auto isRefreshed = lastUpdates[p][i] >= changeFrame;
+				refreshed += isRefreshed ? volumes[i].Coverage : 0.0;
+				staleness += volumes[i].Coverage * (isRefreshed ? 0u : f - changeFrame + 1);
+			}
+			weightedStaleness[p] += totalCoverage > 0.0 ? staleness / totalCoverage : 0.0;
+
+			for (auto j = 0u; j < 2; ++j)
+			{
+				if (isReached[p][j] || refreshed < fractions[j] * totalCoverage) continue;
+				framesTo[p][j] += f - changeFrame + 1;
+				isReached[p][j] = true;
+			}
+		}
+	}
+	addUnreached(numFrames + 1);
+
+	printf("%u volumes, %zu visible, %u frames, %u light-map updates per frame, %llu light changes\n", numVolumes,
+		visibleVolumes.size(), numFrames, numUpdates, static_cast<unsigned long long>(numChanges));
+	const char* const policies[] = { "Scheduled", "Round robin" };
+	for (auto p = 0u; p < 2; ++p)
+		printf("%s: %.1f frames to refresh half the coverage, %.1f to 90%%, %.2f stale frames per pixel\n",
+			policies[p], static_cast<double>(framesTo[p][0]) / numChanges, static_cast<double>(framesTo[p][1]) / numChanges,
+			weightedStaleness[p] / numFrames);
+	CheckReport report;
+	report.ExpectNone("Errors", numErrors);
+
+	return report.Finish();
+}
@@ -0,0 +1,104 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+//--------------------------------------------------------------------------------------
+// Bounded lock-free multi-producer multi-consumer queue (D. Vyukov's ring of sequenced
+// cells). The capacity is rounded up to a power of two.
+//--------------------------------------------------------------------------------------
+template<typename T>
+class MPMCQueue
+{
+public:
+	explicit MPMCQueue(size_t capacity) :
+		m_mask(roundUpPow2((capacity > 2 ? capacity : 2)) - 1),
+		m_cells(new Cell[m_mask + 1]),
+		m_enqueuePos(0),
+		m_dequeuePos(0)
+	{
+		for (size_t i = 0; i <= m_mask; ++i)
+			m_cells[i].Sequence.store(i, std::memory_order_relaxed);
+	}
+
+	MPMCQueue(const MPMCQueue&) = delete;
+	MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+	bool TryPush(T&& value)
+	{
+		Cell* pCell;
+		auto pos = m_enqueuePos.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			pCell = &m_cells[pos & m_mask];
+			const auto seq = pCell->Sequence.load(std::memory_order_acquire);
+			const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+			if (diff == 0)
+			{
+				if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+			}
+			else if (diff < 0) return false; // Full
+			else pos = m_enqueuePos.load(std::memory_order_relaxed);
+		}
+
+		pCell->Value = std::move(value);
+		pCell->Sequence.store(pos + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	bool TryPop(T& value)
+	{
+		Cell* pCell;
+		auto pos = m_dequeuePos.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			pCell = &m_cells[pos & m_mask];
+			const auto seq = pCell->Sequence.load(std::memory_order_acquire);
+			const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+			if (diff == 0)
+			{
+				if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+			}
+			else if (diff < 0) return false; // Empty
+			else pos = m_dequeuePos.load(std::memory_order_relaxed);
+		}
+
+		value = std::move(pCell->Value);
+		pCell->Sequence.store(pos + m_mask + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	size_t GetCapacity() const { return m_mask + 1; }
+
+protected:
+	struct Cell
+	{
+		std::atomic<size_t> Sequence;
+		T Value;
+	};
+
+	static size_t roundUpPow2(size_t n)
+	{
+		size_t pow2 = 1;
+		while (pow2 < n) pow2 <<= 1;
+
+		return pow2;
+	}
+
+	// Producer and consumer cursors are padded onto separate cache lines
+	const size_t m_mask;
+	std::unique_ptr<Cell[]> m_cells;
+	uint8_t m_pad0[64];
+	std::atomic<size_t> m_enqueuePos;
+	uint8_t m_pad1[64];
+	std::atomic<size_t> m_dequeuePos;
+};
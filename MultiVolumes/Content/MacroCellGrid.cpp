@@ -0,0 +1,110 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include "MacroCellGrid.h"
+#include "ParallelFor.h"
+
+using namespace std;
+
+// Texels [first, last] read by linear filtering anywhere in [lo, hi] of texture space
+static void getTexelRange(float lo, float hi, uint32_t size, int32_t& first, int32_t& last)
+{
+	first = static_cast<int32_t>(floorf(lo * size - 0.5f));
+	last = static_cast<int32_t>(floorf(hi * size - 0.5f)) + 1;
+	first = (max)(first, 0);
+	last = (min)(last, static_cast<int32_t>(size) - 1);
+}
+
+static uint32_t getCell(float coord)
+{
+	const auto cell = static_cast<int32_t>(floorf(coord * MacroCellGrid::CellsPerAxis));
+
+	return static_cast<uint32_t>((min)((max)(cell, 0), static_cast<int32_t>(MacroCellGrid::CellsPerAxis) - 1));
+}
+
+MacroCellGrid::MacroCellGrid() :
+	m_maxDensities(NumCells, FLT_MAX)
+{
+}
+
+MacroCellGrid::~MacroCellGrid()
+{
+}
+
+void MacroCellGrid::Build(const VolumeGrid& grid, float margin, uint32_t numThreads)
+{
+	if (grid.GetNumVoxels() == 0)
+	{
+		Fill(FLT_MAX);
+
+		return;
+	}
+
+	const auto cellSize = 1.0f / CellsPerAxis;
+	ParallelFor(CellsPerAxis, [&](uint32_t cz)
+	{
+		int32_t z0, z1;
+		getTexelRange(cz * cellSize - margin, (cz + 1) * cellSize + margin, grid.Depth, z0, z1);
+		for (auto cy = 0u; cy < CellsPerAxis; ++cy)
+		{
+			int32_t y0, y1;
+			getTexelRange(cy * cellSize - margin, (cy + 1) * cellSize + margin, grid.Height, y0, y1);
+			for (auto cx = 0u; cx < CellsPerAxis; ++cx)
+			{
+				int32_t x0, x1;
+				getTexelRange(cx * cellSize - margin, (cx + 1) * cellSize + margin, grid.Width, x0, x1);
+
+				auto maxDensity = -FLT_MAX;
+				for (auto z = z0; z <= z1; ++z)
+					for (auto y = y0; y <= y1; ++y)
+						for (auto x = x0; x <= x1; ++x)
+							maxDensity = (max)(grid.At(x, y, z), maxDensity);
+
+				m_maxDensities[(cz * CellsPerAxis + cy) * CellsPerAxis + cx] = maxDensity;
+			}
+		}
+	}, numThreads);
+}
+
+void MacroCellGrid::Fill(float maxDensity)
+{
+	m_maxDensities.assign(NumCells, maxDensity);
+}
+
+float MacroCellGrid::GetMaxDensity(uint32_t x, uint32_t y, uint32_t z) const
+{
+	return m_maxDensities[(z * CellsPerAxis + y) * CellsPerAxis + x];
+}
+
+float MacroCellGrid::GetMaxDensity(const float uvw[3]) const
+{
+	return GetMaxDensity(getCell(uvw[0]), getCell(uvw[1]), getCell(uvw[2]));
+}
+
+uint32_t MacroCellGrid::GetNumEmptyCells(float threshold) const
+{
+	return static_cast<uint32_t>(count_if(m_maxDensities.cbegin(), m_maxDensities.cend(),
+		[threshold](float value) { return value <= threshold; }));
+}
+
+const float* MacroCellGrid::GetData() const
+{
+	return m_maxDensities.data();
+}
+
+float MacroCellGrid::GetCellExitDistance(const float uvw[3], const float dir[3])
+{
+	// Slab test against the far faces of the cell; lands just past the exit, in the next cell
+	auto t = FLT_MAX;
+	for (auto i = 0u; i < 3; ++i)
+	{
+		const auto cell = static_cast<float>(getCell(uvw[i]));
+		if (dir[i] > 0.0f) t = (min)(((cell + 1.0f) / CellsPerAxis - uvw[i]) / dir[i], t);
+		else if (dir[i] < 0.0f) t = (min)((cell / CellsPerAxis - uvw[i]) / dir[i], t);
+	}
+
+	return (max)(t, 0.0f) + 1.0e-3f;
+}
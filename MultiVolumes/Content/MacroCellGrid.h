@@ -0,0 +1,39 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VolumeGrid.h"
+#include "SharedConsts.h"
+
+//--------------------------------------------------------------------------------------
+// Occupancy grid of macro cells over the normalized texture space of a source volume.
+// Each cell stores the max density that a linearly filtered sample inside the cell can
+// read, so the ray marchers may leap over cells whose max is below their threshold.
+//--------------------------------------------------------------------------------------
+class MacroCellGrid
+{
+public:
+	static const uint32_t CellsPerAxis = MACRO_CELL_GRID;
+	static const uint32_t NumCells = CellsPerAxis * CellsPerAxis * CellsPerAxis;
+
+	MacroCellGrid();
+	virtual ~MacroCellGrid();
+
+	// margin widens every cell in texture space, e.g. for the filter footprint of a
+	// resampled copy of the grid
+	void Build(const VolumeGrid& grid, float margin = 0.0f, uint32_t numThreads = 0);
+	void Fill(float maxDensity);
+
+	float GetMaxDensity(uint32_t x, uint32_t y, uint32_t z) const;
+	float GetMaxDensity(const float uvw[3]) const;
+	uint32_t GetNumEmptyCells(float threshold) const;
+	const float* GetData() const;
+
+	// Ray distance from uvw to the exit of its cell, for a texture-space direction
+	static float GetCellExitDistance(const float uvw[3], const float dir[3]);
+
+protected:
+	std::vector<float> m_maxDensities;
+};
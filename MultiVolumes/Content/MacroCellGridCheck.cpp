@@ -0,0 +1,150 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "MacroCellGrid.h"
+#include "VolumeLoader.h"
+#include "ToolCheck.h"
+
+using namespace std;
+
+struct MarchStats
+{
+	uint64_t Samples;
+	uint64_t Skips;
+	float Opacity;
+};
+
+// CPU reference of the view marcher in CSRayMarch.hlsl, with fixed steps and optional
+// macro-cell leaping
+static MarchStats marchRay(const VolumeGrid& grid, const MacroCellGrid* pMacroCells,
+	const float rayOrigin[3], const float rayDir[3], uint32_t numSamples)
+{
+	MarchStats stats = {};
+	const auto step = 2.0f * sqrtf(3.0f) / numSamples;
+	const float dir[] = { rayDir[0] * 0.5f, rayDir[1] * 0.5f, rayDir[2] * 0.5f };
+
+	auto t = 0.0f;
+	for (auto i = 0u; i < numSamples; ++i)
+	{
+		float pos[3], uvw[3];
+		for (auto j = 0u; j < 3; ++j)
+		{
+			pos[j] = rayOrigin[j] + rayDir[j] * t;
+			uvw[j] = pos[j] * 0.5f + 0.5f;
+		}
+		if (fabsf(pos[0]) > 1.0f || fabsf(pos[1]) > 1.0f || fabsf(pos[2]) > 1.0f) break;
+
+		// Leap over empty macro cells
+		if (pMacroCells && pMacroCells->GetMaxDensity(uvw) * g_gridDensityScale <= g_zeroThreshold)
+		{
+			t += MacroCellGrid::GetCellExitDistance(uvw, dir);
+			++stats.Skips;
+			continue;
+		}
+
+		const auto density = grid.Sample(uvw[0], uvw[1], uvw[2]) * g_gridDensityScale;
+		++stats.Samples;
+		if (density > g_zeroThreshold)
+		{
+			const auto transm = 1.0f - stats.Opacity;
+			stats.Opacity += density * g_absorption * transm;
+			if (transm < g_zeroThreshold) break;
+		}
+
+		t += step;
+	}
+
+	return stats;
+}
+
+// Marches rays from a sphere of view directions, with and without macro-cell leaping,
+// and reports the samples saved and the largest change in ray opacity
+int SkipStats(int argc, char* argv[])
+{
+	auto numSamples = 256u;
+	auto numDirs = 64u;
+	auto margin = 0.0f;
+	ToolArgs args;
+	args.Add("-samples", numSamples, 1);
+	args.Add("-rays", numDirs, 1);
+	args.Add("-margin", margin);
+	vector<const char*> files;
+	if (!args.Parse(argc, argv, &files, 1, 1)) return EXIT_FAILURE;
+
+	LoadedVolume volume;
+	VolumeGrid grid;
+	if (!VolumeLoader::Decode(files[0], volume))
+	{
+		fprintf(stderr, "Failed to read volume %s\n", files[0]);
+
+		return EXIT_FAILURE;
+	}
+
+	VolumeLoader::ExpandGrid(volume, grid, 0);
+	MacroCellGrid macroCells;
+	macroCells.Build(grid, margin);
+
+	const auto numEmptyCells = macroCells.GetNumEmptyCells(g_zeroThreshold / g_gridDensityScale);
+	printf("Volume: %ux%ux%u, %u^3 macro cells, %u empty (%.1f%%)\n", grid.Width, grid.Height, grid.Depth,
+		MacroCellGrid::CellsPerAxis, numEmptyCells,
+		100.0 * numEmptyCells / MacroCellGrid::NumCells);
+
+	// Fibonacci-sphere directions, each with a 16x16 grid of parallel rays across the volume
+	const auto numOffsets = 16u;
+	const auto goldenAngle = 3.14159265f * (3.0f - sqrtf(5.0f));
+	uint64_t numRays = 0, denseSamples = 0, skipSamples = 0, skipLeaps = 0;
+	auto maxOpacityError = 0.0f;
+	for (auto d = 0u; d < numDirs; ++d)
+	{
+		const auto z = 1.0f - 2.0f * (d + 0.5f) / numDirs;
+		const auto r = sqrtf(1.0f - z * z);
+		const float rayDir[] = { r * cosf(goldenAngle * d), r * sinf(goldenAngle * d), z };
+
+		// Orthonormal basis across the ray direction
+		const float up[] = { fabsf(rayDir[2]) < 0.9f ? 0.0f : 1.0f, 0.0f, fabsf(rayDir[2]) < 0.9f ? 1.0f : 0.0f };
+		float u[] = { up[1] * rayDir[2] - up[2] * rayDir[1], up[2] * rayDir[0] - up[0] * rayDir[2], up[0] * rayDir[1] - up[1] * rayDir[0] };
+		const auto uLen = sqrtf(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+		for (auto& c : u) c /= uLen;
+		const float v[] = { rayDir[1] * u[2] - rayDir[2] * u[1], rayDir[2] * u[0] - rayDir[0] * u[2], rayDir[0] * u[1] - rayDir[1] * u[0] };
+
+		for (auto j = 0u; j < numOffsets; ++j)
+			for (auto i = 0u; i < numOffsets; ++i)
+			{
+				const auto a = sqrtf(3.0f) * (2.0f * (i + 0.5f) / numOffsets - 1.0f);
+				const auto b = sqrtf(3.0f) * (2.0f * (j + 0.5f) / numOffsets - 1.0f);
+				float rayOrigin[3];
+				for (auto k = 0u; k < 3; ++k) rayOrigin[k] = a * u[k] + b * v[k] - 3.0f * rayDir[k];
+				if (!ComputeRayOrigin(rayOrigin, rayDir)) continue;
+
+				const auto dense = marchRay(grid, nullptr, rayOrigin, rayDir, numSamples);
+				const auto skipped = marchRay(grid, &macroCells, rayOrigin, rayDir, numSamples);
+				denseSamples += dense.Samples;
+				skipSamples += skipped.Samples;
+				skipLeaps += skipped.Skips;
+				maxOpacityError = (max)(fabsf(dense.Opacity - skipped.Opacity), maxOpacityError);
+				++numRays;
+			}
+	}
+
+	if (numRays == 0 || denseSamples == 0)
+	{
+		fprintf(stderr, "No ray hit the volume\n");
+
+		return EXIT_FAILURE;
+	}
+
+	printf("Rays: %llu, %u max samples per ray\n", static_cast<unsigned long long>(numRays), numSamples);
+	printf("Samples: %llu fixed-step, %llu with leaping (+%llu leaps), %.1f%% saved\n",
+		static_cast<unsigned long long>(denseSamples), static_cast<unsigned long long>(skipSamples),
+		static_cast<unsigned long long>(skipLeaps), 100.0 * (1.0 - static_cast<double>(skipSamples) / denseSamples));
+	printf("Iterations: %.1f%% saved, max ray opacity change %g\n",
+		100.0 * (1.0 - static_cast<double>(skipSamples + skipLeaps) / denseSamples), maxOpacityError);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,154 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "MappedFile.h"
+
+MappedFile::MappedFile() :
+	m_pData(nullptr),
+	m_size(0),
+#ifdef _WIN32
+	m_hFile(INVALID_HANDLE_VALUE),
+	m_hMapping(nullptr)
+#else
+	m_fd(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+bool MappedFile::Open(const char* fileName)
+{
+	Close();
+	m_hFile = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+	return mapView();
+}
+
+bool MappedFile::Open(const wchar_t* fileName)
+{
+	Close();
+	m_hFile = CreateFileW(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+	return mapView();
+}
+
+bool MappedFile::mapView()
+{
+	if (m_hFile == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_hFile, &size) || size.QuadPart <= 0)
+	{
+		Close();
+
+		return false;
+	}
+
+	m_hMapping = CreateFileMappingW(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_hMapping)
+	{
+		Close();
+
+		return false;
+	}
+
+	m_pData = static_cast<const uint8_t*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+	if (!m_pData)
+	{
+		Close();
+
+		return false;
+	}
+
+	m_size = static_cast<size_t>(size.QuadPart);
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_pData) UnmapViewOfFile(m_pData);
+	if (m_hMapping) CloseHandle(m_hMapping);
+	if (m_hFile != INVALID_HANDLE_VALUE) CloseHandle(m_hFile);
+
+	m_pData = nullptr;
+	m_size = 0;
+	m_hMapping = nullptr;
+	m_hFile = INVALID_HANDLE_VALUE;
+}
+#else
+bool MappedFile::Open(const char* fileName)
+{
+	Close();
+	m_fd = open(fileName, O_RDONLY);
+	if (m_fd < 0) return false;
+
+	struct stat st;
+	if (fstat(m_fd, &st) != 0 || st.st_size <= 0)
+	{
+		Close();
+
+		return false;
+	}
+
+	const auto pData = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, m_fd, 0);
+	if (pData == MAP_FAILED)
+	{
+		Close();
+
+		return false;
+	}
+
+	// Volumes are consumed front to back
+	madvise(pData, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+	m_pData = static_cast<const uint8_t*>(pData);
+	m_size = static_cast<size_t>(st.st_size);
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_pData) munmap(const_cast<uint8_t*>(m_pData), m_size);
+	if (m_fd >= 0) close(m_fd);
+
+	m_pData = nullptr;
+	m_size = 0;
+	m_fd = -1;
+}
+#endif
+
+const uint8_t* MappedFile::GetData() const
+{
+	return m_pData;
+}
+
+size_t MappedFile::GetSize() const
+{
+	return m_size;
+}
+
+bool MappedFile::IsOpen() const
+{
+	return m_pData != nullptr;
+}
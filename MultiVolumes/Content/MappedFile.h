@@ -0,0 +1,44 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//--------------------------------------------------------------------------------------
+// Read-only memory-mapped file (Win32 file mapping or POSIX mmap)
+//--------------------------------------------------------------------------------------
+class MappedFile
+{
+public:
+	MappedFile();
+	virtual ~MappedFile();
+
+	bool Open(const char* fileName);
+#ifdef _WIN32
+	bool Open(const wchar_t* fileName);
+#endif
+	void Close();
+
+	const uint8_t* GetData() const;
+	size_t GetSize() const;
+	bool IsOpen() const;
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+protected:
+	const uint8_t* m_pData;
+	size_t m_size;
+
+#ifdef _WIN32
+	bool mapView();
+
+	void* m_hFile;
+	void* m_hMapping;
+#else
+	int m_fd;
+#endif
+};
@@ -0,0 +1,103 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "DDSVolume.h"
+#include "MappedFile.h"
+#include "ToolCheck.h"
+
+using namespace std;
+
+// Copies the top-level mip row by row into an upload buffer laid out like a D3D12
+// placed footprint (256-byte aligned row pitch), as UpdateSubresources would
+static void copyToUpload(const uint8_t* pVoxels, const DDSVolume::Info& info, vector<uint8_t>& upload)
+{
+	const auto rowSize = static_cast<size_t>(info.Width) * DDSVolume::GetBytesPerVoxel(info.VoxelFormat);
+	const auto rowPitch = (rowSize + 255) & ~static_cast<size_t>(255);
+	const auto numRows = static_cast<size_t>(info.Height) * info.Depth;
+	upload.resize(rowPitch * numRows);
+	for (size_t i = 0; i < numRows; ++i)
+		memcpy(&upload[rowPitch * i], pVoxels + rowSize * i, rowSize);
+}
+
+// Read-then-copy, as DDS::Loader::CreateTextureFromFile does
+static bool ingestRead(const char* fileName, vector<uint8_t>& upload, size_t& heapBytes)
+{
+	ifstream file(fileName, ios::binary | ios::ate);
+	if (!file.is_open()) return false;
+
+	vector<uint8_t> fileData(static_cast<size_t>(file.tellg()));
+	file.seekg(0, ios::beg);
+	file.read(reinterpret_cast<char*>(fileData.data()), fileData.size());
+	if (!file.good()) return false;
+
+	DDSVolume::Info info;
+	if (!DDSVolume::ParseHeader(fileData.data(), fileData.size(), info)) return false;
+	if (fileData.size() < info.DataOffset + DDSVolume::GetTopMipByteSize(info)) return false;
+
+	copyToUpload(fileData.data() + info.DataOffset, info, upload);
+	heapBytes = fileData.size();
+
+	return true;
+}
+
+// Memory-mapped, validated in place
+static bool ingestMapped(const char* fileName, vector<uint8_t>& upload, size_t& heapBytes)
+{
+	MappedFile file;
+	if (!file.Open(fileName)) return false;
+
+	DDSVolume::Info info;
+	const auto pVoxels = static_cast<const uint8_t*>(DDSVolume::ParseInPlace(file.GetData(), file.GetSize(), info));
+	if (!pVoxels) return false;
+
+	copyToUpload(pVoxels, info, upload);
+	heapBytes = 0;
+
+	return true;
+}
+
+// Times ingesting a DDS volume into an upload buffer by reading it and by mapping it
+int BenchIngest(int argc, char* argv[])
+{
+	auto numIterations = 10u;
+	ToolArgs args;
+	args.Add("-iterations", numIterations, 1);
+	vector<const char*> files;
+	if (!args.Parse(argc, argv, &files, 1, 1)) return EXIT_FAILURE;
+
+	typedef bool (*IngestFunc)(const char*, vector<uint8_t>&, size_t&);
+	const struct { const char* Name; IngestFunc Func; } methods[] =
+	{
+		{ "read-then-copy", ingestRead },
+		{ "mapped", ingestMapped }
+	};
+
+	// The upload buffer is allocated once, as the GPU upload heap would be
+	vector<uint8_t> upload;
+	for (const auto& method : methods)
+	{
+		size_t heapBytes = 0;
+		if (!method.Func(files[0], upload, heapBytes)) // Warm-up, also faults in the page cache
+		{
+			fprintf(stderr, "Failed to ingest %s\n", files[0]);
+
+			return EXIT_FAILURE;
+		}
+
+		const auto start = chrono::steady_clock::now();
+		for (auto i = 0u; i < numIterations; ++i) method.Func(files[0], upload, heapBytes);
+		const auto seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count() / numIterations;
+
+		printf("%-16s %8.3f ms/file, %8.1f MB/s, %zu transient heap bytes\n", method.Name,
+			seconds * 1000.0, upload.size() / seconds / (1024.0 * 1024.0), heapBytes);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -8,6 +8,7 @@
 #include "Advanced/XUSGDDSLoader.h"
 #undef _INDEPENDENT_DDS_LOADER_
 #include <array>
+#include <cfloat>
 
 using namespace std;
 using namespace DirectX;
@@ -26,36 +27,45 @@ struct CBPerFrame
 	XMFLOAT4 Viewport;
 	XMFLOAT4X4 ScreenToWorld;
 	XMFLOAT4X4 ShadowViewProj;
+	XMFLOAT4X4 ShadowViewProjI;
 	XMFLOAT4 LightPos;
 	XMFLOAT4 LightColor;
 	XMFLOAT4 Ambient;
 	uint32_t FrameIdx;
+	XMFLOAT3 PathCosts;
 };
 
-struct PerObject
+struct LightScheduleEntry
 {
-	XMFLOAT4X4 WorldViewProj;
-	XMFLOAT4X4 WorldViewProjI;
-	XMFLOAT3X4 WorldI;
-	XMFLOAT3X4 World;
+	uint32_t VolumeId;
+	uint32_t FirstCandidate;
+	uint32_t NumCandidates;	// Volumes that may occlude it; UINT32_MAX for all
+	uint32_t Lights;		// First of its lights in the low 24 bits, their number in the high 8
 };
 
-struct VolumeDesc
+struct LightDesc
 {
-	uint32_t VolTexId : 14;
-	uint32_t NumMips : 4;
-	uint32_t CubeMapSize : 14;
+	XMFLOAT4 Position;	// w: 1 for a point light, 0 for a directional one
+	XMFLOAT4 Radiance;
 };
 
-struct VolumeInfo
+struct PerObject
 {
-	uint16_t MipLevel;
-	uint16_t SmpCount;
-	uint16_t FaceMask;
-	uint16_t VolTexId;
+	XMFLOAT4X4 WorldViewProj;
+	XMFLOAT4X4 WorldViewProjI;
+	XMFLOAT3X4 WorldI;
+	XMFLOAT3X4 World;
+	float SampleScale;
 };
 
 const uint8_t g_numCubeMips = NUM_CUBE_MIP;
+const float g_gridDensityScale = 0.25f;	// The expanded grids store a quarter of the source density
+const float g_cullReuseThreshold = 0.5f;	// Pixels of vertex motion below which the CPU culling is reused
+const uint8_t g_allDirtyBits = (1 << (MultiRayCaster::FrameCount + 1)) - 1;
+const uint32_t g_lightCandidatesPerVolume = 16;	// Capacity of the candidate lists of a frame, per volume
+const uint32_t g_deepShadowSize = 512;
+const uint32_t g_lightsPerVolume = 16;	// Of SetLights(), the strongest at each volume
+const uint32_t g_minLightGridSize = 16;	// Of the light maps of the volumes far away
 
 MultiRayCaster::MultiRayCaster() :
 	m_pDepths(nullptr),
@@ -63,13 +73,31 @@ MultiRayCaster::MultiRayCaster() :
 	m_instances(),
 	m_maxRaySamples(256),
 	m_maxLightSamples(96),
+	m_frameIdx(0),
 	m_lightPt(75.0f, 75.0f, -75.0f),
 	m_lightColor(1.0f, 0.7f, 0.3f, 1.0f),
 	m_ambient(0.0f, 0.3f, 1.0f, 0.4f),
+	m_bvhBuildCost(0.0f),
+	m_volumeWorldsChanged(false),
+	m_isDeepShadowDirty(true),
+	m_shadowViewProj(),
+	m_slotViewProjs(),
+	m_cullViewProj(),
+	m_sampleBudget(0),
+	m_numLightMapUpdates(1),
+	m_lightMapFrame(0),
+	m_lightMapTableDirtyBits(0),
+	m_numLightCandidates(0),
+	m_numScheduledLights(0),
+	m_pathCosts(CostModel::GetDefaultWeights()),
+	m_pathWork(),
+	m_cubeMapGroups(),
+	m_isDispatchReadBack(),
 	m_rtSupport(0),
 	m_workGraphSupport(true)
 {
 	m_shaderLib = ShaderLib::MakeUnique();
+	m_lightClusterer.SetMaxLightsPerVolume(g_lightsPerVolume);
 }
 
 MultiRayCaster::~MultiRayCaster()
@@ -78,7 +106,8 @@ MultiRayCaster::~MultiRayCaster()
 
 bool MultiRayCaster::Init(RayTracing::CommandList* pCommandList, const DescriptorTableLib::sptr& descriptorTableLib,
 	Format rtFormat, Format dsFormat, uint32_t gridSize, uint32_t lightGridSize, uint32_t numVolumes, uint32_t numVolumeSrcs,
-	vector<Resource::uptr>& uploaders, RayTracing::GeometryBuffer* pGeometry, uint8_t rtSupport, bool workGraphSupport)
+	vector<Resource::uptr>& uploaders, RayTracing::GeometryBuffer* pGeometry, uint8_t rtSupport, bool workGraphSupport,
+	const XMFLOAT3X4* pVolumeWorlds)
 {
 	const auto pDevice = pCommandList->GetRTDevice();
 	m_rayTracingPipelineLib = RayTracing::PipelineLib::MakeUnique(pDevice);
@@ -96,17 +125,18 @@ bool MultiRayCaster::Init(RayTracing::CommandList* pCommandList, const Descripto
 	// Create resources
 	XUSG_N_RETURN(createVolumeInfoBuffers(pCommandList, numVolumes, numVolumeSrcs, uploaders), false);
 
+	// Full mip chains; light rays and distant volumes march the coarser levels
+	const auto numVolumeMips = static_cast<uint8_t>(VolumeMipChain::GetNumMips(gridSize));
 	m_volumes.resize(numVolumeSrcs);
 	for (auto i = 0u; i < numVolumeSrcs; ++i)
 	{
 		m_volumes[i] = Texture3D::MakeUnique();
 		XUSG_N_RETURN(m_volumes[i]->Create(pDevice, gridSize, gridSize, gridSize, Format::R16G16B16A16_FLOAT,
-			ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, (L"Volume" + to_wstring(i)).c_str()), false);
+			ResourceFlag::ALLOW_UNORDERED_ACCESS, numVolumeMips, MemoryFlag::NONE, (L"Volume" + to_wstring(i)).c_str()), false);
 	}
 
 	m_cubeMaps.resize(numVolumes);
 	m_cubeDepths.resize(numVolumes);
-	m_lightMaps.resize(numVolumes);
 	for (auto i = 0u; i < numVolumes; ++i)
 	{
 		m_cubeMaps[i] = Texture2D::MakeUnique();
@@ -118,13 +148,25 @@ bool MultiRayCaster::Init(RayTracing::CommandList* pCommandList, const Descripto
 		XUSG_N_RETURN(m_cubeDepths[i]->Create(pDevice, gridSize, gridSize, Format::R32_FLOAT, 6,
 			ResourceFlag::ALLOW_UNORDERED_ACCESS, g_numCubeMips, 1, true, MemoryFlag::NONE,
 			(L"DepthCubeMap" + to_wstring(i)).c_str()), false);
+	}
 
-		m_lightMaps[i] = Texture3D::MakeUnique();
-		XUSG_N_RETURN(m_lightMaps[i]->Create(pDevice, m_lightGridSize, m_lightGridSize, m_lightGridSize,
-			Format::R11G11B10_FLOAT, ResourceFlag::ALLOW_UNORDERED_ACCESS,
-			1, MemoryFlag::NONE, (L"LightMap" + to_wstring(i)).c_str()), false);
+	// Light maps of the min size, until the coverages of the volumes call for more
+	m_lightMapAllocator.Init(numVolumes, m_lightGridSize, g_minLightGridSize, FrameCount);
+	m_lightMapFrame = m_lightMapAllocator.GetFrame();
+	m_lightMapPool.resize(m_lightMapAllocator.GetNumMaps());
+	m_lightMaps.resize(numVolumes);
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		const auto map = m_lightMapAllocator.GetMap(i);
+		XUSG_N_RETURN(createLightMap(pDevice, map), false);
+		m_lightMaps[i] = m_lightMapPool[map];
 	}
 
+	m_deepShadow = Texture2D::MakeUnique();
+	XUSG_N_RETURN(m_deepShadow->Create(pDevice, g_deepShadowSize, g_deepShadowSize, Format::R32G32B32A32_UINT,
+		DeepShadowMap::NumKnots / 4, ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, 1, false, MemoryFlag::NONE,
+		L"DeepShadowMap"), false);
+
 	m_cbPerFrame = ConstantBuffer::MakeUnique();
 	XUSG_N_RETURN(m_cbPerFrame->Create(pDevice, sizeof(CBPerFrame[FrameCount]), FrameCount,
 		nullptr, MemoryType::UPLOAD, MemoryFlag::NONE, L"RayCaster.CBPerFrame"), false);
@@ -133,15 +175,17 @@ bool MultiRayCaster::Init(RayTracing::CommandList* pCommandList, const Descripto
 	XUSG_N_RETURN(m_cbPerObject->Create(pDevice, sizeof(CBPerObject[FrameCount]), FrameCount,
 		nullptr, MemoryType::UPLOAD, L"RayCaster.CBPerObject"), false);*/
 
-	// create command layout
-	XUSG_N_RETURN(createCommandLayouts(pDevice), false);
-
 	XUSG_N_RETURN(createCubeVB(pCommandList, uploaders), false);
 	XUSG_N_RETURN(createCubeIB(pCommandList, uploaders), false);
 
-	// Set world transforms
+	// Set world transforms, before the acceleration structures take them
 	m_volumeWorlds.resize(numVolumes);
-	SetVolumesWorld(20.0f, XMFLOAT3(0.0f, 0.0f, 0.0f));
+	m_volumeSampleScales.assign(numVolumes, 1.0f);
+	m_volumeDirtyBits.assign(numVolumes, g_allDirtyBits);
+	m_volumePriorities.assign(numVolumes, 1.0f);
+	m_lightMapScheduler.Reset(numVolumes);
+	if (pVolumeWorlds) m_volumeWorlds.assign(pVolumeWorlds, pVolumeWorlds + numVolumes);
+	else SetVolumesWorld(20.0f, XMFLOAT3(0.0f, 0.0f, 0.0f));
 
 	// Build acceleration structures
 	if (m_rtSupport)
@@ -160,6 +204,9 @@ bool MultiRayCaster::Init(RayTracing::CommandList* pCommandList, const Descripto
 		XUSG_N_RETURN(createDescriptorTables(nullptr), false);
 	}
 
+	// Create command layouts, after the pipeline layouts that their root constants set
+	XUSG_N_RETURN(createCommandLayouts(pDevice), false);
+
 	if (m_workGraphSupport) initWorkGraph(pDevice);
 
 	return true;
@@ -167,21 +214,111 @@ bool MultiRayCaster::Init(RayTracing::CommandList* pCommandList, const Descripto
 
 bool MultiRayCaster::LoadVolumeData(XUSG::CommandList* pCommandList, uint32_t i, const wchar_t* fileName, vector<Resource::uptr>& uploaders)
 {
-	// Load input image
+	// Map and validate the file in place; bricked sparse volumes (.vbk) are decoded
+	LoadedVolume volume;
+	volume.Index = i;
+	if (VolumeLoader::Decode(fileName, volume))
+	{
+		VolumeLoader::BuildDerivedData(volume, GetMacroCellMargin(), m_gridSize, GetGridDensityScale(), 0);
+		XUSG_N_RETURN(UploadVolumeData(pCommandList, volume, uploaders, ResourceState::NON_PIXEL_SHADER_RESOURCE), false);
+	}
+	else
 	{
+		// Fall back to the generic DDS loader for layouts the mapped path does not handle
 		DDS::Loader textureLoader;
 		DDS::AlphaMode alphaMode;
 
-		if (i >= m_fileSrcs.size()) m_fileSrcs.resize(i + 1);
+		Texture::sptr fileSrc;
 		uploaders.emplace_back(Resource::MakeUnique());
 		XUSG_N_RETURN(textureLoader.CreateTextureFromFile(pCommandList, fileName,
-			8192, false, m_fileSrcs[i], uploaders.back().get(), &alphaMode), false);
+			8192, false, fileSrc, uploaders.back().get(), &alphaMode), false);
+		setFileSrc(i, fileSrc, XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f));
+		setMacroCells(i, nullptr);
+		setVolumeMips(i, nullptr);
+	}
+
+	return ExpandVolumeData(pCommandList, i, uploaders);
+}
+
+bool MultiRayCaster::UploadVolumeData(XUSG::CommandList* pCommandList, const LoadedVolume& volume,
+	vector<Resource::uptr>& uploaders, ResourceState dstState)
+{
+	XUSG_N_RETURN(volume.Succeeded, false);
+
+	setMacroCells(volume.Index, volume.MacroCells.get());
+	setVolumeMips(volume.Index, volume.Mips.get());
+	if (volume.Bricks) return uploadBricks(pCommandList, volume.Index, *volume.Bricks, uploaders, dstState);
+	if (volume.Compressed) return uploadCompressed(pCommandList, volume.Index, *volume.Compressed, uploaders, dstState);
+
+	return uploadFileSrc(pCommandList, volume.Index, volume.Info, volume.pVoxels, uploaders, dstState);
+}
+
+bool MultiRayCaster::ExpandVolumeData(XUSG::CommandList* pCommandList, uint32_t i, vector<Resource::uptr>& uploaders)
+{
+	m_isDeepShadowDirty = true;
+
+	// The occupancy changes together with the grid
+	if (i < m_pendingMacroCells.size() && !m_pendingMacroCells[i].empty())
+	{
+		const auto& macroCells = m_pendingMacroCells[i];
+		uploaders.emplace_back(Resource::MakeUnique());
+		XUSG_N_RETURN(m_macroCells->Upload(pCommandList, uploaders.back().get(), macroCells.data(),
+			sizeof(float) * macroCells.size(), sizeof(float) * MacroCellGrid::NumCells * i,
+			ResourceState::ALL_SHADER_RESOURCE), false);
+		m_pendingMacroCells[i].clear();
 	}
 
+	// Upload the coarse levels filtered on the CPU; without them, every level is resampled from the source
+	const auto numMips = m_volumes[i]->GetNumMips();
+	auto numExpandedMips = numMips;
+	if (i < m_pendingMips.size() && !m_pendingMips[i].empty())
+	{
+		vector<SubresourceData> subresources(numMips - 1);
+		auto pTexels = m_pendingMips[i].data();
+		for (uint8_t j = 1; j < numMips; ++j)
+		{
+			const auto levelSize = (max)(m_gridSize >> j, 1u);
+			auto& subresource = subresources[j - 1];
+			subresource.pData = pTexels;
+			subresource.RowPitch = static_cast<intptr_t>(sizeof(uint16_t[4]) * levelSize);
+			subresource.SlicePitch = subresource.RowPitch * levelSize;
+			pTexels += 4 * levelSize * levelSize * levelSize;
+		}
+
+		uploaders.emplace_back(Resource::MakeUnique());
+		XUSG_N_RETURN(m_volumes[i]->Upload(pCommandList, uploaders.back().get(), subresources.data(),
+			numMips - 1, ResourceState::ALL_SHADER_RESOURCE, m_volumes[i]->CalculateSubresource(1)), false);
+		m_pendingMips[i].clear();
+		numExpandedMips = 1;
+	}
+
+	// Each slot cycles through FrameCount versions of its source tables, rewritten in place, so
+	// paging sources through the slots does not grow the descriptor heap. A slot is expanded at
+	// most once a frame, so no frame in flight reads the version being rewritten.
+	if (i >= m_srcTableVersions.size()) m_srcTableVersions.resize(i + 1);
+	const auto version = FrameCount * i + m_srcTableVersions[i]++ % FrameCount;
+
+	const auto isBricked = i < m_brickTables.size() && m_brickTables[i];
+	auto& srcTables = isBricked ? m_brickSrcTables : m_fileSrcTables;
+	if (version >= srcTables.size()) srcTables.resize(FrameCount * (i + 1), XUSG_NULL);
+	if (isBricked)
+	{
+		const Descriptor descriptors[] =
+		{
+			m_brickTables[i]->GetSRV(),
+			m_brickPools[i]->GetSRV()
+		};
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+		XUSG_X_RETURN(srcTables[version], descriptorTable->CreateCbvSrvUavTable(m_descriptorTableLib.get(), srcTables[version]), false);
+	}
+	else
 	{
+		XUSG_N_RETURN(i < m_fileSrcs.size() && m_fileSrcs[i], false);
+
 		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
 		descriptorTable->SetDescriptors(0, 1, &m_fileSrcs[i]->GetSRV());
-		XUSG_X_RETURN(m_srvTables[SRV_TABLE_FILE_SRC], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+		XUSG_X_RETURN(srcTables[version], descriptorTable->CreateCbvSrvUavTable(m_descriptorTableLib.get(), srcTables[version]), false);
 	}
 
 	const auto descriptorHeap = m_descriptorTableLib->GetDescriptorHeap(CBV_SRV_UAV_HEAP);
@@ -191,16 +328,41 @@ bool MultiRayCaster::LoadVolumeData(XUSG::CommandList* pCommandList, uint32_t i,
 	auto numBarriers = m_volumes[i]->SetBarrier(&barrier, ResourceState::UNORDERED_ACCESS);
 	pCommandList->Barrier(numBarriers, &barrier);
 
-	// Set pipeline state
-	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[LOAD_VOLUME_DATA]);
-	pCommandList->SetPipelineState(m_pipelines[LOAD_VOLUME_DATA]);
+	if (isBricked)
+	{
+		const auto& header = m_brickHeaders[i];
+		const uint32_t cbBricks[] =
+		{
+			header.Width, header.Height, header.Depth, header.BrickSize,
+			header.NumBricksX, header.NumBricksY, header.NumBricksZ
+		};
 
-	// Set descriptor tables
-	pCommandList->SetComputeDescriptorTable(0, m_srvTables[SRV_TABLE_FILE_SRC]);
-	pCommandList->SetComputeDescriptorTable(1, m_uavInitTables[i]);
+		// Set pipeline state
+		pCommandList->SetComputePipelineLayout(m_pipelineLayouts[LOAD_VOLUME_BRICKS]);
+		pCommandList->SetPipelineState(m_pipelines[LOAD_VOLUME_BRICKS]);
+
+		// Set descriptor tables
+		pCommandList->SetComputeDescriptorTable(0, srcTables[version]);
+		pCommandList->SetCompute32BitConstants(2, static_cast<uint32_t>(size(cbBricks)), cbBricks);
+	}
+	else
+	{
+		// Set pipeline state
+		pCommandList->SetComputePipelineLayout(m_pipelineLayouts[LOAD_VOLUME_DATA]);
+		pCommandList->SetPipelineState(m_pipelines[LOAD_VOLUME_DATA]);
+
+		// Set descriptor tables
+		pCommandList->SetComputeDescriptorTable(0, srcTables[version]);
+		pCommandList->SetCompute32BitConstants(2, XUSG_UINT32_SIZE_OF(XMFLOAT4), &m_fileSrcScales[i]);
+	}
 
-	// Dispatch grid
-	pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize, 4), XUSG_DIV_UP(m_gridSize, 4), XUSG_DIV_UP(m_gridSize, 4));
+	// Dispatch grid, per mip level
+	for (uint8_t j = 0; j < numExpandedMips; ++j)
+	{
+		const auto levelSize = (max)(m_gridSize >> j, 1u);
+		pCommandList->SetComputeDescriptorTable(1, m_uavInitTables[numMips * i + j]);
+		pCommandList->Dispatch(XUSG_DIV_UP(levelSize, 4), XUSG_DIV_UP(levelSize, 4), XUSG_DIV_UP(levelSize, 4));
+	}
 
 	numBarriers = m_volumes[i]->SetBarrier(&barrier, ResourceState::ALL_SHADER_RESOURCE);
 	pCommandList->Barrier(numBarriers, &barrier);
@@ -208,6 +370,28 @@ bool MultiRayCaster::LoadVolumeData(XUSG::CommandList* pCommandList, uint32_t i,
 	return true;
 }
 
+bool MultiRayCaster::SetVolumeTexIds(XUSG::CommandList* pCommandList, const uint32_t* volTexIds,
+	vector<Resource::uptr>& uploaders)
+{
+	// Remaps the instances to the source slots, e.g. after the residency manager has paged sources in or out
+	m_isDeepShadowDirty = true;
+	const auto numVolumes = static_cast<uint32_t>(m_cubeMaps.size());
+	vector<VolumeDesc> volumeDescs(numVolumes);
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		auto& volume = volumeDescs[i];
+		volume.VolTexId = volTexIds[i];
+		volume.NumMips = g_numCubeMips;
+		volume.CubeMapSize = m_gridSize;
+		m_culler.SetVolumeDesc(i, volume);
+	}
+
+	uploaders.emplace_back(Resource::MakeUnique());
+
+	return m_volumeDescs->Upload(pCommandList, uploaders.back().get(), volumeDescs.data(),
+		sizeof(VolumeDesc) * volumeDescs.size(), 0, ResourceState::ALL_SHADER_RESOURCE);
+}
+
 bool MultiRayCaster::SetRenderTargets(const XUSG::Device* pDevice, const RenderTarget* pColorOut, const DepthStencil::uptr* depths)
 {
 	m_pDepths = depths;
@@ -235,6 +419,13 @@ bool MultiRayCaster::SetViewport(const XUSG::Device* pDevice, uint32_t width, ui
 	XUSG_N_RETURN(m_kColors->Create(pDevice, width, height, Format::R16G16B16A16_FLOAT, NUM_OIT_LAYERS,
 		ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, 1, false, MemoryFlag::NONE, L"ColorKBuffer"), false);
 
+	// Level 0 halves the depth map, so the coarsest levels stay consistent with HiZPyramid
+	const auto hiZWidth = (max)(width / 2, 1u);
+	const auto hiZHeight = (max)(height / 2, 1u);
+	m_hiZ = Texture2D::MakeUnique();
+	XUSG_N_RETURN(m_hiZ->Create(pDevice, hiZWidth, hiZHeight, Format::R32_FLOAT, 1, ResourceFlag::ALLOW_UNORDERED_ACCESS,
+		Texture::CalculateMipLevels(hiZWidth, hiZHeight), 1, false, MemoryFlag::NONE, L"HiZ"), false);
+
 	XUSG_N_RETURN(createDescriptorTables(pColorOut), false);
 
 	return true;
@@ -242,6 +433,8 @@ bool MultiRayCaster::SetViewport(const XUSG::Device* pDevice, uint32_t width, ui
 
 void MultiRayCaster::InitVolumeData(XUSG::CommandList* pCommandList, uint32_t i)
 {
+	m_isDeepShadowDirty = true;
+
 	const auto descriptorHeap = m_descriptorTableLib->GetDescriptorHeap(CBV_SRV_UAV_HEAP);
 	pCommandList->SetDescriptorHeaps(1, &descriptorHeap);
 
@@ -253,16 +446,109 @@ void MultiRayCaster::InitVolumeData(XUSG::CommandList* pCommandList, uint32_t i)
 	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[INIT_VOLUME_DATA]);
 	pCommandList->SetPipelineState(m_pipelines[INIT_VOLUME_DATA]);
 
-	// Set descriptor tables
-	pCommandList->SetComputeDescriptorTable(0, m_uavInitTables[i]);
-
-	// Dispatch grid
-	pCommandList->Dispatch(XUSG_DIV_UP(m_gridSize, 4), XUSG_DIV_UP(m_gridSize, 4), XUSG_DIV_UP(m_gridSize, 4));
+	// Dispatch grid, per mip level; the procedural field is evaluated at the texel centers of each level
+	const auto numMips = m_volumes[i]->GetNumMips();
+	for (uint8_t j = 0; j < numMips; ++j)
+	{
+		const auto levelSize = (max)(m_gridSize >> j, 1u);
+		pCommandList->SetComputeDescriptorTable(0, m_uavInitTables[numMips * i + j]);
+		pCommandList->Dispatch(XUSG_DIV_UP(levelSize, 4), XUSG_DIV_UP(levelSize, 4), XUSG_DIV_UP(levelSize, 4));
+	}
 
 	numBarriers = m_volumes[i]->SetBarrier(&barrier, ResourceState::ALL_SHADER_RESOURCE);
 	pCommandList->Barrier(numBarriers, &barrier);
 }
 
+float MultiRayCaster::GetMacroCellMargin() const
+{
+	// Covers the filter footprint of the expanded grid on top of that of the source
+	return 1.5f / m_gridSize;
+}
+
+uint32_t MultiRayCaster::GetGridSize() const
+{
+	return m_gridSize;
+}
+
+float MultiRayCaster::GetGridDensityScale() const
+{
+	return g_gridDensityScale;
+}
+
+uint32_t MultiRayCaster::GetNumVolumes() const
+{
+	return static_cast<uint32_t>(m_cubeMaps.size());
+}
+
+float MultiRayCaster::GetVolumeCoverage(uint32_t i) const
+{
+	return i < m_culler.GetNumVolumes() ? m_culler.GetCoverages()[i] : 0.0f;
+}
+
+const VolumeBVH& MultiRayCaster::GetVolumeBVH() const
+{
+	return m_bvh;
+}
+
+const VolumeCuller& MultiRayCaster::GetVolumeCuller() const
+{
+	return m_culler;
+}
+
+const SampleBudget& MultiRayCaster::GetSampleBudget() const
+{
+	return m_budget;
+}
+
+const CostModel::Work& MultiRayCaster::GetPathWork() const
+{
+	return m_pathWork;
+}
+
+const LightMapScheduler& MultiRayCaster::GetLightMapScheduler() const
+{
+	return m_lightMapScheduler;
+}
+
+const LightMapAllocator& MultiRayCaster::GetLightMapAllocator() const
+{
+	return m_lightMapAllocator;
+}
+
+uint64_t MultiRayCaster::GetNumLightCandidates() const
+{
+	return m_numLightCandidates;
+}
+
+const LightClusterer& MultiRayCaster::GetLightClusterer() const
+{
+	return m_lightClusterer;
+}
+
+uint64_t MultiRayCaster::GetNumScheduledLights() const
+{
+	return m_numScheduledLights;
+}
+
+const VolumeCuller::CubeMapGroupCounts& MultiRayCaster::GetCubeMapGroupCounts() const
+{
+	return m_cubeMapGroups;
+}
+
+uint64_t MultiRayCaster::GetVolumeByteSize(uint32_t gridSize)
+{
+	// RGBA16F texels over the full mip chain
+	uint64_t byteSize = 0;
+	const auto numMips = VolumeMipChain::GetNumMips(gridSize);
+	for (auto i = 0u; i < numMips; ++i)
+	{
+		const uint64_t levelSize = (max)(gridSize >> i, 1u);
+		byteSize += sizeof(uint16_t[4]) * levelSize * levelSize * levelSize;
+	}
+
+	return byteSize;
+}
+
 void MultiRayCaster::SetSH(const StructuredBuffer::sptr& coeffSH)
 {
 	m_coeffSH = coeffSH;
@@ -270,6 +556,7 @@ void MultiRayCaster::SetSH(const StructuredBuffer::sptr& coeffSH)
 
 void MultiRayCaster::SetMaxSamples(uint32_t maxRaySamples, uint32_t maxLightSamples)
 {
+	m_isDeepShadowDirty = m_isDeepShadowDirty || m_maxLightSamples != maxLightSamples;
 	m_maxRaySamples = maxRaySamples;
 	m_maxLightSamples = maxLightSamples;
 }
@@ -295,19 +582,82 @@ void MultiRayCaster::SetVolumesWorld(float size, const XMFLOAT3& center)
 }
 
 void MultiRayCaster::SetVolumeWorld(uint32_t i, float size, const XMFLOAT3& pos)
+{
+	SetVolumeWorld(i, size, pos, XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+void MultiRayCaster::SetVolumeWorld(uint32_t i, float size, const XMFLOAT3& pos, const XMFLOAT4& rotation)
+{
+	m_volumeWorlds[i] = GetVolumeWorld(size, pos, rotation);
+	m_volumeDirtyBits[i] = g_allDirtyBits;
+	m_volumeWorldsChanged = true;
+	m_isDeepShadowDirty = true;
+}
+
+void MultiRayCaster::SetVolumeSampleScale(uint32_t i, float scale)
+{
+	if (m_volumeSampleScales[i] != scale) m_volumeDirtyBits[i] = g_allDirtyBits;
+	m_volumeSampleScales[i] = scale;
+}
+
+void MultiRayCaster::SetVolumePriority(uint32_t i, float priority)
+{
+	m_volumePriorities[i] = priority;
+}
+
+void MultiRayCaster::SetSampleBudget(uint64_t maxSamples)
+{
+	// The per-object sample scales are rewritten to the unbudgeted ones once disabled
+	if (m_sampleBudget != maxSamples) fill(m_volumeDirtyBits.begin(), m_volumeDirtyBits.end(), g_allDirtyBits);
+	m_sampleBudget = maxSamples;
+}
+
+void MultiRayCaster::SetPathCosts(const CostModel::Weights& weights)
+{
+	m_pathCosts = weights;
+}
+
+void MultiRayCaster::SetLightMapUpdates(uint32_t numUpdates)
+{
+	m_numLightMapUpdates = (max)(numUpdates, 1u);
+}
+
+XMFLOAT3X4 MultiRayCaster::GetVolumeWorld(float size, const XMFLOAT3& pos, const XMFLOAT4& rotation)
 {
 	size *= 0.5f;
 	auto world = XMMatrixScaling(size, size, size);
+	world = world * XMMatrixRotationQuaternion(XMQuaternionNormalize(XMLoadFloat4(&rotation)));
 	world = world * XMMatrixTranslation(pos.x, pos.y, pos.z);
-	XMStoreFloat3x4(&m_volumeWorlds[i], world);
+
+	XMFLOAT3X4 volumeWorld;
+	XMStoreFloat3x4(&volumeWorld, world);
+
+	return volumeWorld;
 }
 
 void MultiRayCaster::SetLight(const XMFLOAT3& pos, const XMFLOAT3& color, float intensity)
 {
+	m_isDeepShadowDirty = m_isDeepShadowDirty || memcmp(&m_lightPt, &pos, sizeof(XMFLOAT3)) != 0;
 	m_lightPt = pos;
 	m_lightColor = XMFLOAT4(color.x, color.y, color.z, intensity);
 }
 
+void MultiRayCaster::SetLights(const LightClusterer::Light* pLights, uint32_t numLights)
+{
+	numLights = (min)(numLights, MaxLights);
+	const auto isChanged = numLights != m_lights.size() || !equal(pLights, pLights + numLights, m_lights.cbegin(),
+		[](const LightClusterer::Light& a, const LightClusterer::Light& b)
+	{
+		return a.IsPoint == b.IsPoint && equal(a.Position, a.Position + 3, b.Position) &&
+			equal(a.Radiance, a.Radiance + 3, b.Radiance);
+	});
+	if (!isChanged) return;
+
+	// Every light map then refreshes, by coverage
+	m_lights.assign(pLights, pLights + numLights);
+	m_lightMapScheduler.Reset(static_cast<uint32_t>(m_volumeWorlds.size()));
+}
+
 void MultiRayCaster::SetAmbient(const XMFLOAT3& color, float intensity)
 {
 	m_ambient = XMFLOAT4(color.x, color.y, color.z, intensity);
@@ -320,6 +670,19 @@ void MultiRayCaster::UpdateFrame(uint8_t frameIndex, CXMMATRIX viewProj,
 	const auto width = static_cast<float>(depth->GetWidth());
 	const auto height = static_cast<float>(depth->GetHeight());
 
+	// Sources replaced FrameCount frames ago are no longer referenced by the GPU
+	m_retiredSrcs[m_frameIdx % FrameCount].clear();
+
+	// Thread groups of the cube-map ray marching, from the dispatch args this frame slot last
+	// read back
+	if (m_isDispatchReadBack[frameIndex])
+	{
+		const auto pArgs = static_cast<const VolumeCuller::CubeMapDispatchArg*>(m_dispatchReadBack->Map(nullptr));
+		m_cubeMapGroups = VolumeCuller::CountCubeMapGroups(m_gridSize, g_numCubeMips, &pArgs[g_numCubeMips * frameIndex]);
+		m_dispatchReadBack->Unmap();
+		m_isDispatchReadBack[frameIndex] = false;
+	}
+
 	// Per-frame
 	{
 		const auto projToWorld = XMMatrixInverse(nullptr, viewProj);
@@ -327,27 +690,263 @@ void MultiRayCaster::UpdateFrame(uint8_t frameIndex, CXMMATRIX viewProj,
 		pCbData->EyePos = XMFLOAT4(eyePt.x, eyePt.y, eyePt.z, 1.0f);
 		pCbData->Viewport = XMFLOAT4(width, height, 0.0f, 0.0f);
 		pCbData->ShadowViewProj = shadowVP;
-		pCbData->LightPos = XMFLOAT4(m_lightPt.x, m_lightPt.y, m_lightPt.z, 1.0f);
+		XMStoreFloat4x4(&pCbData->ShadowViewProjI, XMMatrixInverse(nullptr, XMLoadFloat4x4(&shadowVP)));
+		pCbData->LightPos = XMFLOAT4(m_lightPt.x, m_lightPt.y, m_lightPt.z, 0.0f);
 		pCbData->LightColor = m_lightColor;
 		pCbData->Ambient = m_ambient;
 		pCbData->FrameIdx = m_frameIdx;
+		pCbData->PathCosts = XMFLOAT3(m_pathCosts.CubeMarch, m_pathCosts.CubeGather, m_pathCosts.RayCast);
 		XMStoreFloat4x4(&pCbData->ScreenToWorld, XMMatrixTranspose(projToWorld));
 	}
 
-	// Per-object
+	// The deep shadow map only reruns once the light, the shadow view, the volume worlds or the
+	// sources have changed; it is a single map that no frame slot overwrites
+	if (memcmp(&shadowVP, &m_shadowViewProj, sizeof(XMFLOAT4X4)) != 0)
+	{
+		m_shadowViewProj = shadowVP;
+		m_isDeepShadowDirty = true;
+	}
+
+	// Per-object, only where the world or the view has changed since this frame slot, or the
+	// culler, last took the instance
+	XMFLOAT4X4 cullViewProj;
+	XMStoreFloat4x4(&cullViewProj, viewProj);
 	{
+		const auto slotBit = 1u << frameIndex;
+		const auto cullBit = 1u << FrameCount;
+		const auto isSlotViewChanged = memcmp(&cullViewProj, &m_slotViewProjs[frameIndex], sizeof(XMFLOAT4X4)) != 0;
+		const auto isCullViewChanged = memcmp(&cullViewProj, &m_cullViewProj, sizeof(XMFLOAT4X4)) != 0;
+		m_slotViewProjs[frameIndex] = cullViewProj;
+		m_cullViewProj = cullViewProj;
+
 		const auto numVolumes = static_cast<uint32_t>(m_cubeMaps.size());
 		const auto pMappedData = reinterpret_cast<PerObject*>(m_perObject->Map(frameIndex));
 		for (auto i = 0u; i < numVolumes; ++i)
 		{
+			const auto isSlotDirty = isSlotViewChanged || (m_volumeDirtyBits[i] & slotBit);
+			const auto isCullDirty = isCullViewChanged || (m_volumeDirtyBits[i] & cullBit);
+			if (!isSlotDirty && !isCullDirty) continue;
+			m_volumeDirtyBits[i] &= ~((isSlotDirty ? slotBit : 0) | (isCullDirty ? cullBit : 0));
+
 			const auto world = XMLoadFloat3x4(&m_volumeWorlds[i]);
 			const auto worldI = XMMatrixInverse(nullptr, world);
 			const auto worldViewProj = world * viewProj;
 
+			XMFLOAT4X4 cullWorldViewProj;
+			XMFLOAT3X4 cullWorldI;
+			XMStoreFloat4x4(&cullWorldViewProj, worldViewProj);
+			XMStoreFloat3x4(&cullWorldI, worldI);
+			if (isCullDirty) m_culler.SetVolume(i, &cullWorldViewProj._11, &cullWorldI._11, m_volumeSampleScales[i]);
+			if (!isSlotDirty) continue;
+
 			XMStoreFloat4x4(&pMappedData[i].WorldViewProj, XMMatrixTranspose(worldViewProj));
 			XMStoreFloat4x4(&pMappedData[i].WorldViewProjI, XMMatrixTranspose(XMMatrixInverse(nullptr, worldViewProj)));
-			XMStoreFloat3x4(&pMappedData[i].WorldI, worldI);
+			pMappedData[i].WorldI = cullWorldI;
 			XMStoreFloat3x4(&pMappedData[i].World, world);
+			pMappedData[i].SampleScale = m_volumeSampleScales[i];
+		}
+	}
+
+	// Instance BVH: refit as the volumes move, and rebuilt once the refits have made it twice
+	// as costly to traverse
+	{
+		const auto numVolumes = static_cast<uint32_t>(m_volumeWorlds.size());
+		const auto pWorlds = reinterpret_cast<const float*>(m_volumeWorlds.data());
+		if (m_bvh.GetNumVolumes() != numVolumes || m_volumeWorldsChanged)
+		{
+			if (m_bvh.GetNumVolumes() == numVolumes) m_bvh.Refit(pWorlds);
+			if (m_bvh.GetNumVolumes() != numVolumes || m_bvh.GetSAHCost() > 2.0f * m_bvhBuildCost)
+			{
+				m_bvh.Build(pWorlds, numVolumes);
+				m_bvhBuildCost = m_bvh.GetSAHCost();
+			}
+
+			m_volumeWorldsChanged = false;
+		}
+
+		m_cullCandidates.clear();
+		m_bvh.QueryFrustum(&cullViewProj._11, m_cullCandidates);
+	}
+
+	// The culling stage on the CPU, for the screen coverage that pages the sources in without
+	// a read-back of the GPU culling; only the batches with volumes in the frustum are culled
+	{
+		VolumeCuller::FrameDesc frame = {};
+		frame.EyePt[0] = eyePt.x;
+		frame.EyePt[1] = eyePt.y;
+		frame.EyePt[2] = eyePt.z;
+		frame.Viewport[0] = width;
+		frame.Viewport[1] = height;
+		frame.NumSamples = m_maxRaySamples;
+		frame.ReuseThreshold = g_cullReuseThreshold;
+		frame.PathCosts = m_pathCosts;
+		VolumeCuller::GetFrustumCorners(&cullViewProj._11, frame.FrustumCorners);
+		m_culler.Cull(frame, m_cullCandidates.data(), static_cast<uint32_t>(m_cullCandidates.size()));
+	}
+
+	// Light maps to refresh, by staleness, coverage and lighting change, in the schedule of
+	// the frame slot
+	{
+		const auto numVolumes = static_cast<uint32_t>(m_volumeWorlds.size());
+		const auto pCoverages = m_culler.GetCoverages();
+		m_scheduleVolumes.resize(numVolumes);
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			const auto pWorld = &m_volumeWorlds[i]._11;
+			auto& volume = m_scheduleVolumes[i];
+			volume.Coverage = pCoverages[i];
+			volume.Radius = 0.0f;
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				volume.Center[j] = pWorld[4 * j + 3];
+				for (uint8_t k = 0; k < 3; ++k) volume.Radius += pWorld[4 * j + k] * pWorld[4 * j + k];
+			}
+			volume.Radius = sqrtf(volume.Radius);
+		}
+
+		// Light maps resized by coverage, up to the updates of a frame, so that they are all
+		// lit first; every volume at the first frame
+		const auto maxResizes = m_lightMapAllocator.GetFrame() > 0 ? m_numLightMapUpdates : numVolumes;
+		for (const auto& change : m_lightMapAllocator.Update(pCoverages, maxResizes))
+			m_lightMapScheduler.Invalidate(change.Volume);
+
+		LightMapScheduler::Light light;
+		light.Position[0] = m_lightPt.x;
+		light.Position[1] = m_lightPt.y;
+		light.Position[2] = m_lightPt.z;
+		light.Radiance[0] = m_lightColor.x * m_lightColor.w;
+		light.Radiance[1] = m_lightColor.y * m_lightColor.w;
+		light.Radiance[2] = m_lightColor.z * m_lightColor.w;
+		light.IsPoint = false;	// The key light is directional, as its shadow view
+
+		const auto& schedule = m_lightMapScheduler.Schedule(m_scheduleVolumes.data(),
+			numVolumes, light, m_numLightMapUpdates);
+		m_schedules[frameIndex] = schedule;
+
+		// The lights of SetLights() that reach each volume
+		m_clusterVolumes.resize(numVolumes);
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			const auto& volume = m_scheduleVolumes[i];
+			m_clusterVolumes[i] = { { volume.Center[0], volume.Center[1], volume.Center[2] }, volume.Radius };
+		}
+		const auto numLights = static_cast<uint32_t>(m_lights.size());
+		m_lightClusterer.Cluster(m_clusterVolumes.data(), numVolumes, m_lights.data(), numLights);
+
+		const auto pLightDescs = static_cast<LightDesc*>(m_lightList->Map(frameIndex));
+		for (auto j = 0u; j < numLights; ++j)
+		{
+			const auto& light = m_lights[j];
+			pLightDescs[j].Position = XMFLOAT4(light.Position[0], light.Position[1], light.Position[2], light.IsPoint ? 1.0f : 0.0f);
+			pLightDescs[j].Radiance = XMFLOAT4(light.Radiance[0], light.Radiance[1], light.Radiance[2], 0.0f);
+		}
+
+		// The volumes that the AO rays of each scheduled volume may pass, by its neighbors
+		// within twice its bounding radius; all volumes once the lists of the frame run out of
+		// room. The deep shadow map covers the light rays
+		const auto maxCandidates = g_lightCandidatesPerVolume * numVolumes;
+		const auto pEntries = static_cast<LightScheduleEntry*>(m_lightSchedule->Map(frameIndex));
+		const auto pCandidates = static_cast<uint32_t*>(m_lightCandidates->Map(frameIndex));
+		const auto pLightIndices = static_cast<uint32_t*>(m_lightIndices->Map(frameIndex));
+		auto numCandidates = 0u, numLightIndices = 0u;
+		m_numLightCandidates = 0;
+		m_numScheduledLights = 0;
+		for (size_t k = 0; k < schedule.size(); ++k)
+		{
+			// The sum of the axis lengths bounds the corners of the cube, unlike the scheduler radius
+			const auto& volume = m_scheduleVolumes[schedule[k]];
+			const auto pWorld = &m_volumeWorlds[schedule[k]]._11;
+			auto radius = 0.0f;
+			for (uint8_t j = 0; j < 3; ++j)
+				radius += sqrtf(pWorld[j] * pWorld[j] + pWorld[4 + j] * pWorld[4 + j] + pWorld[8 + j] * pWorld[8 + j]);
+
+			m_candidateList.clear();
+			if (m_coeffSH) m_bvh.QuerySphere(volume.Center, 2.0f * radius, m_candidateList);
+			sort(m_candidateList.begin(), m_candidateList.end());
+
+			auto& entry = pEntries[k];
+			entry.VolumeId = schedule[k];
+			entry.FirstCandidate = numCandidates;
+			entry.NumCandidates = static_cast<uint32_t>(m_candidateList.size());
+			if (entry.NumCandidates <= maxCandidates - numCandidates)
+			{
+				copy(m_candidateList.cbegin(), m_candidateList.cend(), &pCandidates[numCandidates]);
+				numCandidates += entry.NumCandidates;
+			}
+			else entry.NumCandidates = UINT32_MAX;
+			m_numLightCandidates += entry.NumCandidates != UINT32_MAX ? entry.NumCandidates : numVolumes;
+
+			// The clusterer caps the lists at g_lightsPerVolume, hence within the room of the frame
+			const auto numVolumeLights = m_lightClusterer.GetNumLights(schedule[k]);
+			const auto pVolumeLights = m_lightClusterer.GetLights(schedule[k]);
+			copy(pVolumeLights, pVolumeLights + numVolumeLights, &pLightIndices[numLightIndices]);
+			entry.Lights = numLightIndices | (numVolumeLights << 24);
+			numLightIndices += numVolumeLights;
+			m_numScheduledLights += numVolumeLights;
+		}
+	}
+
+	// Ray-sample budget over the visible volumes: the GPU culling caps the sample count of each
+	// volume by its sample scale, hence the LOD, and a scale of 0 drops the volume
+	if (m_sampleBudget > 0)
+	{
+		const auto& visibleVolumes = m_culler.GetVisibleVolumes();
+		const auto numVisible = static_cast<uint32_t>(visibleVolumes.size());
+		const auto pDescs = m_culler.GetVolumeDescs();
+		const auto pInfos = m_culler.GetVolumeInfos();
+		const auto pCoverages = m_culler.GetCoverages();
+		m_budgetVolumes.resize(numVisible);
+		for (auto k = 0u; k < numVisible; ++k)
+		{
+			const auto i = visibleVolumes[k];
+			auto& volume = m_budgetVolumes[k];
+			volume.Coverage = pCoverages[i];
+			volume.Priority = m_volumePriorities[i];
+			volume.MaxSamples = pInfos[i].SmpCount;
+			volume.MipLevel = pInfos[i].MipLevel;
+			volume.FaceMask = pInfos[i].FaceMask;
+			volume.CubeMapSize = pDescs[i].CubeMapSize;
+			volume.NumMips = pDescs[i].NumMips;
+		}
+		m_budget.Allocate(m_budgetVolumes.data(), numVisible, m_sampleBudget);
+
+		// The slot may hold the budget of an earlier frame for any instance
+		const auto numVolumes = static_cast<uint32_t>(m_volumeSampleScales.size());
+		const auto pMappedData = reinterpret_cast<PerObject*>(m_perObject->Map(frameIndex));
+		for (auto i = 0u; i < numVolumes; ++i) pMappedData[i].SampleScale = m_volumeSampleScales[i];
+
+		// uint(g_numSamples * scale) of the shader rounds down to the allocated count
+		const auto& allocations = m_budget.GetAllocations();
+		for (auto k = 0u; k < numVisible; ++k)
+		{
+			const auto smpCount = allocations[k].SmpCount;
+			pMappedData[visibleVolumes[k]].SampleScale = smpCount > 0 ? (smpCount + 0.5f) / m_maxRaySamples : 0.0f;
+		}
+	}
+
+	// Work of each path, after the budget, for the calibration of the path costs; the faces
+	// keep the paths picked at the sample counts before the budget
+	{
+		const auto& visibleVolumes = m_culler.GetVisibleVolumes();
+		const auto pDescs = m_culler.GetVolumeDescs();
+		const auto pInfos = m_culler.GetVolumeInfos();
+		const auto pCoverages = m_culler.GetCoverages();
+		const auto pCubeMapCoverages = m_culler.GetCubeMapCoverages();
+		const auto& allocations = m_budget.GetAllocations();
+		m_pathWork = {};
+		for (size_t k = 0; k < visibleVolumes.size(); ++k)
+		{
+			const auto i = visibleVolumes[k];
+			auto smpCount = static_cast<uint32_t>(pInfos[i].SmpCount);
+			auto mipLevel = static_cast<uint32_t>(pInfos[i].MipLevel);
+			if (m_sampleBudget > 0)
+			{
+				smpCount = allocations[k].SmpCount;
+				mipLevel = allocations[k].MipLevel;
+			}
+			const auto cubeMapFaces = (pInfos[i].FaceMask >> 8) & 0x3f;
+			if (smpCount > 0) CostModel::AddWork(m_pathWork, cubeMapFaces, pDescs[i].CubeMapSize,
+				mipLevel, pCoverages[i], pCubeMapCoverages[i], smpCount);
 		}
 	}
 }
@@ -355,14 +954,19 @@ void MultiRayCaster::UpdateFrame(uint8_t frameIndex, CXMMATRIX viewProj,
 void MultiRayCaster::Render(RayTracing::CommandList* pCommandList, uint8_t frameIndex,
 	RenderTarget* pColorOut, OITMethod oitMethod, bool useWorkGraph)
 {
+	if (!resizeLightMaps(pCommandList, frameIndex)) return;
+
+	buildHiZ(pCommandList);
 	if (useWorkGraph)
 	{
+		if (m_isDeepShadowDirty) renderDeepShadow(pCommandList, frameIndex);
 		rayMarchL(pCommandList, frameIndex);
 		rayMarchWG(pCommandList, frameIndex);
 	}
 	else
 	{
 		cullVolumes(pCommandList, frameIndex);
+		if (m_isDeepShadowDirty) renderDeepShadow(pCommandList, frameIndex);
 		rayMarchL(pCommandList, frameIndex);
 		rayMarchV(pCommandList, frameIndex);
 	}
@@ -384,6 +988,188 @@ void MultiRayCaster::Render(RayTracing::CommandList* pCommandList, uint8_t frame
 	m_frameIdx = m_frameIdx <= UINT32_MAX ? m_frameIdx + 1 : m_frameIdx;
 }
 
+bool MultiRayCaster::uploadFileSrc(XUSG::CommandList* pCommandList, uint32_t i, const DDSVolume::Info& info,
+	const void* pVoxels, vector<Resource::uptr>& uploaders, ResourceState dstState)
+{
+	const auto fileSrc = Texture3D::MakeShared();
+	XUSG_N_RETURN(fileSrc->Create(pCommandList->GetDevice(), info.Width, info.Height, static_cast<uint16_t>(info.Depth),
+		static_cast<Format>(info.VoxelFormat), ResourceFlag::NONE, 1, MemoryFlag::NONE,
+		(L"FileSource" + to_wstring(i)).c_str()), false);
+
+	// Rows are copied straight from the mapping into the upload buffer, with no intermediate heap copy
+	SubresourceData subresource;
+	subresource.pData = pVoxels;
+	subresource.RowPitch = static_cast<intptr_t>(info.Width) * DDSVolume::GetBytesPerVoxel(info.VoxelFormat);
+	subresource.SlicePitch = subresource.RowPitch * info.Height;
+	uploaders.emplace_back(Resource::MakeUnique());
+	XUSG_N_RETURN(fileSrc->Upload(pCommandList, uploaders.back().get(), &subresource, 1, dstState), false);
+
+	setFileSrc(i, fileSrc, XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f));
+
+	return true;
+}
+
+bool MultiRayCaster::uploadBricks(XUSG::CommandList* pCommandList, uint32_t i, const BrickedVolume& volume,
+	vector<Resource::uptr>& uploaders, ResourceState dstState)
+{
+	const auto pDevice = pCommandList->GetDevice();
+	const auto& header = volume.GetHeader();
+	if (i >= m_brickTables.size()) m_brickTables.resize(i + 1);
+	if (i >= m_brickPools.size()) m_brickPools.resize(i + 1);
+	if (i >= m_brickHeaders.size()) m_brickHeaders.resize(i + 1);
+	m_brickHeaders[i] = header;
+	retireSrcs(i);
+
+	// Only the brick table and the data bricks are uploaded
+	m_brickTables[i] = StructuredBuffer::MakeUnique();
+	XUSG_N_RETURN(m_brickTables[i]->Create(pDevice, volume.GetNumBricks(), sizeof(BrickedVolume::BrickEntry),
+		ResourceFlag::NONE, MemoryType::DEFAULT, 1, nullptr, 0, nullptr, MemoryFlag::NONE,
+		(L"BrickTable" + to_wstring(i)).c_str()), false);
+	uploaders.emplace_back(Resource::MakeUnique());
+	XUSG_N_RETURN(m_brickTables[i]->Upload(pCommandList, uploaders.back().get(), volume.GetBrickTable(),
+		sizeof(BrickedVolume::BrickEntry) * volume.GetNumBricks(), 0, dstState), false);
+
+	const auto numPoolVoxels = static_cast<size_t>(volume.GetBrickVoxelCount()) * header.NumDataBricks;
+	m_brickPools[i] = TypedBuffer::MakeUnique();
+	XUSG_N_RETURN(m_brickPools[i]->Create(pDevice, (max<size_t>)(numPoolVoxels, 1), sizeof(uint16_t),
+		Format::R16_FLOAT, ResourceFlag::NONE, MemoryType::DEFAULT, 1, nullptr, 0, nullptr,
+		MemoryFlag::NONE, (L"BrickPool" + to_wstring(i)).c_str()), false);
+	if (numPoolVoxels > 0)
+	{
+		uploaders.emplace_back(Resource::MakeUnique());
+		XUSG_N_RETURN(m_brickPools[i]->Upload(pCommandList, uploaders.back().get(), volume.GetBrickPool(),
+			volume.GetBrickPoolByteSize(), 0, dstState), false);
+	}
+
+	return true;
+}
+
+bool MultiRayCaster::uploadCompressed(XUSG::CommandList* pCommandList, uint32_t i, const CompressedVolume& volume,
+	vector<Resource::uptr>& uploaders, ResourceState dstState)
+{
+	// The BC4 blocks are the texture; the sampler decodes them when the grid is expanded
+	const auto& header = volume.GetHeader();
+	const auto fileSrc = Texture3D::MakeShared();
+	XUSG_N_RETURN(fileSrc->Create(pCommandList->GetDevice(), volume.GetPaddedWidth(), volume.GetPaddedHeight(),
+		static_cast<uint16_t>(header.Depth), Format::BC4_UNORM, ResourceFlag::NONE, 1, MemoryFlag::NONE,
+		(L"CompressedSource" + to_wstring(i)).c_str()), false);
+
+	SubresourceData subresource;
+	subresource.pData = volume.GetBlocks();
+	subresource.RowPitch = static_cast<intptr_t>(volume.GetRowPitch());
+	subresource.SlicePitch = static_cast<intptr_t>(volume.GetSlicePitch());
+	uploaders.emplace_back(Resource::MakeUnique());
+	XUSG_N_RETURN(fileSrc->Upload(pCommandList, uploaders.back().get(), &subresource, 1, dstState), false);
+
+	// Crop the block padding, and restore the normalized density range
+	setFileSrc(i, fileSrc, XMFLOAT4(static_cast<float>(header.Width) / volume.GetPaddedWidth(),
+		static_cast<float>(header.Height) / volume.GetPaddedHeight(), 1.0f, header.Scale));
+
+	return true;
+}
+
+void MultiRayCaster::setFileSrc(uint32_t i, const Texture::sptr& fileSrc, const XMFLOAT4& scales)
+{
+	if (i >= m_fileSrcs.size()) m_fileSrcs.resize(i + 1);
+	if (i >= m_fileSrcScales.size()) m_fileSrcScales.resize(i + 1);
+	retireSrcs(i);
+	m_fileSrcs[i] = fileSrc;
+	m_fileSrcScales[i] = scales;
+}
+
+void MultiRayCaster::retireSrcs(uint32_t i)
+{
+	// A slot is reloaded when the residency manager pages another source into it, while
+	// the frames in flight may still expand from its previous sources
+	auto& retiredSrcs = m_retiredSrcs[m_frameIdx % FrameCount];
+	if (i < m_fileSrcs.size() && m_fileSrcs[i]) retiredSrcs.emplace_back(move(m_fileSrcs[i]));
+	if (i < m_brickTables.size() && m_brickTables[i]) retiredSrcs.emplace_back(move(m_brickTables[i]));
+	if (i < m_brickPools.size() && m_brickPools[i]) retiredSrcs.emplace_back(move(m_brickPools[i]));
+}
+
+void MultiRayCaster::setMacroCells(uint32_t i, const MacroCellGrid* pMacroCells)
+{
+	if (i >= m_pendingMacroCells.size()) m_pendingMacroCells.resize(i + 1);
+
+	// Without occupancy, every cell is marked occupied and nothing is skipped
+	if (pMacroCells) m_pendingMacroCells[i].assign(pMacroCells->GetData(), pMacroCells->GetData() + MacroCellGrid::NumCells);
+	else m_pendingMacroCells[i].assign(MacroCellGrid::NumCells, FLT_MAX);
+}
+
+void MultiRayCaster::setVolumeMips(uint32_t i, const VolumeMipChain* pMips)
+{
+	if (i >= m_pendingMips.size()) m_pendingMips.resize(i + 1);
+
+	// Without CPU mips, the coarse levels are resampled from the source on expansion
+	if (pMips && pMips->GetNumLevels() == m_volumes[i]->GetNumMips() && pMips->GetNumLevels() > 1)
+		m_pendingMips[i].assign(pMips->GetTexels(1), pMips->GetTexels(1) + pMips->GetTexelDataByteSize() / sizeof(uint16_t));
+	else m_pendingMips[i].clear();
+}
+
+bool MultiRayCaster::createLightMap(const XUSG::Device* pDevice, uint32_t map)
+{
+	const auto size = m_lightMapAllocator.GetMapSize(map);
+	if (map >= m_lightMapPool.size()) m_lightMapPool.resize(map + 1);
+	m_lightMapPool[map] = Texture3D::MakeShared();
+
+	return m_lightMapPool[map]->Create(pDevice, size, size, size, Format::R11G11B10_FLOAT,
+		ResourceFlag::ALLOW_UNORDERED_ACCESS, 1, MemoryFlag::NONE, (L"LightMap" + to_wstring(map)).c_str());
+}
+
+bool MultiRayCaster::createLightMapTables(uint8_t frameIndex)
+{
+	const auto numVolumes = static_cast<uint32_t>(m_lightMaps.size());
+	vector<Descriptor> descriptors(numVolumes);
+
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		for (auto i = 0u; i < numVolumes; ++i) descriptors[i] = m_lightMaps[i]->GetUAV();
+		descriptorTable->SetDescriptors(0, numVolumes, descriptors.data());
+		XUSG_X_RETURN(m_lightMapUavTables[frameIndex], descriptorTable->CreateCbvSrvUavTable(m_descriptorTableLib.get(),
+			m_lightMapUavTables[frameIndex]), false);
+	}
+
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		for (auto i = 0u; i < numVolumes; ++i) descriptors[i] = m_lightMaps[i]->GetSRV();
+		descriptorTable->SetDescriptors(0, numVolumes, descriptors.data());
+		XUSG_X_RETURN(m_lightMapSrvTables[frameIndex], descriptorTable->CreateCbvSrvUavTable(m_descriptorTableLib.get(),
+			m_lightMapSrvTables[frameIndex]), false);
+	}
+
+	return true;
+}
+
+bool MultiRayCaster::resizeLightMaps(XUSG::CommandList* pCommandList, uint8_t frameIndex)
+{
+	// The maps of the last allocator update, taken once. A map left by a volume stays in the
+	// pool while retired, so the frames in flight may still read it.
+	if (m_lightMapFrame != m_lightMapAllocator.GetFrame())
+	{
+		m_lightMapFrame = m_lightMapAllocator.GetFrame();
+		for (const auto& map : m_lightMapAllocator.GetReleasedMaps()) m_lightMapPool[map].reset();
+
+		const auto& changes = m_lightMapAllocator.GetChanges();
+		for (const auto& change : changes)
+		{
+			if (change.IsNewMap) XUSG_N_RETURN(createLightMap(pCommandList->GetDevice(), change.Map), false);
+			m_lightMaps[change.Volume] = m_lightMapPool[change.Map];
+		}
+
+		if (!changes.empty()) m_lightMapTableDirtyBits = (1 << FrameCount) - 1;
+	}
+
+	// Each frame slot rewrites its own tables, which no frame in flight reads
+	const uint8_t slotBit = 1 << frameIndex;
+	if (m_lightMapTableDirtyBits & slotBit)
+	{
+		XUSG_N_RETURN(createLightMapTables(frameIndex), false);
+		m_lightMapTableDirtyBits &= ~slotBit;
+	}
+
+	return true;
+}
+
 bool MultiRayCaster::createCubeVB(XUSG::CommandList* pCommandList, vector<Resource::uptr>& uploaders)
 {
 	static const auto CubeVertices = []()
@@ -465,6 +1251,32 @@ bool MultiRayCaster::createVolumeInfoBuffers(XUSG::CommandList* pCommandList, ui
 		XUSG_N_RETURN(m_perObject->Create(pDevice, numVolumes * FrameCount,
 			sizeof(PerObject), ResourceFlag::NONE, MemoryType::UPLOAD, FrameCount,
 			firstSRVElements, 0, nullptr, MemoryFlag::NONE, L"RayCaster.Matrices"), false);
+
+		// Up to every volume in the light-map schedule of a frame
+		m_lightSchedule = StructuredBuffer::MakeUnique();
+		XUSG_N_RETURN(m_lightSchedule->Create(pDevice, numVolumes * FrameCount,
+			sizeof(LightScheduleEntry), ResourceFlag::NONE, MemoryType::UPLOAD, FrameCount,
+			firstSRVElements, 0, nullptr, MemoryFlag::NONE, L"RayCaster.LightSchedule"), false);
+
+		// The candidate volumes of the light rays of the schedule
+		for (uint8_t i = 0; i < FrameCount; ++i) firstSRVElements[i] = g_lightCandidatesPerVolume * numVolumes * i;
+		m_lightCandidates = StructuredBuffer::MakeUnique();
+		XUSG_N_RETURN(m_lightCandidates->Create(pDevice, g_lightCandidatesPerVolume * numVolumes * FrameCount,
+			sizeof(uint32_t), ResourceFlag::NONE, MemoryType::UPLOAD, FrameCount,
+			firstSRVElements, 0, nullptr, MemoryFlag::NONE, L"RayCaster.LightCandidates"), false);
+
+		// The lights of SetLights(), and the lights of each volume of the schedule
+		for (uint8_t i = 0; i < FrameCount; ++i) firstSRVElements[i] = MaxLights * i;
+		m_lightList = StructuredBuffer::MakeUnique();
+		XUSG_N_RETURN(m_lightList->Create(pDevice, MaxLights * FrameCount,
+			sizeof(LightDesc), ResourceFlag::NONE, MemoryType::UPLOAD, FrameCount,
+			firstSRVElements, 0, nullptr, MemoryFlag::NONE, L"RayCaster.Lights"), false);
+
+		for (uint8_t i = 0; i < FrameCount; ++i) firstSRVElements[i] = g_lightsPerVolume * numVolumes * i;
+		m_lightIndices = StructuredBuffer::MakeUnique();
+		XUSG_N_RETURN(m_lightIndices->Create(pDevice, g_lightsPerVolume * numVolumes * FrameCount,
+			sizeof(uint32_t), ResourceFlag::NONE, MemoryType::UPLOAD, FrameCount,
+			firstSRVElements, 0, nullptr, MemoryFlag::NONE, L"RayCaster.LightIndices"), false);
 	}
 
 	{
@@ -478,6 +1290,9 @@ bool MultiRayCaster::createVolumeInfoBuffers(XUSG::CommandList* pCommandList, ui
 			volume.CubeMapSize = m_gridSize;
 		}
 
+		m_culler.Resize(numVolumes);
+		for (auto i = 0u; i < numVolumes; ++i) m_culler.SetVolumeDesc(i, volumeDescs[i]);
+
 		m_volumeDescs = StructuredBuffer::MakeUnique();
 		XUSG_N_RETURN(m_volumeDescs->Create(pDevice, numVolumes,
 			sizeof(VolumeDesc), ResourceFlag::NONE, MemoryType::DEFAULT, 1,
@@ -488,6 +1303,19 @@ bool MultiRayCaster::createVolumeInfoBuffers(XUSG::CommandList* pCommandList, ui
 			volumeDescs.data(), sizeof(VolumeDesc) * volumeDescs.size());
 	}
 
+	{
+		// Macro-cell occupancy of all sources; fully occupied until the sources are loaded
+		const vector<float> macroCells(MacroCellGrid::NumCells * numVolumeSrcs, FLT_MAX);
+		m_macroCells = StructuredBuffer::MakeUnique();
+		XUSG_N_RETURN(m_macroCells->Create(pDevice, static_cast<uint32_t>(macroCells.size()),
+			sizeof(float), ResourceFlag::NONE, MemoryType::DEFAULT, 1, nullptr, 0, nullptr,
+			MemoryFlag::NONE, L"RayCaster.MacroCells"), false);
+
+		uploaders.emplace_back(Resource::MakeUnique());
+		XUSG_N_RETURN(m_macroCells->Upload(pCommandList, uploaders.back().get(), macroCells.data(),
+			sizeof(float) * macroCells.size(), 0, ResourceState::ALL_SHADER_RESOURCE), false);
+	}
+
 	{
 		m_visibleVolumeCounter = StructuredBuffer::MakeShared();
 		XUSG_N_RETURN(m_visibleVolumeCounter->Create(pDevice, 1, sizeof(uint32_t),
@@ -500,16 +1328,11 @@ bool MultiRayCaster::createVolumeInfoBuffers(XUSG::CommandList* pCommandList, ui
 			ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 1, nullptr,
 			1, nullptr, MemoryFlag::NONE, L"RayCaster.VisibleVolumes"), false);
 
-		m_cubeMapVolumeCounter = StructuredBuffer::MakeShared();
-		XUSG_N_RETURN(m_cubeMapVolumeCounter->Create(pDevice, 1, sizeof(uint32_t),
-			ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 1, nullptr,
-			0, nullptr, MemoryFlag::NONE, L"RayCaster.CubeMapVolumeCounter"), false);
-
-		m_cubeMapVolumes = StructuredBuffer::MakeUnique();
-		m_cubeMapVolumes->SetCounter(m_cubeMapVolumeCounter);
-		XUSG_N_RETURN(m_cubeMapVolumes->Create(pDevice, numVolumes, sizeof(uint32_t),
+		// A bin of cube-map face work items per mip level, up to 6 per volume
+		m_cubeMapFaces = StructuredBuffer::MakeUnique();
+		XUSG_N_RETURN(m_cubeMapFaces->Create(pDevice, g_numCubeMips * 6 * numVolumes, sizeof(uint32_t),
 			ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT, 1, nullptr,
-			1, nullptr, MemoryFlag::NONE, L"RayCaster.CubeMapVolumes"), false);
+			1, nullptr, MemoryFlag::NONE, L"RayCaster.CubeMapFaces"), false);
 
 		m_counterReset = StructuredBuffer::MakeUnique();
 		XUSG_N_RETURN(m_counterReset->Create(pDevice, 1, sizeof(uint32_t),
@@ -521,14 +1344,29 @@ bool MultiRayCaster::createVolumeInfoBuffers(XUSG::CommandList* pCommandList, ui
 			Format::R16G16B16A16_UINT, ResourceFlag::ALLOW_UNORDERED_ACCESS, MemoryType::DEFAULT,
 			1, nullptr, 1, nullptr, MemoryFlag::NONE, L"RayCaster.VolumeAttributes"), false);
 
+		// An indirect dispatch per mip bin, sized to the faces at that mip, and counted into
+		// by the culling
+		const auto dispatchArgSize = sizeof(VolumeCuller::CubeMapDispatchArg[g_numCubeMips]);
 		m_volumeDispatchArg = Buffer::MakeUnique();
-		XUSG_N_RETURN(m_volumeDispatchArg->Create(pDevice, sizeof(uint32_t[3]),
+		XUSG_N_RETURN(m_volumeDispatchArg->Create(pDevice, dispatchArgSize,
+			ResourceFlag::DENY_SHADER_RESOURCE | ResourceFlag::ALLOW_UNORDERED_ACCESS,
+			MemoryType::DEFAULT, 0, nullptr, 0, nullptr, MemoryFlag::NONE,
+			L"RayCaster.CubeMapDispatchArgs"), false);
+
+		m_volumeDispatchReset = Buffer::MakeUnique();
+		XUSG_N_RETURN(m_volumeDispatchReset->Create(pDevice, dispatchArgSize,
 			ResourceFlag::DENY_SHADER_RESOURCE, MemoryType::DEFAULT, 0, nullptr,
-			0, nullptr, MemoryFlag::NONE, L"RayCaster.VisibleVolumeDispatchArg"), false);
+			0, nullptr, MemoryFlag::NONE, L"RayCaster.CubeMapDispatchReset"), false);
 
-		const uint32_t pDispatchReset[] = { XUSG_DIV_UP(m_gridSize, 8), XUSG_DIV_UP(m_gridSize, 8), 0 };
+		VolumeCuller::CubeMapDispatchArg pDispatchReset[g_numCubeMips];
+		VolumeCuller::ResetCubeMapDispatchArgs(m_gridSize, g_numCubeMips, pDispatchReset);
 		uploaders.emplace_back(Resource::MakeUnique());
-		XUSG_N_RETURN(m_volumeDispatchArg->Upload(pCommandList, uploaders.back().get(), pDispatchReset, sizeof(uint32_t[3])), false);
+		XUSG_N_RETURN(m_volumeDispatchReset->Upload(pCommandList, uploaders.back().get(), pDispatchReset, dispatchArgSize), false);
+
+		m_dispatchReadBack = Buffer::MakeUnique();
+		XUSG_N_RETURN(m_dispatchReadBack->Create(pDevice, dispatchArgSize * FrameCount,
+			ResourceFlag::DENY_SHADER_RESOURCE, MemoryType::READBACK, 0, nullptr,
+			0, nullptr, MemoryFlag::NONE, L"RayCaster.CubeMapDispatchReadBack"), false);
 
 		m_volumeDrawArg = Buffer::MakeUnique();
 		XUSG_N_RETURN(m_volumeDrawArg->Create(pDevice, sizeof(uint32_t[5]),
@@ -570,11 +1408,22 @@ bool MultiRayCaster::createPipelineLayouts(const XUSG::Device* pDevice)
 		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
 		pipelineLayout->SetRange(0, DescriptorType::SRV, 1, 0);
 		pipelineLayout->SetRange(1, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		pipelineLayout->SetConstants(2, XUSG_UINT32_SIZE_OF(XMFLOAT4), 0);
 		pipelineLayout->SetStaticSamplers(pSamplers, 1, 0);
 		XUSG_X_RETURN(m_pipelineLayouts[LOAD_VOLUME_DATA], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
 			PipelineLayoutFlag::NONE, L"LoadGridDataLayout"), false);
 	}
 
+	// Load bricked grid data
+	{
+		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+		pipelineLayout->SetRange(0, DescriptorType::SRV, 2, 0);
+		pipelineLayout->SetRange(1, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		pipelineLayout->SetConstants(2, 7, 0);
+		XUSG_X_RETURN(m_pipelineLayouts[LOAD_VOLUME_BRICKS], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+			PipelineLayoutFlag::NONE, L"LoadBrickedGridDataLayout"), false);
+	}
+
 	// Init grid data
 	{
 		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
@@ -583,6 +1432,15 @@ bool MultiRayCaster::createPipelineLayouts(const XUSG::Device* pDevice)
 			PipelineLayoutFlag::NONE, L"InitGridDataLayout"), false);
 	}
 
+	// Hi-Z build
+	{
+		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+		pipelineLayout->SetRange(0, DescriptorType::SRV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		pipelineLayout->SetRange(0, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		XUSG_X_RETURN(m_pipelineLayouts[BUILD_HI_Z], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+			PipelineLayoutFlag::NONE, L"HiZBuildingLayout"), false);
+	}
+
 	// Volume culling
 	{
 		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
@@ -591,10 +1449,28 @@ bool MultiRayCaster::createPipelineLayouts(const XUSG::Device* pDevice)
 		pipelineLayout->SetRange(1, DescriptorType::UAV, 3, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
 		pipelineLayout->SetRange(2, DescriptorType::SRV, 1, 1, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
 		pipelineLayout->SetConstants(3, 1, 1);
+		pipelineLayout->SetRange(4, DescriptorType::SRV, 1, 2, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);	// g_txHiZ
+		pipelineLayout->SetRootUAV(5, 3);	// g_rwCubeMapDispatchArgs
 		XUSG_X_RETURN(m_pipelineLayouts[VOLUME_CULL], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
 			PipelineLayoutFlag::NONE, L"VolumeCullingLayout"), false);
 	}
 
+	// Deep shadow map
+	{
+		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
+		pipelineLayout->SetRange(0, DescriptorType::CBV, 1, 0, 0, DescriptorFlag::DATA_STATIC);
+		pipelineLayout->SetRange(0, DescriptorType::SRV, 1, 0, 0, DescriptorFlag::DATA_STATIC);
+		pipelineLayout->SetRange(1, DescriptorType::SRV, 1, 1, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		pipelineLayout->SetRange(2, DescriptorType::UAV, 1, 0, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
+		pipelineLayout->SetRange(3, DescriptorType::SRV, numVolumeSrcs, 0, 1);
+		pipelineLayout->SetConstants(4, 2, 1);
+		pipelineLayout->SetConstants(5, 1, 2);	// g_lightGridSize
+		pipelineLayout->SetRootSRV(6, 2, 2);	// g_roMacroCells
+		pipelineLayout->SetStaticSamplers(pLitSamplers, static_cast<uint32_t>(size(pLitSamplers)), 0);
+		XUSG_X_RETURN(m_pipelineLayouts[DEEP_SHADOW], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
+			PipelineLayoutFlag::NONE, L"DeepShadowLayout"), false);
+	}
+
 	// Light space ray marching
 	{
 		const auto pipelineLayout = Util::PipelineLayout::MakeUnique();
@@ -607,6 +1483,13 @@ bool MultiRayCaster::createPipelineLayouts(const XUSG::Device* pDevice)
 		pipelineLayout->SetRange(4, DescriptorType::SRV, 1, 0, 2);
 		pipelineLayout->SetConstants(5, 2, 1);
 		pipelineLayout->SetRootSRV(6, 1, 2);
+		pipelineLayout->SetRootSRV(7, 2, 2);	// g_roMacroCells
+		pipelineLayout->SetRootSRV(8, 3, 2);	// g_roLightSchedule
+		pipelineLayout->SetRootSRV(9, 4, 2);	// g_roLightCandidates
+		pipelineLayout->SetRange(10, DescriptorType::SRV, 1, 5, 2, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);	// g_txDeepShadow
+		pipelineLayout->SetRootSRV(11, 6, 2);	// g_roLights
+		pipelineLayout->SetRootSRV(12, 7, 2);	// g_roLightIndices
+		pipelineLayout->SetConstants(13, 1, 2);	// g_lightSlot
 		pipelineLayout->SetStaticSamplers(pLitSamplers, static_cast<uint32_t>(size(pLitSamplers)), 0);
 		XUSG_X_RETURN(m_pipelineLayouts[RAY_MARCH_L], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
 			PipelineLayoutFlag::NONE, L"LightSpaceRayMarchingLayout"), false);
@@ -623,6 +1506,8 @@ bool MultiRayCaster::createPipelineLayouts(const XUSG::Device* pDevice)
 		pipelineLayout->SetRange(3, DescriptorType::UAV, g_numCubeMips * numVolumes, 0, 1, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);
 		pipelineLayout->SetRange(4, DescriptorType::SRV, numVolumeSrcs, 0, 1);
 		pipelineLayout->SetRange(5, DescriptorType::SRV, 1, 0, 2);
+		pipelineLayout->SetRootSRV(6, 2, 2);	// g_roMacroCells
+		pipelineLayout->SetConstants(7, 1, 1);	// g_mipBin, set by the indirect args
 		pipelineLayout->SetStaticSamplers(pSamplers, static_cast<uint32_t>(size(pSamplers)), 0);
 		XUSG_X_RETURN(m_pipelineLayouts[RAY_MARCH_V], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
 			PipelineLayoutFlag::NONE, L"ViewSpaceRayMarchingLayout"), false);
@@ -642,6 +1527,8 @@ bool MultiRayCaster::createPipelineLayouts(const XUSG::Device* pDevice)
 		pipelineLayout->SetRange(6, DescriptorType::SRV, numVolumeSrcs, 0, 1);
 		pipelineLayout->SetRange(7, DescriptorType::SRV, 1, 0, 2);
 		pipelineLayout->SetConstants(8, 1, 1);
+		pipelineLayout->SetRootSRV(9, 2, 2);	// g_roMacroCells
+		pipelineLayout->SetRange(10, DescriptorType::SRV, 1, 2, 0, DescriptorFlag::DATA_STATIC_WHILE_SET_AT_EXECUTE);	// g_txHiZ
 		pipelineLayout->SetStaticSamplers(pSamplers, static_cast<uint32_t>(size(pSamplers)), 0);
 		XUSG_X_RETURN(m_pipelineLayouts[RAY_MARCH_WG], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
 			PipelineLayoutFlag::NONE, L"WorkGraphRayMarchingLayout"), false);
@@ -687,6 +1574,7 @@ bool MultiRayCaster::createPipelineLayouts(const XUSG::Device* pDevice)
 		pipelineLayout->SetRange(6, DescriptorType::SRV, 1, 0, 2);
 		pipelineLayout->SetRange(7, DescriptorType::SRV, g_numCubeMips * numVolumes, 0, 3);
 		pipelineLayout->SetRange(8, DescriptorType::SRV, g_numCubeMips * numVolumes, 0, 4);
+		pipelineLayout->SetRootSRV(9, 2, 2, DescriptorFlag::NONE, Shader::Stage::PS);	// g_roMacroCells
 		pipelineLayout->SetStaticSamplers(pSamplers, 1, 0, 0, Shader::Stage::PS);
 		pipelineLayout->SetShaderStage(1, Shader::Stage::VS);
 		pipelineLayout->SetShaderStage(2, Shader::Stage::PS);
@@ -714,6 +1602,7 @@ bool MultiRayCaster::createPipelineLayouts(const XUSG::Device* pDevice)
 		pipelineLayout->SetRange(5, DescriptorType::SRV, 1, 0, 2);
 		pipelineLayout->SetRange(6, DescriptorType::SRV, g_numCubeMips * numVolumes, 0, 3);
 		pipelineLayout->SetRange(7, DescriptorType::SRV, g_numCubeMips * numVolumes, 0, 4);
+		pipelineLayout->SetRootSRV(8, 2, 2, DescriptorFlag::NONE, Shader::Stage::PS);	// g_roMacroCells
 		pipelineLayout->SetStaticSamplers(pSamplers, 1, 0, 0, Shader::Stage::PS);
 		pipelineLayout->SetShaderStage(1, Shader::Stage::VS);
 		pipelineLayout->SetShaderStage(3, Shader::Stage::PS);
@@ -748,6 +1637,7 @@ bool MultiRayCaster::createPipelineLayouts(const XUSG::Device* pDevice)
 		pipelineLayout->SetRange(5, DescriptorType::SRV, 1, 0, 2);
 		pipelineLayout->SetRange(6, DescriptorType::SRV, g_numCubeMips * numVolumes, 0, 3);
 		pipelineLayout->SetRange(7, DescriptorType::SRV, g_numCubeMips * numVolumes, 0, 4);
+		pipelineLayout->SetRootSRV(8, 2, 2);	// g_roMacroCells
 		pipelineLayout->SetStaticSamplers(pSamplers, 1, 0);
 		XUSG_X_RETURN(m_pipelineLayouts[RAY_TRACING], pipelineLayout->GetPipelineLayout(m_pipelineLayoutLib.get(),
 			PipelineLayoutFlag::NONE, L"RayTracingLayout"), false);
@@ -781,6 +1671,16 @@ bool MultiRayCaster::createPipelines(Format rtFormat, Format dsFormat)
 		XUSG_X_RETURN(m_pipelines[LOAD_VOLUME_DATA], state->GetPipeline(m_computePipelineLib.get(), L"InitGridData"), false);
 	}
 
+	// Load bricked grid data
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSLoadBricks.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[LOAD_VOLUME_BRICKS]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[LOAD_VOLUME_BRICKS], state->GetPipeline(m_computePipelineLib.get(), L"LoadBricks"), false);
+	}
+
 	// Init grid data
 	{
 		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSInitGridData.cso"), false);
@@ -791,6 +1691,16 @@ bool MultiRayCaster::createPipelines(Format rtFormat, Format dsFormat)
 		XUSG_X_RETURN(m_pipelines[INIT_VOLUME_DATA], state->GetPipeline(m_computePipelineLib.get(), L"InitGridData"), false);
 	}
 
+	// Hi-Z build
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSBuildHiZ.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[BUILD_HI_Z]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[BUILD_HI_Z], state->GetPipeline(m_computePipelineLib.get(), L"HiZBuilding"), false);
+	}
+
 	// Volume culling
 	{
 		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSVolumeCull.cso"), false);
@@ -801,6 +1711,16 @@ bool MultiRayCaster::createPipelines(Format rtFormat, Format dsFormat)
 		XUSG_X_RETURN(m_pipelines[VOLUME_CULL], state->GetPipeline(m_computePipelineLib.get(), L"VolumeCulling"), false);
 	}
 
+	// Deep shadow map
+	{
+		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSDeepShadow.cso"), false);
+
+		const auto state = Compute::State::MakeUnique();
+		state->SetPipelineLayout(m_pipelineLayouts[DEEP_SHADOW]);
+		state->SetShader(m_shaderLib->GetShader(Shader::Stage::CS, csIndex++));
+		XUSG_X_RETURN(m_pipelines[DEEP_SHADOW], state->GetPipeline(m_computePipelineLib.get(), L"DeepShadow"), false);
+	}
+
 	// Light space ray marching
 	{
 		XUSG_N_RETURN(m_shaderLib->CreateShader(Shader::Stage::CS, csIndex, L"CSRayMarchL.cso"), false);
@@ -964,10 +1884,16 @@ bool MultiRayCaster::createPipelines(Format rtFormat, Format dsFormat)
 bool MultiRayCaster::createCommandLayouts(const XUSG::Device* pDevice)
 {
 	{
-		IndirectArgument arg;
-		arg.Type = IndirectArgumentType::DISPATCH;
+		// The mip bin as a root constant, then the dispatch
+		IndirectArgument args[2];
+		args[0].Type = IndirectArgumentType::CONSTANT;
+		args[0].Constant.Index = 7;
+		args[0].Constant.DestOffsetIn32BitValues = 0;
+		args[0].Constant.Num32BitValuesToSet = 1;
+		args[1].Type = IndirectArgumentType::DISPATCH;
 		m_commandLayouts[DISPATCH_LAYOUT] = CommandLayout::MakeUnique();
-		XUSG_N_RETURN(m_commandLayouts[DISPATCH_LAYOUT]->Create(pDevice, sizeof(uint32_t[3]), 1, &arg), false);
+		XUSG_N_RETURN(m_commandLayouts[DISPATCH_LAYOUT]->Create(pDevice, sizeof(VolumeCuller::CubeMapDispatchArg),
+			static_cast<uint32_t>(size(args)), args, m_pipelineLayouts[RAY_MARCH_V]), false);
 	}
 
 	{
@@ -1019,12 +1945,11 @@ bool MultiRayCaster::createDescriptorTables(const Texture* pColorOut)
 		XUSG_X_RETURN(m_uavTables[UAV_TABLE_CUBE_DEPTH], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
 	}
 
+	if (m_deepShadow)
 	{
 		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-		vector<Descriptor> descriptors(numVolumes);
-		for (auto i = 0u; i < numVolumes; ++i) descriptors[i] = m_lightMaps[i]->GetUAV();
-		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(descriptors.size()), descriptors.data());
-		XUSG_X_RETURN(m_uavTables[UAV_TABLE_LIGHT_MAP], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+		descriptorTable->SetDescriptors(0, 1, &m_deepShadow->GetUAV());
+		XUSG_X_RETURN(m_uavTables[UAV_TABLE_DEEP_SHADOW], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
 	}
 
 	if (m_kDepths)
@@ -1075,8 +2000,8 @@ bool MultiRayCaster::createDescriptorTables(const Texture* pColorOut)
 
 	{
 		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-		descriptorTable->SetDescriptors(0, 1, &m_cubeMapVolumes->GetSRV());
-		XUSG_X_RETURN(m_srvTables[SRV_TABLE_CUBE_VOLUMES], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+		descriptorTable->SetDescriptors(0, 1, &m_cubeMapFaces->GetSRV());
+		XUSG_X_RETURN(m_srvTables[SRV_TABLE_CUBE_FACES], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
 	}
 
 	{
@@ -1085,12 +2010,15 @@ bool MultiRayCaster::createDescriptorTables(const Texture* pColorOut)
 		XUSG_X_RETURN(m_srvTables[SRV_TABLE_VOLUME_ATTRIBS], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
 	}
 
+	// Light-map UAV and SRV tables, per frame slot
+	for (uint8_t i = 0; i < FrameCount; ++i) XUSG_N_RETURN(createLightMapTables(i), false);
+	m_lightMapTableDirtyBits = 0;
+
+	if (m_deepShadow)
 	{
 		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-		vector<Descriptor> descriptors(numVolumes);
-		for (auto i = 0u; i < numVolumes; ++i) descriptors[i] = m_lightMaps[i]->GetSRV();
-		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(descriptors.size()), descriptors.data());
-		XUSG_X_RETURN(m_srvTables[SRV_TABLE_LIGHT_MAP], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+		descriptorTable->SetDescriptors(0, 1, &m_deepShadow->GetSRV());
+		XUSG_X_RETURN(m_srvTables[SRV_TABLE_DEEP_SHADOW], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
 	}
 
 	if (m_kDepths)
@@ -1107,6 +2035,13 @@ bool MultiRayCaster::createDescriptorTables(const Texture* pColorOut)
 		XUSG_X_RETURN(m_srvTables[SRV_TABLE_K_COLORS], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
 	}
 
+	if (m_hiZ)
+	{
+		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+		descriptorTable->SetDescriptors(0, 1, &m_hiZ->GetSRV());
+		XUSG_X_RETURN(m_srvTables[SRV_TABLE_HI_Z], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+	}
+
 	if (m_pDepths)
 	{
 		if (m_pDepths[DEPTH_MAP])
@@ -1114,6 +2049,24 @@ bool MultiRayCaster::createDescriptorTables(const Texture* pColorOut)
 			const auto descriptorTable = Util::DescriptorTable::MakeUnique();
 			descriptorTable->SetDescriptors(0, 1, &m_pDepths[DEPTH_MAP]->GetSRV());
 			XUSG_X_RETURN(m_srvTables[SRV_TABLE_DEPTH], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+
+			// Hi-Z levels, each reduced from the one above, or from the depth map for level 0
+			if (m_hiZ)
+			{
+				const uint8_t numHiZLevels = m_hiZ->GetNumMips();
+				m_hiZTables.resize(numHiZLevels);
+				for (uint8_t j = 0; j < numHiZLevels; ++j)
+				{
+					const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+					const Descriptor descriptors[] =
+					{
+						j > 0 ? m_hiZ->GetSRV(j - 1, true) : m_pDepths[DEPTH_MAP]->GetSRV(),
+						m_hiZ->GetUAV(j)
+					};
+					descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
+					XUSG_X_RETURN(m_hiZTables[j], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+				}
+			}
 		}
 
 		if (m_pDepths[SHADOW_MAP])
@@ -1144,13 +2097,17 @@ bool MultiRayCaster::createDescriptorTables(const Texture* pColorOut)
 		XUSG_X_RETURN(m_srvTables[SRV_TABLE_CUBE_DEPTH], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
 	}
 
-	// Create UAV tables
-	m_uavInitTables.resize(numVolumeSrcs);
+	// Create UAV tables, per mip level
+	const auto numVolumeMips = numVolumeSrcs > 0 ? m_volumes[0]->GetNumMips() : 0u;
+	m_uavInitTables.resize(numVolumeMips * numVolumeSrcs);
 	for (auto i = 0u; i < numVolumeSrcs; ++i)
 	{
-		const auto descriptorTable = Util::DescriptorTable::MakeUnique();
-		descriptorTable->SetDescriptors(0, 1, &m_volumes[i]->GetUAV());
-		XUSG_X_RETURN(m_uavInitTables[i], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+		for (uint8_t j = 0; j < numVolumeMips; ++j)
+		{
+			const auto descriptorTable = Util::DescriptorTable::MakeUnique();
+			descriptorTable->SetDescriptors(0, 1, &m_volumes[i]->GetUAV(j));
+			XUSG_X_RETURN(m_uavInitTables[numVolumeMips * i + j], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
+		}
 	}
 
 	{
@@ -1159,7 +2116,7 @@ bool MultiRayCaster::createDescriptorTables(const Texture* pColorOut)
 		{
 			m_visibleVolumes->GetUAV(),
 			m_volumeAttribs->GetUAV(),
-			m_cubeMapVolumes->GetUAV()
+			m_cubeMapFaces->GetUAV()
 		};
 		descriptorTable->SetDescriptors(0, static_cast<uint32_t>(size(descriptors)), descriptors);
 		XUSG_X_RETURN(m_uavTables[UAV_TABLE_CULL], descriptorTable->GetCbvSrvUavTable(m_descriptorTableLib.get()), false);
@@ -1246,27 +2203,56 @@ bool MultiRayCaster::buildShaderTables(const RayTracing::Device* pDevice)
 	return true;
 }
 
+void MultiRayCaster::buildHiZ(XUSG::CommandList* pCommandList)
+{
+	// Set barriers
+	XUSG::ResourceBarrier barriers[2];
+	auto numBarriers = m_pDepths[DEPTH_MAP]->SetBarrier(barriers, ResourceState::ALL_SHADER_RESOURCE);
+	pCommandList->Barrier(numBarriers, barriers);
+
+	// Set pipeline state
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[BUILD_HI_Z]);
+	pCommandList->SetPipelineState(m_pipelines[BUILD_HI_Z]);
+
+	// Dispatch grid, per level; each level reads the one above once it is written
+	const auto numLevels = m_hiZ->GetNumMips();
+	for (uint8_t j = 0; j < numLevels; ++j)
+	{
+		numBarriers = m_hiZ->SetBarrier(barriers, j, ResourceState::UNORDERED_ACCESS);
+		pCommandList->Barrier(numBarriers, barriers);
+
+		const auto levelWidth = (max)(static_cast<uint32_t>(m_hiZ->GetWidth()) >> j, 1u);
+		const auto levelHeight = (max)(m_hiZ->GetHeight() >> j, 1u);
+		pCommandList->SetComputeDescriptorTable(0, m_hiZTables[j]);
+		pCommandList->Dispatch(XUSG_DIV_UP(levelWidth, 8), XUSG_DIV_UP(levelHeight, 8), 1);
+
+		numBarriers = m_hiZ->SetBarrier(barriers, j, ResourceState::NON_PIXEL_SHADER_RESOURCE);
+		pCommandList->Barrier(numBarriers, barriers);
+	}
+}
+
 void MultiRayCaster::cullVolumes(XUSG::CommandList* pCommandList, uint8_t frameIndex)
 {
 	// Set barriers
 	XUSG::ResourceBarrier barriers[5];
 	auto numBarriers = m_visibleVolumeCounter->SetBarrier(barriers, ResourceState::COPY_DEST,
 		0, XUSG_BARRIER_ALL_SUBRESOURCES, BarrierFlag::NONE, ResourceState::COMMON);
-	numBarriers = m_cubeMapVolumeCounter->SetBarrier(barriers, ResourceState::COPY_DEST,
+	numBarriers = m_volumeDispatchArg->SetBarrier(barriers, ResourceState::COPY_DEST,
 		numBarriers, XUSG_BARRIER_ALL_SUBRESOURCES, BarrierFlag::NONE, ResourceState::COMMON);
 	pCommandList->Barrier(numBarriers, barriers);
 
-	// Reset counters
+	// Reset counters, and the volume counts of the mip bins
 	pCommandList->CopyResource(m_visibleVolumeCounter.get(), m_counterReset.get());
-	pCommandList->CopyResource(m_cubeMapVolumeCounter.get(), m_counterReset.get());
+	pCommandList->CopyResource(m_volumeDispatchArg.get(), m_volumeDispatchReset.get());
 
 	// Set barriers
 	numBarriers = m_visibleVolumes->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS,
 		0, XUSG_BARRIER_ALL_SUBRESOURCES, BarrierFlag::NONE, ResourceState::COMMON);
 	numBarriers = m_volumeAttribs->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS,
 		numBarriers, XUSG_BARRIER_ALL_SUBRESOURCES, BarrierFlag::NONE, ResourceState::COMMON);
-	numBarriers = m_cubeMapVolumes->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS,
+	numBarriers = m_cubeMapFaces->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS,
 		numBarriers, XUSG_BARRIER_ALL_SUBRESOURCES, BarrierFlag::NONE, ResourceState::COMMON);
+	numBarriers = m_volumeDispatchArg->SetBarrier(barriers, ResourceState::UNORDERED_ACCESS, numBarriers);
 	pCommandList->Barrier(numBarriers, barriers);
 
 	// Set pipeline state
@@ -1278,6 +2264,8 @@ void MultiRayCaster::cullVolumes(XUSG::CommandList* pCommandList, uint8_t frameI
 	pCommandList->SetComputeDescriptorTable(1, m_uavTables[UAV_TABLE_CULL]);
 	pCommandList->SetComputeDescriptorTable(2, m_srvTables[SRV_TABLE_VOLUME_DESCS]);
 	pCommandList->SetCompute32BitConstant(3, m_maxRaySamples);
+	pCommandList->SetComputeDescriptorTable(4, m_srvTables[SRV_TABLE_HI_Z]);
+	pCommandList->SetComputeRootUnorderedAccessView(5, m_volumeDispatchArg.get());
 
 	// Dispatch cube
 	const uint32_t numVolumes = static_cast<uint32_t>(m_volumeDescs->GetWidth() / sizeof(VolumeDesc));
@@ -1296,14 +2284,40 @@ bool MultiRayCaster::initWorkGraph(const XUSG::Device* pDevice)
 	return true;
 }
 
+void MultiRayCaster::renderDeepShadow(XUSG::CommandList* pCommandList, uint8_t frameIndex)
+{
+	// Set barrier
+	XUSG::ResourceBarrier barrier;
+	const auto numBarriers = m_deepShadow->SetBarrier(&barrier, ResourceState::UNORDERED_ACCESS);
+	pCommandList->Barrier(numBarriers, &barrier);
+
+	// Set pipeline state
+	pCommandList->SetComputePipelineLayout(m_pipelineLayouts[DEEP_SHADOW]);
+	pCommandList->SetPipelineState(m_pipelines[DEEP_SHADOW]);
+
+	// Set descriptor tables
+	pCommandList->SetComputeDescriptorTable(0, m_cbvSrvTables[frameIndex]);
+	pCommandList->SetComputeDescriptorTable(1, m_srvTables[SRV_TABLE_VOLUME_DESCS]);
+	pCommandList->SetComputeDescriptorTable(2, m_uavTables[UAV_TABLE_DEEP_SHADOW]);
+	pCommandList->SetComputeDescriptorTable(3, m_srvTables[SRV_TABLE_VOLUME]);
+	pCommandList->SetCompute32BitConstant(4, m_maxLightSamples);
+	pCommandList->SetCompute32BitConstant(5, m_lightGridSize);
+	pCommandList->SetComputeRootShaderResourceView(6, m_macroCells.get());
+
+	// One thread per texel, over all volumes
+	pCommandList->Dispatch(XUSG_DIV_UP(g_deepShadowSize, 8), XUSG_DIV_UP(g_deepShadowSize, 8), 1);
+	m_isDeepShadowDirty = false;
+}
+
 void MultiRayCaster::rayMarchL(XUSG::CommandList* pCommandList, uint8_t frameIndex)
 {
 	// Set barriers
-	static vector<XUSG::ResourceBarrier> barriers(m_lightMaps.size() + 3);
+	static vector<XUSG::ResourceBarrier> barriers(m_lightMaps.size() + 4);
 	auto numBarriers = m_visibleVolumeCounter->SetBarrier(barriers.data(),
 		ResourceState::NON_PIXEL_SHADER_RESOURCE | ResourceState::COPY_SOURCE);
 	numBarriers = m_visibleVolumes->SetBarrier(barriers.data(), ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
 	numBarriers = m_coeffSH->SetBarrier(barriers.data(), ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
+	numBarriers = m_deepShadow->SetBarrier(barriers.data(), ResourceState::NON_PIXEL_SHADER_RESOURCE, numBarriers);
 	for (auto& lightMap : m_lightMaps)
 		numBarriers = lightMap->SetBarrier(barriers.data(), ResourceState::UNORDERED_ACCESS, numBarriers);
 	pCommandList->Barrier(numBarriers, barriers.data());
@@ -1315,33 +2329,50 @@ void MultiRayCaster::rayMarchL(XUSG::CommandList* pCommandList, uint8_t frameInd
 	// Set descriptor tables
 	pCommandList->SetComputeDescriptorTable(0, m_cbvSrvTables[frameIndex]);
 	pCommandList->SetComputeDescriptorTable(1, m_srvTables[SRV_TABLE_VOLUME_DESCS]);
-	pCommandList->SetComputeDescriptorTable(2, m_uavTables[UAV_TABLE_LIGHT_MAP]);
+	pCommandList->SetComputeDescriptorTable(2, m_lightMapUavTables[frameIndex]);
 	pCommandList->SetComputeDescriptorTable(3, m_srvTables[SRV_TABLE_VOLUME]);
 	pCommandList->SetComputeDescriptorTable(4, m_srvTables[SRV_TABLE_SHADOW]);
 	pCommandList->SetCompute32BitConstant(5, m_maxLightSamples);
 	pCommandList->SetCompute32BitConstant(5, m_coeffSH ? 1 : 0, 1);
 	if (m_coeffSH) pCommandList->SetComputeRootShaderResourceView(6, m_coeffSH.get());
-
-	// Dispatch grid
-	pCommandList->Dispatch(XUSG_DIV_UP(m_lightGridSize, 4), XUSG_DIV_UP(m_lightGridSize, 4), XUSG_DIV_UP(m_lightGridSize, 4));
+	pCommandList->SetComputeRootShaderResourceView(7, m_macroCells.get());
+	pCommandList->SetComputeRootShaderResourceView(8, m_lightSchedule.get(),
+		static_cast<int32_t>(sizeof(LightScheduleEntry) * m_volumeWorlds.size() * frameIndex));
+	pCommandList->SetComputeRootShaderResourceView(9, m_lightCandidates.get(),
+		static_cast<int32_t>(sizeof(uint32_t) * g_lightCandidatesPerVolume * m_volumeWorlds.size() * frameIndex));
+	pCommandList->SetComputeDescriptorTable(10, m_srvTables[SRV_TABLE_DEEP_SHADOW]);
+	pCommandList->SetComputeRootShaderResourceView(11, m_lightList.get(),
+		static_cast<int32_t>(sizeof(LightDesc) * MaxLights * frameIndex));
+	pCommandList->SetComputeRootShaderResourceView(12, m_lightIndices.get(),
+		static_cast<int32_t>(sizeof(uint32_t) * g_lightsPerVolume * m_volumeWorlds.size() * frameIndex));
+
+	// Dispatch grid, per light map of the schedule at its size
+	const auto& schedule = m_schedules[frameIndex];
+	for (auto k = 0u; k < schedule.size(); ++k)
+	{
+		const auto numGroups = XUSG_DIV_UP(m_lightMapAllocator.GetSize(schedule[k]), 4);
+		pCommandList->SetCompute32BitConstant(13, k);
+		pCommandList->Dispatch(numGroups, numGroups, numGroups);
+	}
 }
 
 void MultiRayCaster::rayMarchV(XUSG::CommandList* pCommandList, uint8_t frameIndex)
 {
 	// Set barrier
 	static vector<XUSG::ResourceBarrier> barriers(m_lightMaps.size() + m_cubeMaps.size() + m_cubeDepths.size() + 4);
-	auto numBarriers = m_volumeDispatchArg->SetBarrier(barriers.data(), ResourceState::COPY_DEST,
-		0, XUSG_BARRIER_ALL_SUBRESOURCES, BarrierFlag::NONE, ResourceState::COMMON);
-	numBarriers = m_cubeMapVolumeCounter->SetBarrier(barriers.data(), ResourceState::COPY_SOURCE, numBarriers);
+	auto numBarriers = m_volumeDispatchArg->SetBarrier(barriers.data(),
+		ResourceState::INDIRECT_ARGUMENT | ResourceState::COPY_SOURCE);
 	pCommandList->Barrier(numBarriers, barriers.data());
 
-	// Copy counter to dispatch arg.z
-	pCommandList->CopyBufferRegion(m_volumeDispatchArg.get(), sizeof(uint32_t[2]), m_cubeMapVolumeCounter.get(), 0, sizeof(uint32_t));
+	// Read back the dispatch args of the mip bins, for the counts of their thread groups
+	const auto dispatchArgSize = sizeof(VolumeCuller::CubeMapDispatchArg[g_numCubeMips]);
+	pCommandList->CopyBufferRegion(m_dispatchReadBack.get(), dispatchArgSize * frameIndex,
+		m_volumeDispatchArg.get(), 0, dispatchArgSize);
+	m_isDispatchReadBack[frameIndex] = true;
 
 	// Set barrier
-	numBarriers = m_volumeDispatchArg->SetBarrier(barriers.data(), ResourceState::INDIRECT_ARGUMENT);
 	numBarriers = m_volumeAttribs->SetBarrier(barriers.data(), ResourceState::ALL_SHADER_RESOURCE, numBarriers);
-	numBarriers = m_cubeMapVolumes->SetBarrier(barriers.data(), ResourceState::ALL_SHADER_RESOURCE, numBarriers);
+	numBarriers = m_cubeMapFaces->SetBarrier(barriers.data(), ResourceState::ALL_SHADER_RESOURCE, numBarriers);
 	numBarriers = m_pDepths[DEPTH_MAP]->SetBarrier(barriers.data(), ResourceState::ALL_SHADER_RESOURCE, numBarriers);
 	for (auto& lightMap : m_lightMaps)
 		numBarriers = lightMap->SetBarrier(barriers.data(), ResourceState::ALL_SHADER_RESOURCE, numBarriers);
@@ -1357,14 +2388,15 @@ void MultiRayCaster::rayMarchV(XUSG::CommandList* pCommandList, uint8_t frameInd
 
 	// Set descriptor tables
 	pCommandList->SetComputeDescriptorTable(0, m_cbvSrvTables[frameIndex]);
-	pCommandList->SetComputeDescriptorTable(1, m_srvTables[SRV_TABLE_CUBE_VOLUMES]);
+	pCommandList->SetComputeDescriptorTable(1, m_srvTables[SRV_TABLE_CUBE_FACES]);
 	pCommandList->SetComputeDescriptorTable(2, m_uavTables[UAV_TABLE_CUBE_MAP]);
 	pCommandList->SetComputeDescriptorTable(3, m_uavTables[UAV_TABLE_CUBE_DEPTH]);
 	pCommandList->SetComputeDescriptorTable(4, m_srvTables[SRV_TABLE_VOLUME]);
 	pCommandList->SetComputeDescriptorTable(5, m_srvTables[SRV_TABLE_DEPTH]);
+	pCommandList->SetComputeRootShaderResourceView(6, m_macroCells.get());
 
-	// Dispatch cube
-	pCommandList->ExecuteIndirect(m_commandLayouts[DISPATCH_LAYOUT].get(), 1, m_volumeDispatchArg.get());
+	// Dispatch the 8x8 tiles of the cube-map faces of each mip bin
+	pCommandList->ExecuteIndirect(m_commandLayouts[DISPATCH_LAYOUT].get(), g_numCubeMips, m_volumeDispatchArg.get());
 }
 
 void MultiRayCaster::rayMarchWG(Ultimate::CommandList* pCommandList, uint8_t frameIndex)
@@ -1404,10 +2436,12 @@ void MultiRayCaster::rayMarchWG(Ultimate::CommandList* pCommandList, uint8_t fra
 	pCommandList->SetComputeDescriptorTable(2, m_uavTables[UAV_TABLE_CUBE_MAP]);
 	pCommandList->SetComputeDescriptorTable(3, m_uavTables[UAV_TABLE_CUBE_DEPTH]);
 	pCommandList->SetComputeDescriptorTable(4, m_srvTables[SRV_TABLE_VOLUME_DESCS]);
-	pCommandList->SetComputeDescriptorTable(5, m_srvTables[SRV_TABLE_LIGHT_MAP]);
+	pCommandList->SetComputeDescriptorTable(5, m_lightMapSrvTables[frameIndex]);
 	pCommandList->SetComputeDescriptorTable(6, m_srvTables[SRV_TABLE_VOLUME]);
 	pCommandList->SetComputeDescriptorTable(7, m_srvTables[SRV_TABLE_DEPTH]);
 	pCommandList->SetCompute32BitConstant(8, m_maxRaySamples);
+	pCommandList->SetComputeRootShaderResourceView(9, m_macroCells.get());
+	pCommandList->SetComputeDescriptorTable(10, m_srvTables[SRV_TABLE_HI_Z]);
 
 	// Set pipeline state
 	assert(m_rayMarchGraph.BackingMemory->GetWidth() >= m_rayMarchGraph.MemRequirments.MaxByteSize);
@@ -1568,11 +2602,12 @@ void MultiRayCaster::renderCube(XUSG::CommandList* pCommandList, uint8_t frameIn
 	pCommandList->SetGraphicsDescriptorTable(1, m_srvTables[SRV_TABLE_VIS_VOLUMES]);
 	pCommandList->SetGraphicsDescriptorTable(2, m_uavTables[UAV_TABLE_K_COLORS]);
 	pCommandList->SetGraphicsDescriptorTable(3, m_srvTables[SRV_TABLE_K_DEPTHS]);
-	pCommandList->SetGraphicsDescriptorTable(4, m_srvTables[SRV_TABLE_LIGHT_MAP]);
+	pCommandList->SetGraphicsDescriptorTable(4, m_lightMapSrvTables[frameIndex]);
 	pCommandList->SetGraphicsDescriptorTable(5, m_srvTables[SRV_TABLE_VOLUME]);
 	pCommandList->SetGraphicsDescriptorTable(6, m_srvTables[SRV_TABLE_DEPTH]);
 	pCommandList->SetGraphicsDescriptorTable(7, m_srvTables[SRV_TABLE_CUBE_MAP]);
 	pCommandList->SetGraphicsDescriptorTable(8, m_srvTables[SRV_TABLE_CUBE_DEPTH]);
+	pCommandList->SetGraphicsRootShaderResourceView(9, m_macroCells.get());
 
 	pCommandList->IASetPrimitiveTopology(PrimitiveTopology::TRIANGLELIST);
 	pCommandList->IASetIndexBuffer(m_indexBuffer->GetIBV());
@@ -1606,6 +2641,7 @@ void MultiRayCaster::renderCubeRT(XUSG::CommandList* pCommandList, uint8_t frame
 	pCommandList->SetGraphicsDescriptorTable(5, m_srvTables[SRV_TABLE_DEPTH]);
 	pCommandList->SetGraphicsDescriptorTable(6, m_srvTables[SRV_TABLE_CUBE_MAP]);
 	pCommandList->SetGraphicsDescriptorTable(7, m_srvTables[SRV_TABLE_CUBE_DEPTH]);
+	pCommandList->SetGraphicsRootShaderResourceView(8, m_macroCells.get());
 
 	pCommandList->IASetPrimitiveTopology(PrimitiveTopology::TRIANGLELIST);
 	pCommandList->IASetIndexBuffer(m_indexBuffer->GetIBV());
@@ -1653,6 +2689,7 @@ void MultiRayCaster::traceCube(RayTracing::CommandList* pCommandList, uint8_t fr
 	pCommandList->SetComputeDescriptorTable(5, m_srvTables[SRV_TABLE_DEPTH]);
 	pCommandList->SetComputeDescriptorTable(6, m_srvTables[SRV_TABLE_CUBE_MAP]);
 	pCommandList->SetComputeDescriptorTable(7, m_srvTables[SRV_TABLE_CUBE_DEPTH]);
+	pCommandList->SetComputeRootShaderResourceView(8, m_macroCells.get());
 
 	pCommandList->SetRayTracingPipeline(m_pipelines[RAY_TRACING]);
 	pCommandList->DispatchRays(m_viewport.x, m_viewport.y, 1, m_rayGenShaderTable.get(), m_hitGroupShaderTable.get(), m_missShaderTable.get());
@@ -6,6 +6,15 @@
 
 #include "Core/XUSG.h"
 #include "RayTracing/XUSGRayTracing.h"
+#include "VolumeBVH.h"
+#include "VolumeCuller.h"
+#include "VolumeLoader.h"
+#include "SampleBudget.h"
+#include "LightMapScheduler.h"
+#include "LightMapAllocator.h"
+#include "LightClusterer.h"
+#include "CostModel.h"
+#include "DeepShadowMap.h"
 
 class MultiRayCaster
 {
@@ -31,9 +40,14 @@ public:
 	bool Init(XUSG::RayTracing::CommandList* pCommandList, const XUSG::DescriptorTableLib::sptr& descriptorTableLib,
 		XUSG::Format rtFormat, XUSG::Format dsFormat, uint32_t gridSize, uint32_t lightGridSize, uint32_t numVolumes,
 		uint32_t numVolumeSrcs, std::vector<XUSG::Resource::uptr>& uploaders, XUSG::RayTracing::GeometryBuffer* pGeometry,
-		uint8_t rtSupport, bool workGraphSupport);
+		uint8_t rtSupport, bool workGraphSupport, const DirectX::XMFLOAT3X4* pVolumeWorlds = nullptr);
 	bool LoadVolumeData(XUSG::CommandList* pCommandList, uint32_t i,
 		const wchar_t* fileName, std::vector<XUSG::Resource::uptr>& uploaders);
+	bool UploadVolumeData(XUSG::CommandList* pCommandList, const LoadedVolume& volume,
+		std::vector<XUSG::Resource::uptr>& uploaders, XUSG::ResourceState dstState);
+	bool ExpandVolumeData(XUSG::CommandList* pCommandList, uint32_t i, std::vector<XUSG::Resource::uptr>& uploaders);
+	bool SetVolumeTexIds(XUSG::CommandList* pCommandList, const uint32_t* volTexIds,
+		std::vector<XUSG::Resource::uptr>& uploaders);
 	bool SetRenderTargets(const XUSG::Device* pDevice, const XUSG::RenderTarget* pColorOut, const XUSG::DepthStencil::uptr* depths);
 	bool SetViewport(const XUSG::Device* pDevice, uint32_t width, uint32_t height, const XUSG::Texture* pColorOut);
 
@@ -42,21 +56,51 @@ public:
 	void SetMaxSamples(uint32_t maxRaySamples, uint32_t maxLightSamples);
 	void SetVolumesWorld(float size, const DirectX::XMFLOAT3& center);
 	void SetVolumeWorld(uint32_t i, float size, const DirectX::XMFLOAT3& pos);
+	void SetVolumeWorld(uint32_t i, float size, const DirectX::XMFLOAT3& pos, const DirectX::XMFLOAT4& rotation);
+	void SetVolumeSampleScale(uint32_t i, float scale);
+	void SetVolumePriority(uint32_t i, float priority);	// Weight of the instance in the sample budget
+	void SetSampleBudget(uint64_t maxSamples);	// Ray samples per frame over the visible volumes; 0 for none
+	void SetPathCosts(const CostModel::Weights& weights);	// Pick the cube-map or the direct path per volume
+	void SetLightMapUpdates(uint32_t numUpdates);	// Light maps refreshed per frame, by the scheduler
 	void SetLight(const DirectX::XMFLOAT3& pos, const DirectX::XMFLOAT3& color, float intensity);
+	void SetLights(const LightClusterer::Light* pLights, uint32_t numLights);	// Besides SetLight(), up to MaxLights, self-shadowed only
 	void SetAmbient(const DirectX::XMFLOAT3& color, float intensity);
 	void UpdateFrame(uint8_t frameIndex, DirectX::CXMMATRIX viewProj,
 		const DirectX::XMFLOAT4X4& shadowVP, const DirectX::XMFLOAT3& eyePt);
 	void Render(XUSG::RayTracing::CommandList* pCommandList, uint8_t frameIndex,
 		XUSG::RenderTarget* pColorOut, OITMethod oitMethod = OIT_K_BUFFER, bool useWorkGraph = false);
 
+	float GetMacroCellMargin() const;
+	uint32_t GetGridSize() const;
+	float GetGridDensityScale() const;
+	uint32_t GetNumVolumes() const;
+	float GetVolumeCoverage(uint32_t i) const;	// Projected pixels of the last UpdateFrame(), 0 when out of view
+	const VolumeBVH& GetVolumeBVH() const;		// Over the worlds of the last UpdateFrame()
+	const VolumeCuller& GetVolumeCuller() const;	// Culled in the last UpdateFrame(), with its reuse counts
+	const SampleBudget& GetSampleBudget() const;	// Allocated in the last UpdateFrame()
+	const CostModel::Work& GetPathWork() const;		// Of the last UpdateFrame(), as the CPU culling sees it
+	const LightMapScheduler& GetLightMapScheduler() const;	// Scheduled in the last UpdateFrame()
+	const LightMapAllocator& GetLightMapAllocator() const;	// Light-map sizes of the last UpdateFrame()
+	uint64_t GetNumLightCandidates() const;	// Volumes per light-map voxel for AO, over the last schedule
+	const LightClusterer& GetLightClusterer() const;	// Clustered in the last UpdateFrame()
+	uint64_t GetNumScheduledLights() const;	// Lights per light-map voxel of SetLights(), over the last schedule
+	const VolumeCuller::CubeMapGroupCounts& GetCubeMapGroupCounts() const;	// Read back from the GPU culling of an earlier frame
+
+	static uint64_t GetVolumeByteSize(uint32_t gridSize);	// Of an expanded grid with its mips
+	static DirectX::XMFLOAT3X4 GetVolumeWorld(float size, const DirectX::XMFLOAT3& pos, const DirectX::XMFLOAT4& rotation);
+
 	static const uint8_t FrameCount = 3;
+	static const uint32_t MaxLights = 256;
 
 protected:
 	enum PipelineIndex : uint8_t
 	{
 		LOAD_VOLUME_DATA,
+		LOAD_VOLUME_BRICKS,
 		INIT_VOLUME_DATA,
+		BUILD_HI_Z,
 		VOLUME_CULL,
+		DEEP_SHADOW,
 		RAY_MARCH_L,
 		RAY_MARCH_V,
 		RAY_MARCH_WG,
@@ -81,15 +125,15 @@ protected:
 
 	enum SrvTable : uint8_t
 	{
-		SRV_TABLE_FILE_SRC,
 		SRV_TABLE_VOLUME_DESCS,
 		SRV_TABLE_VOLUME,
 		SRV_TABLE_VIS_VOLUMES,
 		SRV_TABLE_VOLUME_ATTRIBS,
-		SRV_TABLE_CUBE_VOLUMES,
-		SRV_TABLE_LIGHT_MAP,
+		SRV_TABLE_CUBE_FACES,
 		SRV_TABLE_DEPTH,
+		SRV_TABLE_HI_Z,
 		SRV_TABLE_SHADOW,
+		SRV_TABLE_DEEP_SHADOW,
 		SRV_TABLE_CUBE_MAP,
 		SRV_TABLE_CUBE_DEPTH,
 		SRV_TABLE_K_COLORS,
@@ -103,7 +147,7 @@ protected:
 		UAV_TABLE_CULL,
 		UAV_TABLE_CUBE_MAP,
 		UAV_TABLE_CUBE_DEPTH,
-		UAV_TABLE_LIGHT_MAP,
+		UAV_TABLE_DEEP_SHADOW,
 		UAV_TABLE_K_COLORS,
 		UAV_TABLE_K_DEPTHS,
 		UAV_TABLE_OUT,
@@ -129,6 +173,19 @@ protected:
 		XUSG::WorkGraph::MemoryRequirements MemRequirments;
 	};
 
+	bool uploadFileSrc(XUSG::CommandList* pCommandList, uint32_t i, const DDSVolume::Info& info, const void* pVoxels,
+		std::vector<XUSG::Resource::uptr>& uploaders, XUSG::ResourceState dstState);
+	bool uploadBricks(XUSG::CommandList* pCommandList, uint32_t i, const BrickedVolume& volume,
+		std::vector<XUSG::Resource::uptr>& uploaders, XUSG::ResourceState dstState);
+	bool uploadCompressed(XUSG::CommandList* pCommandList, uint32_t i, const CompressedVolume& volume,
+		std::vector<XUSG::Resource::uptr>& uploaders, XUSG::ResourceState dstState);
+	void setFileSrc(uint32_t i, const XUSG::Texture::sptr& fileSrc, const DirectX::XMFLOAT4& scales);
+	void retireSrcs(uint32_t i);
+	void setMacroCells(uint32_t i, const MacroCellGrid* pMacroCells);
+	void setVolumeMips(uint32_t i, const VolumeMipChain* pMips);
+	bool createLightMap(const XUSG::Device* pDevice, uint32_t map);
+	bool createLightMapTables(uint8_t frameIndex);
+	bool resizeLightMaps(XUSG::CommandList* pCommandList, uint8_t frameIndex);
 	bool createCubeVB(XUSG::CommandList* pCommandList, std::vector<XUSG::Resource::uptr>& uploaders);
 	bool createCubeIB(XUSG::CommandList* pCommandList, std::vector<XUSG::Resource::uptr>& uploaders);
 	bool createVolumeInfoBuffers(XUSG::CommandList* pCommandList, uint32_t numVolumes,
@@ -142,7 +199,9 @@ protected:
 	bool buildShaderTables(const XUSG::RayTracing::Device* pDevice);
 	bool initWorkGraph(const XUSG::Device* pDevice);
 
+	void buildHiZ(XUSG::CommandList* pCommandList);
 	void cullVolumes(XUSG::CommandList* pCommandList, uint8_t frameIndex);
+	void renderDeepShadow(XUSG::CommandList* pCommandList, uint8_t frameIndex);
 	void rayMarchL(XUSG::CommandList* pCommandList, uint8_t frameIndex);
 	void rayMarchV(XUSG::CommandList* pCommandList, uint8_t frameIndex);
 	void rayMarchWG(XUSG::Ultimate::CommandList* pCommandList, uint8_t frameIndex);
@@ -181,28 +240,50 @@ protected:
 	XUSG::CommandLayout::uptr m_commandLayouts[NUM_COMMAND_LAYOUT];
 
 	std::vector<XUSG::DescriptorTable> m_uavInitTables;
+	std::vector<XUSG::DescriptorTable> m_hiZTables;	// Source SRV and destination UAV, per Hi-Z level
 	XUSG::DescriptorTable	m_cbvTables[FrameCount];
 	XUSG::DescriptorTable	m_cbvSrvTables[FrameCount];
 	XUSG::DescriptorTable	m_uavTables[NUM_UAV_TABLE];
 	XUSG::DescriptorTable	m_srvTables[NUM_SRV_TABLE];
+	XUSG::DescriptorTable	m_lightMapUavTables[FrameCount];	// Rewritten in place once the light maps change
+	XUSG::DescriptorTable	m_lightMapSrvTables[FrameCount];	// Likewise
+	std::vector<XUSG::DescriptorTable> m_fileSrcTables;		// FrameCount versions per source slot
+	std::vector<XUSG::DescriptorTable> m_brickSrcTables;	// Likewise
+	std::vector<uint8_t>	m_srcTableVersions;
 
 	std::vector<XUSG::Texture::sptr>	m_fileSrcs;
+	std::vector<DirectX::XMFLOAT4>		m_fileSrcScales;	// xyz: UVW scale, w: density scale
+	std::vector<XUSG::StructuredBuffer::uptr> m_brickTables;
+	std::vector<XUSG::TypedBuffer::uptr> m_brickPools;
+	std::vector<BrickedVolume::Header> m_brickHeaders;
+	std::vector<XUSG::Resource::sptr>	m_retiredSrcs[FrameCount];	// Replaced sources, until the GPU is done with them
 	std::vector<XUSG::Texture3D::uptr>	m_volumes;
 	std::vector<XUSG::Texture2D::uptr>	m_cubeMaps;
 	std::vector<XUSG::Texture2D::uptr>	m_cubeDepths;
-	std::vector<XUSG::Texture3D::uptr>	m_lightMaps;
+	std::vector<XUSG::Texture3D::sptr>	m_lightMaps;		// Per volume, from the pool
+	std::vector<XUSG::Texture3D::sptr>	m_lightMapPool;		// By map of the allocator
 	XUSG::Texture::uptr		m_kDepths;
 	XUSG::Texture::uptr		m_kColors;
+	XUSG::Texture::uptr		m_hiZ;		// Farthest depth of the depth map, from half its size down to 1x1
+	XUSG::Texture::uptr		m_deepShadow;	// Transmittance knots of the shadow view, 4 per slice
 	XUSG::ConstantBuffer::uptr m_cbPerFrame;
 	XUSG::StructuredBuffer::uptr m_perObject;
+	XUSG::StructuredBuffer::uptr m_lightSchedule;	// Per frame slot
+	XUSG::StructuredBuffer::uptr m_lightCandidates;	// Per frame slot
+	XUSG::StructuredBuffer::uptr m_lightList;		// Per frame slot
+	XUSG::StructuredBuffer::uptr m_lightIndices;	// Per frame slot
 	XUSG::StructuredBuffer::uptr m_volumeDescs;
+	XUSG::StructuredBuffer::uptr m_macroCells;
+	std::vector<std::vector<float>> m_pendingMacroCells;	// Uploaded along with the grid expansion
+	std::vector<std::vector<uint16_t>> m_pendingMips;		// RGBA16F levels 1 and below, likewise
 	XUSG::StructuredBuffer::uptr m_visibleVolumes;
-	XUSG::StructuredBuffer::uptr m_cubeMapVolumes;
+	XUSG::StructuredBuffer::uptr m_cubeMapFaces;
 	XUSG::StructuredBuffer::uptr m_counterReset;
 	XUSG::StructuredBuffer::sptr m_visibleVolumeCounter;
-	XUSG::StructuredBuffer::sptr m_cubeMapVolumeCounter;
 	XUSG::TypedBuffer::uptr m_volumeAttribs;
-	XUSG::Buffer::uptr	m_volumeDispatchArg;
+	XUSG::Buffer::uptr	m_volumeDispatchArg;	// Per mip bin
+	XUSG::Buffer::uptr	m_volumeDispatchReset;
+	XUSG::Buffer::uptr	m_dispatchReadBack;		// Per frame slot
 	XUSG::Buffer::uptr	m_volumeDrawArg;
 
 	const XUSG::DepthStencil::uptr* m_pDepths;
@@ -221,7 +302,39 @@ protected:
 	DirectX::XMFLOAT3		m_lightPt;
 	DirectX::XMFLOAT4		m_lightColor;
 	DirectX::XMFLOAT4		m_ambient;
+	std::vector<LightClusterer::Light> m_lights;
 	std::vector<DirectX::XMFLOAT3X4> m_volumeWorlds;
+	VolumeBVH m_bvh;
+	VolumeCuller m_culler;
+	std::vector<uint32_t> m_cullCandidates;
+	float m_bvhBuildCost;
+	bool m_volumeWorldsChanged;
+	bool m_isDeepShadowDirty;	// The light, the shadow view, the volumes or their sources changed since the deep shadow map
+	DirectX::XMFLOAT4X4 m_shadowViewProj;
+	std::vector<float> m_volumeSampleScales;
+	std::vector<uint8_t> m_volumeDirtyBits;	// A bit per frame slot holding a stale PerObject, then one for the culler
+	DirectX::XMFLOAT4X4 m_slotViewProjs[FrameCount];	// That the PerObject of each frame slot was written with
+	DirectX::XMFLOAT4X4 m_cullViewProj;
+	SampleBudget m_budget;
+	std::vector<SampleBudget::Volume> m_budgetVolumes;
+	std::vector<float> m_volumePriorities;
+	uint64_t m_sampleBudget;
+	LightMapScheduler m_lightMapScheduler;
+	std::vector<LightMapScheduler::Volume> m_scheduleVolumes;
+	uint32_t m_numLightMapUpdates;
+	std::vector<uint32_t> m_schedules[FrameCount];	// Volumes of the light maps of the schedule in each frame slot
+	LightMapAllocator m_lightMapAllocator;
+	uint32_t m_lightMapFrame;				// Allocator update that the pool has taken
+	uint8_t m_lightMapTableDirtyBits;		// A bit per frame slot with stale light-map tables
+	std::vector<uint32_t> m_candidateList;
+	uint64_t m_numLightCandidates;			// Volumes the AO rays of a light-map voxel pass, summed over the schedule
+	LightClusterer m_lightClusterer;
+	std::vector<LightClusterer::Volume> m_clusterVolumes;
+	uint64_t m_numScheduledLights;			// Lights of a light-map voxel, summed over the schedule
+	CostModel::Weights m_pathCosts;
+	CostModel::Work m_pathWork;
+	VolumeCuller::CubeMapGroupCounts m_cubeMapGroups;
+	bool m_isDispatchReadBack[FrameCount];
 
 	DirectX::XMUINT2		m_viewport;
 
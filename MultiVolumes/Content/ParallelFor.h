@@ -0,0 +1,41 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// Runs func(i) for i in [0, count) on a transient pool of threads. Items are claimed
+// one at a time through a shared atomic cursor, so uneven items balance themselves.
+// numThreads = 0 uses every hardware thread; the calling thread also takes work.
+//--------------------------------------------------------------------------------------
+template<typename Func>
+void ParallelFor(uint32_t count, const Func& func, uint32_t numThreads = 0)
+{
+	if (numThreads == 0) numThreads = (std::max)(std::thread::hardware_concurrency(), 1u);
+	numThreads = (std::min)(numThreads, count);
+
+	std::atomic<uint32_t> next(0);
+	const auto worker = [&]()
+	{
+		for (auto i = next.fetch_add(1, std::memory_order_relaxed); i < count;
+			i = next.fetch_add(1, std::memory_order_relaxed))
+			func(i);
+	};
+
+	std::vector<std::thread> threads;
+	if (numThreads > 1)
+	{
+		threads.reserve(numThreads - 1);
+		for (auto i = 1u; i < numThreads; ++i) threads.emplace_back(worker);
+	}
+
+	worker();
+	for (auto& thread : threads) thread.join();
+}
@@ -0,0 +1,408 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "ProceduralVolume.h"
+#include "ParallelFor.h"
+
+using namespace std;
+
+static const uint32_t g_maxOctaves = 16;
+static const uint32_t g_maxCutoffSamples = 1 << 18;
+static const size_t g_slabByteSize = 64 << 20;
+
+static const char* const g_shapeNames[] = { "sphere", "cloud", "shell", "noise" };
+
+static inline uint32_t hashU32(uint32_t h)
+{
+	h ^= h >> 16;
+	h *= 0x7feb352d;
+	h ^= h >> 15;
+	h *= 0x846ca68b;
+	h ^= h >> 16;
+
+	return h;
+}
+
+static inline uint32_t hashLattice(int32_t x, int32_t y, int32_t z, uint32_t seed)
+{
+	return hashU32(static_cast<uint32_t>(x) * 0x8da6b343 + static_cast<uint32_t>(y) * 0xd8163841 +
+		static_cast<uint32_t>(z) * 0xcb1ab31f + seed);
+}
+
+static inline float fade(float t)
+{
+	return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+// The 12 edge directions of a cube, padded to 16 as improved Perlin noise picks them
+static const float g_gradients[16][3] =
+{
+	{ 1.0f, 1.0f, 0.0f }, { -1.0f, 1.0f, 0.0f }, { 1.0f, -1.0f, 0.0f }, { -1.0f, -1.0f, 0.0f },
+	{ 1.0f, 0.0f, 1.0f }, { -1.0f, 0.0f, 1.0f }, { 1.0f, 0.0f, -1.0f }, { -1.0f, 0.0f, -1.0f },
+	{ 0.0f, 1.0f, 1.0f }, { 0.0f, -1.0f, 1.0f }, { 0.0f, 1.0f, -1.0f }, { 0.0f, -1.0f, -1.0f },
+	{ 1.0f, 1.0f, 0.0f }, { 0.0f, -1.0f, 1.0f }, { -1.0f, 1.0f, 0.0f }, { 0.0f, -1.0f, -1.0f }
+};
+
+// Hashes of the 4 corners of lattice cell (x, y, z) on its face at x, y fastest
+static inline void hashFace(int32_t x, int32_t y, int32_t z, uint32_t seed, uint32_t hashes[4])
+{
+	for (auto i = 0u; i < 4; ++i) hashes[i] = hashLattice(x, y + (i & 1), z + (i >> 1), seed);
+}
+
+// Gradient noise along x through a lattice cell, at fixed fractional (fy, fz):
+// A + B * fx + fade(fx) * (C + D * fx), from the corner hashes of its faces at x and x + 1
+struct CellLine
+{
+	float A, B, C, D;
+
+	void Init(const uint32_t hashes0[4], const uint32_t hashes1[4], float fy, float fz)
+	{
+		const auto v = fade(fy), w = fade(fz);
+		A = B = C = D = 0.0f;
+		for (auto i = 0u; i < 4; ++i)
+		{
+			const auto dy = fy - (i & 1), dz = fz - (i >> 1);
+			const auto weight = ((i & 1) ? v : 1.0f - v) * ((i >> 1) ? w : 1.0f - w);
+			const auto& g0 = g_gradients[hashes0[i] & 15];
+			const auto& g1 = g_gradients[hashes1[i] & 15];
+			const auto k0 = g0[1] * dy + g0[2] * dz, k1 = g1[1] * dy + g1[2] * dz;
+
+			A += weight * k0;
+			B += weight * g0[0];
+			C += weight * (k1 - g1[0] - k0);
+			D += weight * (g1[0] - g0[0]);
+		}
+	}
+
+	float Eval(float fx) const
+	{
+		return A + B * fx + fade(fx) * (C + D * fx);
+	}
+};
+
+static inline float toUnit(uint32_t i, uint32_t size)
+{
+	return (i + 0.5f) / size;
+}
+
+// Squared distance of the voxel from the center, in half extents
+static inline float getRadiusSq(const ProceduralVolume::Desc& desc, uint32_t x, uint32_t y, uint32_t z)
+{
+	const auto px = toUnit(x, desc.Width) * 2.0f - 1.0f;
+	const auto py = toUnit(y, desc.Height) * 2.0f - 1.0f;
+	const auto pz = toUnit(z, desc.Depth) * 2.0f - 1.0f;
+
+	return px * px + py * py + pz * pz;
+}
+
+// Sum of the octave amplitudes, for normalizing fBm
+static float getAmplitudeSum(const ProceduralVolume::Desc& desc)
+{
+	auto sum = 0.0f, amplitude = 1.0f;
+	for (auto o = 0u; o < desc.Octaves; ++o, amplitude *= desc.Gain) sum += amplitude;
+
+	return sum;
+}
+
+// fBm in [0, 1] along row (y, z) of the volume: each octave sets up its noise line once per
+// lattice cell that the row crosses, which the low octaves do only a few times per row
+static void fbmRow(const ProceduralVolume::Desc& desc, uint32_t y, uint32_t z, float* pRow)
+{
+	const auto v = toUnit(y, desc.Height), w = toUnit(z, desc.Depth);
+	fill(pRow, pRow + desc.Width, 0.0f);
+
+	auto frequency = desc.Frequency, amplitude = 1.0f;
+	for (auto o = 0u; o < desc.Octaves; ++o, frequency *= desc.Lacunarity, amplitude *= desc.Gain)
+	{
+		const auto seed = hashU32(desc.Seed * 0x9e3779b9 + o);
+		const auto qy = v * frequency, qz = w * frequency;
+		const auto iy = static_cast<int32_t>(floorf(qy)), iz = static_cast<int32_t>(floorf(qz));
+		const auto fy = qy - iy, fz = qz - iz;
+
+		// The face at x + 1 of a cell is the face at x of the next
+		uint32_t hashes0[4], hashes1[4];
+		CellLine line = {};
+		auto cellX = INT32_MIN;
+		for (auto x = 0u; x < desc.Width; ++x)
+		{
+			const auto qx = toUnit(x, desc.Width) * frequency;
+			const auto ix = static_cast<int32_t>(floorf(qx));
+			if (ix != cellX)
+			{
+				if (ix == cellX + 1) copy(hashes1, hashes1 + 4, hashes0);
+				else hashFace(ix, iy, iz, seed, hashes0);
+				hashFace(ix + 1, iy, iz, seed, hashes1);
+				line.Init(hashes0, hashes1, fy, fz);
+				cellX = ix;
+			}
+
+			pRow[x] += amplitude * line.Eval(qx - ix);
+		}
+	}
+
+	const auto scale = 0.5f / getAmplitudeSum(desc);
+	for (auto x = 0u; x < desc.Width; ++x) pRow[x] = (min)((max)(pRow[x] * scale + 0.5f, 0.0f), 1.0f);
+}
+
+// The same as an element of fbmRow()
+static float fbm(const ProceduralVolume::Desc& desc, uint32_t x, uint32_t y, uint32_t z)
+{
+	const auto u = toUnit(x, desc.Width), v = toUnit(y, desc.Height), w = toUnit(z, desc.Depth);
+
+	auto sum = 0.0f, frequency = desc.Frequency, amplitude = 1.0f;
+	for (auto o = 0u; o < desc.Octaves; ++o, frequency *= desc.Lacunarity, amplitude *= desc.Gain)
+	{
+		const auto seed = hashU32(desc.Seed * 0x9e3779b9 + o);
+		const auto qx = u * frequency, qy = v * frequency, qz = w * frequency;
+		const auto ix = static_cast<int32_t>(floorf(qx));
+		const auto iy = static_cast<int32_t>(floorf(qy));
+		const auto iz = static_cast<int32_t>(floorf(qz));
+
+		uint32_t hashes0[4], hashes1[4];
+		hashFace(ix, iy, iz, seed, hashes0);
+		hashFace(ix + 1, iy, iz, seed, hashes1);
+
+		CellLine line;
+		line.Init(hashes0, hashes1, qy - iy, qz - iz);
+		sum += amplitude * line.Eval(qx - ix);
+	}
+
+	return (min)((max)(sum * (0.5f / getAmplitudeSum(desc)) + 0.5f, 0.0f), 1.0f);
+}
+
+ProceduralVolume::ProceduralVolume() :
+	m_desc(),
+	m_cutoff(0.0f),
+	m_fieldScale(1.0f)
+{
+}
+
+ProceduralVolume::~ProceduralVolume()
+{
+}
+
+bool ProceduralVolume::Init(const Desc& desc, uint32_t numThreads)
+{
+	if (desc.VolumeShape > SHAPE_NOISE || desc.Width == 0 || desc.Height == 0 || desc.Depth == 0) return false;
+	if (desc.Octaves == 0 || desc.Octaves > g_maxOctaves || !(desc.Frequency > 0.0f)) return false;
+	if (!(desc.EmptyFraction >= 0.0f && desc.EmptyFraction <= 1.0f) || !(desc.Thickness > 0.0f)) return false;
+
+	m_desc = desc;
+	m_cutoff = 0.0f;
+	m_fieldScale = 1.0f;
+	if (desc.VolumeShape != SHAPE_CLOUD && desc.VolumeShape != SHAPE_NOISE) return true;
+
+	// Estimate the quantile of the field at EmptyFraction from a lattice of samples that
+	// depends on the size only, so every run and slab sees the same cut-off
+	const auto numVoxels = static_cast<double>(desc.Width) * desc.Height * desc.Depth;
+	const auto stride = (max)(static_cast<uint32_t>(ceil(cbrt(numVoxels / g_maxCutoffSamples))), 1u);
+	const auto numX = (desc.Width + stride - 1) / stride;
+	const auto numY = (desc.Height + stride - 1) / stride;
+	const auto numZ = (desc.Depth + stride - 1) / stride;
+
+	vector<float> samples(static_cast<size_t>(numX) * numY * numZ);
+	ParallelFor(numZ, [&](uint32_t k)
+	{
+		const auto z = (min)(k * stride + stride / 2, desc.Depth - 1);
+		for (auto j = 0u; j < numY; ++j)
+		{
+			const auto y = (min)(j * stride + stride / 2, desc.Height - 1);
+			for (auto i = 0u; i < numX; ++i)
+			{
+				const auto x = (min)(i * stride + stride / 2, desc.Width - 1);
+				const auto field = getField(fbm(desc, x, y, z), getRadiusSq(desc, x, y, z));
+				samples[(static_cast<size_t>(k) * numY + j) * numX + i] = field;
+			}
+		}
+	}, numThreads);
+
+	const auto maxField = *max_element(samples.cbegin(), samples.cend());
+	const auto numEmpty = static_cast<size_t>(desc.EmptyFraction * samples.size() + 0.5);
+	if (numEmpty > 0)
+	{
+		nth_element(samples.begin(), samples.begin() + (numEmpty - 1), samples.end());
+		m_cutoff = samples[numEmpty - 1];
+	}
+
+	m_fieldScale = maxField > m_cutoff ? 1.0f / (maxField - m_cutoff) : 0.0f;
+
+	return true;
+}
+
+void ProceduralVolume::GenerateSlices(uint32_t firstSlice, uint32_t numSlices, float* pVoxels, uint32_t numThreads) const
+{
+	const auto& desc = m_desc;
+	ParallelFor(numSlices * desc.Height, [&](uint32_t i)
+	{
+		const auto y = i % desc.Height, z = firstSlice + i / desc.Height;
+		const auto pRow = pVoxels + static_cast<size_t>(i) * desc.Width;
+
+		if (desc.VolumeShape == SHAPE_SPHERE) fill(pRow, pRow + desc.Width, 0.0f);
+		else fbmRow(desc, y, z, pRow);
+
+		for (auto x = 0u; x < desc.Width; ++x)
+			pRow[x] = getDensity(getField(pRow[x], getRadiusSq(desc, x, y, z)));
+	}, numThreads);
+}
+
+void ProceduralVolume::Generate(VolumeGrid& grid, uint32_t numThreads) const
+{
+	grid.Resize(m_desc.Width, m_desc.Height, m_desc.Depth);
+	GenerateSlices(0, m_desc.Depth, grid.Voxels.data(), numThreads);
+}
+
+bool ProceduralVolume::WriteDDS(const char* fileName, DDSVolume::Format format, uint32_t numThreads) const
+{
+	if (format != DDSVolume::FORMAT_R32_FLOAT && format != DDSVolume::FORMAT_R16_FLOAT) return false;
+
+	ofstream file(fileName, ios::binary);
+	if (!file.is_open() || !DDSVolume::WriteHeader(file, m_desc.Width, m_desc.Height, m_desc.Depth, format))
+		return false;
+
+	const auto sliceVoxels = static_cast<size_t>(m_desc.Width) * m_desc.Height;
+	const auto slabSlices = static_cast<uint32_t>((min<size_t>)((max<size_t>)(
+		g_slabByteSize / (sizeof(float) * sliceVoxels), 1), m_desc.Depth));
+	vector<float> slab(sliceVoxels * slabSlices);
+	vector<uint16_t> halves(format == DDSVolume::FORMAT_R16_FLOAT ? slab.size() : 0);
+
+	for (auto z = 0u; z < m_desc.Depth && file.good(); z += slabSlices)
+	{
+		const auto numSlices = (min)(slabSlices, m_desc.Depth - z);
+		const auto numVoxels = sliceVoxels * numSlices;
+		GenerateSlices(z, numSlices, slab.data(), numThreads);
+
+		if (halves.empty()) file.write(reinterpret_cast<const char*>(slab.data()), sizeof(float) * numVoxels);
+		else
+		{
+			for (size_t i = 0; i < numVoxels; ++i) halves[i] = FloatToHalf(slab[i]);
+			file.write(reinterpret_cast<const char*>(halves.data()), sizeof(uint16_t) * numVoxels);
+		}
+	}
+
+	return file.good();
+}
+
+const ProceduralVolume::Desc& ProceduralVolume::GetDesc() const
+{
+	return m_desc;
+}
+
+float ProceduralVolume::GetCutoff() const
+{
+	return m_cutoff;
+}
+
+bool ProceduralVolume::ReadDesc(istream& stream, Desc& desc)
+{
+	string line;
+	while (getline(stream, line))
+	{
+		istringstream lineStream(line);
+		string key;
+		if (!(lineStream >> key) || key[0] == '#') continue;
+
+		if (key == "shape")
+		{
+			string name;
+			if (!(lineStream >> name) || !ParseShape(name.c_str(), desc.VolumeShape)) return false;
+		}
+		else if (key == "size")
+		{
+			if (!(lineStream >> desc.Width)) return false;
+			if (!(lineStream >> desc.Height >> desc.Depth))
+			{
+				desc.Height = desc.Depth = desc.Width;
+				lineStream.clear();
+			}
+		}
+		else if (key == "seed") lineStream >> desc.Seed;
+		else if (key == "octaves") lineStream >> desc.Octaves;
+		else if (key == "frequency") lineStream >> desc.Frequency;
+		else if (key == "lacunarity") lineStream >> desc.Lacunarity;
+		else if (key == "gain") lineStream >> desc.Gain;
+		else if (key == "empty") lineStream >> desc.EmptyFraction;
+		else if (key == "radius") lineStream >> desc.Radius;
+		else if (key == "thickness") lineStream >> desc.Thickness;
+		else if (key == "density") lineStream >> desc.Density;
+		else return false;
+
+		if (lineStream.fail()) return false;
+	}
+
+	return true;
+}
+
+bool ProceduralVolume::WriteDesc(ostream& stream, const Desc& desc)
+{
+	stream << "shape " << GetShapeName(desc.VolumeShape) << "\n";
+	stream << "size " << desc.Width << " " << desc.Height << " " << desc.Depth << "\n";
+	stream << "seed " << desc.Seed << "\n";
+	stream << "octaves " << desc.Octaves << "\n";
+	stream << "frequency " << desc.Frequency << "\n";
+	stream << "lacunarity " << desc.Lacunarity << "\n";
+	stream << "gain " << desc.Gain << "\n";
+	stream << "empty " << desc.EmptyFraction << "\n";
+	stream << "radius " << desc.Radius << "\n";
+	stream << "thickness " << desc.Thickness << "\n";
+	stream << "density " << desc.Density << "\n";
+
+	return stream.good();
+}
+
+bool ProceduralVolume::ParseShape(const char* name, Shape& shape)
+{
+	for (auto i = 0u; i <= SHAPE_NOISE; ++i)
+	{
+		if (strcmp(name, g_shapeNames[i]) == 0)
+		{
+			shape = static_cast<Shape>(i);
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+const char* ProceduralVolume::GetShapeName(Shape shape)
+{
+	return shape <= SHAPE_NOISE ? g_shapeNames[shape] : "unknown";
+}
+
+float ProceduralVolume::getField(float noise, float r2) const
+{
+	switch (m_desc.VolumeShape)
+	{
+	case SHAPE_SPHERE:
+	{
+		auto field = (max)(1.0f - r2, 0.0f);
+		field *= field;
+
+		return (min)(field * field * 2.0f, 1.0f);
+	}
+	case SHAPE_CLOUD:
+		return noise * (max)(1.0f - r2, 0.0f);
+	case SHAPE_SHELL:
+	{
+		const auto r = sqrtf(r2) + (noise - 0.5f) * m_desc.Thickness * 2.0f;
+
+		return (max)(1.0f - fabsf(r - m_desc.Radius) / m_desc.Thickness, 0.0f);
+	}
+	default:
+		return noise;
+	}
+}
+
+float ProceduralVolume::getDensity(float field) const
+{
+	if (m_desc.VolumeShape != SHAPE_CLOUD && m_desc.VolumeShape != SHAPE_NOISE) return field * m_desc.Density;
+
+	return field > m_cutoff ? (min)((field - m_cutoff) * m_fieldScale, 1.0f) * m_desc.Density : 0.0f;
+}
@@ -0,0 +1,79 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <iosfwd>
+#include "DDSVolume.h"
+
+//--------------------------------------------------------------------------------------
+// Seeded procedural density volumes for benchmark datasets.
+// Every voxel is a pure function of its coordinates and the desc, so the output is the
+// same for any thread count, and a volume of any size is generated slice by slice. The
+// cut-off that leaves EmptyFraction of the voxels empty is estimated once by Init() from
+// a fixed lattice of samples. It has no graphics API dependency.
+// Desc file (.vgen), one "<key> <value>" per line; blank lines and lines starting with
+// '#' are skipped, and the keys left out keep their defaults:
+//   shape <sphere|cloud|shell|noise>
+//   size <n> | size <width> <height> <depth>
+//   seed, octaves, frequency, lacunarity, gain, empty, radius, thickness, density
+//--------------------------------------------------------------------------------------
+class ProceduralVolume
+{
+public:
+	enum Shape : uint32_t
+	{
+		SHAPE_SPHERE,	// Soft sphere, as CSInitGridData.hlsl initializes the grid
+		SHAPE_CLOUD,	// fBm inside a spherical falloff
+		SHAPE_SHELL,	// Spherical shell, its radius displaced by fBm
+		SHAPE_NOISE		// fBm filling the box
+	};
+
+	struct Desc
+	{
+		Shape VolumeShape = SHAPE_CLOUD;
+		uint32_t Width = 128;
+		uint32_t Height = 128;
+		uint32_t Depth = 128;
+		uint32_t Seed = 0;
+		uint32_t Octaves = 5;
+		float Frequency = 4.0f;			// Of the first octave, in cycles across the volume
+		float Lacunarity = 2.0f;
+		float Gain = 0.5f;
+		float EmptyFraction = 0.5f;		// Of the voxels, for clouds and noise
+		float Radius = 0.7f;			// Of shells, in half extents
+		float Thickness = 0.1f;			// Of shells, in half extents
+		float Density = 1.0f;			// Peak density
+	};
+
+	ProceduralVolume();
+	virtual ~ProceduralVolume();
+
+	bool Init(const Desc& desc, uint32_t numThreads = 0);
+
+	// Slices [firstSlice, firstSlice + numSlices) into pVoxels, x-major then y then z
+	void GenerateSlices(uint32_t firstSlice, uint32_t numSlices, float* pVoxels, uint32_t numThreads = 0) const;
+	void Generate(VolumeGrid& grid, uint32_t numThreads = 0) const;
+
+	// Streams the voxels into a DDS volume a slab at a time, so the grid never has to fit
+	// in memory; format is FORMAT_R32_FLOAT or FORMAT_R16_FLOAT
+	bool WriteDDS(const char* fileName, DDSVolume::Format format = DDSVolume::FORMAT_R32_FLOAT,
+		uint32_t numThreads = 0) const;
+
+	const Desc& GetDesc() const;
+	float GetCutoff() const;	// Field value below which voxels are empty
+
+	static bool ReadDesc(std::istream& stream, Desc& desc);
+	static bool WriteDesc(std::ostream& stream, const Desc& desc);
+	static bool ParseShape(const char* name, Shape& shape);
+	static const char* GetShapeName(Shape shape);
+
+protected:
+	float getField(float noise, float r2) const;
+	float getDensity(float field) const;
+
+	Desc m_desc;
+	float m_cutoff;
+	float m_fieldScale;	// Maps the field above the cut-off to [0, 1]
+};
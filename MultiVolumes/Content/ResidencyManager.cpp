@@ -0,0 +1,217 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include "ResidencyManager.h"
+
+using namespace std;
+
+ResidencyManager::ResidencyManager() :
+	m_desc(),
+	m_frame(0),
+	m_numResident(0),
+	m_stats()
+{
+}
+
+ResidencyManager::~ResidencyManager()
+{
+}
+
+bool ResidencyManager::Init(const Desc& desc)
+{
+	if (desc.NumSources == 0 || desc.SlotByteSize == 0) return false;
+
+	const auto numSlots = static_cast<uint32_t>((min)(GetNumSlots(desc.SlotByteSize,
+		desc.BudgetBytes, desc.MaxSlots), static_cast<uint64_t>(desc.NumSources)));
+	if (numSlots == 0) return false;
+
+	m_desc = desc;
+	m_frame = 0;
+	m_numResident = 0;
+	m_stats = {};
+
+	const Source source = { 0, 0.0f, InvalidSlot, NOT_RESIDENT };
+	m_sources.assign(desc.NumSources, source);
+	m_slotSources.assign(numSlots, InvalidSlot);
+
+	// Popped from the back, so slots are handed out in ascending order
+	m_freeSlots.resize(numSlots);
+	for (auto i = 0u; i < numSlots; ++i) m_freeSlots[i] = numSlots - 1 - i;
+
+	m_touched.clear();
+
+	return true;
+}
+
+void ResidencyManager::BeginFrame()
+{
+	++m_frame;
+	m_touched.clear();
+}
+
+void ResidencyManager::Touch(uint32_t source, float coverage)
+{
+	if (source >= m_sources.size()) return;
+
+	auto& src = m_sources[source];
+	if (src.LastFrame != m_frame)
+	{
+		src.LastFrame = m_frame;
+		src.Coverage = 0.0f;
+		m_touched.emplace_back(source);
+	}
+	src.Coverage += coverage;
+
+	++m_stats.Touches;
+	m_stats.TouchedCoverage += coverage;
+	if (src.Residency == LOADED)
+	{
+		++m_stats.Hits;
+		m_stats.HitCoverage += coverage;
+	}
+}
+
+void ResidencyManager::Update(vector<Event>& events)
+{
+	// Misses of this frame, the largest on screen first
+	vector<uint32_t> misses;
+	for (const auto& source : m_touched)
+		if (m_sources[source].Residency == NOT_RESIDENT) misses.emplace_back(source);
+
+	sort(misses.begin(), misses.end(), [this](uint32_t a, uint32_t b)
+	{
+		const auto& srcA = m_sources[a];
+		const auto& srcB = m_sources[b];
+
+		return srcA.Coverage != srcB.Coverage ? srcA.Coverage > srcB.Coverage : a < b;
+	});
+
+	auto numLoads = 0u;
+	for (size_t i = 0; i < misses.size(); ++i)
+	{
+		const auto source = misses[i];
+		auto& src = m_sources[source];
+		if (m_desc.MaxLoadsPerFrame > 0 && numLoads >= m_desc.MaxLoadsPerFrame)
+		{
+			m_stats.Deferred += misses.size() - i;
+			break;
+		}
+
+		uint32_t slot;
+		if (!m_freeSlots.empty())
+		{
+			slot = m_freeSlots.back();
+			m_freeSlots.pop_back();
+		}
+		else
+		{
+			// The remaining misses score no higher, so none of them would find a victim either
+			const auto victim = findVictim(getKeepScore(src));
+			if (victim == InvalidSlot)
+			{
+				m_stats.Deferred += misses.size() - i;
+				break;
+			}
+
+			auto& victimSrc = m_sources[victim];
+			slot = victimSrc.Slot;
+			events.push_back({ EVENT_EVICT, victim, slot });
+			victimSrc.Residency = NOT_RESIDENT;
+			victimSrc.Slot = InvalidSlot;
+			--m_numResident;
+			++m_stats.Evictions;
+		}
+
+		src.Residency = LOADING;
+		src.Slot = slot;
+		m_slotSources[slot] = source;
+		events.push_back({ EVENT_LOAD, source, slot });
+		++m_numResident;
+		++m_stats.Loads;
+		++numLoads;
+	}
+}
+
+void ResidencyManager::MarkLoaded(uint32_t source)
+{
+	if (source < m_sources.size() && m_sources[source].Residency == LOADING)
+		m_sources[source].Residency = LOADED;
+}
+
+uint32_t ResidencyManager::GetSlot(uint32_t source) const
+{
+	return source < m_sources.size() && m_sources[source].Residency == LOADED ? m_sources[source].Slot : InvalidSlot;
+}
+
+uint32_t ResidencyManager::GetSource(uint32_t slot) const
+{
+	return slot < m_slotSources.size() ? m_slotSources[slot] : InvalidSlot;
+}
+
+bool ResidencyManager::IsLoading(uint32_t source) const
+{
+	return source < m_sources.size() && m_sources[source].Residency == LOADING;
+}
+
+uint32_t ResidencyManager::GetNumSlots() const
+{
+	return static_cast<uint32_t>(m_slotSources.size());
+}
+
+uint32_t ResidencyManager::GetNumResident() const
+{
+	return m_numResident;
+}
+
+uint64_t ResidencyManager::GetResidentBytes() const
+{
+	return m_desc.SlotByteSize * m_numResident;
+}
+
+uint64_t ResidencyManager::GetFrame() const
+{
+	return m_frame;
+}
+
+const ResidencyManager::Stats& ResidencyManager::GetStats() const
+{
+	return m_stats;
+}
+
+uint64_t ResidencyManager::GetNumSlots(uint64_t slotByteSize, uint64_t budgetBytes, uint32_t maxSlots)
+{
+	const auto numSlots = slotByteSize > 0 ? budgetBytes / slotByteSize : 0;
+
+	return maxSlots > 0 ? (min)(numSlots, static_cast<uint64_t>(maxSlots)) : numSlots;
+}
+
+double ResidencyManager::getKeepScore(const Source& source) const
+{
+	return static_cast<double>(source.LastFrame) + m_desc.CoverageWeight * log2(1.0 + source.Coverage);
+}
+
+uint32_t ResidencyManager::findVictim(double maxScore) const
+{
+	// Lowest keep score among the loaded sources not used this frame; ties go to the lower slot
+	auto victim = InvalidSlot;
+	auto minScore = maxScore;
+	for (const auto& source : m_slotSources)
+	{
+		if (source == InvalidSlot) continue;
+
+		const auto& src = m_sources[source];
+		if (src.Residency != LOADED || src.LastFrame == m_frame) continue;
+
+		const auto score = getKeepScore(src);
+		if (score < minScore)
+		{
+			minScore = score;
+			victim = source;
+		}
+	}
+
+	return victim;
+}
@@ -0,0 +1,107 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// Residency policy of source volumes over a pool of equally sized GPU slots.
+// Every frame, the renderer touches the sources its visible instances use, with their
+// screen coverage, and Update() assigns slots to the touched sources that are not
+// resident, evicting the resident sources with the lowest keep score:
+//   lastFrame + CoverageWeight * log2(1 + coverage in pixels),
+// i.e. LRU, where large on-screen volumes count as more recently used. Sources touched in
+// the current frame and sources still loading are never evicted. The policy has no
+// clock, threads or randomness, so a given access trace always yields the same events.
+//--------------------------------------------------------------------------------------
+class ResidencyManager
+{
+public:
+	static const uint32_t InvalidSlot = UINT32_MAX;
+
+	struct Desc
+	{
+		uint32_t NumSources;
+		uint64_t SlotByteSize;
+		uint64_t BudgetBytes;
+		uint32_t MaxSlots;			// Optional cap on top of the budget, 0 for none
+		uint32_t MaxLoadsPerFrame;	// 0 for unlimited
+		float CoverageWeight;		// Frames of recency per doubling of coverage
+	};
+
+	enum EventType : uint8_t
+	{
+		EVENT_EVICT,
+		EVENT_LOAD
+	};
+
+	struct Event
+	{
+		EventType Type;
+		uint32_t Source;
+		uint32_t Slot;
+	};
+
+	struct Stats
+	{
+		uint64_t Touches;
+		uint64_t Hits;			// Touches of loaded sources
+		uint64_t Loads;
+		uint64_t Evictions;
+		uint64_t Deferred;		// Misses left for later frames, for the lack of an evictable slot
+		double TouchedCoverage;
+		double HitCoverage;
+	};
+
+	ResidencyManager();
+	virtual ~ResidencyManager();
+
+	bool Init(const Desc& desc);
+
+	void BeginFrame();
+	void Touch(uint32_t source, float coverage);
+	void Update(std::vector<Event>& events);	// Appends this frame's evictions and loads
+	void MarkLoaded(uint32_t source);
+
+	uint32_t GetSlot(uint32_t source) const;	// InvalidSlot until the source is loaded
+	uint32_t GetSource(uint32_t slot) const;	// Owner of the slot, loading or loaded
+	bool IsLoading(uint32_t source) const;
+	uint32_t GetNumSlots() const;
+	uint32_t GetNumResident() const;
+	uint64_t GetResidentBytes() const;
+	uint64_t GetFrame() const;
+	const Stats& GetStats() const;
+
+	static uint64_t GetNumSlots(uint64_t slotByteSize, uint64_t budgetBytes, uint32_t maxSlots = 0);
+
+protected:
+	enum State : uint8_t
+	{
+		NOT_RESIDENT,
+		LOADING,
+		LOADED
+	};
+
+	struct Source
+	{
+		uint64_t LastFrame;
+		float Coverage;		// Summed over the instances of the last frame it was touched
+		uint32_t Slot;
+		State Residency;
+	};
+
+	double getKeepScore(const Source& source) const;
+	uint32_t findVictim(double maxScore) const;
+
+	Desc m_desc;
+	uint64_t m_frame;
+	uint32_t m_numResident;
+	std::vector<Source> m_sources;
+	std::vector<uint32_t> m_slotSources;
+	std::vector<uint32_t> m_freeSlots;
+	std::vector<uint32_t> m_touched;	// Sources touched in the current frame, in order
+	Stats m_stats;
+};
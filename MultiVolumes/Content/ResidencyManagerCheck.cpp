@@ -0,0 +1,224 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "ResidencyManager.h"
+#include "ToolCheck.h"
+
+using namespace std;
+
+struct ResidencySimDesc
+{
+	uint32_t NumInstances;
+	uint32_t ViewSize;		// Instances in view at a time
+	uint32_t NumFrames;
+	uint32_t LoadLatency;	// Frames from a load request to its MarkLoaded()
+	uint32_t TurnPeriod;	// Mean steps between turns of the camera
+	uint32_t Seed;
+};
+
+struct ResidencySimResult
+{
+	ResidencyManager::Stats Stats;
+	uint64_t LargeTouches;	// Touches of the sources at least twice the base scale
+	uint64_t LargeHits;
+	uint64_t PeakBytes;
+	uint64_t EventHash;
+	uint32_t NumEvents;
+};
+
+// Deterministic access trace: instances sit on a ring, each using a pseudo-random
+// source, and the camera sweeps back and forth along the ring, coming back to regions
+// it has already seen. Source scales are skewed, so a few sources are large on screen
+// and most are small. The coverage of an instance is its projected area, falling off
+// with its distance to the view center.
+static ResidencySimResult simulateResidency(const ResidencyManager::Desc& desc, const ResidencySimDesc& simDesc)
+{
+	vector<float> sourceScales(desc.NumSources);
+	auto state = simDesc.Seed * 2654435761u + 1u;
+	for (auto& scale : sourceScales)
+	{
+		state = state * 1664525u + 1013904223u;
+		const auto u = ((state >> 8) & 0xffff) / 65535.0f;
+		scale = 0.25f + 3.75f * u * u * u * u;
+	}
+
+	vector<uint32_t> instanceSources(simDesc.NumInstances);
+	vector<float> instanceAreas(simDesc.NumInstances);
+	for (auto i = 0u; i < simDesc.NumInstances; ++i)
+	{
+		state = state * 1664525u + 1013904223u;
+		instanceSources[i] = (state >> 8) % desc.NumSources;
+		const auto scale = sourceScales[instanceSources[i]];
+		instanceAreas[i] = 4096.0f * scale * scale;
+	}
+
+	ResidencyManager residency;
+	ResidencySimResult result = {};
+	if (!residency.Init(desc)) return result;
+
+	struct PendingLoad
+	{
+		uint32_t Source;
+		uint64_t DueFrame;
+	};
+
+	vector<PendingLoad> pendingLoads;
+	vector<ResidencyManager::Event> events;
+	auto hash = 14695981039346656037ull;
+	const auto halfView = static_cast<int64_t>(simDesc.ViewSize / 2);
+	int64_t center = 0, step = 1;
+	for (auto f = 0u; f < simDesc.NumFrames; ++f)
+	{
+		residency.BeginFrame();
+
+		// Loads issued in earlier frames complete in order
+		auto numDone = 0u;
+		for (const auto& load : pendingLoads)
+		{
+			if (load.DueFrame > residency.GetFrame()) break;
+			residency.MarkLoaded(load.Source);
+			++numDone;
+		}
+		pendingLoads.erase(pendingLoads.begin(), pendingLoads.begin() + numDone);
+
+		// Random walk, one instance every 2 frames, turning back now and then
+		if (f % 2 == 0)
+		{
+			state = state * 1664525u + 1013904223u;
+			if (((state >> 8) & 0xffff) % simDesc.TurnPeriod == 0) step = -step;
+			center += step;
+		}
+		for (auto d = -halfView; d <= halfView; ++d)
+		{
+			const auto i = ((center + d) % static_cast<int64_t>(simDesc.NumInstances) + simDesc.NumInstances) % simDesc.NumInstances;
+			const auto source = instanceSources[static_cast<size_t>(i)];
+			const auto coverage = instanceAreas[static_cast<size_t>(i)] / (1.0f + 0.1f * static_cast<float>(d * d));
+			if (sourceScales[source] >= 2.0f)
+			{
+				++result.LargeTouches;
+				if (residency.GetSlot(source) != ResidencyManager::InvalidSlot) ++result.LargeHits;
+			}
+			residency.Touch(source, coverage);
+		}
+
+		events.clear();
+		residency.Update(events);
+		for (const auto& e : events)
+		{
+			const uint32_t words[] = { e.Type, e.Source, e.Slot };
+			for (const auto& word : words)
+				for (auto b = 0u; b < 4; ++b) hash = (hash ^ ((word >> (8 * b)) & 0xff)) * 1099511628211ull;
+
+			if (e.Type == ResidencyManager::EVENT_LOAD)
+				pendingLoads.push_back({ e.Source, residency.GetFrame() + simDesc.LoadLatency });
+		}
+
+		result.NumEvents += static_cast<uint32_t>(events.size());
+		result.PeakBytes = (max)(residency.GetResidentBytes(), result.PeakBytes);
+	}
+
+	result.Stats = residency.GetStats();
+	result.EventHash = hash;
+
+	return result;
+}
+
+static void printResidencyResult(const char* name, const ResidencySimResult& result)
+{
+	const auto& stats = result.Stats;
+	printf("%-16s hit rate %6.2f%%, large hit rate %6.2f%%, coverage hit rate %6.2f%%, %6llu loads, %6llu evictions, %6llu deferred, peak %8.1f MB\n",
+		name, 100.0 * stats.Hits / (max)(static_cast<double>(stats.Touches), 1.0),
+		100.0 * result.LargeHits / (max)(static_cast<double>(result.LargeTouches), 1.0), 100.0 * stats.HitCoverage / (max)(stats.TouchedCoverage, 1.0),
+		static_cast<unsigned long long>(stats.Loads), static_cast<unsigned long long>(stats.Evictions),
+		static_cast<unsigned long long>(stats.Deferred), result.PeakBytes / (1024.0 * 1024.0));
+}
+
+// Replays a simulated access trace through the residency policy; checks the budget, that
+// the same trace always yields the same events, and that the coverage weight loses no
+// coverage hits to plain LRU. What it costs in hits and loads is reported next to that
+int ResidencySim(int argc, char* argv[])
+{
+	ResidencyManager::Desc desc = {};
+	desc.NumSources = 1024;
+	desc.SlotByteSize = 64ull * 1024 * 1024;
+	desc.BudgetBytes = 4096ull * 1024 * 1024;
+	desc.MaxLoadsPerFrame = 8;
+	desc.CoverageWeight = 16.0f;	// As the renderer
+
+	ResidencySimDesc simDesc = {};
+	simDesc.NumInstances = 20000;
+	simDesc.ViewSize = 40;
+	simDesc.NumFrames = 20000;
+	simDesc.LoadLatency = 3;
+	simDesc.TurnPeriod = 32;
+	simDesc.Seed = 1;
+
+	ToolArgs args;
+	args.Add("-sources", desc.NumSources, 1);
+	args.Add("-instances", simDesc.NumInstances, 1);
+	args.Add("-view", simDesc.ViewSize);
+	args.Add("-frames", simDesc.NumFrames);
+	args.Add("-slotMB", [&desc](const char* arg) { desc.SlotByteSize = (max)(stoull(arg), 1ull) * 1024 * 1024; });
+	args.Add("-budgetMB", [&desc](const char* arg) { desc.BudgetBytes = stoull(arg) * 1024 * 1024; });
+	args.Add("-maxLoads", desc.MaxLoadsPerFrame);
+	args.Add("-latency", simDesc.LoadLatency);
+	args.Add("-turn", simDesc.TurnPeriod, 1);
+	args.Add("-weight", desc.CoverageWeight);
+	args.Add("-seed", simDesc.Seed);
+	if (!args.Parse(argc, argv)) return EXIT_FAILURE;
+
+	const auto numSlots = ResidencyManager::GetNumSlots(desc.SlotByteSize, desc.BudgetBytes);
+	if (numSlots == 0)
+	{
+		fprintf(stderr, "The budget does not fit a single slot.\n");
+
+		return EXIT_FAILURE;
+	}
+
+	printf("%u sources, %u instances, %u in view, %u frames, %llu slots of %.1f MB in a %.1f MB budget\n",
+		desc.NumSources, simDesc.NumInstances, simDesc.ViewSize + 1, simDesc.NumFrames,
+		static_cast<unsigned long long>((min)(numSlots, static_cast<uint64_t>(desc.NumSources))),
+		desc.SlotByteSize / (1024.0 * 1024.0), desc.BudgetBytes / (1024.0 * 1024.0));
+
+	const auto start = chrono::steady_clock::now();
+	const auto result = simulateResidency(desc, simDesc);
+	const auto seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	const auto replay = simulateResidency(desc, simDesc);
+
+	auto lruDesc = desc;
+	lruDesc.CoverageWeight = 0.0f;
+	const auto lruResult = simulateResidency(lruDesc, simDesc);
+
+	printResidencyResult("weighted LRU", result);
+	printResidencyResult("plain LRU", lruResult);
+
+	// The weight trades hits of small sources for those of large ones, so the overall hit
+	// rate may drop and the loads grow while the coverage hit rate rises
+	const auto getRate = [](double hits, double touches) { return 100.0 * hits / (max)(touches, 1.0); };
+	const auto coverageRate = getRate(result.Stats.HitCoverage, result.Stats.TouchedCoverage);
+	const auto lruCoverageRate = getRate(lruResult.Stats.HitCoverage, lruResult.Stats.TouchedCoverage);
+	const auto loadDelta = static_cast<int64_t>(result.Stats.Loads) - static_cast<int64_t>(lruResult.Stats.Loads);
+	printf("weighted - plain: hit rate %+.2f pt, large hit rate %+.2f pt, coverage hit rate %+.3f pt, loads %+lld (%+.1f%%)\n",
+		getRate(static_cast<double>(result.Stats.Hits), static_cast<double>(result.Stats.Touches)) -
+		getRate(static_cast<double>(lruResult.Stats.Hits), static_cast<double>(lruResult.Stats.Touches)),
+		getRate(static_cast<double>(result.LargeHits), static_cast<double>(result.LargeTouches)) -
+		getRate(static_cast<double>(lruResult.LargeHits), static_cast<double>(lruResult.LargeTouches)),
+		coverageRate - lruCoverageRate, static_cast<long long>(loadDelta),
+		100.0 * loadDelta / (max)(static_cast<double>(lruResult.Stats.Loads), 1.0));
+	printf("%u events, hash %016llx, %.3f us per frame\n", result.NumEvents,
+		static_cast<unsigned long long>(result.EventHash), seconds * 1.0e6 / (max)(simDesc.NumFrames, 1u));
+
+	CheckReport report;
+	report.Expect("Deterministic", replay.EventHash == result.EventHash && replay.NumEvents == result.NumEvents);
+	report.Expect("Within budget", result.PeakBytes <= desc.BudgetBytes && lruResult.PeakBytes <= desc.BudgetBytes);
+	report.Expect("Coverage hit rate of plain LRU or more", coverageRate >= lruCoverageRate);
+
+	return report.Finish();
+}
@@ -0,0 +1,229 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include "SampleBudget.h"
+
+using namespace std;
+
+#define ALL_FACES_VISIBLE	0x3f
+
+static const float g_sqrt2 = 1.4142136f;
+static const float g_sqrt3 = 1.7320508f;
+static const float g_raySampleCountScale = 2.0f;
+
+static inline uint32_t countBits(uint32_t value)
+{
+	auto count = 0u;
+	for (; value; value &= value - 1) ++count;
+
+	return count;
+}
+
+SampleBudget::SampleBudget() :
+	m_totalCost(0),
+	m_maxCost(0),
+	m_numDropped(0),
+	m_numReduced(0)
+{
+}
+
+SampleBudget::~SampleBudget()
+{
+}
+
+uint64_t SampleBudget::Allocate(const Volume* pVolumes, uint32_t numVolumes, uint64_t budget)
+{
+	m_allocations.resize(numVolumes);
+	m_totalCost = 0;
+	m_maxCost = 0;
+	m_numDropped = 0;
+	m_numReduced = 0;
+
+	// Everything at its max samples when it fits
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		auto& allocation = m_allocations[i];
+		allocation.SmpCount = (max)(pVolumes[i].MaxSamples, 1u);
+		allocation.Cost = GetCost(pVolumes[i], allocation.SmpCount, &allocation.MipLevel);
+		m_maxCost += allocation.Cost;
+	}
+
+	if (m_maxCost <= budget)
+	{
+		m_totalCost = m_maxCost;
+
+		return m_totalCost;
+	}
+
+	// Otherwise from 1 sample each
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		auto& allocation = m_allocations[i];
+		allocation.SmpCount = 1;
+		allocation.Cost = GetCost(pVolumes[i], 1, &allocation.MipLevel);
+		m_totalCost += allocation.Cost;
+	}
+
+	// Drop the volumes of the least value per cost, until the rest fits
+	if (m_totalCost > budget)
+	{
+		m_order.resize(numVolumes);
+		for (auto i = 0u; i < numVolumes; ++i) m_order[i] = i;
+		stable_sort(m_order.begin(), m_order.end(), [&](uint32_t a, uint32_t b)
+		{
+			const auto& va = pVolumes[a], &vb = pVolumes[b];
+			const auto costA = m_allocations[a].Cost, costB = m_allocations[b].Cost;
+			const auto densityA = costA > 0 ? static_cast<double>(va.Priority) * va.Coverage / costA : DBL_MAX;
+			const auto densityB = costB > 0 ? static_cast<double>(vb.Priority) * vb.Coverage / costB : DBL_MAX;
+
+			return densityA > densityB;
+		});
+
+		m_totalCost = 0;
+		for (const auto& i : m_order)
+		{
+			auto& allocation = m_allocations[i];
+			if (allocation.Cost <= budget - m_totalCost) m_totalCost += allocation.Cost;
+			else
+			{
+				allocation = {};
+				++m_numDropped;
+			}
+		}
+	}
+
+	// Greedy steps of the most gain per cost, the lower volume first on a tie
+	const auto isLessGain = [](const Step& a, const Step& b)
+	{
+		return a.Gain < b.Gain || (a.Gain == b.Gain && a.Volume > b.Volume);
+	};
+
+	m_steps.clear();
+	const auto pushStep = [&](uint32_t i)
+	{
+		const auto& volume = pVolumes[i];
+		const auto& allocation = m_allocations[i];
+		const auto smpCount = allocation.SmpCount;
+		const auto nextCount = GetNextSampleCount(volume, smpCount);
+		if (nextCount <= smpCount) return;
+
+		const auto nextCost = GetCost(volume, nextCount);
+		const auto gain = static_cast<double>(volume.Priority) * volume.Coverage * (1.0 / smpCount - 1.0 / nextCount);
+		const Step step = { nextCost > allocation.Cost ? gain / (nextCost - allocation.Cost) : DBL_MAX, i };
+		m_steps.push_back(step);
+		push_heap(m_steps.begin(), m_steps.end(), isLessGain);
+	};
+
+	for (auto i = 0u; i < numVolumes; ++i)
+		if (m_allocations[i].SmpCount > 0) pushStep(i);
+
+	while (!m_steps.empty())
+	{
+		pop_heap(m_steps.begin(), m_steps.end(), isLessGain);
+		const auto i = m_steps.back().Volume;
+		m_steps.pop_back();
+
+		// A step that does not fit now never will, as the budget left only shrinks
+		const auto& volume = pVolumes[i];
+		auto& allocation = m_allocations[i];
+		const auto nextCount = GetNextSampleCount(volume, allocation.SmpCount);
+		uint32_t nextMip;
+		const auto nextCost = GetCost(volume, nextCount, &nextMip);
+		if (nextCost > allocation.Cost && nextCost - allocation.Cost > budget - m_totalCost) continue;
+
+		m_totalCost = m_totalCost - allocation.Cost + nextCost;
+		allocation.SmpCount = nextCount;
+		allocation.MipLevel = nextMip;
+		allocation.Cost = nextCost;
+		pushStep(i);
+	}
+
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		const auto smpCount = m_allocations[i].SmpCount;
+		if (smpCount > 0 && smpCount < (max)(pVolumes[i].MaxSamples, 1u)) ++m_numReduced;
+	}
+
+	return m_totalCost;
+}
+
+const vector<SampleBudget::Allocation>& SampleBudget::GetAllocations() const
+{
+	return m_allocations;
+}
+
+uint64_t SampleBudget::GetTotalCost() const
+{
+	return m_totalCost;
+}
+
+uint64_t SampleBudget::GetMaxCost() const
+{
+	return m_maxCost;
+}
+
+uint32_t SampleBudget::GetNumDropped() const
+{
+	return m_numDropped;
+}
+
+uint32_t SampleBudget::GetNumReduced() const
+{
+	return m_numReduced;
+}
+
+uint64_t SampleBudget::GetCost(const Volume& volume, uint32_t smpCount, uint32_t* pMipLevel)
+{
+	uint32_t mipLevel = 0;
+	uint64_t cost = 0;
+
+	const auto maxSamples = (max)(volume.MaxSamples, 1u);
+	if (smpCount > 0)
+	{
+		smpCount = (min)(smpCount, maxSamples);
+		if (smpCount < maxSamples)
+		{
+			// The LOD of EstimateCubeMapLOD() for the clamped ray sample amount
+			const auto s = smpCount / g_raySampleCountScale * g_sqrt3;
+			const auto level = static_cast<uint32_t>((max)(log2f(static_cast<float>(volume.CubeMapSize) / s), 0.0f));
+			mipLevel = (min)(level, (max)(volume.NumMips, 1u) - 1);
+		}
+		else mipLevel = volume.MipLevel;
+
+		// Rays of the cube-map texels, or of the pixels when fewer
+		auto rays = static_cast<uint64_t>(ceilf((max)(volume.Coverage, 0.0f)));
+		const auto faceMask = volume.FaceMask & ALL_FACES_VISIBLE;
+		if (faceMask != ALL_FACES_VISIBLE)
+		{
+			const uint64_t edgeLength = mipLevel < 32 ? volume.CubeMapSize >> mipLevel : 0;
+			rays = (min)(edgeLength * edgeLength * countBits(faceMask), rays);
+		}
+
+		cost = rays * smpCount;
+	}
+
+	if (pMipLevel) *pMipLevel = mipLevel;
+
+	return cost;
+}
+
+uint32_t SampleBudget::GetNextSampleCount(const Volume& volume, uint32_t smpCount)
+{
+	const auto maxSamples = (max)(volume.MaxSamples, 1u);
+	if (smpCount >= maxSamples) return maxSamples;
+
+	const auto nextCount = (max)(smpCount + 1, static_cast<uint32_t>(smpCount * g_sqrt2 + 0.5f));
+
+	return (min)(nextCount, maxSamples);
+}
+
+uint64_t SampleBudget::GetBudgetForTime(float milliseconds, float samplesPerMillisecond)
+{
+	const auto samples = static_cast<double>(milliseconds) * samplesPerMillisecond;
+
+	return samples > 0.0 ? static_cast<uint64_t>(samples) : 0;
+}
@@ -0,0 +1,70 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// Per-frame ray-sample budget over the visible volumes. The cost of a volume at n samples
+// per ray is n times its rays: its projected coverage when ray cast directly, or the
+// visible texels of its cube map at the LOD that EstimateCubeMapLOD() derives from n, if
+// fewer. Every volume starts at 1 sample, and the budget left is spent greedily on the
+// next step of the sample count with the most gain per cost, the gain being
+// Priority * Coverage * (1 / n - 1 / next), until no step fits. Once even 1 sample per
+// volume exceeds the budget, the volumes with the least Priority * Coverage per cost are
+// dropped, so the total never exceeds the budget. It has no graphics API dependency.
+//--------------------------------------------------------------------------------------
+class SampleBudget
+{
+public:
+	struct Volume
+	{
+		float Coverage;			// Projected pixels, from VolumeCuller
+		float Priority;
+		uint32_t MaxSamples;	// SmpCount of the VolumeInfo, before the budget
+		uint32_t MipLevel;		// MipLevel of the VolumeInfo, i.e. at MaxSamples
+		uint32_t FaceMask;		// Lowest 6 bits: face visibility
+		uint32_t CubeMapSize;
+		uint32_t NumMips;
+	};
+
+	struct Allocation
+	{
+		uint32_t SmpCount;		// 0 when dropped
+		uint32_t MipLevel;
+		uint64_t Cost;
+	};
+
+	SampleBudget();
+	virtual ~SampleBudget();
+
+	uint64_t Allocate(const Volume* pVolumes, uint32_t numVolumes, uint64_t budget);	// Returns the total cost
+
+	const std::vector<Allocation>& GetAllocations() const;
+	uint64_t GetTotalCost() const;
+	uint64_t GetMaxCost() const;		// With every volume at its MaxSamples
+	uint32_t GetNumDropped() const;
+	uint32_t GetNumReduced() const;		// Kept below their MaxSamples, dropped ones excluded
+
+	static uint64_t GetCost(const Volume& volume, uint32_t smpCount, uint32_t* pMipLevel = nullptr);
+	static uint32_t GetNextSampleCount(const Volume& volume, uint32_t smpCount);	// Steps of about half an octave
+	static uint64_t GetBudgetForTime(float milliseconds, float samplesPerMillisecond);
+
+protected:
+	struct Step
+	{
+		double Gain;	// Per cost
+		uint32_t Volume;
+	};
+
+	std::vector<Allocation> m_allocations;
+	std::vector<Step> m_steps;
+	std::vector<uint32_t> m_order;
+	uint64_t m_totalCost;
+	uint64_t m_maxCost;
+	uint32_t m_numDropped;
+	uint32_t m_numReduced;
+};
@@ -0,0 +1,232 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "CostModel.h"
+#include "SampleBudget.h"
+#include "SharedConsts.h"
+#include "VolumeCuller.h"
+#include "ToolCheck.h"
+
+using namespace std;
+
+// Checks the allocation of random volume sets under random budgets, from the edge cases to
+// no limit, and the sample scales of a culled scene: the total never exceeds the budget,
+// no step left fits, and the culling reproduces each allocated count and LOD from its scale
+int BudgetCheck(int argc, char* argv[])
+{
+	auto numSets = 2000u;
+	auto maxVolumes = 64u;
+	auto seed = 1u;
+	ToolArgs args;
+	args.Add("-sets", numSets, 1);
+	args.Add("-volumes", maxVolumes, 1);
+	args.Add("-seed", seed);
+	if (!args.Parse(argc, argv)) return EXIT_FAILURE;
+
+	auto state = seed;
+	const auto random = [&state]()
+	{
+		state = state * 1664525u + 1013904223u;
+
+		return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+	};
+
+	// Validates an allocation against its volumes and budget
+	uint64_t numErrors = 0;
+	const auto checkAllocation = [&numErrors](const SampleBudget& budget, const vector<SampleBudget::Volume>& volumes,
+		uint64_t maxSamples)
+	{
+		const auto& allocations = budget.GetAllocations();
+		const auto totalCost = budget.GetTotalCost();
+		const auto budgetLeft = totalCost <= maxSamples ? maxSamples - totalCost : 0;
+		auto isValid = totalCost <= maxSamples && allocations.size() == volumes.size();
+
+		uint64_t sumCost = 0;
+		for (size_t i = 0; isValid && i < volumes.size(); ++i)
+		{
+			const auto& volume = volumes[i];
+			const auto& allocation = allocations[i];
+			uint32_t mipLevel;
+			const auto cost = SampleBudget::GetCost(volume, allocation.SmpCount, &mipLevel);
+			const auto maxCount = (max)(volume.MaxSamples, 1u);
+			isValid = allocation.SmpCount <= maxCount && allocation.Cost == cost && allocation.MipLevel == mipLevel;
+			sumCost += cost;
+
+			// Everything at its max when it fits, otherwise no step left fits
+			if (budget.GetMaxCost() <= maxSamples) isValid = isValid && allocation.SmpCount == maxCount;
+			else if (allocation.SmpCount == 0) isValid = isValid && SampleBudget::GetCost(volume, 1) > budgetLeft;
+			else if (allocation.SmpCount < maxCount)
+			{
+				const auto nextCost = SampleBudget::GetCost(volume, SampleBudget::GetNextSampleCount(volume, allocation.SmpCount));
+				isValid = isValid && nextCost > cost && nextCost - cost > budgetLeft;
+			}
+		}
+		if (!isValid || sumCost != totalCost) ++numErrors;
+	};
+
+	// Random sets
+	SampleBudget budget, budgetAgain;
+	vector<SampleBudget::Volume> volumes;
+	uint64_t numDropped = 0, numReduced = 0, numVolumes = 0;
+	auto seconds = 0.0;
+	for (auto s = 0u; s < numSets; ++s)
+	{
+		volumes.resize(static_cast<uint32_t>(random() * (maxVolumes + 1)));
+		for (auto& volume : volumes)
+		{
+			const auto cubeMapSize = 8u << static_cast<uint32_t>(random() * 6.0f);
+			auto numMips = 0u;
+			while (cubeMapSize >> numMips) ++numMips;
+			volume.CubeMapSize = cubeMapSize;
+			volume.NumMips = (min)(numMips, 1u + static_cast<uint32_t>(random() * numMips));
+
+			const auto kind = random();
+			volume.Coverage = kind < 0.1f ? 0.0f : kind < 0.2f ? 1920.0f * 1080.0f : powf(2.0f, random() * 20.0f);
+			volume.Priority = random() < 0.1f ? 0.0f : random() * 4.0f;
+			volume.MaxSamples = random() < 0.1f ? 1 : 1 + static_cast<uint32_t>(random() * 256.0f);
+			volume.FaceMask = random() < 0.1f ? 0x3f : static_cast<uint32_t>(random() * 64.0f);
+
+			// The LOD of the culling for an ideal amount that rounds up to the max samples
+			const auto raySampleAmt = volume.MaxSamples - random() * 0.99f;
+			const auto level = static_cast<uint32_t>((max)(log2f(cubeMapSize / (raySampleAmt / 2.0f * 1.7320508f)), 0.0f));
+			volume.MipLevel = (min)(level, volume.NumMips - 1);
+		}
+
+		uint64_t maxCost = 0, floorCost = 0;
+		for (const auto& volume : volumes)
+		{
+			maxCost += SampleBudget::GetCost(volume, volume.MaxSamples);
+			floorCost += SampleBudget::GetCost(volume, 1);
+		}
+
+		const auto kind = s % 8;
+		const auto maxSamples = kind == 0 ? 0 : kind == 1 ? UINT64_MAX : kind == 2 ? maxCost : kind == 3 ? floorCost :
+			kind == 4 && floorCost > 0 ? floorCost - 1 : static_cast<uint64_t>(random() * 1.2 * maxCost);
+
+		const auto start = chrono::steady_clock::now();
+		budget.Allocate(volumes.data(), static_cast<uint32_t>(volumes.size()), maxSamples);
+		seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		checkAllocation(budget, volumes, maxSamples);
+
+		// Deterministic
+		budgetAgain.Allocate(volumes.data(), static_cast<uint32_t>(volumes.size()), maxSamples);
+		if (budgetAgain.GetTotalCost() != budget.GetTotalCost() || !equal(budget.GetAllocations().cbegin(),
+			budget.GetAllocations().cend(), budgetAgain.GetAllocations().cbegin(),
+			[](const SampleBudget::Allocation& a, const SampleBudget::Allocation& b)
+			{ return a.SmpCount == b.SmpCount && a.MipLevel == b.MipLevel && a.Cost == b.Cost; }))
+			++numErrors;
+
+		numDropped += budget.GetNumDropped();
+		numReduced += budget.GetNumReduced();
+		numVolumes += volumes.size();
+	}
+
+	printf("Random sets: %u with up to %u volumes, %.1f%% reduced, %.1f%% dropped, %.3f us per set\n", numSets,
+		maxVolumes, 100.0 * numReduced / (max)(numVolumes, static_cast<uint64_t>(1)), 100.0 * numDropped / (max)(numVolumes, static_cast<uint64_t>(1)),
+		seconds * 1.0e6 / numSets);
+
+	// A culled scene of 64 volumes at fractions of its unbudgeted samples
+	const auto numSceneVolumes = 64u;
+	vector<Matrix4> worlds;
+	vector<float> worldIs, sampleScales;
+	const auto extent = ScatterVolumes(numSceneVolumes, seed, worlds, worldIs, sampleScales);
+
+	VolumeDesc desc = {};
+	desc.NumMips = NUM_CUBE_MIP;
+	desc.CubeMapSize = 128;
+
+	VolumeCuller::FrameDesc frame = {};
+	frame.PathCosts = CostModel::GetDefaultWeights();
+	frame.Viewport[0] = 1920.0f;
+	frame.Viewport[1] = 1080.0f;
+	frame.NumSamples = 256;
+	const float eye[] = { 0.0f, 10.0f, -extent * 0.6f };
+	const float at[] = { 0.0f, 0.0f, 0.0f };
+	const auto viewProj = GetViewProj(eye, at, 3.14159265f / 4.0f, frame.Viewport[0] / frame.Viewport[1], g_zNear, g_zFar);
+	copy(eye, eye + 3, frame.EyePt);
+	VolumeCuller::GetFrustumCorners(viewProj.m[0], frame.FrustumCorners);
+
+	vector<Matrix4> worldViewProjs(numSceneVolumes);
+	vector<uint32_t> visibleVolumes;
+	volumes.clear();
+	for (auto i = 0u; i < numSceneVolumes; ++i)
+	{
+		worldViewProjs[i] = Multiply(worlds[i], viewProj);
+		VolumeInfo info;
+		float coverage;
+		if (!VolumeCuller::CullVolume(frame, worldViewProjs[i].m[0], &worldIs[12 * i], desc, sampleScales[i], info, coverage))
+			continue;
+
+		SampleBudget::Volume volume;
+		volume.Coverage = coverage;
+		volume.Priority = 1.0f;
+		volume.MaxSamples = info.SmpCount;
+		volume.MipLevel = info.MipLevel;
+		volume.FaceMask = info.FaceMask;
+		volume.CubeMapSize = desc.CubeMapSize;
+		volume.NumMips = desc.NumMips;
+		volumes.push_back(volume);
+		visibleVolumes.push_back(i);
+	}
+
+	const auto numVisible = static_cast<uint32_t>(volumes.size());
+	VolumeCuller culler;
+	for (auto d = 1u; d <= 65536; d *= 16)
+	{
+		budget.Allocate(volumes.data(), numVisible, 0);
+		const auto maxSamples = budget.GetMaxCost() / d;
+		budget.Allocate(volumes.data(), numVisible, maxSamples);
+		checkAllocation(budget, volumes, maxSamples);
+
+		// The shader rounds the budgeted sample scale down to the allocated count, and the batch
+		// kernels drop the same volumes
+		culler.Resize(numSceneVolumes);
+		for (auto i = 0u; i < numSceneVolumes; ++i)
+		{
+			culler.SetVolumeDesc(i, desc);
+			culler.SetVolume(i, worldViewProjs[i].m[0], &worldIs[12 * i], sampleScales[i]);
+		}
+		for (auto k = 0u; k < numVisible; ++k)
+		{
+			const auto i = visibleVolumes[k];
+			const auto& allocation = budget.GetAllocations()[k];
+			const auto sampleScale = allocation.SmpCount > 0 ? (allocation.SmpCount + 0.5f) / frame.NumSamples : 0.0f;
+			VolumeInfo info;
+			float coverage;
+			const auto isVisible = VolumeCuller::CullVolume(frame, worldViewProjs[i].m[0], &worldIs[12 * i],
+				desc, sampleScale, info, coverage);
+			if (isVisible != (allocation.SmpCount > 0) || (isVisible &&
+				(info.SmpCount != allocation.SmpCount || info.MipLevel != allocation.MipLevel)))
+				++numErrors;
+			culler.SetVolume(i, worldViewProjs[i].m[0], &worldIs[12 * i], sampleScale);
+		}
+
+		culler.Cull(frame);
+		const auto& culledVolumes = culler.GetVisibleVolumes();
+		auto culled = culledVolumes.cbegin();
+		for (auto k = 0u; k < numVisible; ++k)
+		{
+			const auto& allocation = budget.GetAllocations()[k];
+			if (allocation.SmpCount == 0) continue;
+			if (culled == culledVolumes.cend() || *culled != visibleVolumes[k] ||
+				culler.GetVolumeInfos()[*culled].SmpCount != allocation.SmpCount) ++numErrors;
+			else ++culled;
+		}
+		if (culled != culledVolumes.cend()) ++numErrors;
+
+		printf("Scene 1/%u: %u visible volumes, %.3f of %.1f M samples, %u reduced, %u dropped\n", d, numVisible,
+			budget.GetTotalCost() / 1.0e6, budget.GetMaxCost() / 1.0e6, budget.GetNumReduced(), budget.GetNumDropped());
+	}
+
+	CheckReport report;
+	report.ExpectNone("Errors", numErrors);
+
+	return report.Finish();
+}
@@ -0,0 +1,503 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include "SceneManifest.h"
+
+using namespace std;
+
+//--------------------------------------------------------------------------------------
+// Cursor over one line of the text form
+//--------------------------------------------------------------------------------------
+class LineCursor
+{
+public:
+	LineCursor(const char* pLine, const char* pEnd) : m_p(pLine), m_pEnd(pEnd) {}
+
+	bool IsEnd()
+	{
+		skipSpaces();
+
+		return m_p >= m_pEnd;
+	}
+
+	bool IsComment()
+	{
+		skipSpaces();
+
+		return m_p < m_pEnd && *m_p == '#';
+	}
+
+	bool Keyword(const char* keyword)
+	{
+		skipSpaces();
+		const auto length = strlen(keyword);
+		if (static_cast<size_t>(m_pEnd - m_p) < length || strncmp(m_p, keyword, length) != 0) return false;
+		if (m_p + length < m_pEnd && m_p[length] != ' ' && m_p[length] != '\t' && m_p[length] != '\r') return false;
+		m_p += length;
+
+		return true;
+	}
+
+	bool Float(float& value)
+	{
+		// The text is NUL-terminated, and the whitespace before the number is skipped here, so
+		// strtof() stops within the line
+		skipSpaces();
+		if (m_p >= m_pEnd) return false;
+
+		if (parseDecimal(value)) return true;
+
+		char* pNext;
+		value = strtof(m_p, &pNext);
+		if (pNext == m_p || pNext > m_pEnd) return false;
+		m_p = pNext;
+
+		return true;
+	}
+
+	bool Uint(uint32_t& value)
+	{
+		skipSpaces();
+		if (m_p >= m_pEnd || *m_p < '0' || *m_p > '9') return false;
+
+		char* pNext;
+		const auto result = strtoul(m_p, &pNext, 10);
+		if (pNext > m_pEnd || result > UINT32_MAX) return false;
+		value = static_cast<uint32_t>(result);
+		m_p = pNext;
+
+		return true;
+	}
+
+	bool Floats(float* pValues, uint32_t count)
+	{
+		for (auto i = 0u; i < count; ++i)
+			if (!Float(pValues[i])) return false;
+
+		return true;
+	}
+
+	// The rest of the line, trimmed
+	bool Rest(const char*& pFirst, const char*& pLast)
+	{
+		skipSpaces();
+		auto pRest = m_pEnd;
+		while (pRest > m_p && (pRest[-1] == ' ' || pRest[-1] == '\t' || pRest[-1] == '\r')) --pRest;
+		pFirst = m_p;
+		pLast = pRest;
+		m_p = m_pEnd;
+
+		return pLast > pFirst;
+	}
+
+protected:
+	// Fast path for plain decimals of up to 19 digits and small exponents, where the digits
+	// and the power of 10 are exact doubles, so one rounded division or multiplication gives
+	// the nearest double; anything else is left to strtof()
+	bool parseDecimal(float& value)
+	{
+		static const double powersOf10[] =
+		{
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+			1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+
+		auto p = m_p;
+		const auto isNegative = p < m_pEnd && *p == '-';
+		if (p < m_pEnd && (*p == '-' || *p == '+')) ++p;
+
+		uint64_t digits = 0;
+		auto numDigits = 0, exponent = 0;
+		for (; p < m_pEnd && *p >= '0' && *p <= '9'; ++p, ++numDigits) digits = digits * 10 + (*p - '0');
+		if (p < m_pEnd && *p == '.')
+			for (++p; p < m_pEnd && *p >= '0' && *p <= '9'; ++p, ++numDigits, --exponent) digits = digits * 10 + (*p - '0');
+		if (numDigits == 0 || numDigits > 19) return false;
+
+		if (p < m_pEnd && (*p == 'e' || *p == 'E'))
+		{
+			++p;
+			const auto isExpNegative = p < m_pEnd && *p == '-';
+			if (p < m_pEnd && (*p == '-' || *p == '+')) ++p;
+			if (p >= m_pEnd || *p < '0' || *p > '9') return false;
+
+			auto exp = 0;
+			for (; p < m_pEnd && *p >= '0' && *p <= '9' && exp < 1000; ++p) exp = exp * 10 + (*p - '0');
+			exponent += isExpNegative ? -exp : exp;
+		}
+
+		if (p < m_pEnd && *p != ' ' && *p != '\t' && *p != '\r') return false;
+		if (exponent < -22 || exponent > 22 || digits > (1ull << 53)) return false;
+
+		auto result = static_cast<double>(digits);
+		result = exponent < 0 ? result / powersOf10[-exponent] : result * powersOf10[exponent];
+		value = static_cast<float>(isNegative ? -result : result);
+		m_p = p;
+
+		return true;
+	}
+
+	void skipSpaces()
+	{
+		while (m_p < m_pEnd && (*m_p == ' ' || *m_p == '\t' || *m_p == '\r')) ++m_p;
+	}
+
+	const char* m_p;
+	const char* m_pEnd;
+};
+
+// Appends the shortest decimals that read back as the same floats
+static void appendFloats(string& line, const float* pValues, uint32_t count)
+{
+	char text[32];
+	for (auto i = 0u; i < count; ++i)
+	{
+		for (auto precision = 6; precision <= 9; ++precision)
+		{
+			snprintf(text, sizeof(text), " %.*g", precision, pValues[i]);
+			if (strtof(text, nullptr) == pValues[i]) break;
+		}
+		line += text;
+	}
+}
+
+SceneManifest::SceneManifest() :
+	m_pHeader(nullptr),
+	m_pSources(nullptr),
+	m_pInstances(nullptr),
+	m_pLights(nullptr),
+	m_pPaths(nullptr),
+	m_errorLine(0)
+{
+}
+
+SceneManifest::~SceneManifest()
+{
+}
+
+bool SceneManifest::Read(const char* fileName)
+{
+	ifstream file(fileName, ios::binary);
+
+	return file.is_open() && read(file);
+}
+
+#ifdef _WIN32
+bool SceneManifest::Read(const wchar_t* fileName)
+{
+	ifstream file(fileName, ios::binary);
+
+	return file.is_open() && read(file);
+}
+#endif
+
+bool SceneManifest::ReadText(const char* pText, size_t size)
+{
+	// NUL-terminated copy for strtof()
+	vector<char> text(size + 1);
+	memcpy(text.data(), pText, size);
+	text[size] = '\0';
+
+	vector<Source> sources;
+	vector<char> paths;
+	vector<Instance> instances;
+	vector<Light> lights;
+
+	m_errorLine = 0;
+	auto lineNo = 0u;
+	const auto pTextEnd = text.data() + size;
+	for (auto pLine = static_cast<const char*>(text.data()); pLine < pTextEnd; ++lineNo)
+	{
+		auto pLineEnd = static_cast<const char*>(memchr(pLine, '\n', pTextEnd - pLine));
+		pLineEnd = pLineEnd ? pLineEnd : pTextEnd;
+
+		LineCursor cursor(pLine, pLineEnd);
+		auto isValid = true;
+		if (cursor.Keyword("instance"))
+		{
+			Instance instance;
+			SetDefaultInstance(instance);
+			isValid = cursor.Uint(instance.Source) && instance.Source < sources.size() &&
+				cursor.Floats(instance.Position, 3) && cursor.Float(instance.Size);
+			while (isValid && !cursor.IsEnd())
+			{
+				if (cursor.Keyword("rotation")) isValid = cursor.Floats(instance.Rotation, 4);
+				else if (cursor.Keyword("samples")) isValid = cursor.Float(instance.SampleScale) && instance.SampleScale > 0.0f;
+				else isValid = false;
+			}
+			instances.emplace_back(instance);
+		}
+		else if (cursor.Keyword("source"))
+		{
+			const char* pFirst;
+			const char* pLast;
+			isValid = cursor.Rest(pFirst, pLast);
+			if (isValid)
+			{
+				Source source;
+				source.PathOffset = static_cast<uint32_t>(paths.size());
+				source.PathLength = static_cast<uint32_t>(pLast - pFirst);
+				paths.insert(paths.end(), pFirst, pLast);
+				paths.emplace_back('\0');
+				sources.emplace_back(source);
+			}
+		}
+		else if (cursor.Keyword("light"))
+		{
+			Light light = {};
+			if (cursor.Keyword("point"))
+			{
+				light.Type = LIGHT_POINT;
+				isValid = cursor.Floats(light.Position, 3);
+			}
+			else if (cursor.Keyword("directional"))
+			{
+				light.Type = LIGHT_DIRECTIONAL;
+				isValid = cursor.Floats(light.Position, 3);
+			}
+			else if (cursor.Keyword("ambient")) light.Type = LIGHT_AMBIENT;
+			else isValid = false;
+			isValid = isValid && cursor.Floats(light.Color, 3) && cursor.Float(light.Intensity) && cursor.IsEnd();
+			lights.emplace_back(light);
+		}
+		else isValid = cursor.IsEnd() || cursor.IsComment();
+
+		if (!isValid)
+		{
+			m_errorLine = lineNo + 1;
+
+			return false;
+		}
+
+		pLine = pLineEnd + 1;
+	}
+
+	build(sources, paths, instances.data(), static_cast<uint32_t>(instances.size()),
+		lights.data(), static_cast<uint32_t>(lights.size()));
+
+	return true;
+}
+
+bool SceneManifest::ReadBinary(const void* pData, size_t size)
+{
+	const auto pBytes = static_cast<const uint8_t*>(pData);
+	m_data.assign(pBytes, pBytes + size);
+
+	return assign();
+}
+
+bool SceneManifest::WriteText(const char* fileName) const
+{
+	ofstream file(fileName, ios::binary);
+	if (!file.is_open() || !m_pHeader) return false;
+
+	file << "# MultiVolumes scene\n";
+	for (auto i = 0u; i < m_pHeader->NumSources; ++i)
+		file << "source " << GetSourcePath(i) << "\n";
+
+	string line;
+	for (auto i = 0u; i < m_pHeader->NumInstances; ++i)
+	{
+		const auto& instance = m_pInstances[i];
+		line = "instance " + to_string(instance.Source);
+		appendFloats(line, instance.Position, 3);
+		appendFloats(line, &instance.Size, 1);
+		if (instance.Rotation[0] != 0.0f || instance.Rotation[1] != 0.0f ||
+			instance.Rotation[2] != 0.0f || instance.Rotation[3] != 1.0f)
+		{
+			line += " rotation";
+			appendFloats(line, instance.Rotation, 4);
+		}
+		if (instance.SampleScale != 1.0f)
+		{
+			line += " samples";
+			appendFloats(line, &instance.SampleScale, 1);
+		}
+		file << line << "\n";
+	}
+
+	for (auto i = 0u; i < m_pHeader->NumLights; ++i)
+	{
+		const auto& light = m_pLights[i];
+		if (light.Type == LIGHT_AMBIENT) line = "light ambient";
+		else
+		{
+			line = light.Type == LIGHT_POINT ? "light point" : "light directional";
+			appendFloats(line, light.Position, 3);
+		}
+		appendFloats(line, light.Color, 3);
+		appendFloats(line, &light.Intensity, 1);
+		file << line << "\n";
+	}
+
+	return file.good();
+}
+
+bool SceneManifest::WriteBinary(const char* fileName) const
+{
+	ofstream file(fileName, ios::binary);
+	if (!file.is_open() || m_data.empty()) return false;
+
+	file.write(reinterpret_cast<const char*>(m_data.data()), m_data.size());
+
+	return file.good();
+}
+
+void SceneManifest::Create(const vector<const char*>& sourcePaths, const Instance* pInstances,
+	uint32_t numInstances, const Light* pLights, uint32_t numLights)
+{
+	vector<Source> sources(sourcePaths.size());
+	vector<char> paths;
+	for (size_t i = 0; i < sourcePaths.size(); ++i)
+	{
+		const auto length = strlen(sourcePaths[i]);
+		sources[i].PathOffset = static_cast<uint32_t>(paths.size());
+		sources[i].PathLength = static_cast<uint32_t>(length);
+		paths.insert(paths.end(), sourcePaths[i], sourcePaths[i] + length + 1);
+	}
+
+	build(sources, paths, pInstances, numInstances, pLights, numLights);
+}
+
+uint32_t SceneManifest::GetNumSources() const
+{
+	return m_pHeader ? m_pHeader->NumSources : 0;
+}
+
+uint32_t SceneManifest::GetNumInstances() const
+{
+	return m_pHeader ? m_pHeader->NumInstances : 0;
+}
+
+uint32_t SceneManifest::GetNumLights() const
+{
+	return m_pHeader ? m_pHeader->NumLights : 0;
+}
+
+const char* SceneManifest::GetSourcePath(uint32_t i) const
+{
+	return m_pPaths + m_pSources[i].PathOffset;
+}
+
+const SceneManifest::Instance* SceneManifest::GetInstances() const
+{
+	return m_pInstances;
+}
+
+const SceneManifest::Light* SceneManifest::GetLights() const
+{
+	return m_pLights;
+}
+
+uint32_t SceneManifest::GetErrorLine() const
+{
+	return m_errorLine;
+}
+
+void SceneManifest::SetDefaultInstance(Instance& instance)
+{
+	instance = {};
+	instance.Size = 1.0f;
+	instance.Rotation[3] = 1.0f;
+	instance.SampleScale = 1.0f;
+}
+
+bool SceneManifest::read(istream& stream)
+{
+	// One read of the whole file
+	stream.seekg(0, ios::end);
+	const auto size = static_cast<size_t>(stream.tellg());
+	stream.seekg(0, ios::beg);
+
+	vector<uint8_t> data(size);
+	stream.read(reinterpret_cast<char*>(data.data()), size);
+	if (!stream.good()) return false;
+
+	uint32_t magic = 0;
+	if (size >= sizeof(uint32_t)) memcpy(&magic, data.data(), sizeof(uint32_t));
+	if (magic != Magic) return ReadText(reinterpret_cast<const char*>(data.data()), size);
+
+	m_data.swap(data);
+
+	return assign();
+}
+
+bool SceneManifest::assign()
+{
+	m_pHeader = nullptr;
+	if (m_data.size() < sizeof(Header)) return false;
+
+	const auto pHeader = reinterpret_cast<const Header*>(m_data.data());
+	if (pHeader->Magic != Magic || pHeader->Version != Version) return false;
+
+	const auto recordByteSize = sizeof(Source) * pHeader->NumSources +
+		sizeof(Instance) * pHeader->NumInstances + sizeof(Light) * pHeader->NumLights;
+	if (m_data.size() != sizeof(Header) + recordByteSize + pHeader->PathByteSize) return false;
+
+	const auto pSources = reinterpret_cast<const Source*>(pHeader + 1);
+	const auto pInstances = reinterpret_cast<const Instance*>(pSources + pHeader->NumSources);
+	const auto pLights = reinterpret_cast<const Light*>(pInstances + pHeader->NumInstances);
+	const auto pPaths = reinterpret_cast<const char*>(pLights + pHeader->NumLights);
+
+	for (auto i = 0u; i < pHeader->NumSources; ++i)
+	{
+		const auto& source = pSources[i];
+		if (source.PathOffset >= pHeader->PathByteSize ||
+			source.PathLength >= pHeader->PathByteSize - source.PathOffset ||
+			pPaths[source.PathOffset + source.PathLength] != '\0') return false;
+	}
+
+	for (auto i = 0u; i < pHeader->NumInstances; ++i)
+		if (pInstances[i].Source >= pHeader->NumSources) return false;
+
+	for (auto i = 0u; i < pHeader->NumLights; ++i)
+		if (pLights[i].Type > LIGHT_DIRECTIONAL) return false;
+
+	m_pHeader = pHeader;
+	m_pSources = pSources;
+	m_pInstances = pInstances;
+	m_pLights = pLights;
+	m_pPaths = pPaths;
+
+	return true;
+}
+
+void SceneManifest::build(const vector<Source>& sources, const vector<char>& paths,
+	const Instance* pInstances, uint32_t numInstances, const Light* pLights, uint32_t numLights)
+{
+	Header header;
+	header.Magic = Magic;
+	header.Version = Version;
+	header.NumSources = static_cast<uint32_t>(sources.size());
+	header.NumInstances = numInstances;
+	header.NumLights = numLights;
+	header.PathByteSize = static_cast<uint32_t>(paths.size());
+
+	const size_t sizes[] =
+	{
+		sizeof(Header),
+		sizeof(Source) * sources.size(),
+		sizeof(Instance) * numInstances,
+		sizeof(Light) * numLights,
+		paths.size()
+	};
+	const void* pSrcs[] = { &header, sources.data(), pInstances, pLights, paths.data() };
+
+	size_t size = 0;
+	for (const auto& s : sizes) size += s;
+	m_data.resize(size);
+
+	size_t offset = 0;
+	for (auto i = 0u; i < 5; ++i)
+	{
+		if (sizes[i] > 0) memcpy(&m_data[offset], pSrcs[i], sizes[i]);
+		offset += sizes[i];
+	}
+
+	assign();
+}
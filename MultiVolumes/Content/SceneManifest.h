@@ -0,0 +1,109 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// Scene manifest: source volumes, volume instances and lights.
+// Binary form (.vscn): Header | Source[NumSources] | Instance[NumInstances] |
+// Light[NumLights] | NUL-terminated source paths, so it is loaded with one read into a
+// single buffer that the records point into.
+// Text form, one record per line, where an instance refers to a source of a line above;
+// blank lines and lines starting with '#' are skipped:
+//   source <path>
+//   instance <source> <x> <y> <z> <size> [rotation <x> <y> <z> <w>] [samples <scale>]
+//   light point <x> <y> <z> <r> <g> <b> <intensity>
+//   light directional <x> <y> <z> <r> <g> <b> <intensity>
+//   light ambient <r> <g> <b> <intensity>
+//--------------------------------------------------------------------------------------
+class SceneManifest
+{
+public:
+	enum LightType : uint32_t
+	{
+		LIGHT_POINT,
+		LIGHT_AMBIENT,
+		LIGHT_DIRECTIONAL
+	};
+
+	struct Header
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t NumSources;
+		uint32_t NumInstances;
+		uint32_t NumLights;
+		uint32_t PathByteSize;
+	};
+
+	struct Source
+	{
+		uint32_t PathOffset;	// Into the paths, NUL-terminated
+		uint32_t PathLength;
+	};
+
+	struct Instance
+	{
+		float Position[3];
+		float Size;				// Edge length of the volume cube
+		float Rotation[4];		// Quaternion
+		uint32_t Source;
+		float SampleScale;		// Quality hint: scales the max ray samples of the instance
+	};
+
+	struct Light
+	{
+		uint32_t Type;
+		float Position[3];		// Toward the light for LIGHT_DIRECTIONAL; unused for LIGHT_AMBIENT
+		float Color[3];
+		float Intensity;
+	};
+
+	static const uint32_t Magic = 0x4e43534d;	// "MSCN"
+	static const uint32_t Version = 1;
+
+	SceneManifest();
+	virtual ~SceneManifest();
+
+	// The form of a file is told by its magic
+	bool Read(const char* fileName);
+#ifdef _WIN32
+	bool Read(const wchar_t* fileName);
+#endif
+	bool ReadText(const char* pText, size_t size);
+	bool ReadBinary(const void* pData, size_t size);
+	bool WriteText(const char* fileName) const;
+	bool WriteBinary(const char* fileName) const;
+
+	void Create(const std::vector<const char*>& sourcePaths, const Instance* pInstances,
+		uint32_t numInstances, const Light* pLights, uint32_t numLights);
+
+	uint32_t GetNumSources() const;
+	uint32_t GetNumInstances() const;
+	uint32_t GetNumLights() const;
+	const char* GetSourcePath(uint32_t i) const;
+	const Instance* GetInstances() const;
+	const Light* GetLights() const;
+	uint32_t GetErrorLine() const;	// Line of the last text parsing error, 0 for none
+
+	static void SetDefaultInstance(Instance& instance);
+
+protected:
+	bool read(std::istream& stream);
+	bool assign();
+	void build(const std::vector<Source>& sources, const std::vector<char>& paths,
+		const Instance* pInstances, uint32_t numInstances, const Light* pLights, uint32_t numLights);
+
+	std::vector<uint8_t> m_data;	// The binary form
+	const Header* m_pHeader;
+	const Source* m_pSources;
+	const Instance* m_pInstances;
+	const Light* m_pLights;
+	const char* m_pPaths;
+	uint32_t m_errorLine;
+};
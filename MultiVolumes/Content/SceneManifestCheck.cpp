@@ -0,0 +1,139 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "SceneManifest.h"
+#include "ToolCheck.h"
+
+using namespace std;
+
+static bool isSameScene(const SceneManifest& a, const SceneManifest& b)
+{
+	if (a.GetNumSources() != b.GetNumSources() || a.GetNumInstances() != b.GetNumInstances() ||
+		a.GetNumLights() != b.GetNumLights()) return false;
+
+	for (auto i = 0u; i < a.GetNumSources(); ++i)
+		if (strcmp(a.GetSourcePath(i), b.GetSourcePath(i)) != 0) return false;
+
+	return memcmp(a.GetInstances(), b.GetInstances(), sizeof(SceneManifest::Instance) * a.GetNumInstances()) == 0 &&
+		memcmp(a.GetLights(), b.GetLights(), sizeof(SceneManifest::Light) * a.GetNumLights()) == 0;
+}
+
+// Times reading a generated scene in both forms, the file read included, and checks that
+// both forms read back the same scene
+int BenchScene(int argc, char* argv[])
+{
+	auto numInstances = 100000u;
+	auto numSources = 64u;
+	auto numIterations = 5u;
+	string prefix = "bench_scene";
+	ToolArgs args;
+	args.Add("-instances", numInstances);
+	args.Add("-sources", numSources, 1);
+	args.Add("-iterations", numIterations, 1);
+	args.Add("-out", prefix);
+	if (!args.Parse(argc, argv)) return EXIT_FAILURE;
+
+	// Instances on a jittered grid, with pseudo-random sources, rotations and quality hints
+	vector<string> paths(numSources);
+	vector<const char*> pPaths(numSources);
+	for (auto i = 0u; i < numSources; ++i)
+	{
+		paths[i] = "Assets/Volume" + to_string(i) + ".dds";
+		pPaths[i] = paths[i].c_str();
+	}
+
+	auto state = 1u;
+	const auto random = [&state]()
+	{
+		state = state * 1664525u + 1013904223u;
+
+		return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+	};
+
+	const auto rowLength = static_cast<uint32_t>(ceilf(sqrtf(static_cast<float>(numInstances))));
+	vector<SceneManifest::Instance> instances(numInstances);
+	for (auto i = 0u; i < numInstances; ++i)
+	{
+		auto& instance = instances[i];
+		SceneManifest::SetDefaultInstance(instance);
+		instance.Source = static_cast<uint32_t>(random() * numSources) % numSources;
+		instance.Position[0] = (i % rowLength + random() * 0.5f) * 30.0f;
+		instance.Position[1] = random() * 10.0f;
+		instance.Position[2] = (i / rowLength + random() * 0.5f) * 30.0f;
+		instance.Size = 10.0f + random() * 20.0f;
+		if (i % 2)
+		{
+			const auto angle = random() * 3.14159265f;
+			instance.Rotation[1] = sinf(angle);
+			instance.Rotation[3] = cosf(angle);
+		}
+		if (i % 3 == 0) instance.SampleScale = 0.25f + random() * 0.75f;
+	}
+
+	SceneManifest::Light lights[3] = {};
+	lights[0].Type = SceneManifest::LIGHT_POINT;
+	lights[0].Position[0] = lights[0].Position[1] = 75.0f;
+	lights[0].Position[2] = -75.0f;
+	lights[0].Color[0] = 1.0f;
+	lights[0].Color[1] = 0.7f;
+	lights[0].Color[2] = 0.3f;
+	lights[0].Intensity = 9.42477796f;
+	lights[1].Type = SceneManifest::LIGHT_AMBIENT;
+	lights[1].Color[0] = 0.4f;
+	lights[1].Color[1] = 0.6f;
+	lights[1].Color[2] = 1.0f;
+	lights[1].Intensity = 6.28318531f;
+	lights[2].Type = SceneManifest::LIGHT_DIRECTIONAL;
+	lights[2].Position[0] = -1.0f;
+	lights[2].Position[1] = 0.5f;
+	lights[2].Color[0] = lights[2].Color[1] = lights[2].Color[2] = 1.0f;
+	lights[2].Intensity = 0.5f;
+
+	SceneManifest scene;
+	scene.Create(pPaths, instances.data(), numInstances, lights, 3);
+
+	const auto textFileName = prefix + ".txt";
+	const auto binaryFileName = prefix + ".vscn";
+	if (!scene.WriteText(textFileName.c_str()) || !scene.WriteBinary(binaryFileName.c_str()))
+	{
+		fprintf(stderr, "Failed to write %s.\n", prefix.c_str());
+
+		return EXIT_FAILURE;
+	}
+
+	printf("%u instances, %u sources\n", numInstances, numSources);
+
+	CheckReport report;
+	for (const auto& fileName : { textFileName, binaryFileName })
+	{
+		auto bestSeconds = DBL_MAX;
+		auto succeeded = true;
+		for (auto n = 0u; n < numIterations; ++n)
+		{
+			SceneManifest readScene;
+			const auto start = chrono::steady_clock::now();
+			succeeded = readScene.Read(fileName.c_str()) && succeeded;
+			bestSeconds = (min)(chrono::duration<double>(chrono::steady_clock::now() - start).count(), bestSeconds);
+			succeeded = succeeded && isSameScene(scene, readScene);
+		}
+
+		ifstream file(fileName, ios::binary | ios::ate);
+		const auto fileSize = static_cast<double>(file.tellg());
+		printf("%-24s %10.1f KB, read in %8.3f ms, %7.1f M instances/s\n", fileName.c_str(),
+			fileSize / 1024.0, bestSeconds * 1000.0, numInstances / bestSeconds * 1.0e-6);
+		report.Expect(("Round trip of " + fileName).c_str(), succeeded);
+	}
+
+	return report.Finish();
+}
@@ -0,0 +1,34 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+Texture2D<float> g_txSrc;		// The depth map for level 0, otherwise the level above
+RWTexture2D<float> g_rwDst;
+
+//--------------------------------------------------------------------------------------
+// Reduce to the farthest depth of the 2x2 source texels; the last texel of a row or
+// column also takes the odd source texel left over (HiZPyramid::Build() on the CPU)
+//--------------------------------------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint2 DTid : SV_DispatchThreadID)
+{
+	uint2 dstSize, srcSize;
+	g_rwDst.GetDimensions(dstSize.x, dstSize.y);
+	if (any(DTid >= dstSize)) return;
+
+	g_txSrc.GetDimensions(srcSize.x, srcSize.y);
+	const uint2 first = DTid * 2;
+	uint2 last;
+	last.x = DTid.x + 1 == dstSize.x ? srcSize.x - 1 : first.x + 1;
+	last.y = DTid.y + 1 == dstSize.y ? srcSize.y - 1 : first.y + 1;
+
+	float depth = 0.0;
+	for (uint y = first.y; y <= last.y; ++y)
+		for (uint x = first.x; x <= last.x; ++x)
+			depth = max(g_txSrc[uint2(x, y)], depth);
+
+	g_rwDst[DTid] = depth;
+}
@@ -0,0 +1,77 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include "RayMarch.hlsli"
+#include "DeepShadow.hlsli"
+
+//--------------------------------------------------------------------------------------
+// Constant buffer
+//--------------------------------------------------------------------------------------
+cbuffer cbDeepShadow : register (b2)
+{
+	uint g_lightGridSize;	// Light rays march the grid mips of the light maps
+};
+
+//--------------------------------------------------------------------------------------
+// Buffers and textures
+//--------------------------------------------------------------------------------------
+RWTexture2DArray<uint4> g_rwDeepShadow;
+
+StructuredBuffer<PerObject>		g_roPerObject	: register (t0);
+StructuredBuffer<VolumeDesc>	g_roVolumes		: register (t1);
+
+//--------------------------------------------------------------------------------------
+// Compute Shader
+//--------------------------------------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint2 DTid : SV_DispatchThreadID)
+{
+	uint3 mapSize;
+	g_rwDeepShadow.GetDimensions(mapSize.x, mapSize.y, mapSize.z);
+	if (any(DTid >= mapSize.xy)) return;
+
+	uint2 structInfo;
+	g_roVolumes.GetDimensions(structInfo.x, structInfo.y);
+
+	// The light ray of the texel, from the far plane toward the light; t in [0, 1] runs the
+	// depth from 1 to 0
+	float2 pos = (DTid + 0.5) / mapSize.xy * 2.0 - 1.0;
+	pos.y = -pos.y;
+	const float4 farPt = mul(float4(pos, 1.0, 1.0), g_shadowViewProjI);
+	const float4 nearPt = mul(float4(pos, 0.0, 1.0), g_shadowViewProjI);
+	const float3 rayOrigin = farPt.xyz / farPt.w;
+	const float3 rayDir = nearPt.xyz / nearPt.w - rayOrigin;
+
+	uint knots[DEEP_SHADOW_KNOTS];
+	[unroll]
+	for (uint i = 0; i < DEEP_SHADOW_KNOTS; ++i) knots[i] = EMPTY_KNOT;
+
+	for (uint n = 0; n < structInfo.x; ++n)
+	{
+		uint volTexId = GetSourceTextureId(g_roVolumes[n]);
+		volTexId = WaveReadLaneFirst(volTexId);
+
+		// Slabs of the volume cube
+		const PerObject perObject = g_roPerObject[n];
+		const float3 localRayOrigin = mul(float4(rayOrigin, 1.0), perObject.WorldI);
+		const float3 localRayDir = mul(rayDir, (float3x3)perObject.WorldI);
+		const float3 t0 = (-1.0 - localRayOrigin) / localRayDir;
+		const float3 t1 = (1.0 - localRayOrigin) / localRayDir;
+		const float3 tMin = min(t0, t1), tMax = max(t0, t1);
+		const float tNear = max(max(max(tMin.x, tMin.y), tMin.z), 0.0);
+		const float tFar = min(min(min(tMax.x, tMax.y), tMax.z), 1.0);
+		if (tNear >= tFar) continue;
+
+		// Transmittance toward the light, as the light rays of CSRayMarchL.hlsl
+		const uint mipLevel = GetLightMipLevel(volTexId, g_lightGridSize);
+		min16float transm = 1.0;
+		CastLightRay(transm, volTexId, clamp(localRayOrigin + localRayDir * tNear, -1.0, 1.0),
+			normalize(localRayDir), g_step, g_numSamples, mipLevel);
+
+		InsertSpan(knots, 1.0 - tFar, 1.0 - tNear, transm);
+	}
+
+	g_rwDeepShadow[uint3(DTid, 0)] = uint4(knots[0], knots[1], knots[2], knots[3]);
+	g_rwDeepShadow[uint3(DTid, 1)] = uint4(knots[4], knots[5], knots[6], knots[7]);
+}
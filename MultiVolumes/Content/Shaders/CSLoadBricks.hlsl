@@ -0,0 +1,74 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#define BRICK_EMPTY		0
+#define BRICK_CONSTANT	1
+#define BRICK_DATA		2
+
+//--------------------------------------------------------------------------------------
+// Constant buffer
+//--------------------------------------------------------------------------------------
+cbuffer cbBricks
+{
+	uint3 g_volumeSize;
+	uint g_brickSize;
+	uint3 g_brickCount;
+};
+
+//--------------------------------------------------------------------------------------
+// Buffers and textures
+//--------------------------------------------------------------------------------------
+StructuredBuffer<uint2> g_roBrickTable;
+Buffer<float> g_roBrickPool;
+RWTexture3D<float4> g_rwGrid;
+
+//--------------------------------------------------------------------------------------
+// Fetch a source voxel through the brick table (clamp to edge)
+//--------------------------------------------------------------------------------------
+float FetchVoxel(int3 voxel)
+{
+	const uint3 pos = clamp(voxel, 0, int3(g_volumeSize) - 1);
+	const uint3 brick = pos / g_brickSize;
+	const uint3 local = pos % g_brickSize;
+	const uint2 entry = g_roBrickTable[(brick.z * g_brickCount.y + brick.y) * g_brickCount.x + brick.x];
+
+	if (entry.x == BRICK_DATA)
+	{
+		const uint brickVoxelCount = g_brickSize * g_brickSize * g_brickSize;
+		const uint localIdx = (local.z * g_brickSize + local.y) * g_brickSize + local.x;
+
+		return g_roBrickPool[entry.y * brickVoxelCount + localIdx];
+	}
+
+	return entry.x == BRICK_CONSTANT ? asfloat(entry.y) : 0.0;
+}
+
+[numthreads(4, 4, 4)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+	float3 gridSize;
+	g_rwGrid.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
+
+	// Trilinear resampling, equivalent to the linear-clamp sampling of the dense path
+	const float3 uvw = (DTid + 0.5) / gridSize;
+	const float3 pos = uvw * g_volumeSize - 0.5;
+	const float3 p0 = floor(pos);
+	const float3 t = pos - p0;
+	const int3 i0 = int3(p0);
+
+	const float a000 = FetchVoxel(i0);
+	const float a100 = FetchVoxel(i0 + int3(1, 0, 0));
+	const float a010 = FetchVoxel(i0 + int3(0, 1, 0));
+	const float a110 = FetchVoxel(i0 + int3(1, 1, 0));
+	const float a001 = FetchVoxel(i0 + int3(0, 0, 1));
+	const float a101 = FetchVoxel(i0 + int3(1, 0, 1));
+	const float a011 = FetchVoxel(i0 + int3(0, 1, 1));
+	const float a111 = FetchVoxel(i0 + int3(1, 1, 1));
+
+	const float a0 = lerp(lerp(a000, a100, t.x), lerp(a010, a110, t.x), t.y);
+	const float a1 = lerp(lerp(a001, a101, t.x), lerp(a011, a111, t.x), t.y);
+	const float a = lerp(a0, a1, t.z);
+
+	g_rwGrid[DTid] = float4(1.0.xxx, a * 0.25);
+}
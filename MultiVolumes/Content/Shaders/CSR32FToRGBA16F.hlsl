@@ -2,10 +2,19 @@
 // Copyright (c) XU, Tianchen. All rights reserved.
 //--------------------------------------------------------------------------------------
 
+//--------------------------------------------------------------------------------------
+// Constant buffer
+//--------------------------------------------------------------------------------------
+cbuffer cbFileSrc
+{
+	float3 g_uvwScale;		// Crops the block padding of BC4 sources
+	float g_densityScale;	// Restores the range of normalized sources
+};
+
 //--------------------------------------------------------------------------------------
 // Textures
 //--------------------------------------------------------------------------------------
-Texture3D<float> g_txGrid;
+Texture3D<float> g_txGrid;	// R32F, R16F, R8 or BC4, filtered by the sampler directly
 RWTexture3D<float4> g_rwGrid;
 
 //--------------------------------------------------------------------------------------
@@ -19,8 +28,8 @@ void main(uint3 DTid : SV_DispatchThreadID)
 	float3 gridSize;
 	g_rwGrid.GetDimensions(gridSize.x, gridSize.y, gridSize.z);
 
-	const float3 uvw = (DTid + 0.5) / gridSize;
-	const float a = g_txGrid.SampleLevel(g_smpLinear, uvw, 0.0);
+	const float3 uvw = (DTid + 0.5) / gridSize * g_uvwScale;
+	const float a = g_txGrid.SampleLevel(g_smpLinear, uvw, 0.0) * g_densityScale;
 
 	g_rwGrid[DTid] = float4(1.0.xxx, a * 0.25);
 }
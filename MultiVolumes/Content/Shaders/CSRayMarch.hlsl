@@ -14,9 +14,17 @@ RWTexture2DArray<float> g_rwCubeDepths[]	: register (u0, space1);
 #endif
 
 StructuredBuffer<PerObject>	g_roPerObject		: register (t0);
-StructuredBuffer<uint>		g_roVisibleVolumes	: register (t1);
+StructuredBuffer<uint>		g_roCubeMapFaces	: register (t1);	// Work items binned by mip level
 Buffer<uint4>				g_roVolumes			: register (t2);
 
+//--------------------------------------------------------------------------------------
+// Constant buffer
+//--------------------------------------------------------------------------------------
+cbuffer cbMipBin
+{
+	uint g_mipBin;	// Of the indirect dispatch arg, whose groups in x and y cover a face at this mip
+};
+
 //--------------------------------------------------------------------------------------
 // Texture sampler
 //--------------------------------------------------------------------------------------
@@ -74,31 +82,29 @@ float3 GetClipPos(float3 rayOrigin, float3 rayDir, matrix worldViewProj)
 //--------------------------------------------------------------------------------------
 // Compute Shader
 //--------------------------------------------------------------------------------------
-[numthreads(8, 8, 6)]
-void main(uint2 DTid : SV_DispatchThreadID, uint3 GTid : SV_GroupThreadID, uint3 Gid : SV_GroupID)
+[numthreads(8, 8, 1)]
+void main(uint2 DTid : SV_DispatchThreadID, uint3 Gid : SV_GroupID)
 {
-	uint volumeId = g_roVisibleVolumes[Gid.z];
-	VolumeInfo volumeInfo = (VolumeInfo)g_roVolumes[volumeId];
-	volumeInfo.MaskBits = WaveReadLaneAt(volumeInfo.MaskBits, 0);
-
-	const uint faceId = WaveReadLaneAt(GTid.z, 0);
-	if ((volumeInfo.MaskBits & (1u << faceId)) == 0) return;
+	// Work item of a face ray marched in cube-map space: volume Id << 3 | face
+	uint2 structInfo;
+	g_roCubeMapFaces.GetDimensions(structInfo.x, structInfo.y);
+	const uint item = g_roCubeMapFaces[structInfo.x / NUM_CUBE_MIP * g_mipBin + Gid.z];
+	const uint volumeId = item >> 3;
+	const uint faceId = item & 0x7;
 
-	volumeId = WaveReadLaneAt(volumeId, 0);
+	VolumeInfo volumeInfo = (VolumeInfo)g_roVolumes[volumeId];
 	const PerObject perObject = g_roPerObject[volumeId];
 	float3 rayOrigin = mul(float4(g_eyePt, 1.0), perObject.WorldI);
 
-	volumeInfo.MipLevel = WaveReadLaneAt(volumeInfo.MipLevel, 0);
-	volumeInfo.SmpCount = WaveReadLaneAt(volumeInfo.SmpCount, 0);
 	const uint uavIdx = NUM_CUBE_MIP * volumeId + volumeInfo.MipLevel;
-	const float3 target = GetLocalPos(DTid, GTid.z, g_rwCubeMaps[uavIdx]);
+	const float3 target = GetLocalPos(DTid, faceId, g_rwCubeMaps[uavIdx]);
 	const float3 rayDir = normalize(target - rayOrigin);
 	if (!ComputeRayOrigin(rayOrigin, rayDir)) return;
 
 	float tMax = ComputeTargetHit(rayOrigin, target, rayDir);
 	const min16float stepScale = g_maxDist / min16float(volumeInfo.SmpCount);
 
-	const uint3 index = uint3(DTid, GTid.z);
+	const uint3 index = uint3(DTid, faceId);
 #ifdef _HAS_DEPTH_MAP_
 	// Calculate occluded end point
 	const float3 pos = GetClipPos(rayOrigin, rayDir, perObject.WorldViewProj);
@@ -106,8 +112,6 @@ void main(uint2 DTid : SV_DispatchThreadID, uint3 GTid : SV_GroupThreadID, uint3
 	tMax = GetTMax(pos, rayOrigin, rayDir, tMax, perObject.WorldViewProjI);
 #endif
 
-	volumeInfo.VolTexId = WaveReadLaneAt(volumeInfo.VolTexId, 0);
-
 	// In-scattered radiance with inverted transmittance
 	min16float4 scatter = 0.0;
 
@@ -120,8 +124,17 @@ void main(uint2 DTid : SV_DispatchThreadID, uint3 GTid : SV_GroupThreadID, uint3
 		if (any(abs(pos) > 1.0)) break;
 		const float3 uvw = LocalToTex3DSpace(pos);
 
-		// Get a sample
-		min16float4 color = GetSample(volumeInfo.VolTexId, uvw);
+		// Leap over empty macro cells
+		const float skip = GetEmptySpaceSkip(volumeInfo.VolTexId, uvw, rayDir);
+		if (skip > 0.0)
+		{
+			t += skip;
+			if (t > tMax) break;
+			continue;
+		}
+
+		// Get a sample, from the grid mip matching the cube-map level, as the sample count does
+		min16float4 color = GetSample(volumeInfo.VolTexId, uvw, volumeInfo.MipLevel);
 		min16float newStep = stepScale;
 
 		// Skip empty space
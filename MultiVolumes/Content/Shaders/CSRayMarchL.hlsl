@@ -3,6 +3,26 @@
 //--------------------------------------------------------------------------------------
 
 #include "RayMarch.hlsli"
+#include "DeepShadow.hlsli"
+
+#define DEEP_SHADOW_BIAS	0.0027
+
+//--------------------------------------------------------------------------------------
+// Struct
+//--------------------------------------------------------------------------------------
+struct LightDesc
+{
+	float4 Position;	// w: 1 for a point light, 0 for a directional one
+	float4 Radiance;
+};
+
+//--------------------------------------------------------------------------------------
+// Constant buffer
+//--------------------------------------------------------------------------------------
+cbuffer cbLightSlot : register (b2)
+{
+	uint g_lightSlot;	// Of the schedule, a dispatch per light map at its size
+};
 
 //--------------------------------------------------------------------------------------
 // Buffers and textures
@@ -11,8 +31,48 @@ RWTexture3D<float3> g_rwLightMaps[];
 
 StructuredBuffer<PerObject>		g_roPerObject	: register (t0);
 StructuredBuffer<VolumeDesc>	g_roVolumes		: register (t1);
-StructuredBuffer<uint>		g_roVisibleVolumes	: register (t2);
-StructuredBuffer<uint>	g_roVisibleVolumeCount	: register (t3);
+StructuredBuffer<uint4>		g_roLightSchedule	: register (t3, space2);	// Volume, first and number of candidates, lights
+StructuredBuffer<uint>		g_roLightCandidates	: register (t4, space2);	// Volumes that the AO rays may pass
+Texture2DArray<uint4>		g_txDeepShadow		: register (t5, space2);
+StructuredBuffer<LightDesc>	g_roLights			: register (t6, space2);
+StructuredBuffer<uint>		g_roLightIndices	: register (t7, space2);	// Lights of the volumes of the schedule
+
+//--------------------------------------------------------------------------------------
+// Direction toward a light in volume space, and the falloff of a point light, by
+// 1 / max(d^2, 1) as LightClusterer takes it
+//--------------------------------------------------------------------------------------
+float3 GetLocalLightDir(float4 lightPos, float3 pos, float4x3 worldI, out float falloff)
+{
+	const float3 toLight = lightPos.xyz - pos * lightPos.w;
+	falloff = lightPos.w > 0.0 ? 1.0 / max(dot(toLight, toLight), 1.0) : 1.0;
+
+	return normalize(mul(toLight, (float3x3)worldI));
+}
+
+//--------------------------------------------------------------------------------------
+// Transmittance of the other volumes, where the light ray leaves the volume
+//--------------------------------------------------------------------------------------
+min16float DeepShadowTest(float3 localPos, float3 localDir, float4x3 world)
+{
+	// Exit of the [-1, 1] cube
+	const float3 t = (sign(localDir) - localPos) / localDir;
+	const float tExit = max(min(min(t.x, t.y), t.z), 0.0);
+	const float3 pos = mul(float4(localPos + localDir * tExit, 1.0), world);
+
+	const float3 lsPos = mul(float4(pos, 1.0), g_shadowViewProj).xyz;
+	float2 shadowUV = lsPos.xy * 0.5 + 0.5;
+	shadowUV.y = 1.0 - shadowUV.y;
+	if (any(shadowUV < 0.0) || any(shadowUV >= 1.0)) return 1.0;
+
+	uint3 mapSize;
+	g_txDeepShadow.GetDimensions(mapSize.x, mapSize.y, mapSize.z);
+	const uint2 texel = shadowUV * mapSize.xy;
+	const uint4 knots0 = g_txDeepShadow[uint3(texel, 0)];
+	const uint4 knots1 = g_txDeepShadow[uint3(texel, 1)];
+	const uint knots[DEEP_SHADOW_KNOTS] = { knots0.x, knots0.y, knots0.z, knots0.w, knots1.x, knots1.y, knots1.z, knots1.w };
+
+	return min16float(LookupDeepShadow(knots, lsPos.z - DEEP_SHADOW_BIAS));
+}
 
 //--------------------------------------------------------------------------------------
 // Compute Shader
@@ -20,17 +80,15 @@ StructuredBuffer<uint>	g_roVisibleVolumeCount	: register (t3);
 [numthreads(4, 4, 4)]
 void main(uint3 DTid : SV_DispatchThreadID)
 {
-	float3 gridSize;
-	g_rwLightMaps[0].GetDimensions(gridSize.x, gridSize.y, gridSize.z);
-
 	uint2 structInfo;
 	g_roVolumes.GetDimensions(structInfo.x, structInfo.y);
 
-	const uint visibleVolumeCount = g_roVisibleVolumeCount[0];
-	uint volumeId;
-	if (visibleVolumeCount) volumeId = g_roVisibleVolumes[g_frameIdx % visibleVolumeCount];
-	else volumeId = g_frameIdx % structInfo.x;
-	volumeId = WaveReadLaneAt(volumeId, 0);
+	const uint4 entry = g_roLightSchedule[g_lightSlot];
+	const uint volumeId = entry.x;
+
+	// The light map of each volume has its own size; writes past it are dropped
+	float3 gridSize;
+	g_rwLightMaps[volumeId].GetDimensions(gridSize.x, gridSize.y, gridSize.z);
 
 	float4 rayOrigin;
 	rayOrigin.xyz = (DTid + 0.5) / gridSize * 2.0 - 1.0;
@@ -44,6 +102,7 @@ void main(uint3 DTid : SV_DispatchThreadID)
 	const PerObject perObject = g_roPerObject[volumeId];
 	const min16float density = GetSample(volTexId, uvw).w;
 	const bool hasDensity = density >= ZERO_THRESHOLD;
+	const uint mipLevel = GetLightMipLevel(volTexId, gridSize.x);
 
 	rayOrigin.xyz = mul(rayOrigin, perObject.World);	// Light-map space to world space
 
@@ -52,6 +111,7 @@ void main(uint3 DTid : SV_DispatchThreadID)
 #else
 	min16float shadow = 1.0;
 #endif
+	float3 lighting = 0.0;
 
 #ifdef _HAS_LIGHT_PROBE_
 	min16float ao = 1.0;
@@ -74,40 +134,58 @@ void main(uint3 DTid : SV_DispatchThreadID)
 		}
 #endif
 
-		for (uint n = 0; n < structInfo.x; ++n)
+		// Self-shadowing at the light-map resolution, and the other volumes by a lookup of the
+		// deep shadow map
+		if (shadow >= ZERO_THRESHOLD)
 		{
-			uint volTexId = GetSourceTextureId(g_roVolumes[n]);
-			volTexId = WaveReadLaneFirst(volTexId);
-
-			const PerObject perObject = g_roPerObject[n];
-			float3 localRayOrigin = mul(rayOrigin, perObject.WorldI);	// World space to volume space
+			const float3 localRayOrigin = (DTid + 0.5) / gridSize * 2.0 - 1.0;
+			float falloff;
+			const float3 rayDir = GetLocalLightDir(g_lightPos, rayOrigin.xyz, perObject.WorldI, falloff);
+			CastLightRay(shadow, volTexId, localRayOrigin, rayDir, g_step, g_numSamples, mipLevel);
+			shadow *= DeepShadowTest(localRayOrigin, rayDir, perObject.World);
+		}
 
-			if (shadow >= ZERO_THRESHOLD)
+		// The lights that reach the volume, self-shadowed only
+		{
+			const float3 localRayOrigin = (DTid + 0.5) / gridSize * 2.0 - 1.0;
+			const uint firstLight = entry.w & 0xffffff;
+			const uint numLights = entry.w >> 24;
+			for (uint k = 0; k < numLights; ++k)
 			{
-#ifdef _POINT_LIGHT_
-				const float3 localSpaceLightPt = mul(g_lightPos, perObject.WorldI);
-				const float3 rayDir = normalize(localSpaceLightPt - localRayOrigin);
-#else
-				const float3 localSpaceLightPt = mul(g_lightPos.xyz, (float3x3)perObject.WorldI);
-				const float3 rayDir = normalize(localSpaceLightPt);
-#endif
-				// Transmittance
-				if (!ComputeRayOrigin(localRayOrigin, rayDir)) continue;
-				CastLightRay(shadow, volTexId, localRayOrigin, rayDir, g_step, g_numSamples);
+				const LightDesc light = g_roLights[g_roLightIndices[firstLight + k]];
+				float falloff;
+				const float3 rayDir = GetLocalLightDir(light.Position, rayOrigin.xyz, perObject.WorldI, falloff);
+
+				min16float transm = 1.0;
+				CastLightRay(transm, volTexId, localRayOrigin, rayDir, g_step, g_numSamples, mipLevel);
+				lighting += transm * falloff * light.Radiance.xyz;
 			}
+		}
 
 #ifdef _HAS_LIGHT_PROBE_
-			if (g_hasLightProbe)
+		// AO rays through the candidate volumes only, or all of them if the candidate lists
+		// overflowed
+		if (g_hasLightProbe)
+		{
+			const uint numCandidates = entry.z != 0xffffffff ? entry.z : structInfo.x;
+			for (uint k = 0; k < numCandidates; ++k)
 			{
+				const uint n = entry.z != 0xffffffff ? g_roLightCandidates[entry.y + k] : k;
+				uint volTexId = GetSourceTextureId(g_roVolumes[n]);
+				volTexId = WaveReadLaneFirst(volTexId);
+
+				const PerObject perObject = g_roPerObject[n];
+				float3 localRayOrigin = mul(rayOrigin, perObject.WorldI);	// World space to volume space
+
 				const float3 rayDir = normalize(mul(aoRayDir, (float3x3)perObject.WorldI));
 				if (!ComputeRayOrigin(localRayOrigin, rayDir)) continue;
 
 				min16float transm = 1.0;
-				CastLightRay(transm, volTexId, localRayOrigin, rayDir, g_step, g_numSamples);
+				CastLightRay(transm, volTexId, localRayOrigin, rayDir, g_step, g_numSamples, mipLevel);
 				ao *= n == volumeId ? transm : pow(saturate(transm + 0.5), 0.25);
 			}
-#endif
 		}
+#endif
 	}
 
 	const min16float3 lightColor = min16float3(g_lightColor.xyz * g_lightColor.w);
@@ -117,5 +195,5 @@ void main(uint3 DTid : SV_DispatchThreadID)
 	ambient = g_hasLightProbe ? ao * min16float3(irradiance) : ambient;
 #endif
 
-	g_rwLightMaps[volumeId][DTid] = shadow * lightColor + ambient;
+	g_rwLightMaps[volumeId][DTid] = shadow * lightColor + min16float3(lighting) + ambient;
 }
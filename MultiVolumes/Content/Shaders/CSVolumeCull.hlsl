@@ -5,7 +5,14 @@
 #include "Common.hlsli"
 #include "VolumeCull.hlsli"
 
-AppendStructuredBuffer<uint> g_rwCubeMapVolumes;
+// Size of the indirect dispatch arg of a mip bin: mip level, thread groups in x, y and z,
+// the last being the work items, and the cube-map volumes of the bin
+#define DISPATCH_ARG_SIZE	(sizeof(uint) * 5)
+
+// Work items of the cube-map faces, volume Id << 3 | face each, binned by mip level with
+// bin i from 6 * i * the volume count; a thread group ray marches an 8x8 tile of an item
+RWStructuredBuffer<uint> g_rwCubeMapFaces;
+RWByteAddressBuffer g_rwCubeMapDispatchArgs : register (u3);
 
 //--------------------------------------------------------------------------------------
 // Main compute shader for volume culling
@@ -28,25 +35,28 @@ void main(uint Gid : SV_GroupID)
 	// Project vertex to viewport space
 	const float3 v = ProjectToViewport(wTid.x, perObject.WorldViewProj, g_viewport);
 
-	// If any vertices are inside viewport
-	const bool isInView = all(v.xy <= g_viewport && v.xy >= 0.0) && v.z > 0.0 && v.z < 1.0;
-	const uint waveMask = WaveActiveBallot(isInView).x;
-	const uint volumeVis = (waveMask >> (8 * wTid.y)) & 0xff;
-	//if (wTid.x == 0) g_rwVolumeVis[volumeId] = volumeVis;
+	// Frustum culling by separating axes
+	const uint baseLaneId = 8 * wTid.y;
+	const bool isSeparated = IsSeparatedFromFrustum(perObject.WorldViewProj, perObject.WorldI,
+		g_screenToWorld, wTid.x, baseLaneId);
+	const uint waveMask = WaveActiveBallot(isSeparated).x;
+	if ((waveMask >> baseLaneId) & 0xff) return;
+
+	// A sample scale of 0 hides the volume, e.g. dropped by the sample budget
+	if (perObject.SampleScale <= 0.0) return;
 
-	// Viewport-visibility culling
-	if (volumeVis == 0) return;
+	// Occlusion culling against the opaque depth
+	if (IsOccluded(v, g_viewport, baseLaneId)) return;
 
 	VolumeIn volumeIn;
 	uint raySampleCount;
 	if (wTid.x == 0)
 	{
 		volumeIn = g_roVolumes[volumeId];
-		raySampleCount = g_numSamples;
+		raySampleCount = max(uint(g_numSamples * perObject.SampleScale), 1);
 	}
 
 	// Visiblity mask
-	const uint baseLaneId = 8 * wTid.y;
 	const uint faceMask = GenVisibilityMask(perObject.WorldI, g_eyePt, wTid.x, baseLaneId);
 
 	// Get per-lane edges
@@ -54,24 +64,52 @@ void main(uint Gid : SV_GroupID)
 
 	// Cube map LOD
 	const uint cubeMapSize = GetCubeMapSize(volumeIn);
-	const uint mipLevel = EstimateCubeMapLOD(raySampleCount, GetNumMips(volumeIn), cubeMapSize, ep, wTid);
+	const bool isNearClipped = IsNearClipped(perObject.WorldViewProj);
+	const uint mipLevel = EstimateCubeMapLOD(raySampleCount, GetNumMips(volumeIn), cubeMapSize, ep, wTid, isNearClipped);
 
-	// Volume projection coverage
-	const float projCov = EstimateProjCoverage(ep, wTid, faceMask, baseLaneId);
+	// Volume projection coverage, the whole viewport once near-clipped
+	const float faceCov = EstimateFaceCoverage(ep, wTid.x, baseLaneId);
+	float projCov = EstimateProjCoverage(faceCov, wTid, faceMask);
+	if (isNearClipped) projCov = g_viewport.x * g_viewport.y;
 
+#if _ADAPTIVE_RAYMARCH_
+	// Visible pixels of the cube map, for the choice of the whole volume
+	bool useCubeMap = false;
 	if (wTid.x == 0)
 	{
-		// Visible pixels of the cube map
-#if _ADAPTIVE_RAYMARCH_
 		const float cubeMapPix = EstimateCubeMapVisiblePixels(faceMask, mipLevel, cubeMapSize);
-		const bool useCubeMap = cubeMapPix <= projCov;
+		useCubeMap = UseCubeMap(faceMask, cubeMapPix, projCov, raySampleCount);
+	}
+
+	// Render scheme per visible face
+	const uint cubeMapFaces = SelectCubeMapFaces(faceMask, faceCov, mipLevel, cubeMapSize,
+		raySampleCount, useCubeMap, isNearClipped, wTid.x, baseLaneId);
 #else
-		const bool useCubeMap = true;
+	const uint cubeMapFaces = faceMask;
 #endif
-		const uint maskBits = useCubeMap ? (faceMask | CUBEMAP_RAYMARCH_BIT) : faceMask;
+
+	// Compact the cube-map faces into work items, a lane per face
+	const uint bin = WaveReadLaneAt(mipLevel, baseLaneId);
+	uint itemBase = 0;
+	if (wTid.x == 0 && cubeMapFaces)
+	{
+		g_rwCubeMapDispatchArgs.InterlockedAdd(DISPATCH_ARG_SIZE * bin + sizeof(uint3), countbits(cubeMapFaces), itemBase);
+		g_rwCubeMapDispatchArgs.InterlockedAdd(DISPATCH_ARG_SIZE * bin + sizeof(uint4), 1);
+	}
+	itemBase = WaveReadLaneAt(itemBase, baseLaneId);
+
+	if (wTid.x < 6 && (cubeMapFaces & (1u << wTid.x)))
+	{
+		const uint i = itemBase + countbits(cubeMapFaces & ((1u << wTid.x) - 1));
+		g_rwCubeMapFaces[6 * structInfo.x * bin + i] = (volumeId << 3) | wTid.x;
+	}
+
+	if (wTid.x == 0)
+	{
+		uint maskBits = faceMask | (cubeMapFaces << CUBEMAP_FACE_SHIFT);
+		if (cubeMapFaces) maskBits |= CUBEMAP_RAYMARCH_BIT;
 		const uint volTexId = GetSourceTextureId(volumeIn);
 
-		if (useCubeMap) g_rwCubeMapVolumes.Append(volumeId);
 		g_rwVolumes[volumeId] = uint4(mipLevel, raySampleCount, maskBits, volTexId);
 		g_rwVisibleVolumes.Append(volumeId);
 	}
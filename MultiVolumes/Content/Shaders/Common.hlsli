@@ -9,7 +9,8 @@
 #define	INF		asfloat(0x7f800000)
 #define	FLT_MAX	3.402823466e+38
 
-#define CUBEMAP_RAYMARCH_BIT	(1 << 15)
+#define CUBEMAP_RAYMARCH_BIT	(1 << 15)	// Any face ray marched in cube-map space
+#define CUBEMAP_FACE_SHIFT		8			// Bits 8-13: the faces ray marched in cube-map space
 #define _ADAPTIVE_RAYMARCH_		1
 
 typedef uint VolumeDesc;
@@ -21,7 +22,7 @@ struct VolumeInfo
 {
 	uint MipLevel;	// Mip level
 	uint SmpCount;	// Ray sample count
-	uint MaskBits;	// Highest bit in the uint16: render scheme, lowest 6 bits: cube-face visibility mask 
+	uint MaskBits;	// Highest bit in the uint16: any face in cube-map space, bits 8-13: per-face render scheme, lowest 6 bits: cube-face visibility mask
 	uint VolTexId;	// Volume texture Id
 };
 
@@ -31,6 +32,7 @@ struct PerObject
 	float4x4 WorldViewProjI;
 	float4x3 WorldI;
 	float4x3 World;
+	float SampleScale;	// Scales the max ray samples of the volume
 };
 
 //--------------------------------------------------------------------------------------
@@ -42,10 +44,12 @@ cbuffer cbPerFrame
 	float2 g_viewport;
 	float4x4 g_screenToWorld;
 	float4x4 g_shadowViewProj;
-	float4 g_lightPos;
+	float4x4 g_shadowViewProjI;
+	float4 g_lightPos;		// Of the key light, directional with w = 0
 	float4 g_lightColor;
 	float4 g_ambient;
 	uint g_frameIdx;
+	float3 g_pathCosts;	// Per cube-map texel sample, cube-map pixel gather and direct pixel sample
 };
 
 cbuffer cbSampleRes
@@ -78,3 +82,22 @@ uint GetCubeMapSize(VolumeDesc volume)
 {
 	return volume >> 18;
 }
+
+//--------------------------------------------------------------------------------------
+// Cube-map face of a direction or a point on the cube: +X, -X, +Y, -Y, +Z, -Z
+//--------------------------------------------------------------------------------------
+uint GetCubeFace(float3 dir)
+{
+	const float3 a = abs(dir);
+	const uint axis = a.x >= a.y && a.x >= a.z ? 0 : (a.y >= a.z ? 1 : 2);
+
+	return 2 * axis + (dir[axis] < 0.0 ? 1 : 0);
+}
+
+//--------------------------------------------------------------------------------------
+// Whether the face is ray marched in cube-map space, rather than ray cast directly
+//--------------------------------------------------------------------------------------
+bool IsCubeMapFace(uint maskBits, uint face)
+{
+	return (maskBits >> (CUBEMAP_FACE_SHIFT + face)) & 1;
+}
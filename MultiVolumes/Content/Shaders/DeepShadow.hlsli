@@ -0,0 +1,116 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+// Transmittance functions of the deep shadow map, as DeepShadowMap of the CPU: up to
+// DEEP_SHADOW_KNOTS knots per texel, each a 16-bit depth and a 16-bit transmittance,
+// 4 knots per array slice
+#define DEEP_SHADOW_KNOTS	8
+#define EMPTY_KNOT			0xffffffff
+
+float2 DecodeKnot(uint knot)
+{
+	return float2(knot & 0xffff, knot >> 16) / 65535.0;
+}
+
+uint EncodeKnot(float2 knot)
+{
+	const uint2 k = uint2(saturate(knot) * 65535.0 + 0.5);
+
+	return k.x | (k.y << 16);
+}
+
+//--------------------------------------------------------------------------------------
+// Transmittance at a depth: 1 before the first knot, the last beyond it
+//--------------------------------------------------------------------------------------
+float EvaluateKnots(float2 knots[DEEP_SHADOW_KNOTS], uint numKnots, float depth)
+{
+	if (numKnots == 0 || depth <= knots[0].x) return 1.0;
+
+	for (uint i = 1; i < numKnots; ++i)
+	{
+		const float2 prev = knots[i - 1];
+		const float2 knot = knots[i];
+		if (depth > knot.x) continue;
+
+		return lerp(prev.y, knot.y, saturate((depth - prev.x) / max(knot.x - prev.x, 1.0e-7)));
+	}
+
+	return knots[numKnots - 1].y;
+}
+
+float LookupDeepShadow(uint knots[DEEP_SHADOW_KNOTS], float depth)
+{
+	float2 decoded[DEEP_SHADOW_KNOTS];
+	uint numKnots = 0;
+	[unroll]
+	for (uint i = 0; i < DEEP_SHADOW_KNOTS; ++i)
+	{
+		decoded[i] = DecodeKnot(knots[i]);
+		numKnots += numKnots == i && knots[i] != EMPTY_KNOT ? 1 : 0;
+	}
+
+	return EvaluateKnots(decoded, numKnots, depth);
+}
+
+//--------------------------------------------------------------------------------------
+// Multiplies the function by a span of a volume, over which it falls by transm, then
+// removes the interior knots of the least area change beyond DEEP_SHADOW_KNOTS
+//--------------------------------------------------------------------------------------
+void InsertSpan(inout uint knots[DEEP_SHADOW_KNOTS], float nearDepth, float farDepth, float transm)
+{
+	if (transm >= 1.0) return;
+	nearDepth = saturate(nearDepth);
+	farDepth = max(saturate(farDepth), nearDepth);
+	transm = max(transm, 0.0);
+
+	float2 oldKnots[DEEP_SHADOW_KNOTS];
+	uint numOld = 0;
+	[unroll]
+	for (uint i = 0; i < DEEP_SHADOW_KNOTS; ++i)
+	{
+		oldKnots[i] = DecodeKnot(knots[i]);
+		numOld += numOld == i && knots[i] != EMPTY_KNOT ? 1 : 0;
+	}
+
+	// The knots of both in depth order, the old first on a tie
+	float2 merged[DEEP_SHADOW_KNOTS + 2];
+	const uint numMerged = numOld + 2;
+	uint i = 0, j = 0;
+	for (uint k = 0; k < numMerged; ++k)
+	{
+		const float oldDepth = i < numOld ? oldKnots[min(i, DEEP_SHADOW_KNOTS - 1)].x : FLT_MAX;
+		const float spanDepth = j == 0 ? nearDepth : (j == 1 ? farDepth : FLT_MAX);
+		const bool isOld = oldDepth <= spanDepth;
+		const float depth = isOld ? oldDepth : spanDepth;
+		i += isOld ? 1 : 0;
+		j += isOld ? 0 : 1;
+
+		const float t = farDepth > nearDepth ? saturate((depth - nearDepth) / (farDepth - nearDepth)) : (depth < farDepth ? 0.0 : 1.0);
+		merged[k] = float2(depth, EvaluateKnots(oldKnots, numOld, depth) * lerp(1.0, transm, t));
+	}
+
+	// Keep the first and the last knots
+	for (uint n = numMerged; n > DEEP_SHADOW_KNOTS; --n)
+	{
+		float minArea = 0.0;
+		uint removed = 1;
+		for (uint k = 1; k + 1 < n; ++k)
+		{
+			const float width = merged[k + 1].x - merged[k - 1].x;
+			const float t = width > 0.0 ? (merged[k].x - merged[k - 1].x) / width : 0.0;
+			const float area = 0.5 * abs(merged[k].y - lerp(merged[k - 1].y, merged[k + 1].y, t)) * width;
+			if (k == 1 || area < minArea)
+			{
+				minArea = area;
+				removed = k;
+			}
+		}
+
+		for (uint k = removed; k + 1 < n; ++k) merged[k] = merged[k + 1];
+	}
+
+	[unroll]
+	for (uint k = 0; k < DEEP_SHADOW_KNOTS; ++k)
+		knots[k] = k < min(numMerged, DEEP_SHADOW_KNOTS) ? EncodeKnot(merged[k]) : EMPTY_KNOT;
+}
@@ -20,7 +20,7 @@ struct RayMarchRecord
 	uint VolumeId;
 	uint MipLevel;	// Mip level
 	uint SmpCount;	// Ray sample count
-	uint MaskBits;	// Highest bit in the uint16: render scheme, lowest 6 bits: cube-face visibility mask 
+	uint FaceId;	// Cube-map face, one record per face ray marched in cube-map space
 	uint VolTexId;	// Volume texture Id
 };
 
@@ -29,7 +29,7 @@ struct VolumeOutRecord
 	uint VolumeId;
 	uint MipLevel;	// Mip level
 	uint SmpCount;	// Ray sample count
-	uint MaskBits;	// Highest bit in the uint16: render scheme, lowest 6 bits: cube-face visibility mask 
+	uint MaskBits;	// Highest bit in the uint16: any face in cube-map space, bits 8-13: per-face render scheme, lowest 6 bits: cube-face visibility mask
 	uint VolTexId;	// Volume texture Id
 };
 
@@ -42,7 +42,7 @@ struct VolumeOutRecord
 [numthreads(8, GROUP_VOLUME_COUNT, 1)]
 void VolumeCull(uint Gid : SV_GroupID,
 	DispatchNodeInputRecord<VolumeCullRecord> input,
-	[MaxRecords(GROUP_VOLUME_COUNT)] NodeOutput<RayMarchRecord> RayMarch)
+	[MaxRecords(6 * GROUP_VOLUME_COUNT)] NodeOutput<RayMarchRecord> RayMarch)
 {
 	uint2 wTid;
 	wTid.x = WaveGetLaneIndex() % 8;
@@ -61,23 +61,30 @@ void VolumeCull(uint Gid : SV_GroupID,
 		// Project vertex to viewport space
 		v = ProjectToViewport(wTid.x, perObject.WorldViewProj, g_viewport);
 
-		// If any vertices are inside viewport
-		const bool isInView = all(and(v.xy <= g_viewport, v.xy >= 0.0)) && (v.z > 0.0 && v.z < 1.0);
-		const uint waveMask = WaveActiveBallot(isInView).x;
-		volumeVis = (waveMask >> (8 * wTid.y)) & 0xff;
+		// Frustum culling by separating axes
+		const bool isSeparated = IsSeparatedFromFrustum(perObject.WorldViewProj, perObject.WorldI,
+			g_screenToWorld, wTid.x, 8 * wTid.y);
+		const uint waveMask = WaveActiveBallot(isSeparated).x;
+		volumeVis = ((waveMask >> (8 * wTid.y)) & 0xff) ? 0 : 1;
+
+		// A sample scale of 0 hides the volume, e.g. dropped by the sample budget
+		if (perObject.SampleScale <= 0.0) volumeVis = 0;
+
+		// Occlusion culling against the opaque depth
+		if (volumeVis && IsOccluded(v, g_viewport, 8 * wTid.y)) volumeVis = 0;
 	}
 	else volumeVis = 0;
 
 	VolumeIn volumeIn;
 	uint cubeMapSize, mipLevel, raySampleCount, maskBits, volTexId;
-	bool useCubeMap = true;
+	uint cubeMapFaces = 0;
 
 	if (volumeVis)
 	{
 		if (wTid.x == 0)
 		{
 			volumeIn = g_roVolumes[volumeId];
-			raySampleCount = g_numSamples;
+			raySampleCount = max(uint(g_numSamples * perObject.SampleScale), 1);
 		}
 
 		// Visiblity mask
@@ -89,40 +96,55 @@ void VolumeCull(uint Gid : SV_GroupID,
 
 		// Cube map LOD
 		cubeMapSize = GetCubeMapSize(volumeIn);
-		mipLevel = EstimateCubeMapLOD(raySampleCount, GetNumMips(volumeIn), cubeMapSize, ep, wTid);
+		const bool isNearClipped = IsNearClipped(perObject.WorldViewProj);
+		mipLevel = EstimateCubeMapLOD(raySampleCount, GetNumMips(volumeIn), cubeMapSize, ep, wTid, isNearClipped);
 
-		// Volume projection coverage
-		const float projCov = EstimateProjCoverage(ep, wTid, faceMask, baseLaneId);
+		// Volume projection coverage, the whole viewport once near-clipped
+		const float faceCov = EstimateFaceCoverage(ep, wTid.x, baseLaneId);
+		float projCov = EstimateProjCoverage(faceCov, wTid, faceMask);
+		if (isNearClipped) projCov = g_viewport.x * g_viewport.y;
 
+#if _ADAPTIVE_RAYMARCH_
+		// Visible pixels of the cube map, for the choice of the whole volume
+		bool useCubeMap = false;
 		if (wTid.x == 0)
 		{
-			// Visible pixels of the cube map
-#if _ADAPTIVE_RAYMARCH_
 			const float cubeMapPix = EstimateCubeMapVisiblePixels(faceMask, mipLevel, cubeMapSize);
-			useCubeMap = cubeMapPix <= projCov;
+			useCubeMap = UseCubeMap(faceMask, cubeMapPix, projCov, raySampleCount);
+		}
+
+		// Render scheme per visible face
+		cubeMapFaces = SelectCubeMapFaces(faceMask, faceCov, mipLevel, cubeMapSize,
+			raySampleCount, useCubeMap, isNearClipped, wTid.x, baseLaneId);
+#else
+		cubeMapFaces = faceMask;
 #endif
-			maskBits = useCubeMap ? (faceMask | CUBEMAP_RAYMARCH_BIT) : faceMask;
+
+		if (wTid.x == 0)
+		{
+			maskBits = faceMask | (cubeMapFaces << CUBEMAP_FACE_SHIFT);
+			if (cubeMapFaces) maskBits |= CUBEMAP_RAYMARCH_BIT;
 			volTexId = GetSourceTextureId(volumeIn);
 		}
 	}
 
 	const bool needOutput = volumeVis && wTid.x == 0;
-	//useCubeMap = needOutput && useCubeMap;
-	//const uint recordCount = WaveActiveCountBits(useCubeMap);
-	const uint recordCount = WaveActiveCountBits(needOutput && useCubeMap);
+	const uint faceCount = needOutput ? countbits(cubeMapFaces) : 0;
+	const uint recordCount = WaveActiveSum(faceCount);
 	GroupNodeOutputRecords<RayMarchRecord> outRecs = RayMarch.GetGroupNodeOutputRecords(recordCount);
 
 	if (needOutput)
 	{
-		if (useCubeMap)
+		// A record per cube-map face, so the faces rendered directly launch no groups
+		uint i = WavePrefixSum(faceCount);
+		const uint mipCubeMapSize = cubeMapSize >> mipLevel;
+		for (uint faces = cubeMapFaces; faces; faces &= faces - 1, ++i)
 		{
-			const uint i = WavePrefixCountBits(true);
-			const uint mipCubeMapSize = cubeMapSize >> mipLevel;
 			outRecs[i].DispatchGrid = DIV_UP(mipCubeMapSize, 8);
 			outRecs[i].VolumeId = volumeId;
 			outRecs[i].MipLevel = mipLevel;
 			outRecs[i].SmpCount = raySampleCount;
-			outRecs[i].MaskBits = maskBits;
+			outRecs[i].FaceId = firstbitlow(faces);
 			outRecs[i].VolTexId = volTexId;
 		}
 
@@ -201,30 +223,26 @@ float3 GetClipPos(float3 rayOrigin, float3 rayDir, matrix worldViewProj)
 [Shader("node")]
 [NodeLaunch("broadcasting")]
 [NodeMaxDispatchGrid(32, 32, 1)]
-[numthreads(8, 8, 6)]
-void RayMarch(uint2 DTid : SV_DispatchThreadID, uint3 GTid : SV_GroupThreadID,
-	DispatchNodeInputRecord<RayMarchRecord> input)
+[numthreads(8, 8, 1)]
+void RayMarch(uint2 DTid : SV_DispatchThreadID, DispatchNodeInputRecord<RayMarchRecord> input)
 {
 	const uint volumeId = input.Get().VolumeId;
 	VolumeInfo volumeInfo;
 	volumeInfo.MipLevel = input.Get().MipLevel;
 	volumeInfo.SmpCount = input.Get().SmpCount;
 	volumeInfo.VolTexId = input.Get().VolTexId;
-	volumeInfo.MaskBits = input.Get().MaskBits;
-
-	const uint faceId = WaveReadLaneAt(GTid.z, 0);
-	if ((volumeInfo.MaskBits & (1u << faceId)) == 0) return;
+	const uint faceId = input.Get().FaceId;
 
 	const PerObject perObject = g_roPerObject[volumeId];
 	float3 rayOrigin = mul(float4(g_eyePt, 1.0), perObject.WorldI);
 
 	const uint uavIdx = NUM_CUBE_MIP * volumeId + volumeInfo.MipLevel;
-	const float3 target = GetLocalPos(DTid, GTid.z, g_rwCubeMaps[uavIdx]);
+	const float3 target = GetLocalPos(DTid, faceId, g_rwCubeMaps[uavIdx]);
 	const float3 rayDir = normalize(target - rayOrigin);
 	const bool isHit = ComputeRayOrigin(rayOrigin, rayDir);
 	if (!isHit) return;
 
-	const uint3 index = uint3(DTid, GTid.z);
+	const uint3 index = uint3(DTid, faceId);
 #ifdef _HAS_DEPTH_MAP_
 	// Calculate occluded end point
 	const float3 pos = GetClipPos(rayOrigin, rayDir, perObject.WorldViewProj);
@@ -246,8 +264,19 @@ void RayMarch(uint2 DTid : SV_DispatchThreadID, uint3 GTid : SV_GroupThreadID,
 		if (any(abs(pos) > 1.0)) break;
 		const float3 uvw = LocalToTex3DSpace(pos);
 
-		// Get a sample
-		min16float4 color = GetSample(volumeInfo.VolTexId, uvw);
+		// Leap over empty macro cells
+		const float skip = GetEmptySpaceSkip(volumeInfo.VolTexId, uvw, rayDir);
+		if (skip > 0.0)
+		{
+			t += skip;
+#ifdef _HAS_DEPTH_MAP_
+			if (t > tMax) break;
+#endif
+			continue;
+		}
+
+		// Get a sample, from the grid mip matching the cube-map level, as the sample count does
+		min16float4 color = GetSample(volumeInfo.VolTexId, uvw, volumeInfo.MipLevel);
 		min16float newStep = stepScale;
 		float dDensity = 1.0;
 
@@ -109,9 +109,10 @@ float4 main(PSIn input) : SV_TARGET
 			const float3 rayOrigin = mul(float4(ray.Origin, 1.0), q.CommittedWorldToObject4x3());
 			const float3 rayDir = q.CommittedObjectRayDirection();
 			
+			// The render scheme of the face hit
 			min16float4 src;
 #if _ADAPTIVE_RAYMARCH_
-			if (!(volumeInfo.MaskBits & CUBEMAP_RAYMARCH_BIT))
+			if (!IsCubeMapFace(volumeInfo.MaskBits, GetCubeFace(rayOrigin + t * rayDir)))
 			{
 				const PerObject perObject = g_roPerObject[volumeId];
 				src = RayCast(index, xy, rayOrigin, normalize(rayDir), volumeId, 
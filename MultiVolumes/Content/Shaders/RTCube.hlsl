@@ -108,9 +108,10 @@ void closestHitMain(inout RayPayload payload, in Attributes attr)
 	const float3 rayDir = ObjectRayDirection();
 
 	const uint2 index = DispatchRaysIndex().xy;
+	// The render scheme of the face hit
 	min16float4 color;
 #if _ADAPTIVE_RAYMARCH_
-	if (!(volumeInfo.MaskBits & CUBEMAP_RAYMARCH_BIT))
+	if (!IsCubeMapFace(volumeInfo.MaskBits, GetCubeFace(rayOrigin + t * rayDir)))
 	{
 		const PerObject perObject = g_roPerObject[volumeId];
 
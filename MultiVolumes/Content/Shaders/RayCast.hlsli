@@ -65,6 +65,17 @@ min16float4 RayCast(uint2 idx, float2 xy, float3 rayOrigin, float3 rayDir,
 		if (any(abs(pos) > 1.0)) break;
 		const float3 uvw = LocalToTex3DSpace(pos);
 
+		// Leap over empty macro cells
+		const float skip = GetEmptySpaceSkip(volTexId, uvw, rayDir);
+		if (skip > 0.0)
+		{
+			t += skip;
+#ifdef _HAS_DEPTH_MAP_
+			if (t > tMax) break;
+#endif
+			continue;
+		}
+
 		// Get a sample
 		min16float4 color = GetSampleNU(volTexId, uvw);
 		min16float newStep = stepScale;
@@ -2,6 +2,7 @@
 // Copyright (c) XU, Tianchen. All rights reserved.
 //--------------------------------------------------------------------------------------
 
+#include "SharedConsts.h"
 #include "Common.hlsli"
 #ifdef _HAS_LIGHT_PROBE_
 #define SH_ORDER 3
@@ -11,6 +12,13 @@
 #define ABSORPTION		0.8
 #define ZERO_THRESHOLD	0.01
 
+// Light rays march this many grid mips coarser than the light-map resolution
+#ifndef LIGHT_MIP_BIAS
+#define LIGHT_MIP_BIAS	1
+#endif
+
+#define MACRO_CELL_COUNT	(MACRO_CELL_GRID * MACRO_CELL_GRID * MACRO_CELL_GRID)
+
 //--------------------------------------------------------------------------------------
 // Constants
 //--------------------------------------------------------------------------------------
@@ -31,6 +39,9 @@ Texture2D<float> g_txDepth			: register (t0, space2);
 StructuredBuffer<float3> g_roSHCoeffs : register (t1, space2);
 #endif
 
+// Max source density per macro cell, MACRO_CELL_COUNT cells per source volume
+StructuredBuffer<float> g_roMacroCells	: register (t2, space2);
+
 //--------------------------------------------------------------------------------------
 // Texture sampler
 //--------------------------------------------------------------------------------------
@@ -76,6 +87,33 @@ float3 GetDensityGradient(uint i, float3 uvw)
 	return float3(q[1] - q[0], q[3] - q[2], q[5] - q[4]);
 }
 
+//--------------------------------------------------------------------------------------
+// Empty-space skipping: the ray distance to leave the macro cell at uvw if the cell
+// cannot hold a sample above the threshold, or 0 if it is occupied
+//--------------------------------------------------------------------------------------
+float GetEmptySpaceSkip(uint volumeId, float3 uvw, float3 rayDir)
+{
+	const uint3 cell = min(uint3(saturate(uvw) * MACRO_CELL_GRID), MACRO_CELL_GRID - 1);
+	const uint cellIdx = MACRO_CELL_COUNT * volumeId + (cell.z * MACRO_CELL_GRID + cell.y) * MACRO_CELL_GRID + cell.x;
+
+	// The grids store a quarter of the source density (see CSR32FToRGBA16F.hlsl)
+	if (g_roMacroCells[cellIdx] * 0.25 > ZERO_THRESHOLD) return 0.0;
+
+	// Texture-space direction
+#ifdef _TEXCOORD_INVERT_Y_
+	const float3 dir = rayDir * float3(0.5, -0.5, 0.5);
+#else
+	const float3 dir = rayDir * 0.5;
+#endif
+
+	// Slab test against the far faces of the cell; lands just past the exit, in the next cell.
+	// Axes with a zero direction yield +INF.
+	const float3 bound = (cell + float3(dir >= 0.0)) / MACRO_CELL_GRID;
+	const float3 t = (bound - uvw) / dir;
+
+	return max(min(min(t.x, t.y), t.z), 0.0) + 1.0e-3;
+}
+
 //--------------------------------------------------------------------------------------
 // Get occluded end point
 //--------------------------------------------------------------------------------------
@@ -191,14 +229,31 @@ min16float GetStep(float dDensity, min16float transm, min16float density, min16f
 	return step;
 }
 
+//--------------------------------------------------------------------------------------
+// Get the grid mip level for light rays of a light map
+//--------------------------------------------------------------------------------------
+uint GetLightMipLevel(uint volumeId, float lightGridSize)
+{
+	float3 gridSize;
+	float numMips;
+	g_txGrids[volumeId].GetDimensions(0, gridSize.x, gridSize.y, gridSize.z, numMips);
+
+	const float level = floor(log2(max(gridSize.x / lightGridSize, 1.0))) + LIGHT_MIP_BIAS;
+
+	return (uint)min(level, numMips - 1.0);
+}
+
 //--------------------------------------------------------------------------------------
 // Cast light ray
 //--------------------------------------------------------------------------------------
 void CastLightRay(inout min16float transm, uint volumeId, float3 rayOrigin, float3 rayDir,
 	min16float stepScale, uint numSamples, uint mipLevel = 0)
 {
+	// Each level halves the samples and doubles the step, so the ray still spans the volume
 	const float mip = mipLevel;
-	numSamples >>= mipLevel;
+	const min16float mipScale = min16float(1u << mipLevel);
+	numSamples = max(numSamples >> mipLevel, 1u);
+	stepScale *= mipScale;
 
 	float t = stepScale;
 	min16float step = stepScale;
@@ -209,6 +264,14 @@ void CastLightRay(inout min16float transm, uint volumeId, float3 rayOrigin, floa
 		if (any(abs(pos) > 1.0)) break;
 		const float3 uvw = LocalToTex3DSpace(pos);
 
+		// Leap over empty macro cells
+		const float skip = GetEmptySpaceSkip(volumeId, uvw, rayDir);
+		if (skip > 0.0)
+		{
+			t += skip;
+			continue;
+		}
+
 		// Get a sample along light ray
 		const min16float density = GetSample(volumeId, uvw, mip).w;
 
@@ -219,8 +282,8 @@ void CastLightRay(inout min16float transm, uint volumeId, float3 rayOrigin, floa
 		step = (step + newStep) * 0.5;
 		prevDensity = density;
 
-		// Attenuate ray-throughput along light direction
-		transm *= 1.0 - density * ABSORPTION;
+		// Attenuate ray-throughput along light direction; a coarse sample stands for mipScale fine ones
+		transm *= pow(saturate(1.0 - density * ABSORPTION), mipScale);
 		if (transm < ZERO_THRESHOLD) break;
 
 		// Update position along light ray
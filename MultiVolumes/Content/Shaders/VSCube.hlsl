@@ -70,7 +70,9 @@ VSOut main(uint vid : SV_VertexID, uint iid : SV_InstanceID)
 	output.VolId = volumeId;
 	output.SrvId = NUM_CUBE_MIP * volumeId + volumeInfo.MipLevel;
 	output.TexId = volumeInfo.VolTexId;
-	output.SmpCnt = (volumeInfo.MaskBits & CUBEMAP_RAYMARCH_BIT) ? 0 : volumeInfo.SmpCount;
+	// The normal of the face plane gives its cube-map face, and the render scheme of it
+	const uint cubeFace = GetCubeFace(planes[faceId][2]);
+	output.SmpCnt = IsCubeMapFace(volumeInfo.MaskBits, cubeFace) ? 0 : volumeInfo.SmpCount;
 
 	return output;
 }
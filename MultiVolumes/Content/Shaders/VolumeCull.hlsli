@@ -19,6 +19,11 @@ StructuredBuffer<VolumeIn>	g_roVolumes;
 AppendStructuredBuffer<uint> g_rwVisibleVolumes;
 RWBuffer<uint4> g_rwVolumes;
 
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+Texture2D<float> g_txHiZ : register (t2);	// Farthest depth, built by CSBuildHiZ
+
 static const uint g_waveVolumeCount = WaveGetLaneCount() / 8;
 
 //--------------------------------------------------------------------------------------
@@ -40,6 +45,120 @@ float3 ProjectToViewport(uint i, float4x4 worldViewProj, float2 viewport)
 	return float3(p.xy * viewport, p.z);
 }
 
+//--------------------------------------------------------------------------------------
+// Separating-axis test of the cube against the view frustum, in the local space of the
+// cube (VolumeCuller::ClassifyVolume() on the CPU); the cube is outside once any of the
+// 8 lanes of the volume finds a separating axis
+//--------------------------------------------------------------------------------------
+bool IsSeparatedFromFrustum(float4x4 worldViewProj, float4x3 worldI, float4x4 screenToWorld,
+	uint wTidx, uint baseLaneId)
+{
+	// Per frustum-plane processing
+	bool isSeparated = false;
+	if (wTidx < 6)
+	{
+		// Left, right, bottom, top, near, and far planes in clip space
+		const uint axis = wTidx >> 1;
+		float4 n;
+		n.xyz = float3(axis == 0, axis == 1, axis == 2) * ((wTidx & 1) ? -1.0 : 1.0);
+		n.w = wTidx == 4 ? 0.0 : 1.0;
+
+		// Plane in the local space, against the farthest vertex of the cube along its normal
+		const float4 c = mul(worldViewProj, n);
+		isSeparated = c.w + dot(abs(c.xyz), 1.0) < 0.0;
+	}
+
+	// Per frustum-corner processing
+	float4 p;
+	p.x = (wTidx & 1) ? 1.0 : -1.0;
+	p.y = ((wTidx >> 1) & 1) ? 1.0 : -1.0;
+	p.z = (wTidx >> 2) ? 1.0 : 0.0;
+	p.w = 1.0;
+	p = mul(p, screenToWorld);
+	const float3 f = mul(float4(p.xyz / p.w, 1.0), worldI);
+
+	// Each lane takes 3 of the 18 cross products of the cube axes with the distinct frustum
+	// edges, and of the 3 cube axes
+	[unroll]
+	for (uint t = 0; t < 3; ++t)
+	{
+		const uint j = wTidx + 8 * t;
+		const uint e = j / 3;
+		const uint e0 = e < 3 ? 0 : min(e - 2, 7);
+		const uint e1 = e < 3 ? (1u << e) : min(e + 2, 7);
+		const float3 d = WaveReadLaneAt(f, baseLaneId + e1) - WaveReadLaneAt(f, baseLaneId + e0);
+
+		const uint a = j < 18 ? j % 3 : j - 18;
+		const float3 u = float3(a == 0, a == 1, a == 2);
+		const float3 axis = j < 18 ? cross(u, d) : u;	// Zero beyond the 21 axes
+
+		// Project the frustum onto the axis, against the cube radius
+		float lo = dot(f, axis), hi = lo;
+		[unroll]
+		for (uint i = 0; i < 8; ++i)
+		{
+			const float s = dot(WaveReadLaneAt(f, baseLaneId + i), axis);
+			lo = min(lo, s);
+			hi = max(hi, s);
+		}
+
+		const float r = dot(abs(axis), 1.0);
+		isSeparated = isSeparated || lo > r || hi < -r;
+	}
+
+	return isSeparated;
+}
+
+//--------------------------------------------------------------------------------------
+// Whether the cube crosses the camera plane, i.e. min w of its vertices is not positive
+//--------------------------------------------------------------------------------------
+bool IsNearClipped(float4x4 worldViewProj)
+{
+	const float4 w = worldViewProj._14_24_34_44;
+
+	return w.w - dot(abs(w.xyz), 1.0) <= 0.0;
+}
+
+//--------------------------------------------------------------------------------------
+// Conservative Hi-Z occlusion test of the cube (HiZPyramid::IsOccluded() on the CPU)
+//--------------------------------------------------------------------------------------
+bool IsOccluded(float3 v, float2 viewport, uint baseLaneId)
+{
+	// Screen rectangle and nearest depth over the 8 vertices of the cube
+	float4 rect = float4(v.xy, v.xy);
+	float minDepth = v.z;
+
+	[unroll]
+	for (uint i = 0; i < 8; ++i)
+	{
+		const float3 u = WaveReadLaneAt(v, baseLaneId + i);
+		rect.xy = min(rect.xy, u.xy);
+		rect.zw = max(rect.zw, u.xy);
+		minDepth = min(minDepth, u.z);
+	}
+
+	// No decision once a vertex leaves the depth range, e.g. behind the camera
+	const bool isInDepthRange = v.z >= 0.0 && v.z <= 1.0;
+	if (((WaveActiveBallot(isInDepthRange).x >> baseLaneId) & 0xff) != 0xff) return false;
+
+	uint3 dim;
+	g_txHiZ.GetDimensions(0, dim.x, dim.y, dim.z);
+	const uint4 pixelRect = uint4(clamp(rect, 0.0, (viewport - 1.0).xyxy));
+
+	// Coarsest enough that the rectangle spans at most 2x2 texels of 2^(level + 1) pixels
+	const uint extent = max(pixelRect.z - pixelRect.x, pixelRect.w - pixelRect.y);
+	const uint level = min(extent > 0 ? firstbithigh(extent) : 0, dim.z - 1);
+	const uint2 levelSize = max(dim.xy >> level, 1);
+	const uint4 texRect = min(pixelRect >> (level + 1), (levelSize - 1).xyxy);
+
+	float maxDepth = 0.0;
+	for (uint y = texRect.y; y <= texRect.w; ++y)
+		for (uint x = texRect.x; x <= texRect.z; ++x)
+			maxDepth = max(g_txHiZ.Load(uint3(x, y, level)), maxDepth);
+
+	return minDepth > maxDepth;
+}
+
 //--------------------------------------------------------------------------------------
 // Check the visibility of the face
 //--------------------------------------------------------------------------------------
@@ -265,15 +384,15 @@ float EstimateCubeMaxEdgeLength(float4 edgePair, uint2 wTid)
 // Estimate cube map LOD
 //--------------------------------------------------------------------------------------
 uint EstimateCubeMapLOD(inout uint raySampleCount, uint numMips, float cubeMapSize,
-	float4 edgePair, uint2 wTid, float upscale = 2.0, float raySampleCountScale = 2.0)
+	float4 edgePair, uint2 wTid, bool isNearClipped, float upscale = 2.0, float raySampleCountScale = 2.0)
 {
 	// Calulate the ideal cube-map resolution
 	float s = EstimateCubeMaxEdgeLength(edgePair, wTid) / upscale;
 
 	if (wTid.x == 0)
 	{
-		// Get the ideal ray sample amount
-		float raySampleAmt = raySampleCountScale * s / sqrt(3.0);
+		// Get the ideal ray sample amount; the projected edges are unbounded once near-clipped
+		float raySampleAmt = isNearClipped ? raySampleCount : raySampleCountScale * s / sqrt(3.0);
 
 		// Clamp the ideal ray sample amount using the user-specified upper bound of ray sample count
 		const uint raySampleCnt = ceil(raySampleAmt);
@@ -294,24 +413,38 @@ uint EstimateCubeMapLOD(inout uint raySampleCount, uint numMips, float cubeMapSi
 }
 
 //--------------------------------------------------------------------------------------
-// Estimate volume projection coverage in pixels
+// Estimate the projected pixels of each cube-map face, one face per lane
 //--------------------------------------------------------------------------------------
-float EstimateProjCoverage(float4 edgePair, uint2 wTid, uint faceMask, uint baseLaneId)
+float EstimateFaceCoverage(float4 edgePair, uint wTidx, uint baseLaneId)
 {
 	// Per face processing
-	if (wTid.x < 6)
+	if (wTidx < 6)
 	{
-		uint i;
+		// The face quads go -X, +X, -Y, +Y, -Z, +Z, whereas the cube-map faces and the
+		// visibility mask go +X, -X, +Y, -Y, +Z, -Z
 		float2 e[4];
 
 		[unroll]
-		for (i = 0; i < 4; ++i)
-			e[i] = GetCubeFaceEdges(edgePair, wTid.x, i, baseLaneId);
+		for (uint i = 0; i < 4; ++i)
+			e[i] = GetCubeFaceEdges(edgePair, wTidx ^ 1, i, baseLaneId);
+
+		return CalcQuadArea(e);
+	}
 
-		float faceArea = 0.0;
-		if (faceMask & (1u << wTid.x)) faceArea = CalcQuadArea(e);
+	return 0.0;
+}
+
+//--------------------------------------------------------------------------------------
+// Estimate volume projection coverage in pixels, over the visible faces
+//--------------------------------------------------------------------------------------
+float EstimateProjCoverage(float faceCov, uint2 wTid, uint faceMask)
+{
+	// Per face processing
+	if (wTid.x < 6)
+	{
+		const float faceArea = (faceMask & (1u << wTid.x)) ? faceCov : 0.0;
 
-		for (i = 0; i < g_waveVolumeCount; ++i)
+		for (uint i = 0; i < g_waveVolumeCount; ++i)
 		{
 			[branch]
 			if (i == wTid.y) return WaveActiveSum(faceArea);
@@ -332,3 +465,43 @@ float EstimateCubeMapVisiblePixels(uint faceMask, uint mipLevel, uint cubeMapSiz
 
 	return faceArea * visibleFaceCount;
 }
+
+//--------------------------------------------------------------------------------------
+// Pick the cheaper path by the calibrated costs (CostModel): ray marching the visible
+// cube-map texels and gathering them per pixel, or ray casting every covered pixel.
+// Ray cast directly with the eye inside the cube
+//--------------------------------------------------------------------------------------
+bool UseCubeMap(uint faceMask, float cubeMapPix, float projCov, uint raySampleCount)
+{
+	const float samples = raySampleCount;
+	const float cubeMapCost = (g_pathCosts.x * samples) * cubeMapPix + g_pathCosts.y * projCov;
+	const float directCost = (g_pathCosts.z * samples) * projCov;
+
+	return faceMask != 0x3f && cubeMapCost <= directCost;
+}
+
+//--------------------------------------------------------------------------------------
+// Pick the render scheme of each visible face by its own projected pixels, one face per
+// lane; once near-clipped, the face areas are meaningless, and the choice of the whole
+// volume (useCubeMap of the first lane) holds for all faces
+//--------------------------------------------------------------------------------------
+uint SelectCubeMapFaces(uint faceMask, float faceCov, uint mipLevel, uint cubeMapSize,
+	uint raySampleCount, bool useCubeMap, bool isNearClipped, uint wTidx, uint baseLaneId)
+{
+	mipLevel = WaveReadLaneAt(mipLevel, baseLaneId);
+	cubeMapSize = WaveReadLaneAt(cubeMapSize, baseLaneId);
+	raySampleCount = WaveReadLaneAt(raySampleCount, baseLaneId);
+	useCubeMap = WaveReadLaneAt(uint(useCubeMap), baseLaneId);
+
+	// Per face processing
+	bool isCubeMapFace = false;
+	if (wTidx < 6 && (faceMask & (1u << wTidx)))
+	{
+		const float faceTexels = EstimateCubeMapVisiblePixels(1, mipLevel, cubeMapSize);
+		isCubeMapFace = isNearClipped ? useCubeMap : UseCubeMap(faceMask, faceTexels, faceCov, raySampleCount);
+	}
+
+	const uint waveMask = WaveActiveBallot(isCubeMapFace).x;
+
+	return (waveMask >> baseLaneId) & 0x3f;
+}
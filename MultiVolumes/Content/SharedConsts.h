@@ -2,9 +2,12 @@
 // Copyright (c) XU, Tianchen. All rights reserved.
 //--------------------------------------------------------------------------------------
 
+#pragma once
+
 #define GROUP_VOLUME_COUNT	4
 #define NUM_CUBE_MIP		5
 #define NUM_OIT_LAYERS		8
+#define MACRO_CELL_GRID		16
 
 static const float g_zNear = 1.0f;
 static const float g_zFar = 1000.0f;
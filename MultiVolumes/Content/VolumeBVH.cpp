@@ -0,0 +1,627 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include "VolumeBVH.h"
+
+using namespace std;
+
+static const uint32_t g_numBins = 16;
+static const float g_traversalCost = 1.0f;	// Relative to testing a volume
+static const uint32_t g_maxSAHDepth = 32;	// Deeper nodes split at the median, which bounds the depth
+static const uint32_t g_maxStackSize = 72;	// Depth + 2, and the depth stays within 64 below 2^32 volumes
+static const float g_planeSlack = 1.0e-3f;	// Relative to the plane terms, which cancel at the far plane
+
+struct BuildTask
+{
+	uint32_t Node;
+	uint32_t Begin;
+	uint32_t End;
+	uint32_t Depth;
+};
+
+struct BuildRef
+{
+	float Min[3];
+	float Max[3];
+	float Centroid[3];
+	uint32_t Volume;
+};
+
+struct FrustumTask
+{
+	uint32_t Node;
+	uint32_t PlaneMask;	// Planes that the node is not yet known to be inside
+};
+
+struct RayTask
+{
+	uint32_t Node;
+	float TNear;
+};
+
+static inline float getHalfArea(const float aabbMin[3], const float aabbMax[3])
+{
+	const float d[] = { aabbMax[0] - aabbMin[0], aabbMax[1] - aabbMin[1], aabbMax[2] - aabbMin[2] };
+
+	return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+}
+
+static inline void resetAABB(float aabbMin[3], float aabbMax[3])
+{
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		aabbMin[i] = FLT_MAX;
+		aabbMax[i] = -FLT_MAX;
+	}
+}
+
+static inline void growAABB(float aabbMin[3], float aabbMax[3], const float otherMin[3], const float otherMax[3])
+{
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		aabbMin[i] = (min)(aabbMin[i], otherMin[i]);
+		aabbMax[i] = (max)(aabbMax[i], otherMax[i]);
+	}
+}
+
+// Signed distances of the AABB corners farthest along and against the plane normal. The
+// corner coordinates only ever grow from child to parent, and every rounding step is
+// monotonic, so a parent inside a plane implies its children are, bit for bit.
+static inline float getFarDistance(const float plane[4], const float aabbMin[3], const float aabbMax[3])
+{
+	return plane[0] * (plane[0] >= 0.0f ? aabbMax[0] : aabbMin[0]) +
+		plane[1] * (plane[1] >= 0.0f ? aabbMax[1] : aabbMin[1]) +
+		plane[2] * (plane[2] >= 0.0f ? aabbMax[2] : aabbMin[2]) + plane[3];
+}
+
+static inline float getNearDistance(const float plane[4], const float aabbMin[3], const float aabbMax[3])
+{
+	return plane[0] * (plane[0] >= 0.0f ? aabbMin[0] : aabbMax[0]) +
+		plane[1] * (plane[1] >= 0.0f ? aabbMin[1] : aabbMax[1]) +
+		plane[2] * (plane[2] >= 0.0f ? aabbMin[2] : aabbMax[2]) + plane[3];
+}
+
+// Outside only beyond the rounding of VolumeCuller, which tests the cube through the world-
+// view-projection matrix instead, so that every volume it keeps stays a candidate
+static inline bool isOutsidePlane(const float plane[4], const float aabbMin[3], const float aabbMax[3])
+{
+	const auto distance = getFarDistance(plane, aabbMin, aabbMax);
+	if (distance >= 0.0f) return false;
+
+	auto magnitude = fabsf(plane[3]);
+	for (uint8_t i = 0; i < 3; ++i)
+		magnitude += fabsf(plane[i]) * (max)(fabsf(aabbMin[i]), fabsf(aabbMax[i]));
+
+	return distance < -g_planeSlack * magnitude;
+}
+
+// Slab test, with the interval clipped to [0, tMax]
+static inline bool intersectSlabs(const float aabbMin[3], const float aabbMax[3], const float origin[3],
+	const float invDir[3], float tMax, float& tNear, float& tFar)
+{
+	tNear = 0.0f;
+	tFar = tMax;
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		const auto t0 = (aabbMin[i] - origin[i]) * invDir[i];
+		const auto t1 = (aabbMax[i] - origin[i]) * invDir[i];
+		tNear = (max)(tNear, (min)(t0, t1));
+		tFar = (min)(tFar, (max)(t0, t1));
+	}
+
+	return tNear <= tFar;
+}
+
+// Entry order, with ties in volume order
+static inline bool isNearer(const VolumeBVH::RayHit& a, const VolumeBVH::RayHit& b)
+{
+	return a.TNear < b.TNear || (a.TNear == b.TNear && a.Volume < b.Volume);
+}
+
+// Keeps the division finite for axis-aligned rays
+static inline void getInvDir(const float dir[3], float invDir[3])
+{
+	for (uint8_t i = 0; i < 3; ++i)
+		invDir[i] = fabsf(dir[i]) > 1.0e-30f ? 1.0f / dir[i] : copysignf(1.0e30f, dir[i]);
+}
+
+//--------------------------------------------------------------------------------------
+// VolumeBVH
+//--------------------------------------------------------------------------------------
+
+VolumeBVH::VolumeBVH() :
+	m_numVolumes(0)
+{
+}
+
+VolumeBVH::~VolumeBVH()
+{
+}
+
+void VolumeBVH::Build(const float* pWorlds, uint32_t numVolumes, uint32_t maxLeafSize)
+{
+	maxLeafSize = (max)(maxLeafSize, 1u);
+	m_numVolumes = numVolumes;
+	setVolumes(pWorlds);
+
+	m_volumeList.resize(numVolumes);
+	m_nodes.clear();
+	if (numVolumes == 0) return;
+
+	// Bounds and centroids are moved along with the volumes, so that each node reads a
+	// contiguous range rather than gathering from all over the AABBs
+	vector<BuildRef> refs(numVolumes);
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		auto& ref = refs[i];
+		copy(&m_aabbs[6 * i], &m_aabbs[6 * i] + 3, ref.Min);
+		copy(&m_aabbs[6 * i + 3], &m_aabbs[6 * i + 3] + 3, ref.Max);
+		for (uint8_t j = 0; j < 3; ++j) ref.Centroid[j] = (ref.Min[j] + ref.Max[j]) * 0.5f;
+		ref.Volume = i;
+	}
+
+	m_nodes.reserve(2 * numVolumes);
+	m_nodes.emplace_back();
+
+	vector<BuildTask> tasks(1, { 0, 0, numVolumes, 0 });
+	while (!tasks.empty())
+	{
+		const auto task = tasks.back();
+		tasks.pop_back();
+
+		// Bounds of the volumes and of their centroids
+		float centroidMin[3], centroidMax[3];
+		auto& node = m_nodes[task.Node];
+		resetAABB(node.Min, node.Max);
+		resetAABB(centroidMin, centroidMax);
+		for (auto i = task.Begin; i < task.End; ++i)
+		{
+			const auto& ref = refs[i];
+			growAABB(node.Min, node.Max, ref.Min, ref.Max);
+			growAABB(centroidMin, centroidMax, ref.Centroid, ref.Centroid);
+		}
+
+		// Binned SAH along each axis, in units of the cost of testing a volume
+		const auto count = task.End - task.Begin;
+		const auto invArea = 1.0f / (max)(getHalfArea(node.Min, node.Max), FLT_MIN);
+		auto bestCost = static_cast<float>(count);
+		auto bestAxis = -1;
+		auto bestSplit = 0u;
+		auto numBins = g_numBins;
+		if (count > 1 && task.Depth < g_maxSAHDepth)
+		{
+			struct Bin
+			{
+				float Min[3];
+				float Max[3];
+				uint32_t Count;
+			} bins[3][g_numBins];
+
+			// Fewer bins for small nodes, which are most of them
+			numBins = (min)(count, g_numBins);
+			for (auto& axisBins : bins)
+			{
+				for (auto b = 0u; b < numBins; ++b)
+				{
+					resetAABB(axisBins[b].Min, axisBins[b].Max);
+					axisBins[b].Count = 0;
+				}
+			}
+
+			// All three axes binned in one pass
+			float scales[3];
+			for (uint8_t axis = 0; axis < 3; ++axis)
+			{
+				const auto extent = centroidMax[axis] - centroidMin[axis];
+				scales[axis] = extent > 0.0f ? numBins / extent : 0.0f;
+			}
+
+			for (auto i = task.Begin; i < task.End; ++i)
+			{
+				const auto& ref = refs[i];
+				for (uint8_t axis = 0; axis < 3; ++axis)
+				{
+					const auto b = (min)(static_cast<uint32_t>((ref.Centroid[axis] - centroidMin[axis]) * scales[axis]), numBins - 1);
+					growAABB(bins[axis][b].Min, bins[axis][b].Max, ref.Min, ref.Max);
+					++bins[axis][b].Count;
+				}
+			}
+
+			for (uint8_t axis = 0; axis < 3; ++axis)
+			{
+				if (scales[axis] == 0.0f) continue;
+
+				// Right sides swept from the last bin, then the left sides from the first
+				const auto& axisBins = bins[axis];
+				float rightCosts[g_numBins];
+				float aabbMin[3], aabbMax[3];
+				auto rightCount = 0u;
+				resetAABB(aabbMin, aabbMax);
+				for (auto b = numBins - 1; b > 0; --b)
+				{
+					growAABB(aabbMin, aabbMax, axisBins[b].Min, axisBins[b].Max);
+					rightCount += axisBins[b].Count;
+					rightCosts[b] = rightCount ? getHalfArea(aabbMin, aabbMax) * rightCount : 0.0f;
+				}
+
+				auto leftCount = 0u;
+				resetAABB(aabbMin, aabbMax);
+				for (auto b = 1u; b < numBins; ++b)
+				{
+					growAABB(aabbMin, aabbMax, axisBins[b - 1].Min, axisBins[b - 1].Max);
+					leftCount += axisBins[b - 1].Count;
+					if (leftCount == 0 || leftCount == count) continue;
+
+					const auto cost = g_traversalCost + (getHalfArea(aabbMin, aabbMax) * leftCount + rightCosts[b]) * invArea;
+					if (cost < bestCost || (bestAxis < 0 && count > maxLeafSize))
+					{
+						bestCost = cost;
+						bestAxis = axis;
+						bestSplit = b;
+					}
+				}
+			}
+		}
+
+		auto mid = task.Begin;
+		if (bestAxis >= 0)
+		{
+			// Same binning as above, so neither side is empty
+			const auto axis = bestAxis;
+			const auto scale = numBins / (centroidMax[axis] - centroidMin[axis]);
+			const auto first = refs.begin();
+			mid = static_cast<uint32_t>(partition(first + task.Begin, first + task.End, [&](const BuildRef& ref)
+			{
+				return (min)(static_cast<uint32_t>((ref.Centroid[axis] - centroidMin[axis]) * scale), numBins - 1) < bestSplit;
+			}) - first);
+		}
+		else if (count > maxLeafSize)
+		{
+			// Coincident centroids, or too deep: split at the median along the widest axis
+			auto axis = 0u;
+			for (auto i = 1u; i < 3; ++i)
+				if (centroidMax[i] - centroidMin[i] > centroidMax[axis] - centroidMin[axis]) axis = i;
+
+			const auto first = refs.begin();
+			mid = task.Begin + count / 2;
+			nth_element(first + task.Begin, first + mid, first + task.End, [axis](const BuildRef& a, const BuildRef& b)
+			{
+				return a.Centroid[axis] < b.Centroid[axis];
+			});
+		}
+
+		if (mid == task.Begin)
+		{
+			node.Offset = task.Begin;
+			node.Count = count;
+			continue;
+		}
+
+		const auto left = static_cast<uint32_t>(m_nodes.size());
+		node.Offset = left;
+		node.Count = 0;
+		m_nodes.resize(left + 2);
+		tasks.push_back({ left + 1, mid, task.End, task.Depth + 1 });
+		tasks.push_back({ left, task.Begin, mid, task.Depth + 1 });
+	}
+
+	for (auto i = 0u; i < numVolumes; ++i) m_volumeList[i] = refs[i].Volume;
+}
+
+void VolumeBVH::Refit(const float* pWorlds)
+{
+	setVolumes(pWorlds);
+	refitNodes();
+}
+
+void VolumeBVH::QueryFrustum(const float viewProj[16], vector<uint32_t>& volumes) const
+{
+	if (m_nodes.empty()) return;
+
+	float planes[6][4];
+	GetFrustumPlanes(viewProj, planes);
+
+	FrustumTask stack[g_maxStackSize];
+	uint32_t subtree[g_maxStackSize];
+	auto stackSize = 0u;
+	stack[stackSize++] = { 0, 0x3f };
+	while (stackSize > 0)
+	{
+		const auto task = stack[--stackSize];
+		const auto& node = m_nodes[task.Node];
+
+		auto planeMask = task.PlaneMask;
+		auto isOutside = false;
+		for (uint8_t i = 0; i < 6 && !isOutside; ++i)
+		{
+			if (!(planeMask & (1 << i))) continue;
+			isOutside = isOutsidePlane(planes[i], node.Min, node.Max);
+			if (getNearDistance(planes[i], node.Min, node.Max) >= 0.0f) planeMask &= ~(1 << i);
+		}
+
+		if (isOutside) continue;
+
+		if (planeMask == 0)
+		{
+			// Fully inside: every volume below is in, without testing
+			auto subtreeSize = 0u;
+			subtree[subtreeSize++] = task.Node;
+			while (subtreeSize > 0)
+			{
+				const auto& inner = m_nodes[subtree[--subtreeSize]];
+				if (inner.Count > 0) volumes.insert(volumes.end(), &m_volumeList[inner.Offset],
+					&m_volumeList[inner.Offset] + inner.Count);
+				else
+				{
+					subtree[subtreeSize++] = inner.Offset + 1;
+					subtree[subtreeSize++] = inner.Offset;
+				}
+			}
+		}
+		else if (node.Count > 0)
+		{
+			for (auto i = 0u; i < node.Count; ++i)
+			{
+				const auto volume = m_volumeList[node.Offset + i];
+				const auto pMin = &m_aabbs[6 * volume];
+				const auto pMax = pMin + 3;
+
+				isOutside = false;
+				for (uint8_t j = 0; j < 6 && !isOutside; ++j)
+					if (planeMask & (1 << j)) isOutside = isOutsidePlane(planes[j], pMin, pMax);
+				if (!isOutside) volumes.emplace_back(volume);
+			}
+		}
+		else
+		{
+			stack[stackSize++] = { node.Offset + 1, planeMask };
+			stack[stackSize++] = { node.Offset, planeMask };
+		}
+	}
+}
+
+uint32_t VolumeBVH::QueryRay(const float origin[3], const float dir[3], float tMax, uint32_t k, RayHit* pHits) const
+{
+	if (k == 0 || m_nodes.empty()) return 0;
+
+	float invDir[3];
+	getInvDir(dir, invDir);
+
+	float tNear, tFar;
+	if (!intersectSlabs(m_nodes[0].Min, m_nodes[0].Max, origin, invDir, tMax, tNear, tFar)) return 0;
+
+	// Front to back; once k hits are found, only nearer entries are of interest
+	auto maxEntry = tMax;
+	RayTask stack[g_maxStackSize];
+	auto stackSize = 0u;
+	auto numHits = 0u;
+	stack[stackSize++] = { 0, tNear };
+	while (stackSize > 0)
+	{
+		const auto task = stack[--stackSize];
+		if (task.TNear > maxEntry) continue;
+
+		const auto& node = m_nodes[task.Node];
+		if (node.Count > 0)
+		{
+			for (auto i = 0u; i < node.Count; ++i)
+			{
+				const auto volume = m_volumeList[node.Offset + i];
+				if (!IntersectVolume(&m_worldIs[12 * volume], origin, dir, tMax, tNear, tFar)) continue;
+				const RayHit hit = { volume, tNear, tFar };
+				if (numHits == k && !isNearer(hit, pHits[k - 1])) continue;
+
+				auto j = numHits < k ? numHits++ : k - 1;
+				for (; j > 0 && isNearer(hit, pHits[j - 1]); --j) pHits[j] = pHits[j - 1];
+				pHits[j] = hit;
+				if (numHits == k) maxEntry = pHits[k - 1].TNear;
+			}
+		}
+		else
+		{
+			float tNears[2];
+			bool isHits[2];
+			for (uint8_t i = 0; i < 2; ++i)
+			{
+				const auto& child = m_nodes[node.Offset + i];
+				isHits[i] = intersectSlabs(child.Min, child.Max, origin, invDir, maxEntry, tNears[i], tFar);
+			}
+
+			const uint8_t nearChild = isHits[1] && (!isHits[0] || tNears[1] < tNears[0]) ? 1 : 0;
+			const uint8_t farChild = 1 - nearChild;
+			if (isHits[farChild]) stack[stackSize++] = { node.Offset + farChild, tNears[farChild] };
+			if (isHits[nearChild]) stack[stackSize++] = { node.Offset + nearChild, tNears[nearChild] };
+		}
+	}
+
+	return numHits;
+}
+
+void VolumeBVH::QuerySphere(const float center[3], float radius, vector<uint32_t>& volumes) const
+{
+	if (m_nodes.empty()) return;
+
+	// The squared distance from the center to the AABB
+	const auto radiusSq = radius * radius;
+	const auto intersect = [&](const float aabbMin[3], const float aabbMax[3])
+	{
+		auto distSq = 0.0f;
+		for (uint8_t i = 0; i < 3; ++i)
+		{
+			const auto d = (max)(aabbMin[i] - center[i], 0.0f) + (max)(center[i] - aabbMax[i], 0.0f);
+			distSq += d * d;
+		}
+
+		return distSq <= radiusSq;
+	};
+
+	uint32_t stack[g_maxStackSize];
+	auto stackSize = 0u;
+	if (intersect(m_nodes[0].Min, m_nodes[0].Max)) stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		const auto& node = m_nodes[stack[--stackSize]];
+		if (node.Count > 0)
+		{
+			for (auto i = 0u; i < node.Count; ++i)
+			{
+				const auto volume = m_volumeList[node.Offset + i];
+				if (intersect(&m_aabbs[6 * volume], &m_aabbs[6 * volume + 3])) volumes.emplace_back(volume);
+			}
+		}
+		else
+		{
+			for (uint8_t i = 2; i-- > 0;)
+			{
+				const auto& child = m_nodes[node.Offset + i];
+				if (intersect(child.Min, child.Max)) stack[stackSize++] = node.Offset + i;
+			}
+		}
+	}
+}
+
+uint32_t VolumeBVH::GetNumVolumes() const
+{
+	return m_numVolumes;
+}
+
+uint32_t VolumeBVH::GetNumNodes() const
+{
+	return static_cast<uint32_t>(m_nodes.size());
+}
+
+const VolumeBVH::Node* VolumeBVH::GetNodes() const
+{
+	return m_nodes.data();
+}
+
+const uint32_t* VolumeBVH::GetVolumeList() const
+{
+	return m_volumeList.data();
+}
+
+float VolumeBVH::GetSAHCost() const
+{
+	if (m_nodes.empty()) return 0.0f;
+
+	const auto invArea = 1.0f / (max)(getHalfArea(m_nodes[0].Min, m_nodes[0].Max), FLT_MIN);
+	auto cost = 0.0;
+	for (const auto& node : m_nodes)
+		cost += getHalfArea(node.Min, node.Max) * invArea * (node.Count > 0 ? node.Count : g_traversalCost);
+
+	return static_cast<float>(cost);
+}
+
+void VolumeBVH::GetWorldAABB(const float world[12], float aabbMin[3], float aabbMax[3])
+{
+	// The corners of the [-1, 1] cube span the absolute sum of the basis vectors
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		const auto pRow = &world[4 * i];
+		const auto extent = fabsf(pRow[0]) + fabsf(pRow[1]) + fabsf(pRow[2]);
+		aabbMin[i] = pRow[3] - extent;
+		aabbMax[i] = pRow[3] + extent;
+	}
+}
+
+void VolumeBVH::GetFrustumPlanes(const float viewProj[16], float planes[6][4])
+{
+	// Inside when dot(plane, (x, y, z, 1)) >= 0; depth is in [0, w]
+	for (uint8_t i = 0; i < 4; ++i)
+	{
+		const auto x = viewProj[4 * i], y = viewProj[4 * i + 1], z = viewProj[4 * i + 2], w = viewProj[4 * i + 3];
+		planes[0][i] = w + x;	// Left
+		planes[1][i] = w - x;	// Right
+		planes[2][i] = w + y;	// Bottom
+		planes[3][i] = w - y;	// Top
+		planes[4][i] = z;		// Near
+		planes[5][i] = w - z;	// Far
+	}
+}
+
+bool VolumeBVH::IsAABBOutside(const float planes[6][4], const float aabbMin[3], const float aabbMax[3])
+{
+	for (uint8_t i = 0; i < 6; ++i)
+		if (isOutsidePlane(planes[i], aabbMin, aabbMax)) return true;
+
+	return false;
+}
+
+void VolumeBVH::GetInverseWorld(const float world[12], float worldI[12])
+{
+	// The inverse of the 3x3 part by cofactors, then the translation
+	const auto a = [world](uint8_t r, uint8_t c) { return world[4 * r + c]; };
+	const float inv[3][3] =
+	{
+		{ a(1, 1) * a(2, 2) - a(1, 2) * a(2, 1), a(0, 2) * a(2, 1) - a(0, 1) * a(2, 2), a(0, 1) * a(1, 2) - a(0, 2) * a(1, 1) },
+		{ a(1, 2) * a(2, 0) - a(1, 0) * a(2, 2), a(0, 0) * a(2, 2) - a(0, 2) * a(2, 0), a(0, 2) * a(1, 0) - a(0, 0) * a(1, 2) },
+		{ a(1, 0) * a(2, 1) - a(1, 1) * a(2, 0), a(0, 1) * a(2, 0) - a(0, 0) * a(2, 1), a(0, 0) * a(1, 1) - a(0, 1) * a(1, 0) }
+	};
+
+	const auto det = a(0, 0) * inv[0][0] + a(0, 1) * inv[1][0] + a(0, 2) * inv[2][0];
+	const auto invDet = det != 0.0f ? 1.0f / det : 0.0f;	// Degenerate cubes are never hit
+	for (uint8_t r = 0; r < 3; ++r)
+	{
+		for (uint8_t c = 0; c < 3; ++c) worldI[4 * r + c] = inv[r][c] * invDet;
+		worldI[4 * r + 3] = -(worldI[4 * r] * a(0, 3) + worldI[4 * r + 1] * a(1, 3) + worldI[4 * r + 2] * a(2, 3));
+	}
+}
+
+bool VolumeBVH::IntersectVolume(const float worldI[12], const float origin[3], const float dir[3],
+	float tMax, float& tNear, float& tFar)
+{
+	// An affine map keeps the ray parameter, so t is the same in volume space
+	float localOrigin[3], localDir[3];
+	for (uint8_t i = 0; i < 3; ++i)
+	{
+		const auto pRow = &worldI[4 * i];
+		localOrigin[i] = pRow[0] * origin[0] + pRow[1] * origin[1] + pRow[2] * origin[2] + pRow[3];
+		localDir[i] = pRow[0] * dir[0] + pRow[1] * dir[1] + pRow[2] * dir[2];
+	}
+
+	static const float cubeMin[] = { -1.0f, -1.0f, -1.0f };
+	static const float cubeMax[] = { 1.0f, 1.0f, 1.0f };
+	float invDir[3];
+	getInvDir(localDir, invDir);
+
+	return intersectSlabs(cubeMin, cubeMax, localOrigin, invDir, tMax, tNear, tFar);
+}
+
+void VolumeBVH::setVolumes(const float* pWorlds)
+{
+	m_aabbs.resize(6 * m_numVolumes);
+	m_worldIs.resize(12 * m_numVolumes);
+	for (auto i = 0u; i < m_numVolumes; ++i)
+	{
+		const auto pWorld = &pWorlds[12 * i];
+		GetWorldAABB(pWorld, &m_aabbs[6 * i], &m_aabbs[6 * i + 3]);
+		GetInverseWorld(pWorld, &m_worldIs[12 * i]);
+	}
+}
+
+void VolumeBVH::refitNodes()
+{
+	// Children come after their parent, so a backward sweep sees them first
+	for (auto i = static_cast<uint32_t>(m_nodes.size()); i-- > 0;)
+	{
+		auto& node = m_nodes[i];
+		resetAABB(node.Min, node.Max);
+		if (node.Count > 0)
+		{
+			for (auto j = 0u; j < node.Count; ++j)
+			{
+				const auto volume = m_volumeList[node.Offset + j];
+				growAABB(node.Min, node.Max, &m_aabbs[6 * volume], &m_aabbs[6 * volume + 3]);
+			}
+		}
+		else
+		{
+			growAABB(node.Min, node.Max, m_nodes[node.Offset].Min, m_nodes[node.Offset].Max);
+			growAABB(node.Min, node.Max, m_nodes[node.Offset + 1].Min, m_nodes[node.Offset + 1].Max);
+		}
+	}
+}
@@ -0,0 +1,79 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// Bounding volume hierarchy over the world AABBs of the volume cubes, built with the
+// binned surface area heuristic. Refit() keeps the topology and only updates the bounds,
+// for transforms that change from frame to frame; Build() again once they have moved far.
+// Frustum queries skip the plane tests under nodes fully inside, and ray queries return
+// the k nearest cubes a ray hits, tested exactly against the cubes in volume space.
+// Sphere queries return the cubes near a point, by their AABBs, conservatively.
+// The worlds are stored as XMFLOAT3X4, i.e. row c holds column c of the world matrix of
+// the [-1, 1] cube. It has no graphics API dependency.
+//--------------------------------------------------------------------------------------
+class VolumeBVH
+{
+public:
+	struct Node
+	{
+		float Min[3];
+		uint32_t Offset;	// Leaves: first entry of the volume list; otherwise the left child, followed by the right
+		float Max[3];
+		uint32_t Count;		// Volumes of a leaf; 0 for inner nodes
+	};
+
+	struct RayHit
+	{
+		uint32_t Volume;
+		float TNear;	// Clamped to 0 when the ray starts inside
+		float TFar;
+	};
+
+	VolumeBVH();
+	virtual ~VolumeBVH();
+
+	void Build(const float* pWorlds, uint32_t numVolumes, uint32_t maxLeafSize = 4);
+	void Refit(const float* pWorlds);	// The same volumes as the last Build()
+
+	// Appends the volumes whose AABBs are not outside the frustum of viewProj, which is
+	// row-major for row vectors, as XMFLOAT4X4 with D3D depth; the order is the leaf order
+	void QueryFrustum(const float viewProj[16], std::vector<uint32_t>& volumes) const;
+
+	// The k nearest hits within [0, tMax] in order of entry, ties in volume order; returns the
+	// number of hits. dir needs no normalization; t is in its units
+	uint32_t QueryRay(const float origin[3], const float dir[3], float tMax, uint32_t k, RayHit* pHits) const;
+
+	// Appends the volumes whose AABBs come within radius of center, i.e. all that a ray
+	// within the sphere may pass, e.g. the AO rays of a volume's neighborhood; the order is
+	// the leaf order
+	void QuerySphere(const float center[3], float radius, std::vector<uint32_t>& volumes) const;
+
+	uint32_t GetNumVolumes() const;
+	uint32_t GetNumNodes() const;
+	const Node* GetNodes() const;
+	const uint32_t* GetVolumeList() const;
+	float GetSAHCost() const;	// Expected node visits plus volume tests of a random ray through the root
+
+	static void GetWorldAABB(const float world[12], float aabbMin[3], float aabbMax[3]);
+	static void GetFrustumPlanes(const float viewProj[16], float planes[6][4]);
+	static void GetInverseWorld(const float world[12], float worldI[12]);	// Both as XMFLOAT3X4
+	static bool IsAABBOutside(const float planes[6][4], const float aabbMin[3], const float aabbMax[3]);
+	static bool IntersectVolume(const float worldI[12], const float origin[3], const float dir[3],
+		float tMax, float& tNear, float& tFar);
+
+protected:
+	void setVolumes(const float* pWorlds);
+	void refitNodes();
+
+	uint32_t m_numVolumes;
+	std::vector<Node> m_nodes;			// Root first; children always come after their parent
+	std::vector<uint32_t> m_volumeList;	// Volume indices, grouped by leaf
+	std::vector<float> m_aabbs;			// Min and max of volume i at [6 * i]
+	std::vector<float> m_worldIs;		// XMFLOAT3X4 layout, 12 floats each
+};
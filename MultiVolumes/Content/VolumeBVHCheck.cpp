@@ -0,0 +1,333 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "CostModel.h"
+#include "SharedConsts.h"
+#include "VolumeBVH.h"
+#include "VolumeCuller.h"
+#include "ToolCheck.h"
+
+using namespace std;
+
+struct BVHCheckResult
+{
+	uint64_t NumMismatches;
+	double NumCandidates;
+};
+
+// Builds the instance BVH over scattered volumes that then move, refits it, and checks the
+// frustum and ray queries against linear scans, timing both; the culling of the frustum
+// candidates must agree with culling every volume
+static BVHCheckResult checkBVH(uint32_t numVolumes, uint32_t numViews, uint32_t numRays, uint32_t k, uint32_t seed)
+{
+	vector<Matrix4> worlds;
+	vector<float> worldIs, sampleScales;
+	const auto extent = ScatterVolumes(numVolumes, seed, worlds, worldIs, sampleScales);
+
+	auto state = seed ^ 0x9e3779b9u;
+	const auto random = [&state]()
+	{
+		state = state * 1664525u + 1013904223u;
+
+		return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+	};
+
+	// Built where the volumes were a few frames ago, then refit to where they are
+	vector<float> worlds3x4(12 * numVolumes), prevWorlds3x4(12 * numVolumes);
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		GetWorld3x4(worlds[i], &worlds3x4[12 * i]);
+		copy(&worlds3x4[12 * i], &worlds3x4[12 * i] + 12, &prevWorlds3x4[12 * i]);
+		for (auto c = 0u; c < 3; ++c) prevWorlds3x4[12 * i + 4 * c + 3] += (random() - 0.5f) * 8.0f;
+	}
+
+	VolumeBVH bvh;
+	auto start = chrono::steady_clock::now();
+	bvh.Build(prevWorlds3x4.data(), numVolumes);
+	const auto buildSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	const auto buildCost = bvh.GetSAHCost();
+
+	start = chrono::steady_clock::now();
+	bvh.Refit(worlds3x4.data());
+	const auto refitSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	printf("%u volumes: build %.3f ms, %u nodes, SAH cost %.1f, refit %.3f ms, SAH cost %.1f after refit\n",
+		numVolumes, buildSeconds * 1000.0, bvh.GetNumNodes(), buildCost, refitSeconds * 1000.0, bvh.GetSAHCost());
+
+	// The linear scans test the same bounds and inverses as the BVH
+	vector<float> aabbs(6 * numVolumes), bvhWorldIs(12 * numVolumes);
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		VolumeBVH::GetWorldAABB(&worlds3x4[12 * i], &aabbs[6 * i], &aabbs[6 * i + 3]);
+		VolumeBVH::GetInverseWorld(&worlds3x4[12 * i], &bvhWorldIs[12 * i]);
+	}
+
+	VolumeCuller culler;
+	culler.Resize(numVolumes);
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		VolumeDesc desc;
+		desc.VolTexId = i % 1024;
+		desc.NumMips = NUM_CUBE_MIP;
+		desc.CubeMapSize = 128;
+		culler.SetVolumeDesc(i, desc);
+	}
+
+	VolumeCuller::FrameDesc frame = {};
+	frame.PathCosts = CostModel::GetDefaultWeights();
+	frame.Viewport[0] = 1920.0f;
+	frame.Viewport[1] = 1080.0f;
+	frame.NumSamples = 256;
+
+	// Frustum queries, and the culling of their candidates
+	BVHCheckResult result = {};
+	auto bvhSeconds = 0.0, linearSeconds = 0.0, cullAllSeconds = 0.0, cullCandidateSeconds = 0.0;
+	vector<uint32_t> candidates, linearCandidates;
+	vector<uint32_t> visibleVolumes;
+	vector<float> coverages;
+	for (auto v = 0u; v < numViews; ++v)
+	{
+		const auto angle = 6.2831853f * v / numViews;
+		const float eye[] = { cosf(angle) * extent * 0.25f, 10.0f, sinf(angle) * extent * 0.25f };
+		const float at[] = { 0.0f, 0.0f, 0.0f };
+		const auto viewProj = GetViewProj(eye, at, 3.14159265f / 4.0f, frame.Viewport[0] / frame.Viewport[1], g_zNear, g_zFar);
+		copy(eye, eye + 3, frame.EyePt);
+		VolumeCuller::GetFrustumCorners(viewProj.m[0], frame.FrustumCorners);
+
+		candidates.clear();
+		start = chrono::steady_clock::now();
+		bvh.QueryFrustum(viewProj.m[0], candidates);
+		bvhSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		float planes[6][4];
+		linearCandidates.clear();
+		start = chrono::steady_clock::now();
+		VolumeBVH::GetFrustumPlanes(viewProj.m[0], planes);
+		for (auto i = 0u; i < numVolumes; ++i)
+			if (!VolumeBVH::IsAABBOutside(planes, &aabbs[6 * i], &aabbs[6 * i + 3])) linearCandidates.emplace_back(i);
+		linearSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		sort(candidates.begin(), candidates.end());
+		if (candidates != linearCandidates) ++result.NumMismatches;
+		result.NumCandidates += candidates.size();
+
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			const auto worldViewProj = Multiply(worlds[i], viewProj);
+			culler.SetVolume(i, worldViewProj.m[0], &worldIs[12 * i], sampleScales[i]);
+		}
+
+		start = chrono::steady_clock::now();
+		culler.Cull(frame);
+		cullAllSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		visibleVolumes = culler.GetVisibleVolumes();
+		coverages.assign(culler.GetCoverages(), culler.GetCoverages() + numVolumes);
+
+		start = chrono::steady_clock::now();
+		culler.Cull(frame, candidates.data(), static_cast<uint32_t>(candidates.size()));
+		cullCandidateSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		if (culler.GetVisibleVolumes() != visibleVolumes ||
+			memcmp(coverages.data(), culler.GetCoverages(), sizeof(float) * numVolumes) != 0)
+			++result.NumMismatches;
+	}
+
+	printf("  Frustum: %.1f%% candidates, BVH %.3f ms, linear %.3f ms per view, speedup %.1fx\n",
+		100.0 * result.NumCandidates / (static_cast<double>(numVolumes) * numViews), bvhSeconds * 1000.0 / numViews,
+		linearSeconds * 1000.0 / numViews, linearSeconds / bvhSeconds);
+	printf("  Culling: all %.3f ms, candidates %.3f ms per view\n", cullAllSeconds * 1000.0 / numViews,
+		cullCandidateSeconds * 1000.0 / numViews);
+
+	// Nearest ray hits, from points in the field in random directions
+	vector<VolumeBVH::RayHit> hits(k), linearHits;
+	auto numHits = 0ull;
+	bvhSeconds = linearSeconds = 0.0;
+	for (auto r = 0u; r < numRays; ++r)
+	{
+		const float origin[] = { (random() - 0.5f) * extent, (random() - 0.5f) * 40.0f, (random() - 0.5f) * extent };
+		const float dir[] = { random() - 0.5f, (random() - 0.5f) * 0.25f, random() - 0.5f };
+
+		start = chrono::steady_clock::now();
+		const auto n = bvh.QueryRay(origin, dir, FLT_MAX, k, hits.data());
+		bvhSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		numHits += n;
+
+		start = chrono::steady_clock::now();
+		linearHits.clear();
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			VolumeBVH::RayHit hit = { i, 0.0f, 0.0f };
+			if (VolumeBVH::IntersectVolume(&bvhWorldIs[12 * i], origin, dir, FLT_MAX, hit.TNear, hit.TFar))
+				linearHits.emplace_back(hit);
+		}
+
+		const auto numLinearHits = (min)(static_cast<uint32_t>(linearHits.size()), k);
+		partial_sort(linearHits.begin(), linearHits.begin() + numLinearHits, linearHits.end(),
+			[](const VolumeBVH::RayHit& a, const VolumeBVH::RayHit& b)
+		{
+			return a.TNear < b.TNear || (a.TNear == b.TNear && a.Volume < b.Volume);
+		});
+		linearSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		auto isSame = n == numLinearHits;
+		for (auto i = 0u; i < n && isSame; ++i)
+			isSame = hits[i].Volume == linearHits[i].Volume && hits[i].TNear == linearHits[i].TNear;
+		if (!isSame) ++result.NumMismatches;
+	}
+
+	if (numRays > 0)
+		printf("  Rays: %.2f of %u nearest hits, BVH %.2f us, linear %.2f us per ray, speedup %.1fx\n",
+			static_cast<double>(numHits) / numRays, k, bvhSeconds * 1.0e6 / numRays,
+			linearSeconds * 1.0e6 / numRays, linearSeconds / bvhSeconds);
+
+	return result;
+}
+
+// Runs checkBVH() at 1k, 10k and 100k volumes, or at the given count
+int BVHCheck(int argc, char* argv[])
+{
+	auto numVolumes = 0u;
+	auto numViews = 8u;
+	auto numRays = 1000u;
+	auto k = 4u;
+	auto seed = 1u;
+	ToolArgs args;
+	args.Add("-volumes", numVolumes, 1);
+	args.Add("-views", numViews, 1);
+	args.Add("-rays", numRays);
+	args.Add("-k", k, 1);
+	args.Add("-seed", seed);
+	if (!args.Parse(argc, argv)) return EXIT_FAILURE;
+
+	const uint32_t defaultCounts[] = { 1000, 10000, 100000 };
+	const auto pCounts = numVolumes ? &numVolumes : defaultCounts;
+	const auto numCounts = numVolumes ? 1u : 3u;
+
+	uint64_t numMismatches = 0;
+	for (auto i = 0u; i < numCounts; ++i)
+		numMismatches += checkBVH(pCounts[i], numViews, numRays, k, seed).NumMismatches;
+
+	CheckReport report;
+	report.ExpectNone("Mismatches", numMismatches);
+
+	return report.Finish();
+}
+
+// Candidate volumes of the AO rays of each light map, by the neighbors within twice the
+// bounding radius of the volume, as UpdateFrame() of MultiRayCaster; the BVH must return
+// what a linear scan of the AABBs does, and every volume that the AO ray of a sampled voxel
+// enters within the bounding radius must be a candidate
+int AOCheck(int argc, char* argv[])
+{
+	uint32_t volumeCounts[] = { 16, 64, 256 }, numCounts = 3;
+	uint32_t numVoxels = 256, seed = 1;
+	ToolArgs args;
+	args.Add("-volumes", [&](const char* arg)
+	{
+		volumeCounts[0] = static_cast<uint32_t>(stoul(arg));
+		numCounts = 1;
+	});
+	args.Add("-voxels", numVoxels);
+	args.Add("-seed", seed);
+	if (!args.Parse(argc, argv)) return EXIT_FAILURE;
+
+	auto state = seed ^ 0x5d0e;
+	const auto random = [&state]()
+	{
+		state = state * 1664525u + 1013904223u;
+
+		return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+	};
+
+	uint64_t numMismatches = 0, numMisses = 0;
+	for (auto c = 0u; c < numCounts; ++c)
+	{
+		const auto numVolumes = (max)(volumeCounts[c], 1u);
+		vector<Matrix4> worlds;
+		vector<float> worldIs, sampleScales;
+		ScatterVolumes(numVolumes, seed + c, worlds, worldIs, sampleScales);
+
+		vector<float> worlds3x4(12 * numVolumes), aabbs(6 * numVolumes);
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			GetWorld3x4(worlds[i], &worlds3x4[12 * i]);
+			VolumeBVH::GetWorldAABB(&worlds3x4[12 * i], &aabbs[6 * i], &aabbs[6 * i + 3]);
+		}
+		VolumeBVH bvh;
+		bvh.Build(worlds3x4.data(), numVolumes);
+
+		uint64_t numCandidates = 0, numHits = 0, numRays = 0;
+		vector<uint32_t> candidates;
+		vector<uint8_t> isCandidate(numVolumes);
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			const auto pWorld = &worlds3x4[12 * i];
+			const float center[] = { pWorld[3], pWorld[7], pWorld[11] };
+			auto radius = 0.0f;
+			for (auto j = 0u; j < 3; ++j)
+				radius += sqrtf(pWorld[j] * pWorld[j] + pWorld[4 + j] * pWorld[4 + j] + pWorld[8 + j] * pWorld[8 + j]);
+
+			candidates.clear();
+			bvh.QuerySphere(center, 2.0f * radius, candidates);
+			numCandidates += candidates.size();
+			fill(isCandidate.begin(), isCandidate.end(), 0);
+			for (const auto n : candidates) isCandidate[n] = 1;
+
+			// Against the linear scan
+			for (auto n = 0u; n < numVolumes; ++n)
+			{
+				auto distSq = 0.0f;
+				for (auto j = 0u; j < 3; ++j)
+				{
+					const auto d = (max)(aabbs[6 * n + j] - center[j], 0.0f) + (max)(center[j] - aabbs[6 * n + 3 + j], 0.0f);
+					distSq += d * d;
+				}
+				if ((distSq <= 4.0f * radius * radius) != (isCandidate[n] != 0)) ++numMismatches;
+			}
+
+			// AO rays of voxels within the local cube in random directions, against every volume
+			for (auto v = 0u; v < numVoxels; ++v)
+			{
+				const float local[] = { random() * 2.0f - 1.0f, random() * 2.0f - 1.0f, random() * 2.0f - 1.0f };
+				float origin[3], dir[3];
+				for (auto j = 0u; j < 3; ++j)
+					origin[j] = pWorld[4 * j] * local[0] + pWorld[4 * j + 1] * local[1] + pWorld[4 * j + 2] * local[2] + center[j];
+
+				auto dirLen = 0.0f;
+				do
+				{
+					for (auto& d : dir) d = random() * 2.0f - 1.0f;
+					dirLen = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+				} while (dirLen > 1.0f || dirLen < 1e-3f);
+				for (auto& d : dir) d /= dirLen;
+
+				for (auto n = 0u; n < numVolumes; ++n)
+				{
+					float tNear, tFar;
+					if (!VolumeBVH::IntersectVolume(&worldIs[12 * n], origin, dir, radius, tNear, tFar)) continue;
+					++numHits;
+					if (!isCandidate[n]) ++numMisses;
+				}
+				++numRays;
+			}
+		}
+
+		printf("%u volumes: %u volumes per light-map voxel before, %.2f AO candidates, %.2f hits per ray "
+			"within the bounding radius\n", numVolumes, numVolumes, static_cast<double>(numCandidates) / numVolumes,
+			numRays > 0 ? static_cast<double>(numHits) / numRays : 0.0);
+	}
+
+	CheckReport report;
+	report.ExpectNone("Mismatches against the linear scan", numMismatches);
+	report.ExpectNone("Hits missing from the candidates", numMisses);
+
+	return report.Finish();
+}
@@ -0,0 +1,1008 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include "VolumeCuller.h"
+#include "ParallelFor.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VOLUME_CULL_AVX2
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VOLUME_CULL_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define VOLUME_CULL_NEON
+#endif
+
+using namespace std;
+
+#define CUBEMAP_RAYMARCH_BIT	(1 << 15)
+#define CUBEMAP_FACE_SHIFT		8
+#define ALL_FACES_VISIBLE		0x3f	// The eye is inside the cube
+
+static const uint32_t g_batchesPerTask = 64;
+static const float g_sqrt3 = 1.7320508f;
+static const float g_upscale = 2.0f;
+static const float g_raySampleCountScale = 2.0f;
+static const uint32_t g_cubeMapGroupSize = 8;	// Of CSRayMarch.hlsl in x and y
+
+enum BatchState : uint8_t
+{
+	BATCH_ZEROED,		// Culled out by the candidates, or never culled
+	BATCH_UNTRACKED,	// Recomputed with reuse off, so without the inputs to reuse it by
+	BATCH_RECOMPUTED,
+	BATCH_REUSED
+};
+
+// Cube edges as vertex pairs (GetCubeEdge() of VolumeCull.hlsli), 2 per shader lane
+static const uint8_t g_edgeVerts[12][2] =
+{
+	{ 0, 1 }, { 3, 2 },
+	{ 1, 3 }, { 2, 0 },
+	{ 6, 7 }, { 5, 4 },
+	{ 4, 6 }, { 7, 5 },
+	{ 4, 0 }, { 2, 6 },
+	{ 7, 3 }, { 1, 5 }
+};
+
+// Face quads as edge pairs (GetCubeFaceEdges() of VolumeCull.hlsli); the quad of cube-map
+// face f, in the order +X, -X, +Y, -Y, +Z, -Z, is at f ^ 1
+static const uint8_t g_faceEdges[6][4] =
+{
+	{ 8, 3, 9, 6 }, { 10, 2, 11, 7 },	// -X, +X
+	{ 0, 8, 5, 11 }, { 1, 10, 4, 9 },	// -Y, +Y
+	{ 0, 2, 1, 3 }, { 4, 6, 5, 7 }		// -Z, +Z
+};
+
+// Frustum planes as clip-space coefficients of x, y, z and w: left, right, bottom, top, near, far
+static const float g_clipPlanes[6][4] =
+{
+	{ 1.0f, 0.0f, 0.0f, 1.0f }, { -1.0f, 0.0f, 0.0f, 1.0f },
+	{ 0.0f, 1.0f, 0.0f, 1.0f }, { 0.0f, -1.0f, 0.0f, 1.0f },
+	{ 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, -1.0f, 1.0f }
+};
+
+// Frustum edge directions as corner pairs: the 2 of the near rectangle, then the 4 from near to far
+static const uint8_t g_frustumEdges[6][2] = { { 0, 1 }, { 0, 2 }, { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 } };
+
+//--------------------------------------------------------------------------------------
+// Batch lanes: one instance per lane
+//--------------------------------------------------------------------------------------
+namespace
+{
+#if defined(VOLUME_CULL_AVX2)
+	const uint32_t g_numLanes = 8;
+	const char* const g_instructionSet = "AVX2";
+
+	struct Lanes { __m256 v; };
+	struct Mask { __m256 v; };
+
+	inline Lanes Load(const float* p) { return { _mm256_loadu_ps(p) }; }
+	inline void Store(float* p, Lanes a) { _mm256_storeu_ps(p, a.v); }
+	inline Lanes Splat(float a) { return { _mm256_set1_ps(a) }; }
+	inline Lanes operator+(Lanes a, Lanes b) { return { _mm256_add_ps(a.v, b.v) }; }
+	inline Lanes operator-(Lanes a, Lanes b) { return { _mm256_sub_ps(a.v, b.v) }; }
+	inline Lanes operator*(Lanes a, Lanes b) { return { _mm256_mul_ps(a.v, b.v) }; }
+	inline Lanes operator/(Lanes a, Lanes b) { return { _mm256_div_ps(a.v, b.v) }; }
+	inline Lanes Sqrt(Lanes a) { return { _mm256_sqrt_ps(a.v) }; }
+	inline Lanes Min(Lanes a, Lanes b) { return { _mm256_min_ps(a.v, b.v) }; }
+	inline Lanes Max(Lanes a, Lanes b) { return { _mm256_max_ps(a.v, b.v) }; }
+	inline Lanes Abs(Lanes a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) }; }
+	inline Mask operator<(Lanes a, Lanes b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+	inline Mask operator<=(Lanes a, Lanes b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+	inline Mask operator>(Lanes a, Lanes b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+	inline Mask operator>=(Lanes a, Lanes b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+	inline Mask operator&(Mask a, Mask b) { return { _mm256_and_ps(a.v, b.v) }; }
+	inline Mask operator|(Mask a, Mask b) { return { _mm256_or_ps(a.v, b.v) }; }
+	inline Mask NoLanes() { return { _mm256_setzero_ps() }; }
+	inline Lanes Select(Mask m, Lanes a, Lanes b) { return { _mm256_blendv_ps(b.v, a.v, m.v) }; }
+	inline uint32_t GetBits(Mask m) { return static_cast<uint32_t>(_mm256_movemask_ps(m.v)); }
+#elif defined(VOLUME_CULL_SSE2)
+	const uint32_t g_numLanes = 4;
+	const char* const g_instructionSet = "SSE2";
+
+	struct Lanes { __m128 v; };
+	struct Mask { __m128 v; };
+
+	inline Lanes Load(const float* p) { return { _mm_loadu_ps(p) }; }
+	inline void Store(float* p, Lanes a) { _mm_storeu_ps(p, a.v); }
+	inline Lanes Splat(float a) { return { _mm_set1_ps(a) }; }
+	inline Lanes operator+(Lanes a, Lanes b) { return { _mm_add_ps(a.v, b.v) }; }
+	inline Lanes operator-(Lanes a, Lanes b) { return { _mm_sub_ps(a.v, b.v) }; }
+	inline Lanes operator*(Lanes a, Lanes b) { return { _mm_mul_ps(a.v, b.v) }; }
+	inline Lanes operator/(Lanes a, Lanes b) { return { _mm_div_ps(a.v, b.v) }; }
+	inline Lanes Sqrt(Lanes a) { return { _mm_sqrt_ps(a.v) }; }
+	inline Lanes Min(Lanes a, Lanes b) { return { _mm_min_ps(a.v, b.v) }; }
+	inline Lanes Max(Lanes a, Lanes b) { return { _mm_max_ps(a.v, b.v) }; }
+	inline Lanes Abs(Lanes a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+	inline Mask operator<(Lanes a, Lanes b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+	inline Mask operator<=(Lanes a, Lanes b) { return { _mm_cmple_ps(a.v, b.v) }; }
+	inline Mask operator>(Lanes a, Lanes b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+	inline Mask operator>=(Lanes a, Lanes b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+	inline Mask operator&(Mask a, Mask b) { return { _mm_and_ps(a.v, b.v) }; }
+	inline Mask operator|(Mask a, Mask b) { return { _mm_or_ps(a.v, b.v) }; }
+	inline Mask NoLanes() { return { _mm_setzero_ps() }; }
+	inline Lanes Select(Mask m, Lanes a, Lanes b) { return { _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)) }; }
+	inline uint32_t GetBits(Mask m) { return static_cast<uint32_t>(_mm_movemask_ps(m.v)); }
+#elif defined(VOLUME_CULL_NEON)
+	const uint32_t g_numLanes = 4;
+	const char* const g_instructionSet = "NEON";
+
+	struct Lanes { float32x4_t v; };
+	struct Mask { uint32x4_t v; };
+
+	inline Lanes Load(const float* p) { return { vld1q_f32(p) }; }
+	inline void Store(float* p, Lanes a) { vst1q_f32(p, a.v); }
+	inline Lanes Splat(float a) { return { vdupq_n_f32(a) }; }
+	inline Lanes operator+(Lanes a, Lanes b) { return { vaddq_f32(a.v, b.v) }; }
+	inline Lanes operator-(Lanes a, Lanes b) { return { vsubq_f32(a.v, b.v) }; }
+	inline Lanes operator*(Lanes a, Lanes b) { return { vmulq_f32(a.v, b.v) }; }
+	inline Lanes operator/(Lanes a, Lanes b) { return { vdivq_f32(a.v, b.v) }; }
+	inline Lanes Sqrt(Lanes a) { return { vsqrtq_f32(a.v) }; }
+	inline Lanes Min(Lanes a, Lanes b) { return { vminq_f32(a.v, b.v) }; }
+	inline Lanes Max(Lanes a, Lanes b) { return { vmaxq_f32(a.v, b.v) }; }
+	inline Lanes Abs(Lanes a) { return { vabsq_f32(a.v) }; }
+	inline Mask operator<(Lanes a, Lanes b) { return { vcltq_f32(a.v, b.v) }; }
+	inline Mask operator<=(Lanes a, Lanes b) { return { vcleq_f32(a.v, b.v) }; }
+	inline Mask operator>(Lanes a, Lanes b) { return { vcgtq_f32(a.v, b.v) }; }
+	inline Mask operator>=(Lanes a, Lanes b) { return { vcgeq_f32(a.v, b.v) }; }
+	inline Mask operator&(Mask a, Mask b) { return { vandq_u32(a.v, b.v) }; }
+	inline Mask operator|(Mask a, Mask b) { return { vorrq_u32(a.v, b.v) }; }
+	inline Mask NoLanes() { return { vdupq_n_u32(0) }; }
+	inline Lanes Select(Mask m, Lanes a, Lanes b) { return { vbslq_f32(m.v, a.v, b.v) }; }
+	inline uint32_t GetBits(Mask m)
+	{
+		static const uint32_t laneBits[] = { 1, 2, 4, 8 };
+
+		return vaddvq_u32(vandq_u32(m.v, vld1q_u32(laneBits)));
+	}
+#else
+	// Scalar builds cull the lanes one by one through CullVolume()
+	const uint32_t g_numLanes = 4;
+	const char* const g_instructionSet = "scalar";
+#endif
+}
+
+// Float-to-uint conversion as D3D defines it: NaN and negatives to 0, saturated at the top
+static inline uint32_t floatToUint(float value)
+{
+	if (!(value > 0.0f)) return 0;
+
+	return value >= 4294967296.0f ? UINT32_MAX : static_cast<uint32_t>(value);
+}
+
+static inline uint16_t saturateU16(uint32_t value)
+{
+	return static_cast<uint16_t>((min)(value, 0xffffu));
+}
+
+static inline uint32_t countBits(uint32_t value)
+{
+	auto count = 0u;
+	for (; value; value &= value - 1) ++count;
+
+	return count;
+}
+
+// The scalar part of the shader for a visible instance, from the outputs of its lanes: the
+// ray sample count and LOD of EstimateCubeMapLOD(), the render scheme of each face
+// (SelectCubeMapFaces()) and the record; faceCoverages is null once near-clipped
+static void finishVolume(const VolumeCuller::FrameDesc& frame, const VolumeDesc& desc, float sampleScale,
+	uint32_t faceMask, float raySampleAmt, float coverage, const float* faceCoverages, VolumeInfo& info,
+	float& cubeMapCoverage)
+{
+	auto raySampleCount = (max)(floatToUint(frame.NumSamples * sampleScale), 1u);
+
+	// Clamp the ideal ray sample amount using the upper bound of ray sample count, and
+	// inversely derive the cube-map resolution from the clamped amount
+	const auto raySampleCnt = floatToUint(ceilf(raySampleAmt));
+	raySampleCount = (min)(raySampleCnt, raySampleCount);
+	raySampleAmt = (min)(raySampleAmt, static_cast<float>(raySampleCount));
+	const auto s = raySampleAmt / g_raySampleCountScale * g_sqrt3;
+
+	// Use the more detailed integer level for conservation
+	const auto level = floatToUint((max)(log2f(static_cast<float>(desc.CubeMapSize) / s), 0.0f));
+	const auto mipLevel = (min)(level, desc.NumMips - 1u);
+
+	// Visible pixels of the cube map, and the cheaper path of the whole volume; with the eye
+	// inside the cube, ray cast it directly
+	const auto edgeLength = mipLevel < 32 ? desc.CubeMapSize >> mipLevel : 0;
+	const auto faceArea = static_cast<float>(edgeLength * edgeLength);
+	const auto cubeMapPix = faceArea * static_cast<float>(countBits(faceMask));
+	const auto useCubeMap = CostModel::UseCubeMap(frame.PathCosts, faceMask, cubeMapPix, coverage, raySampleCount);
+
+	// The cheaper path of each visible face, by its own projected pixels; once near-clipped,
+	// that of the whole volume
+	auto cubeMapFaces = 0u;
+	cubeMapCoverage = 0.0f;
+	for (auto face = 0u; face < 6; ++face)
+	{
+		if (!(faceMask & (1 << face))) continue;
+		const auto isCubeMapFace = faceCoverages ? CostModel::UseCubeMap(frame.PathCosts, faceMask, faceArea,
+			faceCoverages[face], raySampleCount) : useCubeMap;
+		if (isCubeMapFace)
+		{
+			cubeMapFaces |= 1 << face;
+			cubeMapCoverage = cubeMapCoverage + (faceCoverages ? faceCoverages[face] : 0.0f);
+		}
+	}
+	if (!faceCoverages && useCubeMap) cubeMapCoverage = coverage;
+
+	auto maskBits = faceMask | (cubeMapFaces << CUBEMAP_FACE_SHIFT);
+	if (cubeMapFaces) maskBits |= CUBEMAP_RAYMARCH_BIT;
+
+	info.MipLevel = saturateU16(mipLevel);
+	info.SmpCount = saturateU16(raySampleCount);
+	info.FaceMask = saturateU16(maskBits);
+	info.VolTexId = saturateU16(desc.VolTexId);
+}
+
+#if !defined(VOLUME_CULL_AVX2) && !defined(VOLUME_CULL_SSE2) && !defined(VOLUME_CULL_NEON)
+// Whether every vertex of the cube is outside the clip plane (ClassifyVolume())
+static inline bool isOutsidePlane(const float worldViewProj[16], const float plane[4])
+{
+	const auto m = worldViewProj;
+	float c[4];
+	for (auto i = 0u; i < 4; ++i)
+		c[i] = ((m[4 * i] * plane[0] + m[4 * i + 1] * plane[1]) + m[4 * i + 2] * plane[2]) + m[4 * i + 3] * plane[3];
+
+	return c[3] + ((fabsf(c[0]) + fabsf(c[1])) + fabsf(c[2])) < 0.0f;
+}
+
+// Upper bound of how many pixels any vertex of the cube has moved between two world-view-
+// projection matrices, with the NDC depth counted as the wider screen axis; 0 while both
+// are outside the same clip plane, e.g. behind the camera, and FLT_MAX once either crosses
+// the camera plane otherwise
+static float getFootprintChange(const float prevWorldViewProj[16], const float worldViewProj[16],
+	const float viewport[2])
+{
+	const auto m0 = prevWorldViewProj, m1 = worldViewProj;
+	for (const auto& plane : g_clipPlanes)
+		if (isOutsidePlane(m0, plane) && isOutsidePlane(m1, plane)) return 0.0f;
+
+	const auto minW0 = m0[15] - ((fabsf(m0[3]) + fabsf(m0[7])) + fabsf(m0[11]));
+	const auto minW1 = m1[15] - ((fabsf(m1[3]) + fabsf(m1[7])) + fabsf(m1[11]));
+	if (!(minW0 > 0.0f && minW1 > 0.0f)) return FLT_MAX;
+
+	// Max change of the clip coordinates over the vertices (+-1 each), and max |NDC| before
+	float d[4], ndc[3];
+	for (auto c = 0u; c < 4; ++c)
+	{
+		d[c] = fabsf(m1[c] - m0[c]) + fabsf(m1[4 + c] - m0[4 + c]) + fabsf(m1[8 + c] - m0[8 + c]) + fabsf(m1[12 + c] - m0[12 + c]);
+		if (c < 3) ndc[c] = (fabsf(m0[c]) + fabsf(m0[4 + c]) + fabsf(m0[8 + c]) + fabsf(m0[12 + c])) / minW0;
+	}
+
+	// x1 / w1 - x0 / w0 = ((x1 - x0) - x0 / w0 * (w1 - w0)) / w1
+	const float scales[] = { viewport[0], viewport[1], (max)(viewport[0], viewport[1]) };
+	auto change = 0.0f;
+	for (auto c = 0u; c < 3; ++c) change = (max)((d[c] + ndc[c] * d[3]) / minW1 * 0.5f * scales[c], change);
+
+	return change;
+}
+#endif
+
+VolumeCuller::VolumeCuller() :
+	m_numVolumes(0),
+	m_stride(0),
+	m_cullViewport(),
+	m_cullNumSamples(0),
+	m_cullPathCosts(),
+	m_numReused(0),
+	m_numRecomputed(0)
+{
+}
+
+VolumeCuller::~VolumeCuller()
+{
+}
+
+void VolumeCuller::Resize(uint32_t numVolumes)
+{
+	m_numVolumes = numVolumes;
+	m_stride = (numVolumes + g_numLanes - 1) / g_numLanes * g_numLanes;
+
+	// The padding lanes are never visible, see cullBatch()
+	m_worldViewProjs.assign(16 * m_stride, 0.0f);
+	m_worldIs.assign(12 * m_stride, 0.0f);
+	m_sampleScales.assign(m_stride, 1.0f);
+	m_descs.assign(m_stride, VolumeDesc());
+
+	m_infos.assign(m_stride, VolumeInfo());
+	m_coverages.assign(m_stride, 0.0f);
+	m_cubeMapCoverages.assign(m_stride, 0.0f);
+	m_visibility.assign(m_stride, 0);
+	m_visibleVolumes.clear();
+	m_cubeMapVolumes.clear();
+
+	m_cullWorldViewProjs.assign(16 * m_stride, 0.0f);
+	m_cullSampleScales.assign(m_stride, 1.0f);
+	m_batchStates.assign(m_stride / g_numLanes, BATCH_ZEROED);
+	m_numReused = 0;
+	m_numRecomputed = 0;
+}
+
+void VolumeCuller::SetVolume(uint32_t i, const float worldViewProj[16], const float worldI[12], float sampleScale)
+{
+	for (auto k = 0u; k < 16; ++k) m_worldViewProjs[k * m_stride + i] = worldViewProj[k];
+	for (auto k = 0u; k < 12; ++k) m_worldIs[k * m_stride + i] = worldI[k];
+	m_sampleScales[i] = sampleScale;
+}
+
+void VolumeCuller::SetVolumeDesc(uint32_t i, const VolumeDesc& desc)
+{
+	m_descs[i] = desc;
+	m_batchStates[i / g_numLanes] = BATCH_ZEROED;
+}
+
+void VolumeCuller::Cull(const FrameDesc& frame, uint32_t numThreads)
+{
+	cullBatches(frame, nullptr, numThreads);
+}
+
+void VolumeCuller::Cull(const FrameDesc& frame, const uint32_t* pCandidates, uint32_t numCandidates, uint32_t numThreads)
+{
+	m_batchMask.assign(m_stride / g_numLanes, 0);
+	for (auto i = 0u; i < numCandidates; ++i) m_batchMask[pCandidates[i] / g_numLanes] = 1;
+	cullBatches(frame, m_batchMask.data(), numThreads);
+}
+
+void VolumeCuller::cullBatches(const FrameDesc& frame, const uint8_t* pBatchMask, uint32_t numThreads)
+{
+	const auto numBatches = m_stride / g_numLanes;
+	const auto numTasks = (numBatches + g_batchesPerTask - 1) / g_batchesPerTask;
+
+	// The results of every batch depend on the viewport, the sample count and the path costs
+	if (frame.Viewport[0] != m_cullViewport[0] || frame.Viewport[1] != m_cullViewport[1] ||
+		frame.NumSamples != m_cullNumSamples || memcmp(&frame.PathCosts, &m_cullPathCosts, sizeof(m_cullPathCosts)) != 0)
+	{
+		fill(m_batchStates.begin(), m_batchStates.end(), BATCH_ZEROED);
+		m_cullViewport[0] = frame.Viewport[0];
+		m_cullViewport[1] = frame.Viewport[1];
+		m_cullNumSamples = frame.NumSamples;
+		m_cullPathCosts = frame.PathCosts;
+	}
+
+	ParallelFor(numTasks, [&](uint32_t task)
+	{
+		const auto lastBatch = (min)((task + 1) * g_batchesPerTask, numBatches);
+		for (auto batch = task * g_batchesPerTask; batch < lastBatch; ++batch)
+		{
+			const auto first = batch * g_numLanes;
+			auto& state = m_batchStates[batch];
+			if (pBatchMask && !pBatchMask[batch])
+			{
+				fill_n(&m_coverages[first], g_numLanes, 0.0f);
+				fill_n(&m_cubeMapCoverages[first], g_numLanes, 0.0f);
+				fill_n(&m_visibility[first], g_numLanes, 0);
+				state = BATCH_ZEROED;
+			}
+			else if (frame.ReuseThreshold <= 0.0f)
+			{
+				// No snapshot of the inputs, which would cost as much as the batch kernel
+				cullBatch(frame, first);
+				state = BATCH_UNTRACKED;
+			}
+			else if ((state == BATCH_RECOMPUTED || state == BATCH_REUSED) && isBatchReusable(frame, first))
+				state = BATCH_REUSED;
+			else
+			{
+				cullBatch(frame, first);
+				for (auto k = 0u; k < 16; ++k) copy_n(&m_worldViewProjs[k * m_stride + first], g_numLanes,
+					&m_cullWorldViewProjs[k * m_stride + first]);
+				copy_n(&m_sampleScales[first], g_numLanes, &m_cullSampleScales[first]);
+				state = BATCH_RECOMPUTED;
+			}
+		}
+	}, numThreads);
+
+	m_numReused = 0;
+	m_numRecomputed = 0;
+	for (auto batch = 0u; batch < numBatches; ++batch)
+	{
+		const auto numLanes = (min)(m_numVolumes - batch * g_numLanes, g_numLanes);
+		if (m_batchStates[batch] == BATCH_REUSED) m_numReused += numLanes;
+		if (m_batchStates[batch] == BATCH_RECOMPUTED || m_batchStates[batch] == BATCH_UNTRACKED) m_numRecomputed += numLanes;
+	}
+
+	// Listed in instance order, unlike the append buffers of the shader
+	m_visibleVolumes.clear();
+	m_cubeMapVolumes.clear();
+	for (auto i = 0u; i < m_numVolumes; ++i)
+	{
+		if (m_visibility[i] & 1) m_visibleVolumes.emplace_back(i);
+		if (m_visibility[i] & 2) m_cubeMapVolumes.emplace_back(i);
+	}
+}
+
+uint32_t VolumeCuller::GetNumVolumes() const
+{
+	return m_numVolumes;
+}
+
+const VolumeDesc* VolumeCuller::GetVolumeDescs() const
+{
+	return m_descs.data();
+}
+
+const VolumeInfo* VolumeCuller::GetVolumeInfos() const
+{
+	return m_infos.data();
+}
+
+const float* VolumeCuller::GetCoverages() const
+{
+	return m_coverages.data();
+}
+
+const float* VolumeCuller::GetCubeMapCoverages() const
+{
+	return m_cubeMapCoverages.data();
+}
+
+const vector<uint32_t>& VolumeCuller::GetVisibleVolumes() const
+{
+	return m_visibleVolumes;
+}
+
+const vector<uint32_t>& VolumeCuller::GetCubeMapVolumes() const
+{
+	return m_cubeMapVolumes;
+}
+
+uint32_t VolumeCuller::GetNumReused() const
+{
+	return m_numReused;
+}
+
+uint32_t VolumeCuller::GetNumRecomputed() const
+{
+	return m_numRecomputed;
+}
+
+bool VolumeCuller::IsReused(uint32_t i) const
+{
+	return m_batchStates[i / g_numLanes] == BATCH_REUSED;
+}
+
+void VolumeCuller::GetCubeMapDispatchArgs(uint32_t gridSize, uint32_t numBins, CubeMapDispatchArg* pArgs,
+	vector<uint32_t>* pBinnedFaces) const
+{
+	ResetCubeMapDispatchArgs(gridSize, numBins, pArgs);
+	if (pBinnedFaces) pBinnedFaces->assign(static_cast<size_t>(numBins) * 6 * m_numVolumes, 0);
+
+	for (const auto& i : m_cubeMapVolumes)
+	{
+		const auto bin = (min)(static_cast<uint32_t>(m_infos[i].MipLevel), numBins - 1);
+		const auto cubeMapFaces = (m_infos[i].FaceMask >> CUBEMAP_FACE_SHIFT) & ALL_FACES_VISIBLE;
+		auto& arg = pArgs[bin];
+		++arg.NumVolumes;
+
+		// A work item per cube-map face, the lane of the face writing it
+		for (auto f = 0u; f < 6; ++f)
+		{
+			if (!(cubeMapFaces & (1 << f))) continue;
+			const auto k = arg.ThreadGroupCountZ++;
+			if (pBinnedFaces) (*pBinnedFaces)[static_cast<size_t>(bin) * 6 * m_numVolumes + k] = (i << 3) | f;
+		}
+	}
+}
+
+bool VolumeCuller::CullVolume(const FrameDesc& frame, const float worldViewProj[16], const float worldI[12],
+	const VolumeDesc& desc, float sampleScale, VolumeInfo& info, float& coverage, float* pCubeMapCoverage)
+{
+	const auto m = worldViewProj;
+	coverage = 0.0f;
+	if (pCubeMapCoverage) *pCubeMapCoverage = 0.0f;
+
+	// A sample scale of 0 hides the instance, e.g. dropped by the sample budget
+	if (sampleScale <= 0.0f) return false;
+	if (ClassifyVolume(frame.FrustumCorners, worldViewProj, worldI) == FRUSTUM_OUTSIDE) return false;
+
+	// Project the vertices to viewport space, one per lane (ProjectToViewport())
+	float vx[8], vy[8];
+	for (auto i = 0u; i < 8; ++i)
+	{
+		const auto px = (i & 1) ? 1.0f : -1.0f;
+		const auto py = ((i >> 1) & 1) ? 1.0f : -1.0f;
+		const auto pz = (i >> 2) ? 1.0f : -1.0f;
+		const auto pw = 1.0f;
+
+		auto x = ((px * m[0] + py * m[4]) + pz * m[8]) + pw * m[12];
+		auto y = ((px * m[1] + py * m[5]) + pz * m[9]) + pw * m[13];
+		const auto w = ((px * m[3] + py * m[7]) + pz * m[11]) + pw * m[15];
+		x = x / w;
+		y = y / w;
+		x = x * 0.5f + 0.5f;
+		y = y * 0.5f + 0.5f;
+		y = 1.0f - y;
+		vx[i] = x * frame.Viewport[0];
+		vy[i] = y * frame.Viewport[1];
+	}
+
+	// Visibility mask (GenVisibilityMask())
+	const auto& e = frame.EyePt;
+	float localEyePt[3];
+	for (auto c = 0u; c < 3; ++c)
+		localEyePt[c] = ((e[0] * worldI[c * 4] + e[1] * worldI[c * 4 + 1]) + e[2] * worldI[c * 4 + 2]) + 1.0f * worldI[c * 4 + 3];
+
+	auto faceMask = 0u;
+	for (auto face = 0u; face < 6; ++face)
+	{
+		const auto viewComp = localEyePt[face >> 1];
+		if ((face & 1) ? viewComp > -1.0f : viewComp < 1.0f) faceMask |= 1 << face;
+	}
+
+	// Edges, the max edge length and the cube-map size (EstimateCubeMaxEdgeLength())
+	float ex[12], ey[12];
+	auto maxLength = 0.0f;
+	for (auto i = 0u; i < 12; ++i)
+	{
+		ex[i] = vx[g_edgeVerts[i][1]] - vx[g_edgeVerts[i][0]];
+		ey[i] = vy[g_edgeVerts[i][1]] - vy[g_edgeVerts[i][0]];
+		maxLength = (max)(sqrtf(ex[i] * ex[i] + ey[i] * ey[i]), maxLength);
+	}
+
+	const auto s = maxLength / g_upscale;
+	auto raySampleAmt = g_raySampleCountScale * s / g_sqrt3;
+
+	// Projected pixels of each face (EstimateFaceCoverage()), and of the volume over the
+	// visible faces (EstimateProjCoverage())
+	float faceCoverages[6];
+	for (auto face = 0u; face < 6; ++face)
+	{
+		const auto& edges = g_faceEdges[face ^ 1];
+		const auto e0 = edges[0], e1 = edges[1], e2 = edges[2], e3 = edges[3];
+		faceCoverages[face] = 0.5f * fabsf(ex[e0] * ey[e1] - ey[e0] * ex[e1]) +
+			0.5f * fabsf(ex[e2] * ey[e3] - ey[e2] * ex[e3]);
+		coverage = coverage + ((faceMask & (1 << face)) ? faceCoverages[face] : 0.0f);
+	}
+
+	// Behind the camera plane, take the most detailed level and the whole viewport
+	const auto isNearClipped = IsNearClipped(worldViewProj);
+	if (isNearClipped)
+	{
+		raySampleAmt = FLT_MAX;
+		coverage = frame.Viewport[0] * frame.Viewport[1];
+	}
+
+	float cubeMapCoverage;
+	finishVolume(frame, desc, sampleScale, faceMask, raySampleAmt, coverage, isNearClipped ? nullptr : faceCoverages,
+		info, cubeMapCoverage);
+	if (pCubeMapCoverage) *pCubeMapCoverage = cubeMapCoverage;
+
+	return true;
+}
+
+VolumeCuller::Classification VolumeCuller::ClassifyVolume(const float frustumCorners[8][3],
+	const float worldViewProj[16], const float worldI[12])
+{
+	const auto m = worldViewProj;
+
+	// Each frustum plane is a plane in volume space, whose range over the cube is its value at
+	// the center +- the sum of its absolute coefficients
+	auto isInside = true;
+	for (const auto& n : g_clipPlanes)
+	{
+		float c[4];
+		for (auto i = 0u; i < 4; ++i)
+			c[i] = ((m[4 * i] * n[0] + m[4 * i + 1] * n[1]) + m[4 * i + 2] * n[2]) + m[4 * i + 3] * n[3];
+
+		const auto r = (fabsf(c[0]) + fabsf(c[1])) + fabsf(c[2]);
+		if (c[3] + r < 0.0f) return FRUSTUM_OUTSIDE;
+		isInside = isInside && c[3] - r >= 0.0f;
+	}
+
+	// The frustum corners in volume space, where the cube is [-1, 1]
+	float f[8][3];
+	for (auto k = 0u; k < 8; ++k)
+	{
+		const auto p = frustumCorners[k];
+		for (auto c = 0u; c < 3; ++c)
+			f[k][c] = ((p[0] * worldI[c * 4] + p[1] * worldI[c * 4 + 1]) + p[2] * worldI[c * 4 + 2]) + 1.0f * worldI[c * 4 + 3];
+	}
+
+	// Cube axes
+	for (auto c = 0u; c < 3; ++c)
+	{
+		auto lo = f[0][c], hi = f[0][c];
+		for (auto k = 1u; k < 8; ++k)
+		{
+			lo = (min)(lo, f[k][c]);
+			hi = (max)(hi, f[k][c]);
+		}
+
+		if (lo > 1.0f || hi < -1.0f) return FRUSTUM_OUTSIDE;
+	}
+
+	// Cross products of the cube axes and the frustum edges, a x d with a = axis c
+	for (const auto& edge : g_frustumEdges)
+	{
+		float d[3];
+		for (auto c = 0u; c < 3; ++c) d[c] = f[edge[1]][c] - f[edge[0]][c];
+
+		for (auto c = 0u; c < 3; ++c)
+		{
+			const auto u = (c + 1) % 3, v = (c + 2) % 3;
+			const auto au = -d[v], av = d[u];
+			const auto r = fabsf(au) + fabsf(av);
+
+			auto lo = f[0][u] * au + f[0][v] * av;
+			auto hi = lo;
+			for (auto k = 1u; k < 8; ++k)
+			{
+				const auto t = f[k][u] * au + f[k][v] * av;
+				lo = (min)(lo, t);
+				hi = (max)(hi, t);
+			}
+
+			if (lo > r || hi < -r) return FRUSTUM_OUTSIDE;
+		}
+	}
+
+	return isInside ? FRUSTUM_INSIDE : FRUSTUM_INTERSECTING;
+}
+
+void VolumeCuller::GetFrustumCorners(const float viewProj[16], float frustumCorners[8][3])
+{
+	// Adjugate, since the determinant cancels in the perspective divide
+	const auto m = viewProj;
+	float inv[16];
+	inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+	inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+	inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+	inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+	inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+	inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+	inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+	inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+	inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+	inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+	inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+	inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+	inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+	inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+	inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+	inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+	for (auto k = 0u; k < 8; ++k)
+	{
+		const float p[] = { (k & 1) ? 1.0f : -1.0f, ((k >> 1) & 1) ? 1.0f : -1.0f, (k >> 2) ? 1.0f : 0.0f, 1.0f };
+		float q[4];
+		for (auto j = 0u; j < 4; ++j)
+			q[j] = p[0] * inv[j] + p[1] * inv[4 + j] + p[2] * inv[8 + j] + p[3] * inv[12 + j];
+		for (auto c = 0u; c < 3; ++c) frustumCorners[k][c] = q[c] / q[3];
+	}
+}
+
+bool VolumeCuller::IsNearClipped(const float worldViewProj[16])
+{
+	const auto m = worldViewProj;
+
+	// Min of clip w over the cube
+	return m[15] - ((fabsf(m[3]) + fabsf(m[7])) + fabsf(m[11])) <= 0.0f;
+}
+
+void VolumeCuller::ResetCubeMapDispatchArgs(uint32_t gridSize, uint32_t numBins, CubeMapDispatchArg* pArgs)
+{
+	for (auto i = 0u; i < numBins; ++i)
+	{
+		const auto faceSize = (max)(gridSize >> i, 1u);
+		const auto numGroups = (faceSize + g_cubeMapGroupSize - 1) / g_cubeMapGroupSize;
+		pArgs[i].MipLevel = i;
+		pArgs[i].ThreadGroupCountX = numGroups;
+		pArgs[i].ThreadGroupCountY = numGroups;
+		pArgs[i].ThreadGroupCountZ = 0;
+		pArgs[i].NumVolumes = 0;
+	}
+}
+
+VolumeCuller::CubeMapGroupCounts VolumeCuller::CountCubeMapGroups(uint32_t gridSize, uint32_t numBins,
+	const CubeMapDispatchArg* pArgs)
+{
+	const uint64_t fullGroups = (gridSize + g_cubeMapGroupSize - 1) / g_cubeMapGroupSize;
+
+	CubeMapGroupCounts counts = {};
+	for (auto i = 0u; i < numBins; ++i)
+	{
+		// Groups with any thread on the face of the bin's mip
+		const auto& arg = pArgs[i];
+		const auto faceSize = (max)(gridSize >> arg.MipLevel, 1u);
+		const uint64_t numGroups = (faceSize + g_cubeMapGroupSize - 1) / g_cubeMapGroupSize;
+		const auto groupsX = (min)(static_cast<uint64_t>(arg.ThreadGroupCountX), numGroups);
+		const auto groupsY = (min)(static_cast<uint64_t>(arg.ThreadGroupCountY), numGroups);
+		const uint64_t numFaces = arg.ThreadGroupCountZ;
+
+		// The full-size dispatch runs the 6 faces of each volume, live on its cube-map faces
+		const auto launched = static_cast<uint64_t>(arg.ThreadGroupCountX) * arg.ThreadGroupCountY;
+		const auto unbinnedLaunched = fullGroups * fullGroups * 6 * arg.NumVolumes;
+		counts.Launched += launched * numFaces;
+		counts.Wasted += (launched - groupsX * groupsY) * numFaces;
+		counts.UnbinnedLaunched += unbinnedLaunched;
+		counts.UnbinnedWasted += unbinnedLaunched - (min)(numGroups * numGroups * numFaces, unbinnedLaunched);
+	}
+
+	return counts;
+}
+
+uint32_t VolumeCuller::GetBatchSize()
+{
+	return g_numLanes;
+}
+
+const char* VolumeCuller::GetInstructionSet()
+{
+	return g_instructionSet;
+}
+
+bool VolumeCuller::isBatchReusable(const FrameDesc& frame, uint32_t first) const
+{
+#if !defined(VOLUME_CULL_AVX2) && !defined(VOLUME_CULL_SSE2) && !defined(VOLUME_CULL_NEON)
+	const auto last = (min)(first + g_numLanes, m_numVolumes);
+	for (auto i = first; i < last; ++i)
+	{
+		if (m_sampleScales[i] != m_cullSampleScales[i]) return false;
+
+		float prevWorldViewProj[16], worldViewProj[16];
+		for (auto k = 0u; k < 16; ++k)
+		{
+			prevWorldViewProj[k] = m_cullWorldViewProjs[k * m_stride + i];
+			worldViewProj[k] = m_worldViewProjs[k * m_stride + i];
+		}
+
+		if (getFootprintChange(prevWorldViewProj, worldViewProj, frame.Viewport) >= frame.ReuseThreshold) return false;
+	}
+
+	return true;
+#else
+	// The same bound as getFootprintChange() of scalar builds, one instance per lane
+	Lanes m0[16], m1[16];
+	for (auto k = 0u; k < 16; ++k)
+	{
+		m0[k] = Load(&m_cullWorldViewProjs[k * m_stride + first]);
+		m1[k] = Load(&m_worldViewProjs[k * m_stride + first]);
+	}
+
+	const auto zero = Splat(0.0f);
+
+	// Outside the same clip plane in both
+	auto outside = NoLanes();
+	for (const auto& plane : g_clipPlanes)
+	{
+		const Lanes n[] = { Splat(plane[0]), Splat(plane[1]), Splat(plane[2]), Splat(plane[3]) };
+		Lanes c0[4], c1[4];
+		for (auto i = 0u; i < 4; ++i)
+		{
+			c0[i] = ((m0[4 * i] * n[0] + m0[4 * i + 1] * n[1]) + m0[4 * i + 2] * n[2]) + m0[4 * i + 3] * n[3];
+			c1[i] = ((m1[4 * i] * n[0] + m1[4 * i + 1] * n[1]) + m1[4 * i + 2] * n[2]) + m1[4 * i + 3] * n[3];
+		}
+
+		outside = outside | ((c0[3] + ((Abs(c0[0]) + Abs(c0[1])) + Abs(c0[2])) < zero) &
+			(c1[3] + ((Abs(c1[0]) + Abs(c1[1])) + Abs(c1[2])) < zero));
+	}
+
+	// Max vertex motion in pixels, in front of the camera plane
+	const auto minW0 = m0[15] - ((Abs(m0[3]) + Abs(m0[7])) + Abs(m0[11]));
+	const auto minW1 = m1[15] - ((Abs(m1[3]) + Abs(m1[7])) + Abs(m1[11]));
+	Lanes d[4];
+	for (auto c = 0u; c < 4; ++c)
+		d[c] = ((Abs(m1[c] - m0[c]) + Abs(m1[4 + c] - m0[4 + c])) + Abs(m1[8 + c] - m0[8 + c])) + Abs(m1[12 + c] - m0[12 + c]);
+
+	const Lanes scales[] = { Splat(frame.Viewport[0]), Splat(frame.Viewport[1]), Splat((max)(frame.Viewport[0], frame.Viewport[1])) };
+	auto change = zero;
+	for (auto c = 0u; c < 3; ++c)
+	{
+		const auto ndc = (((Abs(m0[c]) + Abs(m0[4 + c])) + Abs(m0[8 + c])) + Abs(m0[12 + c])) / minW0;
+		change = Max((d[c] + ndc * d[3]) / minW1 * Splat(0.5f) * scales[c], change);
+	}
+
+	const auto moved = (minW0 > zero) & (minW1 > zero) & (change < Splat(frame.ReuseThreshold));
+
+	// The sample scales must not have changed
+	const auto sampleScale0 = Load(&m_cullSampleScales[first]), sampleScale1 = Load(&m_sampleScales[first]);
+	const auto reusable = (outside | moved) & (sampleScale0 <= sampleScale1) & (sampleScale0 >= sampleScale1);
+
+	const auto numLanes = (min)(m_numVolumes - first, g_numLanes);
+	const auto validLanes = (1u << numLanes) - 1;
+
+	return (GetBits(reusable) & validLanes) == validLanes;
+#endif
+}
+
+void VolumeCuller::cullBatch(const FrameDesc& frame, uint32_t first)
+{
+#if !defined(VOLUME_CULL_AVX2) && !defined(VOLUME_CULL_SSE2) && !defined(VOLUME_CULL_NEON)
+	for (auto i = first; i < first + g_numLanes; ++i)
+	{
+		float worldViewProj[16], worldI[12];
+		for (auto k = 0u; k < 16; ++k) worldViewProj[k] = m_worldViewProjs[k * m_stride + i];
+		for (auto k = 0u; k < 12; ++k) worldI[k] = m_worldIs[k * m_stride + i];
+
+		const auto isVisible = CullVolume(frame, worldViewProj, worldI, m_descs[i], m_sampleScales[i], m_infos[i],
+			m_coverages[i], &m_cubeMapCoverages[i]);
+		m_visibility[i] = isVisible ? ((m_infos[i].FaceMask & CUBEMAP_RAYMARCH_BIT) ? 3 : 1) : 0;
+	}
+#else
+	// The same operations as CullVolume(), one instance per lane
+	Lanes m[16];
+	for (auto k = 0u; k < 16; ++k) m[k] = Load(&m_worldViewProjs[k * m_stride + first]);
+
+	const auto zero = Splat(0.0f), one = Splat(1.0f), half = Splat(0.5f);
+	const auto width = Splat(frame.Viewport[0]), height = Splat(frame.Viewport[1]);
+
+	// Padding lanes are never visible
+	const auto numLanes = (min)(m_numVolumes - first, g_numLanes);
+	const auto validLanes = (1u << numLanes) - 1;
+	for (auto lane = 0u; lane < g_numLanes; ++lane)
+	{
+		m_visibility[first + lane] = 0;
+		m_coverages[first + lane] = 0.0f;
+		m_cubeMapCoverages[first + lane] = 0.0f;
+	}
+
+	// Frustum planes (ClassifyVolume()), on top of the instances hidden by their sample scales
+	auto outside = Load(&m_sampleScales[first]) <= zero;
+	for (const auto& plane : g_clipPlanes)
+	{
+		const Lanes n[] = { Splat(plane[0]), Splat(plane[1]), Splat(plane[2]), Splat(plane[3]) };
+		Lanes c[4];
+		for (auto i = 0u; i < 4; ++i)
+			c[i] = ((m[4 * i] * n[0] + m[4 * i + 1] * n[1]) + m[4 * i + 2] * n[2]) + m[4 * i + 3] * n[3];
+
+		const auto r = (Abs(c[0]) + Abs(c[1])) + Abs(c[2]);
+		outside = outside | (c[3] + r < zero);
+	}
+
+	// Most batches are done here, before the separating axes of the frustum corners
+	if ((GetBits(outside) & validLanes) == validLanes) return;
+
+	// The frustum corners in volume space
+	Lanes worldI[12];
+	for (auto k = 0u; k < 12; ++k) worldI[k] = Load(&m_worldIs[k * m_stride + first]);
+
+	Lanes f[8][3];
+	for (auto k = 0u; k < 8; ++k)
+	{
+		const auto p = frame.FrustumCorners[k];
+		const auto px = Splat(p[0]), py = Splat(p[1]), pz = Splat(p[2]);
+		for (auto c = 0u; c < 3; ++c)
+			f[k][c] = ((px * worldI[c * 4] + py * worldI[c * 4 + 1]) + pz * worldI[c * 4 + 2]) + one * worldI[c * 4 + 3];
+	}
+
+	// Cube axes
+	for (auto c = 0u; c < 3; ++c)
+	{
+		auto lo = f[0][c], hi = f[0][c];
+		for (auto k = 1u; k < 8; ++k)
+		{
+			lo = Min(lo, f[k][c]);
+			hi = Max(hi, f[k][c]);
+		}
+
+		outside = outside | (lo > one) | (hi < zero - one);
+	}
+
+	// Cross products of the cube axes and the frustum edges
+	for (const auto& edge : g_frustumEdges)
+	{
+		Lanes d[3];
+		for (auto c = 0u; c < 3; ++c) d[c] = f[edge[1]][c] - f[edge[0]][c];
+
+		for (auto c = 0u; c < 3; ++c)
+		{
+			const auto u = (c + 1) % 3, v = (c + 2) % 3;
+			const auto au = zero - d[v], av = d[u];
+			const auto r = Abs(au) + Abs(av);
+
+			auto lo = f[0][u] * au + f[0][v] * av;
+			auto hi = lo;
+			for (auto k = 1u; k < 8; ++k)
+			{
+				const auto t = f[k][u] * au + f[k][v] * av;
+				lo = Min(lo, t);
+				hi = Max(hi, t);
+			}
+
+			outside = outside | (lo > r) | (hi < zero - r);
+		}
+	}
+
+	const auto visibleLanes = ~GetBits(outside) & validLanes;
+	if (visibleLanes == 0) return;
+
+	// Project the vertices to viewport space
+	Lanes vx[8], vy[8];
+	for (auto i = 0u; i < 8; ++i)
+	{
+		const auto px = Splat((i & 1) ? 1.0f : -1.0f);
+		const auto py = Splat(((i >> 1) & 1) ? 1.0f : -1.0f);
+		const auto pz = Splat((i >> 2) ? 1.0f : -1.0f);
+		const auto pw = one;
+
+		auto x = ((px * m[0] + py * m[4]) + pz * m[8]) + pw * m[12];
+		auto y = ((px * m[1] + py * m[5]) + pz * m[9]) + pw * m[13];
+		const auto w = ((px * m[3] + py * m[7]) + pz * m[11]) + pw * m[15];
+		x = x / w;
+		y = y / w;
+		x = x * half + half;
+		y = y * half + half;
+		y = one - y;
+		vx[i] = x * width;
+		vy[i] = y * height;
+	}
+
+	// Visibility mask
+	Lanes localEyePt[3];
+	const auto ex = Splat(frame.EyePt[0]), ey = Splat(frame.EyePt[1]), ez = Splat(frame.EyePt[2]);
+	for (auto c = 0u; c < 3; ++c)
+		localEyePt[c] = ((ex * worldI[c * 4] + ey * worldI[c * 4 + 1]) + ez * worldI[c * 4 + 2]) + one * worldI[c * 4 + 3];
+
+	Mask faceVis[6];
+	uint32_t faceBits[6];
+	for (auto face = 0u; face < 6; ++face)
+	{
+		const auto viewComp = localEyePt[face >> 1];
+		faceVis[face] = (face & 1) ? viewComp > Splat(-1.0f) : viewComp < one;
+		faceBits[face] = GetBits(faceVis[face]);
+	}
+
+	// Edges and the max edge length
+	Lanes edgeX[12], edgeY[12];
+	auto maxLength = zero;
+	for (auto i = 0u; i < 12; ++i)
+	{
+		edgeX[i] = vx[g_edgeVerts[i][1]] - vx[g_edgeVerts[i][0]];
+		edgeY[i] = vy[g_edgeVerts[i][1]] - vy[g_edgeVerts[i][0]];
+		maxLength = Max(Sqrt(edgeX[i] * edgeX[i] + edgeY[i] * edgeY[i]), maxLength);
+	}
+
+	const auto s = maxLength / Splat(g_upscale);
+	auto raySampleAmt = Splat(g_raySampleCountScale) * s / Splat(g_sqrt3);
+
+	// Projected pixels of each face, and of the volume over the visible faces
+	auto coverage = zero;
+	float faceCoverages[6][g_numLanes];
+	for (auto face = 0u; face < 6; ++face)
+	{
+		const auto& edges = g_faceEdges[face ^ 1];
+		const auto e0 = edges[0], e1 = edges[1], e2 = edges[2], e3 = edges[3];
+		const auto faceArea = half * Abs(edgeX[e0] * edgeY[e1] - edgeY[e0] * edgeX[e1]) +
+			half * Abs(edgeX[e2] * edgeY[e3] - edgeY[e2] * edgeX[e3]);
+		coverage = coverage + Select(faceVis[face], faceArea, zero);
+		Store(faceCoverages[face], faceArea);
+	}
+
+	// Behind the camera plane, take the most detailed level and the whole viewport
+	const auto nearClipped = m[15] - ((Abs(m[3]) + Abs(m[7])) + Abs(m[11])) <= zero;
+	raySampleAmt = Select(nearClipped, Splat(FLT_MAX), raySampleAmt);
+	coverage = Select(nearClipped, Splat(frame.Viewport[0] * frame.Viewport[1]), coverage);
+
+	float raySampleAmts[g_numLanes], coverages[g_numLanes];
+	Store(raySampleAmts, raySampleAmt);
+	Store(coverages, coverage);
+	const auto nearClippedLanes = GetBits(nearClipped);
+
+	for (auto lane = 0u; lane < g_numLanes; ++lane)
+	{
+		if (!((visibleLanes >> lane) & 1)) continue;
+
+		const auto i = first + lane;
+		auto faceMask = 0u;
+		for (auto face = 0u; face < 6; ++face) faceMask |= ((faceBits[face] >> lane) & 1) << face;
+
+		float laneFaceCoverages[6];
+		for (auto face = 0u; face < 6; ++face) laneFaceCoverages[face] = faceCoverages[face][lane];
+		const auto isNearClipped = (nearClippedLanes >> lane) & 1;
+
+		finishVolume(frame, m_descs[i], m_sampleScales[i], faceMask, raySampleAmts[lane], coverages[lane],
+			isNearClipped ? nullptr : laneFaceCoverages, m_infos[i], m_cubeMapCoverages[i]);
+		m_coverages[i] = coverages[lane];
+		m_visibility[i] = (m_infos[i].FaceMask & CUBEMAP_RAYMARCH_BIT) ? 3 : 1;
+	}
+#endif
+}
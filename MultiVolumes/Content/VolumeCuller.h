@@ -0,0 +1,171 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "CostModel.h"
+
+// Source of an instance, as the culling reads it (VolumeDesc of Common.hlsli)
+struct VolumeDesc
+{
+	uint32_t VolTexId : 14;
+	uint32_t NumMips : 4;
+	uint32_t CubeMapSize : 14;
+};
+
+// Culling result of a visible instance, as stored in the R16G16B16A16_UINT volume buffer
+// (VolumeInfo of Common.hlsli)
+struct VolumeInfo
+{
+	uint16_t MipLevel;
+	uint16_t SmpCount;
+	uint16_t FaceMask;	// Highest bit: any face in cube-map space; bits 8-13: per-face cube-map ray marching;
+						// lowest 6 bits: face visibility; faces go +X, -X, +Y, -Y, +Z, -Z
+	uint16_t VolTexId;
+};
+
+//--------------------------------------------------------------------------------------
+// CPU version of the VolumeCull stage (CSVolumeCull.hlsl and VolumeCull.hlsli): frustum
+// culling, face masks, cube-map LOD, ray sample count and projected coverage per instance.
+// The instances are kept in SoA form and culled a batch at a time: 8 with AVX2, 4 with SSE2
+// or NEON, whichever the build targets. Every batch kernel rounds as CullVolume() does, which
+// follows the shader operation by operation, so both give the same records bit for bit.
+// The GPU may still differ where its approximate log2 crosses a mip boundary. With a reuse
+// threshold, a batch keeps the results of its last culling while no vertex of its instances
+// can have moved that many pixels since. It has no graphics API dependency.
+//--------------------------------------------------------------------------------------
+class VolumeCuller
+{
+public:
+	struct FrameDesc
+	{
+		float EyePt[3];
+		float Viewport[2];
+		uint32_t NumSamples;	// Max ray samples, before the sample scales of the instances
+		float FrustumCorners[8][3];	// World space, from GetFrustumCorners()
+		float ReuseThreshold;		// Pixels of vertex motion below which results are reused; 0 culls all
+		CostModel::Weights PathCosts;	// Picks the cube-map or the direct path of each volume
+	};
+
+	// Indirect argument of the cube-map ray marching of one mip bin (CSRayMarch.hlsl): the
+	// root constant of the bin, then the thread groups of a face at its mip by the work items
+	// of the cube-map faces; the command signature skips the trailing volume count
+	struct CubeMapDispatchArg
+	{
+		uint32_t MipLevel;
+		uint32_t ThreadGroupCountX;
+		uint32_t ThreadGroupCountY;
+		uint32_t ThreadGroupCountZ;	// Cube-map faces in the bin, counted by the culling
+		uint32_t NumVolumes;		// Cube-map volumes in the bin
+	};
+
+	// 8x8 tiles of threads of the cube-map ray marching, a thread group of the face dispatch
+	// each, and those of them with no thread on a cube-map face at its mip, against one
+	// dispatch of 6 full-size faces for every cube-map volume
+	struct CubeMapGroupCounts
+	{
+		uint64_t Launched;
+		uint64_t Wasted;
+		uint64_t UnbinnedLaunched;
+		uint64_t UnbinnedWasted;
+	};
+
+	enum Classification : uint8_t
+	{
+		FRUSTUM_OUTSIDE,
+		FRUSTUM_INTERSECTING,
+		FRUSTUM_INSIDE
+	};
+
+	VolumeCuller();
+	virtual ~VolumeCuller();
+
+	void Resize(uint32_t numVolumes);
+
+	// worldViewProj is row-major for row vectors, as XMFLOAT4X4; worldI is stored as
+	// XMFLOAT3X4, i.e. row c holds column c of the inverse world matrix; a sample scale of 0
+	// hides the instance
+	void SetVolume(uint32_t i, const float worldViewProj[16], const float worldI[12], float sampleScale);
+	void SetVolumeDesc(uint32_t i, const VolumeDesc& desc);
+
+	void Cull(const FrameDesc& frame, uint32_t numThreads = 1);
+
+	// Only culls the batches holding a candidate, e.g. from VolumeBVH::QueryFrustum(); any
+	// volume in view must be a candidate for the same results
+	void Cull(const FrameDesc& frame, const uint32_t* pCandidates, uint32_t numCandidates, uint32_t numThreads = 1);
+
+	uint32_t GetNumVolumes() const;
+	const VolumeDesc* GetVolumeDescs() const;
+	const VolumeInfo* GetVolumeInfos() const;	// Valid for the visible instances
+	const float* GetCoverages() const;			// Projected pixels, 0 when culled
+	const float* GetCubeMapCoverages() const;	// Of the faces ray marched in cube-map space
+	const std::vector<uint32_t>& GetVisibleVolumes() const;	// In instance order
+	const std::vector<uint32_t>& GetCubeMapVolumes() const;
+	uint32_t GetNumReused() const;		// Instances whose results the last Cull() kept
+	uint32_t GetNumRecomputed() const;	// Instances the last Cull() culled anew
+	bool IsReused(uint32_t i) const;
+
+	// The work items of the cube-map faces binned by mip level as the culling shader writes
+	// them, volume << 3 | face each: bin b holds its items from 6 * b * GetNumVolumes(), in
+	// instance and face order here, in any order of the volumes on the GPU
+	void GetCubeMapDispatchArgs(uint32_t gridSize, uint32_t numBins, CubeMapDispatchArg* pArgs,
+		std::vector<uint32_t>* pBinnedFaces = nullptr) const;
+
+	// Scalar reference of the shader for one instance; false when it is culled. Each visible
+	// face takes the cheaper path by its own projected pixels, and the cube-map coverage sums
+	// those of the faces ray marched in cube-map space
+	static bool CullVolume(const FrameDesc& frame, const float worldViewProj[16], const float worldI[12],
+		const VolumeDesc& desc, float sampleScale, VolumeInfo& info, float& coverage,
+		float* pCubeMapCoverage = nullptr);
+
+	// Exact frustum-cube classification on the separating axes: the 6 frustum planes, the 3
+	// cube axes and the 18 cross products of their edges (IsSeparatedFromFrustum() of the shader)
+	static Classification ClassifyVolume(const float frustumCorners[8][3], const float worldViewProj[16],
+		const float worldI[12]);
+
+	// Corner i is at NDC x = i & 1 ? 1 : -1, y = (i >> 1) & 1 ? 1 : -1, z = i >> 2; viewProj is
+	// row-major for row vectors, as XMFLOAT4X4 with D3D depth
+	static void GetFrustumCorners(const float viewProj[16], float frustumCorners[8][3]);
+
+	// True when the cube crosses the camera plane, where its projected edges are meaningless
+	static bool IsNearClipped(const float worldViewProj[16]);
+	static uint32_t GetBatchSize();
+	static const char* GetInstructionSet();
+
+	// The args of empty bins, which the culling counts into each frame
+	static void ResetCubeMapDispatchArgs(uint32_t gridSize, uint32_t numBins, CubeMapDispatchArg* pArgs);
+	static CubeMapGroupCounts CountCubeMapGroups(uint32_t gridSize, uint32_t numBins, const CubeMapDispatchArg* pArgs);
+
+protected:
+	void cullBatches(const FrameDesc& frame, const uint8_t* pBatchMask, uint32_t numThreads);
+	void cullBatch(const FrameDesc& frame, uint32_t first);
+	bool isBatchReusable(const FrameDesc& frame, uint32_t first) const;
+
+	uint32_t m_numVolumes;
+	uint32_t m_stride;	// Padded to whole batches
+	std::vector<float> m_worldViewProjs;	// Element k of instance i at [k * m_stride + i]
+	std::vector<float> m_worldIs;
+	std::vector<float> m_sampleScales;
+	std::vector<VolumeDesc> m_descs;
+
+	std::vector<VolumeInfo> m_infos;
+	std::vector<float> m_coverages;
+	std::vector<float> m_cubeMapCoverages;
+	std::vector<uint8_t> m_visibility;	// 1 for visible, plus 2 for any face in cube-map space
+	std::vector<uint32_t> m_visibleVolumes;
+	std::vector<uint32_t> m_cubeMapVolumes;
+	std::vector<uint8_t> m_batchMask;
+
+	// Temporal reuse: the inputs each batch was last culled with
+	std::vector<float> m_cullWorldViewProjs;
+	std::vector<float> m_cullSampleScales;
+	std::vector<uint8_t> m_batchStates;
+	float m_cullViewport[2];
+	uint32_t m_cullNumSamples;
+	CostModel::Weights m_cullPathCosts;
+	uint32_t m_numReused;
+	uint32_t m_numRecomputed;
+};
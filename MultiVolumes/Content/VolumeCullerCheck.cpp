@@ -0,0 +1,1140 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "CostModel.h"
+#include "SharedConsts.h"
+#include "VolumeCuller.h"
+#include "ToolCheck.h"
+
+using namespace std;
+
+// Culls random volumes from several views with the batch kernels and with the scalar
+// reference of the shader, which must agree bit for bit, and times both
+int CullCheck(int argc, char* argv[])
+{
+	auto numVolumes = 100000u;
+	auto numViews = 8u;
+	auto numThreads = 1u;
+	auto seed = 1u;
+	ToolArgs args;
+	args.Add("-volumes", numVolumes, 1);
+	args.Add("-views", numViews, 1);
+	args.Add("-threads", numThreads);
+	args.Add("-seed", seed);
+	if (!args.Parse(argc, argv)) return EXIT_FAILURE;
+
+	// Volumes scattered over a field around the cameras, some of them close enough to clip
+	vector<Matrix4> worlds;
+	vector<float> worldIs, sampleScales;
+	const auto extent = ScatterVolumes(numVolumes, seed, worlds, worldIs, sampleScales);
+	vector<VolumeDesc> descs(numVolumes);
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		descs[i].VolTexId = i % 1024;
+		descs[i].NumMips = NUM_CUBE_MIP;
+		descs[i].CubeMapSize = 128;
+	}
+
+	VolumeCuller culler;
+	culler.Resize(numVolumes);
+	for (auto i = 0u; i < numVolumes; ++i) culler.SetVolumeDesc(i, descs[i]);
+
+	VolumeCuller::FrameDesc frame = {};
+	frame.PathCosts = CostModel::GetDefaultWeights();
+	frame.Viewport[0] = 1920.0f;
+	frame.Viewport[1] = 1080.0f;
+	frame.NumSamples = 256;
+
+	printf("%u volumes, %u views, %s batches of %u, %u threads\n", numVolumes, numViews,
+		VolumeCuller::GetInstructionSet(), VolumeCuller::GetBatchSize(), numThreads);
+
+	vector<float> worldViewProjs(16 * numVolumes);
+	auto batchSeconds = 0.0, refSeconds = 0.0;
+	uint64_t numVisible = 0, numCubeMap = 0, numMismatches = 0;
+	for (auto v = 0u; v < numViews; ++v)
+	{
+		const auto angle = 6.2831853f * v / numViews;
+		const float eye[] = { cosf(angle) * extent * 0.25f, 10.0f, sinf(angle) * extent * 0.25f };
+		const float at[] = { 0.0f, 0.0f, 0.0f };
+		const auto viewProj = GetViewProj(eye, at, 3.14159265f / 4.0f, frame.Viewport[0] / frame.Viewport[1], g_zNear, g_zFar);
+		copy(eye, eye + 3, frame.EyePt);
+		VolumeCuller::GetFrustumCorners(viewProj.m[0], frame.FrustumCorners);
+
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			const auto worldViewProj = Multiply(worlds[i], viewProj);
+			memcpy(&worldViewProjs[16 * i], worldViewProj.m, sizeof(worldViewProj.m));
+			culler.SetVolume(i, worldViewProj.m[0], &worldIs[12 * i], sampleScales[i]);
+		}
+
+		auto start = chrono::steady_clock::now();
+		culler.Cull(frame, numThreads);
+		batchSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		vector<VolumeInfo> infos(numVolumes);
+		vector<float> coverages(numVolumes), cubeMapCoverages(numVolumes);
+		vector<uint8_t> visibility(numVolumes);
+		start = chrono::steady_clock::now();
+		for (auto i = 0u; i < numVolumes; ++i)
+			visibility[i] = VolumeCuller::CullVolume(frame, &worldViewProjs[16 * i], &worldIs[12 * i],
+				descs[i], sampleScales[i], infos[i], coverages[i], &cubeMapCoverages[i]);
+		refSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		// Records of visible volumes, and the coverage bits of all
+		auto visible = culler.GetVisibleVolumes().cbegin();
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			const auto isVisible = visible != culler.GetVisibleVolumes().cend() && *visible == i;
+			if (isVisible) ++visible;
+
+			auto isSame = isVisible == (visibility[i] != 0) &&
+				memcmp(&coverages[i], &culler.GetCoverages()[i], sizeof(float)) == 0;
+			if (isVisible) isSame = isSame && memcmp(&infos[i], &culler.GetVolumeInfos()[i], sizeof(VolumeInfo)) == 0 &&
+				memcmp(&cubeMapCoverages[i], &culler.GetCubeMapCoverages()[i], sizeof(float)) == 0;
+			if (!isSame) ++numMismatches;
+		}
+
+		numVisible += culler.GetVisibleVolumes().size();
+		numCubeMap += culler.GetCubeMapVolumes().size();
+	}
+
+	const auto numCulled = static_cast<double>(numVolumes) * numViews;
+	printf("Visible: %.1f%%, cube-map ray marching: %.1f%% of visible\n", 100.0 * numVisible / numCulled,
+		numVisible ? 100.0 * numCubeMap / numVisible : 0.0);
+	printf("Batch: %.3f ms per view, %.1f Mvolumes/s\n", batchSeconds * 1000.0 / numViews, numCulled / batchSeconds * 1.0e-6);
+	printf("Reference: %.3f ms per view, %.1f Mvolumes/s, speedup %.2fx\n", refSeconds * 1000.0 / numViews,
+		numCulled / refSeconds * 1.0e-6, refSeconds / batchSeconds);
+
+	CheckReport report;
+	report.ExpectNone("Mismatches", numMismatches);
+
+	return report.Finish();
+}
+
+struct Point3d
+{
+	double x[3];
+};
+
+// Sutherland-Hodgman clipping of a convex polygon by the half-space dot(plane, (p, 1)) >= 0
+static void clipPolygon(vector<Point3d>& polygon, const double plane[4])
+{
+	const auto distance = [plane](const Point3d& p)
+	{
+		return plane[0] * p.x[0] + plane[1] * p.x[1] + plane[2] * p.x[2] + plane[3];
+	};
+
+	vector<Point3d> clipped;
+	for (size_t i = 0; i < polygon.size(); ++i)
+	{
+		const auto& a = polygon[i];
+		const auto& b = polygon[(i + 1) % polygon.size()];
+		const auto da = distance(a), db = distance(b);
+		if (da >= 0.0) clipped.emplace_back(a);
+		if ((da >= 0.0) != (db >= 0.0))
+		{
+			const auto t = da / (da - db);
+			Point3d p;
+			for (auto c = 0u; c < 3; ++c) p.x[c] = a.x[c] + (b.x[c] - a.x[c]) * t;
+			clipped.emplace_back(p);
+		}
+	}
+
+	polygon.swap(clipped);
+}
+
+// True if any face of the hexahedron keeps a part inside all 6 planes; corner i is at
+// x = i & 1, y = (i >> 1) & 1, z = i >> 2, as the cube vertices and the frustum corners
+static bool isAnyFaceInside(const Point3d corners[8], const double planes[6][4])
+{
+	static const uint8_t faces[6][4] =
+	{
+		{ 0, 2, 6, 4 }, { 1, 5, 7, 3 },
+		{ 0, 4, 5, 1 }, { 2, 3, 7, 6 },
+		{ 0, 1, 3, 2 }, { 4, 6, 7, 5 }
+	};
+
+	for (const auto& face : faces)
+	{
+		vector<Point3d> polygon = { corners[face[0]], corners[face[1]], corners[face[2]], corners[face[3]] };
+		for (auto i = 0u; i < 6 && !polygon.empty(); ++i) clipPolygon(polygon, planes[i]);
+		if (!polygon.empty()) return true;
+	}
+
+	return false;
+}
+
+// World-space frustum corners of the camera of GetViewProj(), in double precision
+static void getFrustumCorners(const float eye[3], const float at[3], float fovY, float aspect, Point3d corners[8])
+{
+	const auto normalize = [](double v[3])
+	{
+		const auto len = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		for (auto i = 0u; i < 3; ++i) v[i] /= len;
+	};
+
+	double z[3] = { at[0] - eye[0], at[1] - eye[1], at[2] - eye[2] };
+	normalize(z);
+	double x[3] = { z[2], 0.0, -z[0] };
+	normalize(x);
+	const double y[3] = { z[1] * x[2] - z[2] * x[1], z[2] * x[0] - z[0] * x[2], z[0] * x[1] - z[1] * x[0] };
+
+	const auto tanY = tan(fovY * 0.5), tanX = tanY * aspect;
+	for (auto i = 0u; i < 8; ++i)
+	{
+		const auto sx = (i & 1) ? tanX : -tanX;
+		const auto sy = ((i >> 1) & 1) ? tanY : -tanY;
+		const double d = (i >> 2) ? g_zFar : g_zNear;
+		for (auto c = 0u; c < 3; ++c) corners[i].x[c] = eye[c] + (z[c] + x[c] * sx + y[c] * sy) * d;
+	}
+}
+
+// Ground truth by clipping, in double precision, of the volume cube scaled by 1 + delta:
+// the solids intersect iff a face of either keeps a part inside the planes of the other
+static VolumeCuller::Classification classifyByClipping(const Matrix4& world, const Matrix4& viewProj,
+	const Point3d frustumCorners[8], double delta)
+{
+	// Frustum planes, as VolumeBVH::GetFrustumPlanes()
+	double frustumPlanes[6][4];
+	for (auto i = 0u; i < 4; ++i)
+	{
+		const double x = viewProj.m[i][0], y = viewProj.m[i][1], z = viewProj.m[i][2], w = viewProj.m[i][3];
+		frustumPlanes[0][i] = w + x;
+		frustumPlanes[1][i] = w - x;
+		frustumPlanes[2][i] = w + y;
+		frustumPlanes[3][i] = w - y;
+		frustumPlanes[4][i] = z;
+		frustumPlanes[5][i] = w - z;
+	}
+
+	// Cube corners
+	const auto s = 1.0 + delta;
+	Point3d cubeCorners[8];
+	auto isInside = true;
+	for (auto i = 0u; i < 8; ++i)
+	{
+		const double l[] = { (i & 1) ? s : -s, ((i >> 1) & 1) ? s : -s, (i >> 2) ? s : -s };
+		auto& p = cubeCorners[i];
+		for (auto c = 0u; c < 3; ++c) p.x[c] = l[0] * world.m[0][c] + l[1] * world.m[1][c] + l[2] * world.m[2][c] + world.m[3][c];
+
+		for (const auto& plane : frustumPlanes)
+			isInside = isInside && plane[0] * p.x[0] + plane[1] * p.x[1] + plane[2] * p.x[2] + plane[3] >= 0.0;
+	}
+
+	if (isInside) return VolumeCuller::FRUSTUM_INSIDE;
+
+	// Cube planes s -+ l_c >= 0, with l = (p - t) * A^-1
+	const auto a = [&world](uint8_t r, uint8_t c) { return static_cast<double>(world.m[r][c]); };
+	double inv[3][3] =
+	{
+		{ a(1, 1) * a(2, 2) - a(1, 2) * a(2, 1), a(0, 2) * a(2, 1) - a(0, 1) * a(2, 2), a(0, 1) * a(1, 2) - a(0, 2) * a(1, 1) },
+		{ a(1, 2) * a(2, 0) - a(1, 0) * a(2, 2), a(0, 0) * a(2, 2) - a(0, 2) * a(2, 0), a(0, 2) * a(1, 0) - a(0, 0) * a(1, 2) },
+		{ a(1, 0) * a(2, 1) - a(1, 1) * a(2, 0), a(0, 1) * a(2, 0) - a(0, 0) * a(2, 1), a(0, 0) * a(1, 1) - a(0, 1) * a(1, 0) }
+	};
+
+	const auto det = a(0, 0) * inv[0][0] + a(0, 1) * inv[1][0] + a(0, 2) * inv[2][0];
+	double cubePlanes[6][4];
+	for (auto c = 0u; c < 3; ++c)
+	{
+		auto offset = 0.0;
+		for (auto j = 0u; j < 3; ++j)
+		{
+			inv[j][c] /= det;
+			cubePlanes[2 * c][j] = inv[j][c];
+			cubePlanes[2 * c + 1][j] = -inv[j][c];
+			offset += a(3, j) * inv[j][c];
+		}
+
+		cubePlanes[2 * c][3] = s - offset;
+		cubePlanes[2 * c + 1][3] = s + offset;
+	}
+
+	return isAnyFaceInside(cubeCorners, frustumPlanes) || isAnyFaceInside(frustumCorners, cubePlanes) ?
+		VolumeCuller::FRUSTUM_INTERSECTING : VolumeCuller::FRUSTUM_OUTSIDE;
+}
+
+// The former test of the shader: visible once a vertex lands in the viewport with 0 < z < 1
+static bool isAnyVertexInView(const float worldViewProj[16], const float viewport[2])
+{
+	const auto m = worldViewProj;
+	for (auto i = 0u; i < 8; ++i)
+	{
+		const auto px = (i & 1) ? 1.0f : -1.0f;
+		const auto py = ((i >> 1) & 1) ? 1.0f : -1.0f;
+		const auto pz = (i >> 2) ? 1.0f : -1.0f;
+
+		const auto w = px * m[3] + py * m[7] + pz * m[11] + m[15];
+		const auto x = ((px * m[0] + py * m[4] + pz * m[8] + m[12]) / w * 0.5f + 0.5f) * viewport[0];
+		const auto y = (0.5f - (px * m[1] + py * m[5] + pz * m[9] + m[13]) / w * 0.5f) * viewport[1];
+		const auto z = (px * m[2] + py * m[6] + pz * m[10] + m[14]) / w;
+		if (x >= 0.0f && x <= viewport[0] && y >= 0.0f && y <= viewport[1] && z > 0.0f && z < 1.0f) return true;
+	}
+
+	return false;
+}
+
+static bool isEyeInside(const float eye[3], const float worldI[12])
+{
+	auto isInside = true;
+	for (auto c = 0u; c < 3; ++c)
+	{
+		const auto l = eye[0] * worldI[4 * c] + eye[1] * worldI[4 * c + 1] + eye[2] * worldI[4 * c + 2] + worldI[4 * c + 3];
+		isInside = isInside && fabsf(l) < 1.0f;
+	}
+
+	return isInside;
+}
+
+// Checks the separating-axis classification of VolumeCuller against exact clipping, on
+// edge configurations and on random volumes around random cameras, together with the fast
+// paths of visible volumes: no cube map with the eye inside, and all the samples once
+// near-clipped. Volumes within 0.1% of touching the frustum are ambiguous and skipped
+int FrustumCheck(int argc, char* argv[])
+{
+	auto numVolumes = 100000u;
+	auto numViews = 16u;
+	auto seed = 1u;
+	ToolArgs args;
+	args.Add("-volumes", numVolumes, 1);
+	args.Add("-views", numViews, 1);
+	args.Add("-seed", seed);
+	if (!args.Parse(argc, argv)) return EXIT_FAILURE;
+
+	static const char* classNames[] = { "outside", "intersecting", "inside" };
+	static const double delta = 1.0e-3;
+
+	VolumeCuller::FrameDesc frame = {};
+	frame.PathCosts = CostModel::GetDefaultWeights();
+	frame.Viewport[0] = 1920.0f;
+	frame.Viewport[1] = 1080.0f;
+	frame.NumSamples = 256;
+	const auto fovY = 3.14159265f / 4.0f;
+	const auto aspect = frame.Viewport[0] / frame.Viewport[1];
+
+	VolumeDesc desc;
+	desc.VolTexId = 0;
+	desc.NumMips = NUM_CUBE_MIP;
+	desc.CubeMapSize = 128;
+
+	// Checks one volume against the ground truth and the fast paths; false on a mismatch
+	uint64_t numAmbiguous = 0;
+	const auto checkVolume = [&](const Matrix4& world, const Matrix4& viewProj, const Point3d frustumCorners[8],
+		const float worldI[12], VolumeCuller::Classification& classification)
+	{
+		const auto worldViewProj = Multiply(world, viewProj);
+		classification = VolumeCuller::ClassifyVolume(frame.FrustumCorners, worldViewProj.m[0], worldI);
+
+		auto isSame = true;
+		const auto expected = classifyByClipping(world, viewProj, frustumCorners, -delta);
+		if (expected == classifyByClipping(world, viewProj, frustumCorners, delta)) isSame = classification == expected;
+		else ++numAmbiguous;
+
+		VolumeInfo info;
+		float coverage;
+		const auto isVisible = VolumeCuller::CullVolume(frame, worldViewProj.m[0], worldI, desc, 1.0f, info, coverage);
+		isSame = isSame && isVisible == (classification != VolumeCuller::FRUSTUM_OUTSIDE);
+		if (isVisible && isEyeInside(frame.EyePt, worldI))
+			isSame = isSame && info.FaceMask == 0x3f;
+		if (isVisible && VolumeCuller::IsNearClipped(worldViewProj.m[0]))
+			isSame = isSame && info.SmpCount == frame.NumSamples && coverage == frame.Viewport[0] * frame.Viewport[1];
+
+		return isSame;
+	};
+
+	// Edge configurations, from a camera at the origin looking down +z
+	struct EdgeCase
+	{
+		const char* Name;
+		float Size;
+		float Pos[3];
+		float Rotation[4];
+		VolumeCuller::Classification Expected;
+	};
+
+	const auto s = sinf(3.14159265f / 8.0f), c = cosf(3.14159265f / 8.0f);
+	const EdgeCase edgeCases[] =
+	{
+		{ "eye inside", 10.0f, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, VolumeCuller::FRUSTUM_INTERSECTING },
+		{ "frustum inside", 4000.0f, { 0.0f, 0.0f, 500.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, VolumeCuller::FRUSTUM_INTERSECTING },
+		{ "screen covered", 100.0f, { 0.0f, 0.0f, 60.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, VolumeCuller::FRUSTUM_INTERSECTING },
+		{ "across the near plane", 4.0f, { 3.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, VolumeCuller::FRUSTUM_INTERSECTING },
+		{ "behind the eye", 10.0f, { 0.0f, 0.0f, -20.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, VolumeCuller::FRUSTUM_OUTSIDE },
+		{ "beyond the far plane", 10.0f, { 0.0f, 0.0f, 1010.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, VolumeCuller::FRUSTUM_OUTSIDE },
+		{ "off a frustum edge", 20.0f, { 90.0f, 54.5f, 100.0f }, { 0.0f, 0.0f, s, c }, VolumeCuller::FRUSTUM_OUTSIDE },
+		{ "fully inside", 10.0f, { 0.0f, 0.0f, 100.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, VolumeCuller::FRUSTUM_INSIDE }
+	};
+
+	const float eye[] = { 0.0f, 0.0f, 0.0f };
+	const float at[] = { 0.0f, 0.0f, 1.0f };
+	auto viewProj = GetViewProj(eye, at, fovY, aspect, g_zNear, g_zFar);
+	Point3d frustumCorners[8];
+	getFrustumCorners(eye, at, fovY, aspect, frustumCorners);
+	VolumeCuller::GetFrustumCorners(viewProj.m[0], frame.FrustumCorners);
+	copy(eye, eye + 3, frame.EyePt);
+
+	// The batch kernels must agree on the edge configurations too
+	const auto numEdgeCases = static_cast<uint32_t>(sizeof(edgeCases) / sizeof(edgeCases[0]));
+	VolumeCuller culler;
+	culler.Resize(numEdgeCases);
+	vector<uint32_t> visibleVolumes;
+
+	uint64_t numMismatches = 0;
+	printf("Edge configurations:\n");
+	for (auto i = 0u; i < numEdgeCases; ++i)
+	{
+		const auto& edgeCase = edgeCases[i];
+		float worldI[12];
+		const auto world = GetVolumeWorld(edgeCase.Size, edgeCase.Pos, edgeCase.Rotation, worldI);
+		VolumeCuller::Classification classification;
+		const auto isSame = checkVolume(world, viewProj, frustumCorners, worldI, classification) &&
+			classification == edgeCase.Expected;
+		if (!isSame) ++numMismatches;
+
+		const auto worldViewProj = Multiply(world, viewProj);
+		culler.SetVolume(i, worldViewProj.m[0], worldI, 1.0f);
+		culler.SetVolumeDesc(i, desc);
+		if (classification != VolumeCuller::FRUSTUM_OUTSIDE) visibleVolumes.emplace_back(i);
+
+		printf("  %-22s %-12s vertex test %s%s\n", edgeCase.Name, classNames[classification],
+			isAnyVertexInView(worldViewProj.m[0], frame.Viewport) ? "visible" : "culled",
+			isSame ? "" : ", MISMATCH");
+	}
+
+	culler.Cull(frame);
+	if (culler.GetVisibleVolumes() != visibleVolumes) ++numMismatches;
+
+	// Random volumes of all sizes around random cameras, mostly toward the view direction
+	auto state = seed;
+	const auto random = [&state]()
+	{
+		state = state * 1664525u + 1013904223u;
+
+		return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+	};
+
+	uint64_t numClasses[3] = {}, numVertexCulled = 0;
+	const auto numVolumesPerView = (numVolumes + numViews - 1) / numViews;
+	for (auto v = 0u; v < numViews; ++v)
+	{
+		float viewEye[3], viewAt[3];
+		for (auto i = 0u; i < 3; ++i)
+		{
+			viewEye[i] = (random() - 0.5f) * 200.0f;
+			viewAt[i] = viewEye[i] + random() - 0.5f;
+		}
+
+		viewProj = GetViewProj(viewEye, viewAt, fovY, aspect, g_zNear, g_zFar);
+		getFrustumCorners(viewEye, viewAt, fovY, aspect, frustumCorners);
+		VolumeCuller::GetFrustumCorners(viewProj.m[0], frame.FrustumCorners);
+		copy(viewEye, viewEye + 3, frame.EyePt);
+
+		for (auto n = 0u; n < numVolumesPerView && v * numVolumesPerView + n < numVolumes; ++n)
+		{
+			// A point of the far plane, up to half the frustum beyond its sides, or any direction
+			const auto u = (random() - 0.5f) * 1.5f, w = (random() - 0.5f) * 1.5f;
+			float dir[3];
+			for (auto i = 0u; i < 3; ++i)
+			{
+				if (n & 3) dir[i] = static_cast<float>((frustumCorners[4].x[i] + frustumCorners[7].x[i]) * 0.5 - viewEye[i] +
+					(frustumCorners[5].x[i] - frustumCorners[4].x[i]) * u + (frustumCorners[6].x[i] - frustumCorners[4].x[i]) * w);
+				else dir[i] = random() - 0.5f;
+			}
+
+			const auto len = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+			const auto dist = random() * random() * 1.2f * g_zFar;
+			const float pos[] = { viewEye[0] + dir[0] / len * dist, viewEye[1] + dir[1] / len * dist, viewEye[2] + dir[2] / len * dist };
+
+			float rotation[] = { random() - 0.5f, random() - 0.5f, random() - 0.5f, random() - 0.5f };
+			const auto qLen = sqrtf(rotation[0] * rotation[0] + rotation[1] * rotation[1] +
+				rotation[2] * rotation[2] + rotation[3] * rotation[3]);
+			for (auto& q : rotation) q /= qLen;
+
+			const auto r = random();
+			float worldI[12];
+			const auto world = GetVolumeWorld(0.5f + r * r * r * r * 2000.0f, pos, rotation, worldI);
+			VolumeCuller::Classification classification;
+			if (!checkVolume(world, viewProj, frustumCorners, worldI, classification)) ++numMismatches;
+			++numClasses[classification];
+
+			const auto worldViewProj = Multiply(world, viewProj);
+			if (classification != VolumeCuller::FRUSTUM_OUTSIDE && !isAnyVertexInView(worldViewProj.m[0], frame.Viewport))
+				++numVertexCulled;
+		}
+	}
+
+	const auto numVisible = numClasses[VolumeCuller::FRUSTUM_INTERSECTING] + numClasses[VolumeCuller::FRUSTUM_INSIDE];
+	printf("%u volumes, %u views: %.1f%% outside, %.1f%% intersecting, %.1f%% inside, %llu ambiguous\n",
+		numVolumes, numViews, 100.0 * numClasses[0] / numVolumes, 100.0 * numClasses[1] / numVolumes,
+		100.0 * numClasses[2] / numVolumes, static_cast<unsigned long long>(numAmbiguous));
+	printf("Vertex test: culls %.1f%% of the visible volumes\n", numVisible ? 100.0 * numVertexCulled / numVisible : 0.0);
+	CheckReport report;
+	report.ExpectNone("Mismatches", numMismatches);
+
+	return report.Finish();
+}
+
+// Max pixels any vertex of the cube moved between two world-view-projection matrices, with
+// the NDC depth counted as the wider screen axis, as VolumeCuller bounds it; FLT_MAX once a
+// vertex is behind the camera plane
+static float getVertexMotion(const float prevWorldViewProj[16], const float worldViewProj[16], const float viewport[2])
+{
+	const float scales[] = { 0.5f * viewport[0], 0.5f * viewport[1], 0.5f * (max)(viewport[0], viewport[1]) };
+	auto motion = 0.0f;
+	for (auto i = 0u; i < 8; ++i)
+	{
+		const float p[] = { (i & 1) ? 1.0f : -1.0f, ((i >> 1) & 1) ? 1.0f : -1.0f, (i >> 2) ? 1.0f : -1.0f, 1.0f };
+		float ndc[2][3];
+		for (auto n = 0u; n < 2; ++n)
+		{
+			const auto m = n ? worldViewProj : prevWorldViewProj;
+			const auto w = p[0] * m[3] + p[1] * m[7] + p[2] * m[11] + p[3] * m[15];
+			if (!(w > 0.0f)) return FLT_MAX;
+			for (auto c = 0u; c < 3; ++c) ndc[n][c] = (p[0] * m[c] + p[1] * m[4 + c] + p[2] * m[8 + c] + p[3] * m[12 + c]) / w;
+		}
+
+		for (auto c = 0u; c < 3; ++c) motion = (max)(fabsf(ndc[1][c] - ndc[0][c]) * scales[c], motion);
+	}
+
+	return motion;
+}
+
+// Culls volumes along a slow camera path, with some of them moving, and reuses the results
+// within the threshold: recomputed instances must match the scalar reference bit for bit,
+// and reused ones must keep the records of their last culling, either culled then and now
+// or with no vertex moved as far as the threshold since; reports the reused and recomputed
+// instances per frame
+int TemporalCheck(int argc, char* argv[])
+{
+	auto numVolumes = 10000u;
+	auto numFrames = 32u;
+	auto threshold = 1.0f;
+	auto movingRatio = 0.05f;
+	auto seed = 1u;
+	ToolArgs args;
+	args.Add("-volumes", numVolumes, 1);
+	args.Add("-frames", numFrames, 1);
+	args.Add("-threshold", threshold);
+	args.Add("-moving", movingRatio);
+	args.Add("-seed", seed);
+	if (!args.Parse(argc, argv)) return EXIT_FAILURE;
+
+	vector<Matrix4> worlds;
+	vector<float> worldIs, sampleScales;
+	const auto extent = ScatterVolumes(numVolumes, seed, worlds, worldIs, sampleScales);
+
+	auto state = seed ^ 0x5bd1e995u;
+	const auto random = [&state]()
+	{
+		state = state * 1664525u + 1013904223u;
+
+		return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+	};
+
+	vector<VolumeDesc> descs(numVolumes);
+	VolumeCuller culler, fullCuller;
+	culler.Resize(numVolumes);
+	fullCuller.Resize(numVolumes);
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		descs[i].VolTexId = i % 1024;
+		descs[i].NumMips = NUM_CUBE_MIP;
+		descs[i].CubeMapSize = 128;
+		culler.SetVolumeDesc(i, descs[i]);
+		fullCuller.SetVolumeDesc(i, descs[i]);
+	}
+
+	VolumeCuller::FrameDesc frame = {};
+	frame.PathCosts = CostModel::GetDefaultWeights();
+	frame.Viewport[0] = 1920.0f;
+	frame.Viewport[1] = 1080.0f;
+	frame.NumSamples = 256;
+	auto fullFrame = frame;
+	frame.ReuseThreshold = threshold;
+
+	// The records of the last culling of each instance
+	vector<float> cullWorldViewProjs(16 * numVolumes), coverages(numVolumes);
+	vector<VolumeInfo> infos(numVolumes);
+	vector<uint8_t> visibility(numVolumes);
+
+	uint64_t numMismatches = 0, numReused = 0, numRecomputed = 0;
+	auto reuseSeconds = 0.0, fullSeconds = 0.0;
+	for (auto f = 0u; f < numFrames; ++f)
+	{
+		// The camera stops every other 4 frames; some volumes drift on the others
+		const auto isStill = (f / 4) & 1;
+		const auto angle = 0.0002f * (f - (isStill ? f % 4 : 0));
+		const float eye[] = { cosf(angle) * extent * 0.25f, 10.0f, sinf(angle) * extent * 0.25f };
+		const float at[] = { 0.0f, 0.0f, 0.0f };
+		const auto viewProj = GetViewProj(eye, at, 3.14159265f / 4.0f, frame.Viewport[0] / frame.Viewport[1], g_zNear, g_zFar);
+		copy(eye, eye + 3, frame.EyePt);
+		VolumeCuller::GetFrustumCorners(viewProj.m[0], frame.FrustumCorners);
+		copy(eye, eye + 3, fullFrame.EyePt);
+		memcpy(fullFrame.FrustumCorners, frame.FrustumCorners, sizeof(frame.FrustumCorners));
+
+		for (auto i = 0u; i < numVolumes && f > 0 && !isStill; ++i)
+		{
+			if (random() >= movingRatio) continue;
+
+			float delta[3];
+			for (auto& d : delta) d = (random() - 0.5f) * 0.1f;
+			for (auto c = 0u; c < 3; ++c)
+			{
+				worlds[i].m[3][c] += delta[c];
+				worldIs[12 * i + 4 * c + 3] -= delta[0] * worldIs[12 * i + 4 * c] +
+					delta[1] * worldIs[12 * i + 4 * c + 1] + delta[2] * worldIs[12 * i + 4 * c + 2];
+			}
+		}
+
+		vector<Matrix4> worldViewProjs(numVolumes);
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			worldViewProjs[i] = Multiply(worlds[i], viewProj);
+			culler.SetVolume(i, worldViewProjs[i].m[0], &worldIs[12 * i], sampleScales[i]);
+			fullCuller.SetVolume(i, worldViewProjs[i].m[0], &worldIs[12 * i], sampleScales[i]);
+		}
+
+		auto start = chrono::steady_clock::now();
+		culler.Cull(frame);
+		reuseSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		start = chrono::steady_clock::now();
+		fullCuller.Cull(fullFrame);
+		fullSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		auto visible = culler.GetVisibleVolumes().cbegin();
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			const auto isVisible = visible != culler.GetVisibleVolumes().cend() && *visible == i;
+			if (isVisible) ++visible;
+
+			// Reused instances stay culled, or have barely moved
+			const auto pWorldViewProj = worldViewProjs[i].m[0];
+			const auto pCullWorldViewProj = &cullWorldViewProjs[16 * i];
+			VolumeInfo info;
+			float coverage;
+			const auto isRefVisible = VolumeCuller::CullVolume(frame, pWorldViewProj, &worldIs[12 * i],
+				descs[i], sampleScales[i], info, coverage);
+			if (!culler.IsReused(i))
+			{
+				memcpy(pCullWorldViewProj, pWorldViewProj, sizeof(float[16]));
+				visibility[i] = isRefVisible;
+				infos[i] = info;
+				coverages[i] = coverage;
+			}
+			else if ((visibility[i] || isRefVisible) &&
+				getVertexMotion(pCullWorldViewProj, pWorldViewProj, frame.Viewport) >= threshold)
+				++numMismatches;
+
+			auto isSame = isVisible == (visibility[i] != 0) &&
+				memcmp(&coverages[i], &culler.GetCoverages()[i], sizeof(float)) == 0;
+			if (isVisible) isSame = isSame && memcmp(&infos[i], &culler.GetVolumeInfos()[i], sizeof(VolumeInfo)) == 0;
+			if (!isSame) ++numMismatches;
+		}
+
+		printf("Frame %u: %u reused, %u recomputed (%.1f%% reused), %zu visible\n", f, culler.GetNumReused(),
+			culler.GetNumRecomputed(), 100.0 * culler.GetNumReused() / numVolumes, culler.GetVisibleVolumes().size());
+		numReused += culler.GetNumReused();
+		numRecomputed += culler.GetNumRecomputed();
+	}
+
+	printf("Reused: %.1f%% of the instances, %s batches of %u\n", 100.0 * numReused / (numReused + numRecomputed),
+		VolumeCuller::GetInstructionSet(), VolumeCuller::GetBatchSize());
+	printf("Reuse: %.3f ms per frame, full culling: %.3f ms per frame\n", reuseSeconds * 1000.0 / numFrames,
+		fullSeconds * 1000.0 / numFrames);
+	CheckReport report;
+	report.ExpectNone("Mismatches", numMismatches);
+
+	return report.Finish();
+}
+
+// Projects the corners of a volume cube to viewport pixels in double
+static void projectCorners(const Matrix4& worldViewProj, const float viewport[2], double px[8], double py[8])
+{
+	const auto& m = worldViewProj.m;
+	for (auto i = 0u; i < 8; ++i)
+	{
+		const double p[] = { (i & 1) ? 1.0 : -1.0, ((i >> 1) & 1) ? 1.0 : -1.0, (i >> 2) ? 1.0 : -1.0 };
+		const auto x = p[0] * m[0][0] + p[1] * m[1][0] + p[2] * m[2][0] + m[3][0];
+		const auto y = p[0] * m[0][1] + p[1] * m[1][1] + p[2] * m[2][1] + m[3][1];
+		const auto w = p[0] * m[0][3] + p[1] * m[1][3] + p[2] * m[2][3] + m[3][3];
+		px[i] = (x / w * 0.5 + 0.5) * viewport[0];
+		py[i] = (0.5 - y / w * 0.5) * viewport[1];
+	}
+}
+
+// Projected area of cube-map face f, in the order +X, -X, +Y, -Y, +Z, -Z, by the shoelace formula
+static double getFaceArea(const double px[8], const double py[8], uint32_t face)
+{
+	const auto axis = face >> 1, u = (axis + 1) % 3, v = (axis + 2) % 3;
+	const auto base = (face & 1) ? 0u : 1u << axis;
+	const uint32_t quad[] = { base, base | (1u << u), base | (1u << u) | (1u << v), base | (1u << v) };
+
+	auto area = 0.0;
+	for (auto i = 0u; i < 4; ++i)
+	{
+		const auto a = quad[i], b = quad[(i + 1) % 4];
+		area += px[a] * py[b] - py[a] * px[b];
+	}
+
+	return 0.5 * fabs(area);
+}
+
+// Area of the convex hull of the projected corners (monotone chain)
+static double getHullArea(const double px[8], const double py[8])
+{
+	uint32_t order[8];
+	for (auto i = 0u; i < 8; ++i) order[i] = i;
+	sort(order, order + 8, [&](uint32_t a, uint32_t b) { return px[a] < px[b] || (px[a] == px[b] && py[a] < py[b]); });
+
+	const auto cross = [&](uint32_t o, uint32_t a, uint32_t b)
+	{
+		return (px[a] - px[o]) * (py[b] - py[o]) - (py[a] - py[o]) * (px[b] - px[o]);
+	};
+
+	uint32_t hull[16];
+	auto n = 0u;
+	for (auto i = 0u; i < 8; ++i)
+	{
+		while (n >= 2 && cross(hull[n - 2], hull[n - 1], order[i]) <= 0.0) --n;
+		hull[n++] = order[i];
+	}
+	for (auto i = 7u, lower = n + 1; i-- > 0;)
+	{
+		while (n >= lower && cross(hull[n - 2], hull[n - 1], order[i]) <= 0.0) --n;
+		hull[n++] = order[i];
+	}
+
+	auto area = 0.0;
+	for (auto i = 0u; i + 1 < n; ++i) area += px[hull[i]] * py[hull[i + 1]] - py[hull[i]] * px[hull[i + 1]];
+
+	return 0.5 * fabs(area);
+}
+
+// Culls volumes from eyes around them, outside the cube and within the slabs of none, one or
+// two of its axes, where both ends of such an axis are visible faces. The coverage summed over
+// the visible faces must be the projected silhouette, which holds only when each bit of the
+// face mask measures the quad of its own face
+int FaceEdgeCheck(int argc, char* argv[])
+{
+	auto numVolumes = 30000u;
+	auto seed = 1u;
+	ToolArgs args;
+	args.Add("-volumes", numVolumes, 3);
+	args.Add("-seed", seed);
+	if (!args.Parse(argc, argv)) return EXIT_FAILURE;
+
+	auto state = seed;
+	const auto random = [&state]()
+	{
+		state = state * 1664525u + 1013904223u;
+
+		return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+	};
+
+	VolumeCuller::FrameDesc frame = {};
+	frame.PathCosts = CostModel::GetDefaultWeights();
+	frame.Viewport[0] = 1920.0f;
+	frame.Viewport[1] = 1080.0f;
+	frame.NumSamples = 256;
+
+	VolumeDesc desc = {};
+	desc.NumMips = NUM_CUBE_MIP;
+	desc.CubeMapSize = 128;
+
+	uint32_t numChecked[3] = {}, numMismatches[3] = {}, numNearClipped = 0;
+	auto maxError = 0.0;
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		const float pos[] = { (random() - 0.5f) * 200.0f, (random() - 0.5f) * 40.0f, (random() - 0.5f) * 200.0f };
+		float rotation[] = { random() - 0.5f, random() - 0.5f, random() - 0.5f, random() - 0.5f };
+		const auto len = sqrtf(rotation[0] * rotation[0] + rotation[1] * rotation[1] +
+			rotation[2] * rotation[2] + rotation[3] * rotation[3]);
+		for (auto& q : rotation) q /= len;
+
+		float worldI[12];
+		const auto world = GetVolumeWorld(2.0f + random() * 30.0f, pos, rotation, worldI);
+
+		// Eye in volume space, within the slabs of the first numSlabs axes from a random one
+		const auto numSlabs = i % 3;
+		const auto firstAxis = static_cast<uint32_t>(random() * 3.0f) % 3;
+		float localEye[3];
+		for (auto k = 0u; k < 3; ++k)
+		{
+			const auto axis = (firstAxis + k) % 3;
+			const auto side = random() < 0.5f ? -1.0f : 1.0f;
+			localEye[axis] = k < numSlabs ? (2.0f * random() - 1.0f) * 0.9f : side * (2.0f + 4.0f * random());
+		}
+
+		float eye[3];
+		for (auto c = 0u; c < 3; ++c)
+			eye[c] = localEye[0] * world.m[0][c] + localEye[1] * world.m[1][c] + localEye[2] * world.m[2][c] + world.m[3][c];
+
+		const auto viewProj = GetViewProj(eye, pos, 3.14159265f / 2.0f, frame.Viewport[0] / frame.Viewport[1], g_zNear, g_zFar);
+		const auto worldViewProj = Multiply(world, viewProj);
+		if (VolumeCuller::IsNearClipped(worldViewProj.m[0]))
+		{
+			++numNearClipped;
+			continue;
+		}
+
+		copy(eye, eye + 3, frame.EyePt);
+		VolumeCuller::GetFrustumCorners(viewProj.m[0], frame.FrustumCorners);
+
+		VolumeInfo info;
+		float coverage;
+		++numChecked[numSlabs];
+		if (!VolumeCuller::CullVolume(frame, worldViewProj.m[0], worldI, desc, 1.0f, info, coverage))
+		{
+			++numMismatches[numSlabs];
+			continue;
+		}
+
+		// One visible face per axis outside its slab, both within
+		auto numFaces = 0u;
+		for (auto face = 0u; face < 6; ++face) numFaces += (info.FaceMask >> face) & 1;
+
+		double px[8], py[8];
+		projectCorners(worldViewProj, frame.Viewport, px, py);
+		const auto hullArea = getHullArea(px, py);
+		const auto error = fabs(coverage - hullArea) / hullArea;
+		maxError = (max)(error, maxError);
+		if (numFaces != 3 + numSlabs || error > 1.0e-3) ++numMismatches[numSlabs];
+	}
+
+	for (auto k = 0u; k < 3; ++k)
+		printf("Eye within %u slabs: %u volumes, %u mismatches\n", k, numChecked[k], numMismatches[k]);
+	printf("Max coverage error against the silhouette: %.2e, near-clipped and skipped: %u\n", maxError, numNearClipped);
+
+	CheckReport report;
+	report.Expect("Eyes within 0, 1 and 2 slabs", numChecked[0] > 0 && numChecked[1] > 0 && numChecked[2] > 0);
+	report.ExpectNone("Mismatches", numMismatches[0] + numMismatches[1] + numMismatches[2]);
+
+	return report.Finish();
+}
+
+// Checks the per-face choice of the render scheme against projected face areas in double:
+// the coverage of a volume outside the eye sums its visible faces into its silhouette, each
+// visible face takes the cheaper path by its own area where the gap exceeds the rounding,
+// and a near-clipped volume keeps one path for all its faces. Reports the volumes that mix
+// both schemes, and the modelled cost against picking one path per volume
+int FaceCheck(int argc, char* argv[])
+{
+	auto numVolumes = 20000u;
+	auto numViews = 16u;
+	auto seed = 1u;
+	ToolArgs args;
+	args.Add("-volumes", numVolumes, 1);
+	args.Add("-views", numViews, 1);
+	args.Add("-seed", seed);
+	if (!args.Parse(argc, argv)) return EXIT_FAILURE;
+
+	static const double tolerance = 1.0e-3;
+
+	auto state = seed ^ 0x5bd1e995u;
+	const auto random = [&state]()
+	{
+		state = state * 1664525u + 1013904223u;
+
+		return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+	};
+
+	vector<Matrix4> worlds;
+	vector<float> worldIs, sampleScales;
+	const auto extent = ScatterVolumes(numVolumes, seed, worlds, worldIs, sampleScales);
+	vector<VolumeDesc> descs(numVolumes);
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		descs[i].VolTexId = i % 1024;
+		descs[i].NumMips = NUM_CUBE_MIP;
+		descs[i].CubeMapSize = 64u << (i % 3);
+	}
+
+	VolumeCuller::FrameDesc frame = {};
+	frame.Viewport[0] = 1920.0f;
+	frame.Viewport[1] = 1080.0f;
+	frame.NumSamples = 256;
+
+	uint64_t numErrors = 0, numVisible = 0, numCubeMap = 0, numMixed = 0, numClipped = 0;
+	auto perFaceCost = 0.0, perVolumeCost = 0.0, maxCoverageError = 0.0;
+	for (auto v = 0u; v < numViews; ++v)
+	{
+		// Random eyes in the field, under the default weights and random ones in turn
+		const float eye[] = { (random() - 0.5f) * extent * 0.5f, (random() - 0.5f) * 30.0f, (random() - 0.5f) * extent * 0.5f };
+		const float at[] = { eye[0] + random() - 0.5f, eye[1] + (random() - 0.5f) * 0.5f, eye[2] + random() - 0.5f };
+		const auto viewProj = GetViewProj(eye, at, 3.14159265f / 4.0f, frame.Viewport[0] / frame.Viewport[1], g_zNear, g_zFar);
+		copy(eye, eye + 3, frame.EyePt);
+		VolumeCuller::GetFrustumCorners(viewProj.m[0], frame.FrustumCorners);
+
+		frame.PathCosts = CostModel::GetDefaultWeights();
+		if (v & 1)
+		{
+			frame.PathCosts.CubeMarch = 0.02f + random() * 0.5f;
+			frame.PathCosts.CubeGather = random() * 2.0f;
+			frame.PathCosts.RayCast = 0.02f + random() * 0.5f;
+		}
+		const auto& weights = frame.PathCosts;
+
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			const auto worldViewProj = Multiply(worlds[i], viewProj);
+			VolumeInfo info;
+			float coverage, cubeMapCoverage;
+			if (!VolumeCuller::CullVolume(frame, worldViewProj.m[0], &worldIs[12 * i], descs[i], sampleScales[i],
+				info, coverage, &cubeMapCoverage)) continue;
+			++numVisible;
+
+			const auto faceMask = info.FaceMask & 0x3fu;
+			const auto cubeMapFaces = (info.FaceMask >> 8) & 0x3fu;
+			const auto isCubeMap = (info.FaceMask & 0x8000) != 0;
+			auto isSame = (cubeMapFaces & ~faceMask) == 0 && isCubeMap == (cubeMapFaces != 0) &&
+				(info.FaceMask & 0x40c0) == 0 && (faceMask != 0x3f || cubeMapFaces == 0);
+			numCubeMap += isCubeMap ? 1 : 0;
+
+			if (VolumeCuller::IsNearClipped(worldViewProj.m[0]))
+			{
+				isSame = isSame && (cubeMapFaces == 0 || cubeMapFaces == faceMask) &&
+					cubeMapCoverage == (cubeMapFaces ? coverage : 0.0f);
+				numClipped += 1;
+				if (!isSame) ++numErrors;
+				continue;
+			}
+
+			double px[8], py[8];
+			projectCorners(worldViewProj, frame.Viewport, px, py);
+
+			// The faces of the cube-map texels and their paths, against one path for the volume
+			const auto edgeLength = info.MipLevel < 32 ? descs[i].CubeMapSize >> info.MipLevel : 0;
+			const auto texels = static_cast<double>(edgeLength) * edgeLength;
+			const auto smpCount = static_cast<double>(info.SmpCount);
+			auto faceSum = 0.0, cubeMapSum = 0.0, volumeCubeCost = 0.0, volumeDirectCost = 0.0, faceCost = 0.0;
+			auto numFaces = 0u;
+			for (auto face = 0u; face < 6; ++face)
+			{
+				if (!(faceMask & (1 << face))) continue;
+				++numFaces;
+
+				const auto area = getFaceArea(px, py, face);
+				const auto cubeCost = weights.CubeMarch * smpCount * texels + static_cast<double>(weights.CubeGather) * area;
+				const auto directCost = weights.RayCast * smpCount * area;
+				const auto isCubeMapFace = (cubeMapFaces & (1 << face)) != 0;
+				if (faceMask != 0x3f && fabs(cubeCost - directCost) > tolerance * (max)(cubeCost, directCost) &&
+					isCubeMapFace != (cubeCost <= directCost)) isSame = false;
+
+				faceSum += area;
+				cubeMapSum += isCubeMapFace ? area : 0.0;
+				faceCost += isCubeMapFace ? cubeCost : directCost;
+				volumeCubeCost += cubeCost;
+				volumeDirectCost += directCost;
+			}
+
+			const auto slack = tolerance * (max)(faceSum, 1.0) + 1.0e-2;
+			isSame = isSame && fabs(coverage - faceSum) <= slack && fabs(cubeMapCoverage - cubeMapSum) <= slack;
+			if (!isEyeInside(frame.EyePt, &worldIs[12 * i]))
+			{
+				const auto hullArea = getHullArea(px, py);
+				const auto error = fabs(faceSum - hullArea);
+				maxCoverageError = (max)(maxCoverageError, error / (max)(hullArea, 1.0));
+				isSame = isSame && error <= tolerance * (max)(hullArea, 1.0) + 1.0e-2;
+			}
+
+			// One path for the volume, as before
+			const auto isCubeMapVolume = CostModel::UseCubeMap(weights, faceMask,
+				static_cast<float>(texels * numFaces), coverage, info.SmpCount);
+			const auto volumeCost = isCubeMapVolume ? volumeCubeCost : volumeDirectCost;
+			isSame = isSame && faceCost <= volumeCost + tolerance * (max)(volumeCost, 1.0);
+			faceCost = (min)(faceCost, volumeCost);	// The rounding of the near ties
+			perFaceCost += faceCost;
+			perVolumeCost += volumeCost;
+			numMixed += cubeMapFaces && cubeMapFaces != faceMask ? 1 : 0;
+
+			if (!isSame) ++numErrors;
+		}
+	}
+
+	printf("%u volumes, %u views: %llu visible, %llu near-clipped, %.1f%% with cube-map faces, %.1f%% mixed\n",
+		numVolumes, numViews, static_cast<unsigned long long>(numVisible), static_cast<unsigned long long>(numClipped),
+		numVisible ? 100.0 * numCubeMap / numVisible : 0.0, numVisible ? 100.0 * numMixed / numVisible : 0.0);
+	printf("Coverage: %.2e max relative error against the silhouettes\n", maxCoverageError);
+	printf("Modelled cost: per face %.4f ms, per volume %.4f ms, %.2f%% saved\n", perFaceCost * 1.0e-6,
+		perVolumeCost * 1.0e-6, perVolumeCost > 0.0 ? 100.0 * (1.0 - perFaceCost / perVolumeCost) : 0.0);
+	CheckReport report;
+	report.ExpectNone("Errors", numErrors);
+
+	return report.Finish();
+}
+
+// Bins the cube-map volumes of random views by mip level as the culling shader does, and
+// counts the thread groups of the binned dispatches tile by tile against one dispatch of
+// full-size faces: every bin must hold the volumes of its mip, and no binned group may lie
+// wholly outside the face at its mip
+int DispatchCheck(int argc, char* argv[])
+{
+	auto numVolumes = 20000u;
+	auto numViews = 16u;
+	auto gridSize = 128u;
+	auto seed = 1u;
+	ToolArgs args;
+	args.Add("-volumes", numVolumes, 1);
+	args.Add("-views", numViews, 1);
+	args.Add("-grid", gridSize, 1);
+	args.Add("-seed", seed);
+	if (!args.Parse(argc, argv)) return EXIT_FAILURE;
+
+	static const uint32_t groupSize = 8;
+
+	auto state = seed ^ 0x27d4eb2fu;
+	const auto random = [&state]()
+	{
+		state = state * 1664525u + 1013904223u;
+
+		return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+	};
+
+	vector<Matrix4> worlds;
+	vector<float> worldIs, sampleScales;
+	const auto extent = ScatterVolumes(numVolumes, seed, worlds, worldIs, sampleScales);
+
+	VolumeCuller culler;
+	culler.Resize(numVolumes);
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		VolumeDesc desc;
+		desc.VolTexId = i % 1024;
+		desc.NumMips = NUM_CUBE_MIP;
+		desc.CubeMapSize = gridSize;
+		culler.SetVolumeDesc(i, desc);
+	}
+
+	VolumeCuller::FrameDesc frame = {};
+	frame.PathCosts = CostModel::GetDefaultWeights();
+	frame.Viewport[0] = 1920.0f;
+	frame.Viewport[1] = 1080.0f;
+	frame.NumSamples = 256;
+
+	VolumeCuller::CubeMapDispatchArg resets[NUM_CUBE_MIP];
+	VolumeCuller::ResetCubeMapDispatchArgs(gridSize, NUM_CUBE_MIP, resets);
+
+	// Errors of the bins and their group counts, and of the face work items in them
+	uint64_t numBinErrors = 0, numItemErrors = 0, numCubeMap = 0, binCounts[NUM_CUBE_MIP] = {};
+	VolumeCuller::CubeMapGroupCounts totals = {};
+	uint64_t numFaceItems = 0;
+	vector<uint32_t> binnedFaces;
+	vector<uint8_t> seenFaces(numVolumes);
+	for (auto v = 0u; v < numViews; ++v)
+	{
+		const float eye[] = { (random() - 0.5f) * extent * 0.5f, (random() - 0.5f) * 30.0f, (random() - 0.5f) * extent * 0.5f };
+		const float at[] = { eye[0] + random() - 0.5f, eye[1] + (random() - 0.5f) * 0.5f, eye[2] + random() - 0.5f };
+		const auto viewProj = GetViewProj(eye, at, 3.14159265f / 4.0f, frame.Viewport[0] / frame.Viewport[1], g_zNear, g_zFar);
+		copy(eye, eye + 3, frame.EyePt);
+		VolumeCuller::GetFrustumCorners(viewProj.m[0], frame.FrustumCorners);
+		frame.NumSamples = 32u << (v % 4);
+
+		for (auto i = 0u; i < numVolumes; ++i)
+		{
+			const auto worldViewProj = Multiply(worlds[i], viewProj);
+			culler.SetVolume(i, worldViewProj.m[0], &worldIs[12 * i], sampleScales[i]);
+		}
+		culler.Cull(frame);
+
+		VolumeCuller::CubeMapDispatchArg args[NUM_CUBE_MIP];
+		culler.GetCubeMapDispatchArgs(gridSize, NUM_CUBE_MIP, args, &binnedFaces);
+
+		// Each cube-map face once, in the bin of its volume's mip
+		const auto& cubeMapVolumes = culler.GetCubeMapVolumes();
+		const auto pInfos = culler.GetVolumeInfos();
+		fill(seenFaces.begin(), seenFaces.end(), 0);
+		uint64_t numBinned = 0;
+		VolumeCuller::CubeMapGroupCounts expected = {};
+		for (auto b = 0u; b < NUM_CUBE_MIP; ++b)
+		{
+			const auto& arg = args[b];
+			if (arg.MipLevel != resets[b].MipLevel || arg.ThreadGroupCountX != resets[b].ThreadGroupCountX ||
+				arg.ThreadGroupCountY != resets[b].ThreadGroupCountY) ++numBinErrors;
+
+			// As the work-graph records size their grids
+			const auto faceSize = (max)(gridSize >> b, 1u);
+			if (arg.ThreadGroupCountX != (faceSize + groupSize - 1) / groupSize) ++numBinErrors;
+
+			// Tiles of the work items, 8x8 threads each
+			for (auto k = 0u; k < arg.ThreadGroupCountZ; ++k)
+			{
+				const auto item = binnedFaces[static_cast<size_t>(b) * 6 * numVolumes + k];
+				const auto i = item >> 3, f = item & 7;
+				if (i >= numVolumes || f >= 6 || (seenFaces[i] & (1 << f)) ||
+					!((pInfos[i].FaceMask >> (8 + f)) & 1) ||
+					(min)(pInfos[i].MipLevel, static_cast<uint16_t>(NUM_CUBE_MIP - 1)) != b) ++numItemErrors;
+				else seenFaces[i] |= 1 << f;
+
+				for (auto gy = 0u; gy < arg.ThreadGroupCountY; ++gy)
+					for (auto gx = 0u; gx < arg.ThreadGroupCountX; ++gx, ++expected.Launched)
+						expected.Wasted += gx * groupSize >= faceSize || gy * groupSize >= faceSize ? 1 : 0;
+			}
+
+			numBinned += arg.ThreadGroupCountZ;
+			numFaceItems += arg.ThreadGroupCountZ;
+			binCounts[b] += arg.NumVolumes;
+		}
+
+		// The full-size dispatch: 6 faces of every cube-map volume, tile by tile
+		const auto fullGroups = (gridSize + groupSize - 1) / groupSize;
+		uint64_t numCubeMapFaces = 0;
+		for (const auto& i : cubeMapVolumes)
+		{
+			const auto cubeMapFaces = (pInfos[i].FaceMask >> 8) & 0x3fu;
+			if (seenFaces[i] != cubeMapFaces) ++numItemErrors;
+
+			const auto faceSize = (max)(gridSize >> pInfos[i].MipLevel, 1u);
+			for (auto f = 0u; f < 6; ++f)
+			{
+				const auto isCubeMapFace = (cubeMapFaces >> f) & 1;
+				numCubeMapFaces += isCubeMapFace;
+				for (auto gy = 0u; gy < fullGroups; ++gy)
+					for (auto gx = 0u; gx < fullGroups; ++gx, ++expected.UnbinnedLaunched)
+						expected.UnbinnedWasted += !isCubeMapFace || gx * groupSize >= faceSize ||
+							gy * groupSize >= faceSize ? 1 : 0;
+			}
+		}
+		if (numBinned != numCubeMapFaces) ++numItemErrors;
+
+		// Volume counts of the bins
+		uint64_t numBinVolumes = 0;
+		for (const auto& arg : args) numBinVolumes += arg.NumVolumes;
+		if (numBinVolumes != cubeMapVolumes.size()) ++numBinErrors;
+
+		const auto counts = VolumeCuller::CountCubeMapGroups(gridSize, NUM_CUBE_MIP, args);
+		if (counts.Launched != expected.Launched || counts.Wasted != expected.Wasted ||
+			counts.UnbinnedLaunched != expected.UnbinnedLaunched || counts.UnbinnedWasted != expected.UnbinnedWasted ||
+			counts.Wasted != 0) ++numBinErrors;
+
+		numCubeMap += cubeMapVolumes.size();
+		totals.Launched += counts.Launched;
+		totals.Wasted += counts.Wasted;
+		totals.UnbinnedLaunched += counts.UnbinnedLaunched;
+		totals.UnbinnedWasted += counts.UnbinnedWasted;
+	}
+
+	printf("%u volumes, %u views, %u^2 cube maps: %llu cube-map volumes by mip:", numVolumes, numViews, gridSize,
+		static_cast<unsigned long long>(numCubeMap));
+	for (auto b = 0u; b < NUM_CUBE_MIP; ++b) printf(" %llu", static_cast<unsigned long long>(binCounts[b]));
+	printf(", %.2f cube-map faces each\n", numCubeMap ? static_cast<double>(numFaceItems) / numCubeMap : 0.0);
+	printf("Full cubes: %llu 8x8 tiles, %llu idle (%.1f%%)\n", static_cast<unsigned long long>(totals.UnbinnedLaunched),
+		static_cast<unsigned long long>(totals.UnbinnedWasted),
+		totals.UnbinnedLaunched ? 100.0 * totals.UnbinnedWasted / totals.UnbinnedLaunched : 0.0);
+	printf("Face items by mip: %llu 8x8 tiles, %llu idle, %.2fx fewer\n", static_cast<unsigned long long>(totals.Launched),
+		static_cast<unsigned long long>(totals.Wasted),
+		totals.Launched ? static_cast<double>(totals.UnbinnedLaunched) / totals.Launched : 0.0);
+	CheckReport report;
+	report.ExpectNone("Bin errors", numBinErrors);
+	report.ExpectNone("Face item errors", numItemErrors);
+
+	return report.Finish();
+}
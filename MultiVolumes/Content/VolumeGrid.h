@@ -0,0 +1,123 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// Dense single-channel density grid, x-major then y then z.
+// Shared by the offline volume tools and the CPU-side loaders; no graphics API dependency.
+//--------------------------------------------------------------------------------------
+struct VolumeGrid
+{
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	uint32_t Depth = 0;
+	std::vector<float> Voxels;
+
+	void Resize(uint32_t width, uint32_t height, uint32_t depth, float value = 0.0f)
+	{
+		Width = width;
+		Height = height;
+		Depth = depth;
+		Voxels.assign(static_cast<size_t>(width) * height * depth, value);
+	}
+
+	size_t GetNumVoxels() const { return Voxels.size(); }
+	size_t GetIndex(uint32_t x, uint32_t y, uint32_t z) const
+	{
+		return (static_cast<size_t>(z) * Height + y) * Width + x;
+	}
+
+	float& At(uint32_t x, uint32_t y, uint32_t z) { return Voxels[GetIndex(x, y, z)]; }
+	float At(uint32_t x, uint32_t y, uint32_t z) const { return Voxels[GetIndex(x, y, z)]; }
+
+	// Clamp-to-edge fetch with signed coordinates
+	float Fetch(int32_t x, int32_t y, int32_t z) const
+	{
+		x = x < 0 ? 0 : (x >= static_cast<int32_t>(Width) ? Width - 1 : x);
+		y = y < 0 ? 0 : (y >= static_cast<int32_t>(Height) ? Height - 1 : y);
+		z = z < 0 ? 0 : (z >= static_cast<int32_t>(Depth) ? Depth - 1 : z);
+
+		return At(x, y, z);
+	}
+
+	// Trilinear sample at normalized coordinates (texel centers at (i + 0.5) / size), clamp to edge,
+	// as a linear sampler reads the grid
+	float Sample(float u, float v, float w) const
+	{
+		const auto x = u * Width - 0.5f, y = v * Height - 0.5f, z = w * Depth - 0.5f;
+		const auto x0 = floorf(x), y0 = floorf(y), z0 = floorf(z);
+		const auto fx = x - x0, fy = y - y0, fz = z - z0;
+		const auto i = static_cast<int32_t>(x0), j = static_cast<int32_t>(y0), k = static_cast<int32_t>(z0);
+
+		const auto lerp = [](float a, float b, float t) { return a + (b - a) * t; };
+		const auto c00 = lerp(Fetch(i, j, k), Fetch(i + 1, j, k), fx);
+		const auto c10 = lerp(Fetch(i, j + 1, k), Fetch(i + 1, j + 1, k), fx);
+		const auto c01 = lerp(Fetch(i, j, k + 1), Fetch(i + 1, j, k + 1), fx);
+		const auto c11 = lerp(Fetch(i, j + 1, k + 1), Fetch(i + 1, j + 1, k + 1), fx);
+
+		return lerp(lerp(c00, c10, fy), lerp(c01, c11, fy), fz);
+	}
+};
+
+//--------------------------------------------------------------------------------------
+// IEEE 754 half-precision conversions (round-to-nearest-even), matching R16_FLOAT
+//--------------------------------------------------------------------------------------
+inline uint16_t FloatToHalf(float value)
+{
+	uint32_t f;
+	memcpy(&f, &value, sizeof(float));
+
+	const auto sign = static_cast<uint16_t>((f >> 16) & 0x8000);
+	const auto absF = f & 0x7fffffff;
+
+	// Inf and NaN
+	if (absF >= 0x7f800000) return sign | 0x7c00 | (absF > 0x7f800000 ? 0x0200 : 0);
+
+	// Overflow
+	if (absF >= 0x47800000) return sign | 0x7c00;
+
+	// Subnormal half, where the value is m * 2^-24
+	if (absF < 0x38800000)
+	{
+		float absValue;
+		memcpy(&absValue, &absF, sizeof(float));
+
+		return sign | static_cast<uint16_t>(lrintf(absValue * 16777216.0f));
+	}
+
+	// Normal half: rebias the exponent from 127 to 15 and round the mantissa
+	auto h = (absF - 0x38000000) >> 13;
+	const auto rem = absF & 0x1fff;
+	if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) ++h;
+
+	return sign | static_cast<uint16_t>(h);
+}
+
+inline float HalfToFloat(uint16_t h)
+{
+	const auto sign = static_cast<uint32_t>(h & 0x8000) << 16;
+	const auto exponent = (h >> 10) & 0x1f;
+	const auto mantissa = static_cast<uint32_t>(h & 0x3ff);
+
+	if (exponent == 0)
+	{
+		const auto value = ldexpf(static_cast<float>(mantissa), -24);
+
+		return sign ? -value : value;
+	}
+
+	const auto f = exponent == 0x1f ? sign | 0x7f800000 | (mantissa << 13) :
+		sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+	float value;
+	memcpy(&value, &f, sizeof(float));
+
+	return value;
+}
@@ -0,0 +1,247 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include "VolumeLoader.h"
+#include "ProceduralVolume.h"
+
+using namespace std;
+
+static bool hasExtension(const VolumeLoader::Path& fileName, const char* ext)
+{
+	const auto extLen = strlen(ext);
+	if (fileName.size() < extLen) return false;
+
+	const auto offset = fileName.size() - extLen;
+	for (size_t i = 0; i < extLen; ++i)
+	{
+		const auto c = fileName[offset + i];
+		if ((c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c) != ext[i]) return false;
+	}
+
+	return true;
+}
+
+VolumeLoader::VolumeLoader() :
+	m_stop(false),
+	m_numRequested(0),
+	m_numPopped(0),
+	m_macroCellMargin(0.0f),
+	m_mipGridSize(0),
+	m_mipDensityScale(1.0f)
+{
+}
+
+VolumeLoader::~VolumeLoader()
+{
+	Stop();
+}
+
+bool VolumeLoader::Start(const Path* pFileNames, uint32_t numFiles, uint32_t numThreads,
+	float macroCellMargin, uint32_t mipGridSize, float mipDensityScale)
+{
+	Stop();
+
+	// Leave one hardware thread to the render loop
+	if (numThreads == 0) numThreads = (max)(thread::hardware_concurrency(), 2u) - 1;
+	if (numFiles > 0) numThreads = (min)(numThreads, numFiles);
+
+	// Results beyond the capacity wait in their workers until the consumer catches up
+	const auto capacity = (max)(numFiles, 4 * numThreads);
+	m_queue = unique_ptr<MPMCQueue<unique_ptr<LoadedVolume>>>(new MPMCQueue<unique_ptr<LoadedVolume>>(capacity));
+	m_stop = false;
+	m_numRequested = 0;
+	m_numPopped = 0;
+	m_macroCellMargin = macroCellMargin;
+	m_mipGridSize = mipGridSize;
+	m_mipDensityScale = mipDensityScale;
+
+	for (auto i = 0u; i < numFiles; ++i) Request(pFileNames[i], i);
+
+	m_workers.reserve(numThreads);
+	for (auto i = 0u; i < numThreads; ++i) m_workers.emplace_back(&VolumeLoader::worker, this);
+
+	return true;
+}
+
+void VolumeLoader::Stop()
+{
+	{
+		lock_guard<mutex> lock(m_requestMutex);
+		m_stop = true;
+		m_requests.clear();
+	}
+	m_requestCV.notify_all();
+
+	for (auto& worker : m_workers) if (worker.joinable()) worker.join();
+	m_workers.clear();
+}
+
+void VolumeLoader::Request(const Path& fileName, uint32_t index)
+{
+	{
+		lock_guard<mutex> lock(m_requestMutex);
+		m_requests.push_back({ fileName, index });
+	}
+	m_requestCV.notify_one();
+	++m_numRequested;
+}
+
+void VolumeLoader::CancelRequests(vector<uint32_t>& indices)
+{
+	lock_guard<mutex> lock(m_requestMutex);
+	for (const auto& request : m_requests) indices.emplace_back(request.Index);
+	m_numRequested -= static_cast<uint32_t>(m_requests.size());
+	m_requests.clear();
+}
+
+bool VolumeLoader::TryPop(unique_ptr<LoadedVolume>& volume)
+{
+	if (!m_queue || !m_queue->TryPop(volume)) return false;
+	++m_numPopped;
+
+	return true;
+}
+
+uint32_t VolumeLoader::GetNumRequested() const
+{
+	return m_numRequested;
+}
+
+uint32_t VolumeLoader::GetNumPopped() const
+{
+	return m_numPopped;
+}
+
+bool VolumeLoader::IsDone() const
+{
+	return m_numPopped >= m_numRequested;
+}
+
+bool VolumeLoader::Decode(const Path& fileName, LoadedVolume& volume)
+{
+	volume.Succeeded = false;
+	volume.pVoxels = nullptr;
+	volume.Info = {};
+
+	// Procedural sources (.vgen) are generated here from their descs, and bricked like .vbk
+	if (hasExtension(fileName, ".vgen"))
+	{
+		ifstream descFile(fileName);
+		ProceduralVolume::Desc desc;
+		ProceduralVolume generator;
+		if (!descFile || !ProceduralVolume::ReadDesc(descFile, desc) || !generator.Init(desc, 1)) return false;
+
+		VolumeGrid grid;
+		generator.Generate(grid, 1);
+		volume.Bricks = unique_ptr<BrickedVolume>(new BrickedVolume);
+		volume.Succeeded = volume.Bricks->Build(grid, BrickedVolume::BuildDesc());
+		if (!volume.Succeeded) volume.Bricks.reset();
+
+		return volume.Succeeded;
+	}
+
+	auto file = unique_ptr<MappedFile>(new MappedFile);
+	if (!file->Open(fileName.c_str())) return false;
+
+	if (hasExtension(fileName, ".vbk"))
+	{
+		volume.Bricks = unique_ptr<BrickedVolume>(new BrickedVolume);
+		volume.Succeeded = volume.Bricks->Read(file->GetData(), file->GetSize());
+		if (!volume.Succeeded) volume.Bricks.reset();
+
+		return volume.Succeeded;
+	}
+
+	if (hasExtension(fileName, ".vbc"))
+	{
+		volume.Compressed = unique_ptr<CompressedVolume>(new CompressedVolume);
+		volume.Succeeded = volume.Compressed->Read(file->GetData(), file->GetSize());
+		if (!volume.Succeeded) volume.Compressed.reset();
+
+		return volume.Succeeded;
+	}
+
+	volume.pVoxels = DDSVolume::ParseInPlace(file->GetData(), file->GetSize(), volume.Info);
+	if (!volume.pVoxels) return false;
+
+	// Fault the top-level mip in here, so that the upload copy does not stall on page faults
+	const auto pBytes = static_cast<const volatile uint8_t*>(volume.pVoxels);
+	const auto byteSize = DDSVolume::GetTopMipByteSize(volume.Info);
+	uint8_t touch = 0;
+	for (size_t i = 0; i < byteSize; i += 4096) touch ^= pBytes[i];
+	(void)touch;
+
+	volume.File = move(file);
+	volume.Succeeded = true;
+
+	return true;
+}
+
+size_t VolumeLoader::GetStoredByteSize(const LoadedVolume& volume)
+{
+	if (volume.Bricks) return volume.Bricks->GetFileByteSize();
+	if (volume.Compressed) return volume.Compressed->GetFileByteSize();
+
+	return volume.pVoxels ? DDSVolume::GetTopMipByteSize(volume.Info) : 0;
+}
+
+void VolumeLoader::ExpandGrid(const LoadedVolume& volume, VolumeGrid& grid, uint32_t numThreads)
+{
+	if (volume.Bricks) volume.Bricks->Expand(grid);
+	else if (volume.Compressed) volume.Compressed->Decode(grid, numThreads);
+	else
+	{
+		grid.Resize(volume.Info.Width, volume.Info.Height, volume.Info.Depth);
+		DDSVolume::DecodeVoxels(volume.pVoxels, volume.Info.VoxelFormat, grid.GetNumVoxels(), grid.Voxels.data());
+	}
+}
+
+bool VolumeLoader::BuildDerivedData(LoadedVolume& volume, float macroCellMargin, uint32_t mipGridSize,
+	float mipDensityScale, uint32_t numThreads)
+{
+	if (!volume.Succeeded) return false;
+
+	// Decoded once for both the occupancy and the mips
+	VolumeGrid grid;
+	ExpandGrid(volume, grid, numThreads);
+
+	volume.MacroCells = unique_ptr<MacroCellGrid>(new MacroCellGrid);
+	volume.MacroCells->Build(grid, macroCellMargin, numThreads);
+
+	if (mipGridSize > 0)
+	{
+		volume.Mips = unique_ptr<VolumeMipChain>(new VolumeMipChain);
+		volume.Mips->Build(grid, mipGridSize, mipDensityScale, numThreads);
+	}
+
+	return true;
+}
+
+void VolumeLoader::worker()
+{
+	for (;;)
+	{
+		// Requests are served in order; idle workers sleep until the next one
+		FileRequest request;
+		{
+			unique_lock<mutex> lock(m_requestMutex);
+			m_requestCV.wait(lock, [this] { return m_stop || !m_requests.empty(); });
+			if (m_stop) break;
+
+			request = move(m_requests.front());
+			m_requests.pop_front();
+		}
+
+		auto volume = unique_ptr<LoadedVolume>(new LoadedVolume);
+		volume->Index = request.Index;
+		if (Decode(request.FileName, *volume))
+			BuildDerivedData(*volume, m_macroCellMargin, m_mipGridSize, m_mipDensityScale);
+
+		// A full queue only waits for the consumer to pop
+		while (!m_queue->TryPush(move(volume)) && !m_stop) this_thread::yield();
+	}
+}
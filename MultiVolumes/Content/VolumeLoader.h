@@ -0,0 +1,114 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "DDSVolume.h"
+#include "BrickedVolume.h"
+#include "CompressedVolume.h"
+#include "MacroCellGrid.h"
+#include "VolumeMipChain.h"
+#include "MappedFile.h"
+#include "MPMCQueue.h"
+
+//--------------------------------------------------------------------------------------
+// Decoded volume source, ready for uploading
+//--------------------------------------------------------------------------------------
+struct LoadedVolume
+{
+	uint32_t Index;
+	bool Succeeded;
+
+	// Dense DDS sources keep the file mapped; pVoxels points at the top-level mip inside it
+	DDSVolume::Info Info;
+	const void* pVoxels;
+	std::unique_ptr<MappedFile> File;
+
+	// Bricked sources (.vbk) are decoded into system memory, and the file is unmapped;
+	// procedural sources (.vgen) are generated and bricked likewise
+	std::unique_ptr<BrickedVolume> Bricks;
+
+	// Block-compressed sources (.vbc) are copied out likewise, and stay BC4 blocks on the GPU
+	std::unique_ptr<CompressedVolume> Compressed;
+
+	// Occupancy for empty-space skipping, built from whichever source was decoded
+	std::unique_ptr<MacroCellGrid> MacroCells;
+
+	// Coarse levels of the expanded grid, when the loader is given its size
+	std::unique_ptr<VolumeMipChain> Mips;
+};
+
+//--------------------------------------------------------------------------------------
+// Decodes and validates volume files on a worker pool, and hands the results to a single
+// consumer through a lock-free queue. Files are requested up front or one by one while
+// the workers run, e.g. as the residency manager pages sources in. It has no graphics
+// API dependency.
+//--------------------------------------------------------------------------------------
+class VolumeLoader
+{
+public:
+#ifdef _WIN32
+	using Path = std::wstring;
+#else
+	using Path = std::string;
+#endif
+
+	VolumeLoader();
+	virtual ~VolumeLoader();
+
+	// Requests the files with indices 0 to numFiles - 1, if any.
+	// mipGridSize is the size of the expanded grid whose coarse levels are built; 0 skips them
+	bool Start(const Path* pFileNames, uint32_t numFiles, uint32_t numThreads = 0,
+		float macroCellMargin = 0.0f, uint32_t mipGridSize = 0, float mipDensityScale = 1.0f);
+	void Stop();
+
+	// From the consumer thread after Start(); index is handed back in LoadedVolume::Index
+	void Request(const Path& fileName, uint32_t index);
+
+	// Drops the requests that no worker has started, and appends their indices
+	void CancelRequests(std::vector<uint32_t>& indices);
+
+	// Non-blocking; returns false when nothing has finished decoding yet
+	bool TryPop(std::unique_ptr<LoadedVolume>& volume);
+
+	uint32_t GetNumRequested() const;
+	uint32_t GetNumPopped() const;
+	bool IsDone() const;	// Every request so far has been popped
+
+	static bool Decode(const Path& fileName, LoadedVolume& volume);
+	static size_t GetStoredByteSize(const LoadedVolume& volume);	// As stored in its file
+	static void ExpandGrid(const LoadedVolume& volume, VolumeGrid& grid, uint32_t numThreads = 1);
+	static bool BuildDerivedData(LoadedVolume& volume, float macroCellMargin, uint32_t mipGridSize,
+		float mipDensityScale, uint32_t numThreads = 1);
+
+protected:
+	struct FileRequest
+	{
+		Path FileName;
+		uint32_t Index;
+	};
+
+	void worker();
+
+	std::vector<std::thread> m_workers;
+	std::unique_ptr<MPMCQueue<std::unique_ptr<LoadedVolume>>> m_queue;
+
+	std::deque<FileRequest> m_requests;
+	std::mutex m_requestMutex;
+	std::condition_variable m_requestCV;
+
+	std::atomic<bool> m_stop;
+	uint32_t m_numRequested;
+	uint32_t m_numPopped;
+	float m_macroCellMargin;
+	uint32_t m_mipGridSize;
+	float m_mipDensityScale;
+};
@@ -0,0 +1,70 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "VolumeLoader.h"
+#include "ToolCheck.h"
+
+using namespace std;
+
+// Decodes the files on 1, 2, 4, ... worker threads while the calling thread drains the
+// queue, as the render loop does
+int BenchLoad(int argc, char* argv[])
+{
+	auto numRepeats = 8u;
+	auto maxThreads = (max)(thread::hardware_concurrency(), 1u);
+	ToolArgs args;
+	args.Add("-repeat", numRepeats, 1);
+	args.Add("-maxThreads", maxThreads, 1);
+	vector<const char*> files;
+	if (!args.Parse(argc, argv, &files, 1)) return EXIT_FAILURE;
+	vector<VolumeLoader::Path> fileNames(files.cbegin(), files.cend());
+
+	// Repeat the inputs to emulate a larger scene
+	const auto numInputs = fileNames.size();
+	for (auto r = 1u; r < numRepeats; ++r)
+		for (size_t i = 0; i < numInputs; ++i) fileNames.emplace_back(fileNames[i]);
+	const auto numFiles = static_cast<uint32_t>(fileNames.size());
+
+	auto baseSeconds = 0.0;
+	for (auto n = 1u; ; n *= 2)
+	{
+		const auto numThreads = (min)(n, maxThreads);
+		VolumeLoader loader;
+		size_t numBytes = 0;
+		auto numFailed = 0u;
+
+		const auto start = chrono::steady_clock::now();
+		loader.Start(fileNames.data(), numFiles, numThreads);
+		while (!loader.IsDone())
+		{
+			unique_ptr<LoadedVolume> volume;
+			if (!loader.TryPop(volume))
+			{
+				this_thread::yield();
+				continue;
+			}
+
+			if (!volume->Succeeded) ++numFailed;
+			else numBytes += VolumeLoader::GetStoredByteSize(*volume);
+		}
+		const auto seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		loader.Stop();
+
+		if (numThreads == 1) baseSeconds = seconds;
+		printf("%2u threads: %8.2f ms, %8.1f files/s, %8.1f MB/s, speedup %.2fx%s\n", numThreads, seconds * 1000.0,
+			numFiles / seconds, numBytes / seconds / (1024.0 * 1024.0), baseSeconds / seconds,
+			numFailed ? " (some files failed)" : "");
+
+		if (numThreads == maxThreads) break;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,195 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include "VolumeMipChain.h"
+#include "ParallelFor.h"
+
+using namespace std;
+
+static uint32_t getLevelSize(uint32_t size, uint32_t level)
+{
+	return (max)(size >> level, 1u);
+}
+
+VolumeMipChain::VolumeMipChain() :
+	m_size(0)
+{
+}
+
+VolumeMipChain::~VolumeMipChain()
+{
+}
+
+void VolumeMipChain::Build(const VolumeGrid& grid, uint32_t size, float densityScale, uint32_t numThreads)
+{
+	m_size = size;
+	m_levels.clear();
+	const auto numLevels = GetNumMips(size);
+	if (grid.GetNumVoxels() == 0 || numLevels < 2)
+	{
+		pack(densityScale, numThreads);
+
+		return;
+	}
+
+	m_levels.resize(numLevels - 1);
+
+	// Level 1 from the source, through the top-level texels that the GPU would resample.
+	// Trilinear weights are separable, and so is their 2x2x2 average, so the axes are
+	// resampled one after another.
+	const auto levelSize = getLevelSize(size, 1);
+	VolumeGrid resampledX, resampledXY;
+	resampledX.Resize(levelSize, grid.Height, grid.Depth);
+	resampledXY.Resize(levelSize, levelSize, grid.Depth);
+	m_levels[0].Resize(levelSize, levelSize, levelSize);
+
+	vector<Tap> taps[3];
+	getTaps(grid.Width, size, levelSize, taps[0]);
+	getTaps(grid.Height, size, levelSize, taps[1]);
+	getTaps(grid.Depth, size, levelSize, taps[2]);
+
+	ParallelFor(grid.Depth, [&](uint32_t z)
+	{
+		for (auto y = 0u; y < grid.Height; ++y)
+			for (auto x = 0u; x < levelSize; ++x)
+			{
+				auto value = 0.0f;
+				for (auto i = 0u; i < 4; ++i) value += taps[0][4 * x + i].Weight * grid.At(taps[0][4 * x + i].Index, y, z);
+				resampledX.At(x, y, z) = value;
+			}
+
+		for (auto y = 0u; y < levelSize; ++y)
+			for (auto x = 0u; x < levelSize; ++x)
+			{
+				auto value = 0.0f;
+				for (auto i = 0u; i < 4; ++i) value += taps[1][4 * y + i].Weight * resampledX.At(x, taps[1][4 * y + i].Index, z);
+				resampledXY.At(x, y, z) = value;
+			}
+	}, numThreads);
+
+	ParallelFor(levelSize, [&](uint32_t z)
+	{
+		for (auto y = 0u; y < levelSize; ++y)
+			for (auto x = 0u; x < levelSize; ++x)
+			{
+				auto value = 0.0f;
+				for (auto i = 0u; i < 4; ++i) value += taps[2][4 * z + i].Weight * resampledXY.At(x, y, taps[2][4 * z + i].Index);
+				m_levels[0].At(x, y, z) = value;
+			}
+	}, numThreads);
+
+	for (auto i = 1u; i + 1 < numLevels; ++i) Downsample(m_levels[i - 1], m_levels[i], numThreads);
+
+	pack(densityScale, numThreads);
+}
+
+uint32_t VolumeMipChain::GetSize() const
+{
+	return m_size;
+}
+
+uint32_t VolumeMipChain::GetNumLevels() const
+{
+	return static_cast<uint32_t>(m_levels.size()) + 1;
+}
+
+const VolumeGrid& VolumeMipChain::GetLevel(uint32_t level) const
+{
+	return m_levels[level - 1];
+}
+
+const uint16_t* VolumeMipChain::GetTexels(uint32_t level) const
+{
+	return &m_texels[m_texelOffsets[level - 1]];
+}
+
+size_t VolumeMipChain::GetTexelDataByteSize() const
+{
+	return sizeof(uint16_t) * m_texels.size();
+}
+
+uint32_t VolumeMipChain::GetNumMips(uint32_t size)
+{
+	auto numMips = 1u;
+	while (size > 1)
+	{
+		size >>= 1;
+		++numMips;
+	}
+
+	return numMips;
+}
+
+void VolumeMipChain::Downsample(const VolumeGrid& src, VolumeGrid& dst, uint32_t numThreads)
+{
+	dst.Resize((max)(src.Width >> 1, 1u), (max)(src.Height >> 1, 1u), (max)(src.Depth >> 1, 1u));
+
+	// 2x2x2 box; an odd edge texel of the source is covered by clamping
+	ParallelFor(dst.Depth, [&](uint32_t z)
+	{
+		for (auto y = 0u; y < dst.Height; ++y)
+		{
+			for (auto x = 0u; x < dst.Width; ++x)
+			{
+				auto sum = 0.0f;
+				for (auto k = 0; k < 2; ++k)
+					for (auto j = 0; j < 2; ++j)
+						for (auto i = 0; i < 2; ++i)
+							sum += src.Fetch(2 * x + i, 2 * y + j, 2 * z + k);
+
+				dst.At(x, y, z) = sum / 8.0f;
+			}
+		}
+	}, numThreads);
+}
+
+void VolumeMipChain::pack(float densityScale, uint32_t numThreads)
+{
+	m_texelOffsets.resize(m_levels.size());
+	size_t numTexels = 0;
+	for (size_t i = 0; i < m_levels.size(); ++i)
+	{
+		m_texelOffsets[i] = numTexels;
+		numTexels += 4 * m_levels[i].GetNumVoxels();
+	}
+
+	// The color channels are white, as the GPU expansion writes them
+	m_texels.resize(numTexels);
+	const auto one = FloatToHalf(1.0f);
+	for (size_t i = 0; i < m_levels.size(); ++i)
+	{
+		const auto& level = m_levels[i];
+		const auto pTexels = &m_texels[m_texelOffsets[i]];
+		const auto sliceSize = static_cast<size_t>(level.Width) * level.Height;
+		ParallelFor(level.Depth, [&](uint32_t z)
+		{
+			for (auto j = sliceSize * z; j < sliceSize * (z + 1); ++j)
+			{
+				pTexels[4 * j] = pTexels[4 * j + 1] = pTexels[4 * j + 2] = one;
+				pTexels[4 * j + 3] = FloatToHalf(level.Voxels[j] * densityScale);
+			}
+		}, numThreads);
+	}
+}
+
+void VolumeMipChain::getTaps(uint32_t srcSize, uint32_t size, uint32_t levelSize, vector<Tap>& taps)
+{
+	// Source texels and weights of each level-1 texel along an axis: the average of the
+	// linear interpolations at its two top-level texel centers, clamped to edge
+	taps.resize(4 * levelSize);
+	for (auto i = 0u; i < levelSize; ++i)
+	{
+		for (auto j = 0u; j < 2; ++j)
+		{
+			const auto x = (2 * i + j + 0.5f) / size * srcSize - 0.5f;
+			const auto x0 = floorf(x);
+			const auto f = x - x0;
+			const auto first = static_cast<int32_t>(x0);
+			const auto last = static_cast<int32_t>(srcSize) - 1;
+			taps[4 * i + 2 * j] = { static_cast<uint32_t>((min)((max)(first, 0), last)), 0.5f * (1.0f - f) };
+			taps[4 * i + 2 * j + 1] = { static_cast<uint32_t>((min)((max)(first + 1, 0), last)), 0.5f * f };
+		}
+	}
+}
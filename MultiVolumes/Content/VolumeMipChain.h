@@ -0,0 +1,51 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VolumeGrid.h"
+
+//--------------------------------------------------------------------------------------
+// Coarse mip levels of the expanded size^3 grid of a source volume.
+// The top level is resampled from the source on the GPU; level 1 box-filters 2x2x2
+// trilinear samples of the source at the top-level texel centers, so it matches what
+// the GPU expands, and every further level box-filters the previous one. The levels are
+// also packed as the RGBA16F texels of the expanded grid for uploading.
+//--------------------------------------------------------------------------------------
+class VolumeMipChain
+{
+public:
+	VolumeMipChain();
+	virtual ~VolumeMipChain();
+
+	// densityScale maps source densities to the alpha channel of the expanded grid
+	void Build(const VolumeGrid& grid, uint32_t size, float densityScale, uint32_t numThreads = 0);
+
+	uint32_t GetSize() const;
+	uint32_t GetNumLevels() const;	// Including the top level
+	const VolumeGrid& GetLevel(uint32_t level) const;	// For level >= 1
+
+	// RGBA16F texels of levels 1 to GetNumLevels() - 1, level after level
+	const uint16_t* GetTexels(uint32_t level) const;
+	size_t GetTexelDataByteSize() const;
+
+	static uint32_t GetNumMips(uint32_t size);
+	static void Downsample(const VolumeGrid& src, VolumeGrid& dst, uint32_t numThreads = 0);
+
+protected:
+	struct Tap
+	{
+		uint32_t Index;
+		float Weight;
+	};
+
+	void pack(float densityScale, uint32_t numThreads);
+
+	static void getTaps(uint32_t srcSize, uint32_t size, uint32_t levelSize, std::vector<Tap>& taps);
+
+	uint32_t m_size;
+	std::vector<VolumeGrid> m_levels;	// m_levels[0] is level 1
+	std::vector<size_t> m_texelOffsets;
+	std::vector<uint16_t> m_texels;
+};
@@ -0,0 +1,128 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "VolumeLoader.h"
+#include "VolumeMipChain.h"
+#include "ToolCheck.h"
+
+using namespace std;
+
+// Builds the mip chain of the expanded grid, checks that each level keeps the mean
+// density, and compares light-ray transmittance through every level with the top level
+int MipStats(int argc, char* argv[])
+{
+	auto size = 128u;
+	auto numSamples = 96u;
+	auto numDirs = 64u;
+	auto numThreads = 0u;
+	ToolArgs args;
+	args.Add("-size", size, 1);
+	args.Add("-samples", numSamples, 1);
+	args.Add("-rays", numDirs, 1);
+	args.Add("-threads", numThreads);
+	vector<const char*> files;
+	if (!args.Parse(argc, argv, &files, 1, 1)) return EXIT_FAILURE;
+
+	LoadedVolume volume;
+	VolumeGrid grid;
+	if (!VolumeLoader::Decode(files[0], volume))
+	{
+		fprintf(stderr, "Failed to read volume %s\n", files[0]);
+
+		return EXIT_FAILURE;
+	}
+	VolumeLoader::ExpandGrid(volume, grid, 0);
+
+	const auto start = chrono::steady_clock::now();
+	VolumeMipChain mips;
+	mips.Build(grid, size, g_gridDensityScale, numThreads);
+	const auto buildTime = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+	// The top level, as the GPU expands it
+	VolumeGrid top;
+	top.Resize(size, size, size);
+	for (auto z = 0u; z < size; ++z)
+		for (auto y = 0u; y < size; ++y)
+			for (auto x = 0u; x < size; ++x)
+				top.At(x, y, z) = grid.Sample((x + 0.5f) / size, (y + 0.5f) / size, (z + 0.5f) / size);
+
+	const auto getMean = [](const VolumeGrid& level)
+	{
+		auto sum = 0.0;
+		for (const auto& value : level.Voxels) sum += value;
+
+		return sum / level.GetNumVoxels();
+	};
+
+	const auto numLevels = mips.GetNumLevels();
+	const auto topMean = getMean(top);
+	printf("Volume: %ux%ux%u, expanded to %u^3 with %u levels\n", grid.Width, grid.Height, grid.Depth, size, numLevels);
+	printf("Coarse levels: %.2f ms, %.2f MB of RGBA16F texels\n", buildTime,
+		mips.GetTexelDataByteSize() / (1024.0 * 1024.0));
+
+	// Light rays from a sphere of directions, each with a 16x16 grid of parallel rays
+	const auto numOffsets = 16u;
+	const auto goldenAngle = 3.14159265f * (3.0f - sqrtf(5.0f));
+	vector<float> rayOrigins, rayDirs, topTransms;
+	for (auto d = 0u; d < numDirs; ++d)
+	{
+		const auto z = 1.0f - 2.0f * (d + 0.5f) / numDirs;
+		const auto r = sqrtf(1.0f - z * z);
+		const float rayDir[] = { r * cosf(goldenAngle * d), r * sinf(goldenAngle * d), z };
+
+		const float up[] = { fabsf(rayDir[2]) < 0.9f ? 0.0f : 1.0f, 0.0f, fabsf(rayDir[2]) < 0.9f ? 1.0f : 0.0f };
+		float u[] = { up[1] * rayDir[2] - up[2] * rayDir[1], up[2] * rayDir[0] - up[0] * rayDir[2], up[0] * rayDir[1] - up[1] * rayDir[0] };
+		const auto uLen = sqrtf(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+		for (auto& c : u) c /= uLen;
+		const float v[] = { rayDir[1] * u[2] - rayDir[2] * u[1], rayDir[2] * u[0] - rayDir[0] * u[2], rayDir[0] * u[1] - rayDir[1] * u[0] };
+
+		for (auto j = 0u; j < numOffsets; ++j)
+			for (auto i = 0u; i < numOffsets; ++i)
+			{
+				const auto a = sqrtf(3.0f) * (2.0f * (i + 0.5f) / numOffsets - 1.0f);
+				const auto b = sqrtf(3.0f) * (2.0f * (j + 0.5f) / numOffsets - 1.0f);
+				float rayOrigin[3];
+				for (auto k = 0u; k < 3; ++k) rayOrigin[k] = a * u[k] + b * v[k] - 3.0f * rayDir[k];
+				if (!ComputeRayOrigin(rayOrigin, rayDir)) continue;
+
+				rayOrigins.insert(rayOrigins.end(), rayOrigin, rayOrigin + 3);
+				rayDirs.insert(rayDirs.end(), rayDir, rayDir + 3);
+				topTransms.emplace_back(CastLightRay(top, rayOrigin, rayDir, numSamples, 0));
+			}
+	}
+
+	printf("Level  Size  Mean drift  Samples/ray  Transm. error (mean / max)\n");
+	auto isMeanKept = true;
+	for (auto i = 0u; i < numLevels; ++i)
+	{
+		const auto& level = i > 0 ? mips.GetLevel(i) : top;
+		const auto drift = topMean > 0.0 ? getMean(level) / topMean - 1.0 : 0.0;
+
+		auto sumError = 0.0;
+		auto maxError = 0.0f;
+		for (size_t r = 0; r < topTransms.size(); ++r)
+		{
+			const auto error = fabsf(CastLightRay(level, &rayOrigins[3 * r], &rayDirs[3 * r], numSamples, i) - topTransms[r]);
+			sumError += error;
+			maxError = (max)(error, maxError);
+		}
+
+		printf("%5u %5u  %+9.2e%%  %11u  %.4f / %.4f\n", i, level.Width, 100.0 * drift, (max)(numSamples >> i, 1u),
+			topTransms.empty() ? 0.0 : sumError / topTransms.size(), maxError);
+
+		// Box filters keep the mean of power-of-two levels
+		if ((level.Width << i) == size && fabs(drift) > 1.0e-3) isMeanKept = false;
+	}
+
+	CheckReport report;
+	report.Expect("Mean density kept", isMeanKept);
+
+	return report.Finish();
+}
@@ -0,0 +1,222 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include "VolumeSequence.h"
+
+using namespace std;
+
+VolumeSequence::VolumeSequence() :
+	m_desc(),
+	m_playhead(0),
+	m_shown(NoFrame),
+	m_stats()
+{
+}
+
+VolumeSequence::~VolumeSequence()
+{
+	Stop();
+}
+
+bool VolumeSequence::Start(const Path* pFrameFiles, uint32_t numFrames, const Desc& desc)
+{
+	Stop();
+	if (numFrames == 0 || desc.RingSize == 0) return false;
+
+	m_desc = desc;
+	m_frameFiles.assign(pFrameFiles, pFrameFiles + numFrames);
+	m_ring.resize(desc.RingSize);
+	for (auto& entry : m_ring) entry.State = ENTRY_EMPTY;
+	m_playhead = 0;
+	m_shown = NoFrame;
+	m_stats = {};
+
+	if (!m_loader.Start(nullptr, 0, desc.NumThreads, desc.MacroCellMargin,
+		desc.MipGridSize, desc.MipDensityScale)) return false;
+	request();
+
+	return true;
+}
+
+void VolumeSequence::Stop()
+{
+	m_loader.Stop();
+	m_ring.clear();
+}
+
+void VolumeSequence::Update(uint64_t playhead)
+{
+	if (m_ring.empty()) return;
+
+	const auto numFrames = static_cast<uint64_t>(m_frameFiles.size());
+	m_playhead = m_desc.Loop ? playhead : (min)(playhead, numFrames - 1);
+
+	land();
+	if (isAfterShown(m_playhead) && !findNext()) ++m_stats.Late;
+	request();
+}
+
+bool VolumeSequence::TryTake(unique_ptr<LoadedVolume>& frame)
+{
+	const auto pEntry = findNext();
+	if (!pEntry) return false;
+
+	if (m_shown != NoFrame) m_stats.Skipped += pEntry->Frame - m_shown - 1;
+	++m_stats.Shown;
+	if (pEntry->Volume->Succeeded) m_stats.DecodedBytes += VolumeLoader::GetStoredByteSize(*pEntry->Volume);
+
+	m_shown = pEntry->Frame;
+	frame = move(pEntry->Volume);
+	pEntry->State = ENTRY_EMPTY;
+
+	// The ring moves on past the frame taken
+	request();
+
+	return true;
+}
+
+uint64_t VolumeSequence::GetShownFrame() const
+{
+	return m_shown;
+}
+
+uint32_t VolumeSequence::GetFileIndex(uint64_t frame) const
+{
+	return static_cast<uint32_t>(frame % m_frameFiles.size());
+}
+
+uint32_t VolumeSequence::GetNumFrames() const
+{
+	return static_cast<uint32_t>(m_frameFiles.size());
+}
+
+uint32_t VolumeSequence::GetNumReady() const
+{
+	return static_cast<uint32_t>(count_if(m_ring.cbegin(), m_ring.cend(),
+		[](const RingEntry& entry) { return entry.State == ENTRY_READY; }));
+}
+
+const VolumeSequence::Stats& VolumeSequence::GetStats() const
+{
+	return m_stats;
+}
+
+uint64_t VolumeSequence::GetFrameAt(double time, float frameRate)
+{
+	return static_cast<uint64_t>((max)(floor(time * frameRate), 0.0));
+}
+
+bool VolumeSequence::ReadList(const Path& fileName, vector<Path>& frameFiles, float& frameRate)
+{
+	ifstream fileStream(fileName);
+	if (!fileStream) return false;
+
+	frameFiles.clear();
+	string line;
+	while (getline(fileStream, line))
+	{
+		const auto first = line.find_first_not_of(" \t\r");
+		if (first == string::npos || line[first] == '#') continue;
+
+		const auto last = line.find_last_not_of(" \t\r");
+		if (line.compare(first, 4, "fps ") == 0) frameRate = stof(line.substr(first + 4));
+		else frameFiles.emplace_back(line.cbegin() + first, line.cbegin() + last + 1);
+	}
+
+	return !frameFiles.empty() && frameRate > 0.0f;
+}
+
+void VolumeSequence::land()
+{
+	unique_ptr<LoadedVolume> volume;
+	while (m_loader.TryPop(volume))
+	{
+		auto isLanded = false;
+		for (auto& entry : m_ring)
+		{
+			if (entry.State == ENTRY_PENDING && static_cast<uint32_t>(entry.Frame) == volume->Index)
+			{
+				entry.Volume = move(volume);
+				entry.State = ENTRY_READY;
+				isLanded = true;
+				break;
+			}
+		}
+
+		// Its entry no longer waits for it
+		if (!isLanded) ++m_stats.Dropped;
+	}
+}
+
+void VolumeSequence::request()
+{
+	// The window starts at the next frame to show: the newest decoded one up to the playhead,
+	// if any, since the frames before it would be skipped anyway; otherwise the frame at the
+	// playhead, or the one after the shown frame when the playhead has not moved on
+	const auto pNext = findNext();
+	auto start = m_shown == NoFrame ? 0 : m_shown + 1;
+	start = pNext ? pNext->Frame : (max)(m_playhead, start);
+	const auto ringSize = static_cast<uint64_t>(m_ring.size());
+
+	// Evict the decoded frames outside the window
+	auto hasStale = false;
+	for (auto& entry : m_ring)
+	{
+		if (entry.State == ENTRY_EMPTY || (entry.Frame >= start && entry.Frame < start + ringSize)) continue;
+		if (entry.State == ENTRY_PENDING) hasStale = true;
+		else
+		{
+			++m_stats.Dropped;
+			entry.Volume.reset();
+			entry.State = ENTRY_EMPTY;
+		}
+	}
+
+	// Requests that no worker has started are reissued in window order, without the stale ones.
+	// The stale frames being decoded keep their entries; they may still be the newest up to
+	// the playhead when they land, and they bound the frames in flight to the ring size.
+	if (hasStale)
+	{
+		vector<uint32_t> canceled;
+		m_loader.CancelRequests(canceled);
+		for (const auto& index : canceled)
+			for (auto& entry : m_ring)
+				if (entry.State == ENTRY_PENDING && static_cast<uint32_t>(entry.Frame) == index)
+					entry.State = ENTRY_EMPTY;
+	}
+
+	const auto numFrames = static_cast<uint64_t>(m_frameFiles.size());
+	for (auto frame = start; frame < start + ringSize; ++frame)
+	{
+		if (!m_desc.Loop && frame >= numFrames) break;
+
+		// Taken by this frame, or by a stale one being decoded
+		auto& entry = m_ring[frame % ringSize];
+		if (entry.State != ENTRY_EMPTY) continue;
+
+		entry.Frame = frame;
+		entry.State = ENTRY_PENDING;
+		m_loader.Request(m_frameFiles[GetFileIndex(frame)], static_cast<uint32_t>(frame));
+	}
+}
+
+VolumeSequence::RingEntry* VolumeSequence::findNext()
+{
+	RingEntry* pNext = nullptr;
+	for (auto& entry : m_ring)
+	{
+		if (entry.State != ENTRY_READY || !isAfterShown(entry.Frame) || entry.Frame > m_playhead) continue;
+		if (!pNext || entry.Frame > pNext->Frame) pNext = &entry;
+	}
+
+	return pNext;
+}
+
+bool VolumeSequence::isAfterShown(uint64_t frame) const
+{
+	return m_shown == NoFrame || frame > m_shown;
+}
@@ -0,0 +1,94 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VolumeLoader.h"
+
+//--------------------------------------------------------------------------------------
+// Playback of an animated volume sequence, one volume file per frame.
+// Frames are numbered on the playback timeline, looping over the files. The frames after
+// the playhead are decoded ahead on a worker pool into a ring of RingSize frames, and
+// TryTake() hands out the newest decoded frame up to the playhead, so the consumer swaps
+// whole frames and holds the previous one when decoding falls behind. It has no graphics
+// API dependency.
+//--------------------------------------------------------------------------------------
+class VolumeSequence
+{
+public:
+	using Path = VolumeLoader::Path;
+
+	struct Desc
+	{
+		uint32_t RingSize;			// Frames decoded ahead of the playhead
+		bool Loop;					// Otherwise the last frame holds
+		uint32_t NumThreads;		// 0 for the default of VolumeLoader
+		float MacroCellMargin;
+		uint32_t MipGridSize;
+		float MipDensityScale;
+	};
+
+	struct Stats
+	{
+		uint64_t Shown;				// Frames taken
+		uint64_t Skipped;			// Frames the playhead passed before they were decoded
+		uint64_t Late;				// Updates with the playhead ahead of the shown frame and nothing to show
+		uint64_t Dropped;			// Decoded frames that fell out of the ring
+		uint64_t DecodedBytes;		// Of the frames taken, as stored in their files
+	};
+
+	static const uint64_t NoFrame = UINT64_MAX;
+
+	VolumeSequence();
+	virtual ~VolumeSequence();
+
+	bool Start(const Path* pFrameFiles, uint32_t numFrames, const Desc& desc);
+	void Stop();
+
+	// Lands the decoded frames, and requests the frames of the ring after the playhead
+	void Update(uint64_t playhead);
+
+	// The newest decoded frame after the last one taken, up to the playhead; false if none
+	bool TryTake(std::unique_ptr<LoadedVolume>& frame);
+
+	uint64_t GetShownFrame() const;	// On the timeline, NoFrame before the first
+	uint32_t GetFileIndex(uint64_t frame) const;
+	uint32_t GetNumFrames() const;
+	uint32_t GetNumReady() const;
+	const Stats& GetStats() const;
+
+	static uint64_t GetFrameAt(double time, float frameRate);
+
+	// Sequence list (.vseq): one frame file per line, and optionally "fps <rate>", else
+	// frameRate is kept; blank lines and lines starting with '#' are skipped
+	static bool ReadList(const Path& fileName, std::vector<Path>& frameFiles, float& frameRate);
+
+protected:
+	enum EntryState : uint8_t
+	{
+		ENTRY_EMPTY,
+		ENTRY_PENDING,
+		ENTRY_READY
+	};
+
+	struct RingEntry
+	{
+		uint64_t Frame;
+		EntryState State;
+		std::unique_ptr<LoadedVolume> Volume;
+	};
+
+	void land();
+	void request();
+	RingEntry* findNext();
+	bool isAfterShown(uint64_t frame) const;
+
+	Desc m_desc;
+	std::vector<Path> m_frameFiles;
+	std::vector<RingEntry> m_ring;	// Frame f lives in entry f % RingSize
+	VolumeLoader m_loader;
+	uint64_t m_playhead;
+	uint64_t m_shown;
+	Stats m_stats;
+};
@@ -0,0 +1,140 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "VolumeSequence.h"
+#include "ToolCheck.h"
+
+using namespace std;
+
+struct SequenceRunResult
+{
+	double Seconds;
+	VolumeSequence::Stats Stats;
+};
+
+// Plays numFrames frames of the sequence; with a frame rate, the playhead follows the clock
+// and is polled at the render rate, otherwise it moves on as soon as each frame is taken
+static SequenceRunResult runSequence(VolumeSequence& sequence, uint32_t numFrames, float frameRate, float renderRate)
+{
+	const auto start = chrono::steady_clock::now();
+	const auto tick = chrono::duration<double>(1.0 / renderRate);
+	auto nextTick = start;
+	uint64_t playhead = 0;
+	unique_ptr<LoadedVolume> frame;
+	while (sequence.GetShownFrame() == VolumeSequence::NoFrame || sequence.GetShownFrame() + 1 < numFrames)
+	{
+		if (frameRate > 0.0f)
+		{
+			nextTick += chrono::duration_cast<chrono::steady_clock::duration>(tick);
+			this_thread::sleep_until(nextTick);
+			const auto time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			playhead = (min)(VolumeSequence::GetFrameAt(time, frameRate), static_cast<uint64_t>(numFrames - 1));
+		}
+
+		sequence.Update(playhead);
+		if (sequence.TryTake(frame))
+		{
+			if (frameRate <= 0.0f) playhead = sequence.GetShownFrame() + 1;
+		}
+		else if (frameRate <= 0.0f) this_thread::yield();
+	}
+
+	SequenceRunResult result;
+	result.Seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	result.Stats = sequence.GetStats();
+
+	return result;
+}
+
+// Streams a volume sequence through the prefetch ring, as the renderer plays it back:
+// first as fast as the frames decode, then at a frame rate against a render loop
+int BenchSequence(int argc, char* argv[])
+{
+	vector<VolumeSequence::Path> frameFiles;
+	auto frameRate = 0.0f;
+	auto renderRate = 60.0f;
+	auto numFrames = 0u;
+	auto mipGridSize = 0u;
+	VolumeSequence::Desc desc = {};
+	desc.RingSize = 4;
+	desc.Loop = true;
+	desc.MipDensityScale = g_gridDensityScale;
+	ToolArgs args;
+	args.Add("-frames", numFrames);
+	args.Add("-ring", desc.RingSize, 1);
+	args.Add("-threads", desc.NumThreads);
+	args.Add("-size", mipGridSize);
+	args.Add("-fps", frameRate);
+	args.Add("-renderHz", [&renderRate](const char* arg) { renderRate = (max)(stof(arg), 1.0f); });
+	vector<const char*> files;
+	if (!args.Parse(argc, argv, &files, 1)) return EXIT_FAILURE;
+
+	for (const auto& file : files)
+	{
+		if (HasExtension(file, ".vseq"))
+		{
+			vector<VolumeSequence::Path> listFiles;
+			auto listFrameRate = frameRate;
+			if (!VolumeSequence::ReadList(file, listFiles, listFrameRate))
+			{
+				fprintf(stderr, "Failed to read %s.\n", file);
+
+				return EXIT_FAILURE;
+			}
+			frameFiles.insert(frameFiles.end(), listFiles.cbegin(), listFiles.cend());
+			frameRate = frameRate > 0.0f ? frameRate : listFrameRate;
+		}
+		else frameFiles.emplace_back(file);
+	}
+
+	if (frameFiles.empty())
+	{
+		PrintUsage();
+
+		return EXIT_FAILURE;
+	}
+
+	// The derived data that the renderer needs are built on the workers as well
+	desc.MipGridSize = mipGridSize;
+	desc.MacroCellMargin = mipGridSize > 0 ? 1.0f / mipGridSize : 0.0f;
+	numFrames = numFrames > 0 ? numFrames : 4 * static_cast<uint32_t>(frameFiles.size());
+
+	printf("%u frames over %zu files, ring of %u, %s threads\n", numFrames, frameFiles.size(), desc.RingSize,
+		desc.NumThreads > 0 ? to_string(desc.NumThreads).c_str() : "default");
+
+	CheckReport report;
+	for (const auto rate : { 0.0f, frameRate })
+	{
+		VolumeSequence sequence;
+		if (!sequence.Start(frameFiles.data(), static_cast<uint32_t>(frameFiles.size()), desc))
+		{
+			fprintf(stderr, "Failed to start the sequence.\n");
+
+			return EXIT_FAILURE;
+		}
+
+		const auto result = runSequence(sequence, numFrames, rate, renderRate);
+		const auto& stats = result.Stats;
+		if (rate <= 0.0f) printf("unthrottled: ");
+		else printf("%.1f fps at %.0f Hz: ", rate, renderRate);
+		printf("%8.1f frames/s, %8.1f MB/s, %llu shown, %llu skipped, %llu late updates, %llu dropped\n",
+			stats.Shown / result.Seconds, stats.DecodedBytes / result.Seconds / (1024.0 * 1024.0),
+			static_cast<unsigned long long>(stats.Shown), static_cast<unsigned long long>(stats.Skipped),
+			static_cast<unsigned long long>(stats.Late), static_cast<unsigned long long>(stats.Dropped));
+
+		// Unthrottled, every frame is shown in order
+		if (rate <= 0.0f) report.Expect("Every frame shown in order", stats.Shown == numFrames && stats.Skipped == 0);
+		if (frameRate <= 0.0f) break;
+	}
+
+	return report.Finish();
+}
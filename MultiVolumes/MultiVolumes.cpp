@@ -13,6 +13,7 @@
 #include "MultiVolumes.h"
 #include "stb_image_write.h"
 #include <DirectXColors.h>
+#include <fstream>
 
 using namespace std;
 using namespace XUSG;
@@ -24,9 +25,17 @@ const auto g_backFormat = Format::R8G8B8A8_UNORM;
 const auto g_rtFormat = Format::R16G16B16A16_FLOAT;
 const auto g_dsFormat = Format::D32_FLOAT;
 
+const uint32_t g_numCostMeasurements = 240;	// Timed frames of -calibrateCost
+
 MultiVolumes::MultiVolumes(uint32_t width, uint32_t height, std::wstring name) :
 	DXFramework(width, height, name),
 	m_frameIndex(0),
+	m_copyFenceValue(0),
+	m_placeholderSlot(0),
+	m_playbackTime(0.0),
+	m_frameWorks(),
+	m_isFrameTimed(),
+	m_timestampFreq(0),
 	m_deviceType(DEVICE_DISCRETE),
 	m_oitMethod(MultiRayCaster::OIT_RAY_QUERY),
 	m_useWorkGraph(false),
@@ -34,16 +43,26 @@ MultiVolumes::MultiVolumes(uint32_t width, uint32_t height, std::wstring name) :
 	m_showMesh(false),
 	m_showFPS(true),
 	m_isPaused(false),
+	m_syncLoad(false),
+	m_calibrateCost(false),
 	m_tracking(false),
 	m_gridSize(128),
-	m_lightGridSize(96),
+	m_lightGridSize(128),
 	m_maxRaySamples(256),
 	m_maxLightSamples(96),
+	m_lightMapUpdates(1),
 	m_numVolumes(2),
+	m_residencyBudget(0),
+	m_sampleBudget(0),
+	m_sampleBudgetMs(0.0f),
+	m_costProfileFile("CostProfile.txt"),
 	m_radianceFile(L"Assets/LA_Radiance.dds"),
 	m_meshFileName("Assets/bunny.obj"),
 	m_volPosScale(0.0f, 0.0f, 0.0f, 10.0f),
 	m_meshPosScale(0.0f, -9.0f, 0.0f, 1.8f),
+	m_lightPt(75.0f, 75.0f, -75.0f),
+	m_lightColor(1.0f, 0.7f, 0.3f, 3.0f * XM_PI),
+	m_ambientColor(0.4f, 0.6f, 1.0f, 2.0f * XM_PI),
 	m_screenShot(0)
 {
 #if defined (_DEBUG)
@@ -55,16 +74,19 @@ MultiVolumes::MultiVolumes(uint32_t width, uint32_t height, std::wstring name) :
 	freopen_s(&stream, "CONOUT$", "w+t", stderr);
 #endif
 
-	m_volumeFiles[0] = L"Assets/bunny.dds";
-	m_volumeFiles[1] = L"Assets/buddha.dds";
-	m_volumeFiles[2] = L"Assets/dragon.dds";
-	m_volumeFiles[3] = L"Assets/Eagle.dds";
-	m_volumeFiles[4] = L"Assets/Jacquemart.dds";
-	m_volumeFiles[5] = L"Assets/lucy.dds";
-	m_volumeFiles[6] = L"Assets/penelope.dds";
-	m_volumeFiles[7] = L"Assets/Cloud1.dds";
-	m_volumeFiles[8] = L"Assets/Cloud2.dds";
-	m_volumeFiles[9] = L"Assets/Devil.dds";
+	m_volumeFiles =
+	{
+		L"Assets/bunny.dds",
+		L"Assets/buddha.dds",
+		L"Assets/dragon.dds",
+		L"Assets/Eagle.dds",
+		L"Assets/Jacquemart.dds",
+		L"Assets/lucy.dds",
+		L"Assets/penelope.dds",
+		L"Assets/Cloud1.dds",
+		L"Assets/Cloud2.dds",
+		L"Assets/Devil.dds"
+	};
 }
 
 MultiVolumes::~MultiVolumes()
@@ -160,6 +182,14 @@ void MultiVolumes::LoadPipeline()
 	XUSG_N_RETURN(m_commandQueue->Create(m_device.get(), CommandListType::DIRECT, CommandQueueFlag::NONE,
 		0, 0, L"CommandQueue"), ThrowIfFailed(E_FAIL));
 
+	// Create the copy queue for asynchronous volume uploads.
+	m_copyQueue = CommandQueue::MakeUnique();
+	XUSG_N_RETURN(m_copyQueue->Create(m_device.get(), CommandListType::COPY, CommandQueueFlag::NONE,
+		0, 0, L"CopyQueue"), ThrowIfFailed(E_FAIL));
+
+	m_copyAllocator = CommandAllocator::MakeUnique();
+	XUSG_N_RETURN(m_copyAllocator->Create(m_device.get(), CommandListType::COPY, L"CopyAllocator"), ThrowIfFailed(E_FAIL));
+
 	// Create the swap chain.
 	CreateSwapchain();
 
@@ -190,15 +220,60 @@ void MultiVolumes::LoadAssets()
 	// Create ray tracing interfaces
 	XUSG_N_RETURN(m_commandList->CreateInterface(), ThrowIfFailed(E_FAIL));
 
+	// A scene replaces the sources of the list, and the instances and lights of the other settings
+	LoadVolumeList();
+	vector<XMFLOAT3X4> volumeWorlds;
+	vector<float> sampleScales;
+	LoadScene(volumeWorlds, sampleScales);
+	LoadSequences();
+
 	// Clear color setting
+	const auto hasVolumeFiles = !m_volumeFiles.empty() && !m_volumeFiles[0].empty();
 	m_clearColor = { 0.2f, 0.2f, 0.2f, 0.0f };
-	m_clearColor = m_volumeFiles->empty() ? m_clearColor : DirectX::Colors::Transparent;
+	m_clearColor = hasVolumeFiles ? DirectX::Colors::Transparent : m_clearColor;
 	m_clearColor.v = XMVectorPow(m_clearColor, XMVectorReplicate(1.0f / 1.25f));
 	m_clearColor.v = 0.7f * m_clearColor / (XMVectorReplicate(1.25f) - m_clearColor);
 	m_clearColor.f[3] = 0.0f;
 
+	// The static sources share a pool of GPU slots within the residency budget, plus a
+	// placeholder slot for the instances whose sources are not resident, and the sequences
+	// have two slots each on top
+	auto numVolumeSlots = 1u;
+	if (hasVolumeFiles)
+	{
+		const auto numSources = static_cast<uint32_t>(m_volumeFiles.size());
+		const auto slotByteSize = MultiRayCaster::GetVolumeByteSize(m_gridSize);
+
+		// Without a scene, the instances cycle through the sources
+		if (m_instanceSources.empty())
+		{
+			m_instanceSources.resize(m_numVolumes);
+			for (auto i = 0u; i < m_numVolumes; ++i) m_instanceSources[i] = i % numSources;
+		}
+
+		ResidencyManager::Desc desc = {};
+		desc.NumSources = numSources;
+		desc.SlotByteSize = slotByteSize;
+		desc.BudgetBytes = m_residencyBudget > 0 ? (max)(m_residencyBudget, 2 * slotByteSize) - slotByteSize : slotByteSize * numSources;
+		desc.MaxSlots = (1u << 14) - 1 - 2 * static_cast<uint32_t>(m_sequences.size());	// VolumeDesc::VolTexId has 14 bits
+		desc.MaxLoadsPerFrame = 4;
+		desc.CoverageWeight = 16.0f;	// A volume filling the 1280x800 window (20 doublings) outlives a 32x32 one (10) by 160 frames, ~2.7 s at 60 Hz, a look away and back
+		m_residency = make_unique<ResidencyManager>();
+		XUSG_N_RETURN(m_residency->Init(desc), ThrowIfFailed(E_FAIL));
+
+		m_placeholderSlot = m_residency->GetNumSlots();
+		numVolumeSlots = m_placeholderSlot + 1;
+		for (auto& sequence : m_sequences)
+		{
+			sequence.Slots[0] = numVolumeSlots++;
+			sequence.Slots[1] = numVolumeSlots++;
+		}
+	}
+
+	// Per slot: the SRV, the UAVs of the mips, and the versions of the source tables
+	const auto numSlotDescriptors = VolumeMipChain::GetNumMips(m_gridSize) + 1 + 2 * MultiRayCaster::FrameCount;
 	vector<Resource::uptr> uploaders(0);
-	m_descriptorTableLib->AllocateDescriptorHeap(CBV_SRV_UAV_HEAP, 1600);
+	m_descriptorTableLib->AllocateDescriptorHeap(CBV_SRV_UAV_HEAP, 1600 + numSlotDescriptors * numVolumeSlots);
 
 	if (!m_radianceFile.empty())
 	{
@@ -211,28 +286,93 @@ void MultiVolumes::LoadAssets()
 	XUSG_N_RETURN(m_objectRenderer->Init(m_commandList.get(), m_descriptorTableLib, uploaders,
 		m_meshFileName.c_str(), g_backFormat, g_rtFormat, g_dsFormat, m_meshPosScale), ThrowIfFailed(E_FAIL));
 
-	const auto numVolumeSrcs = static_cast<uint32_t>(size(m_volumeFiles));
-
 	GeometryBuffer geometry;
 	m_rayCaster = make_unique<MultiRayCaster>();
 	if (!m_rayCaster) ThrowIfFailed(E_FAIL);
 	if (!m_rayCaster->Init(pCommandList, m_descriptorTableLib, g_rtFormat, g_dsFormat,
-		m_gridSize, m_lightGridSize, m_numVolumes, numVolumeSrcs, uploaders,
-		&geometry, m_dxrSupport, m_workGraphSupport)) ThrowIfFailed(E_FAIL);
-	const auto volumeSize = m_volPosScale.w * 2.0f;
-	const auto volumePos = XMFLOAT3(m_volPosScale.x, m_volPosScale.y, m_volPosScale.z);
-	m_rayCaster->SetVolumesWorld(volumeSize, volumePos);
-	m_rayCaster->SetMaxSamples(m_maxRaySamples, m_maxLightSamples);
-
-	if (m_volumeFiles->empty())
+		m_gridSize, m_lightGridSize, m_numVolumes, numVolumeSlots, uploaders,
+		&geometry, m_dxrSupport, m_workGraphSupport, volumeWorlds.empty() ? nullptr : volumeWorlds.data())) ThrowIfFailed(E_FAIL);
+	if (volumeWorlds.empty())
 	{
-		for (auto i = 0u; i < numVolumeSrcs; ++i)
-			m_rayCaster->InitVolumeData(pCommandList, i);
+		const auto volumeSize = m_volPosScale.w * 2.0f;
+		const auto volumePos = XMFLOAT3(m_volPosScale.x, m_volPosScale.y, m_volPosScale.z);
+		m_rayCaster->SetVolumesWorld(volumeSize, volumePos);
 	}
+	for (auto i = 0u; i < sampleScales.size(); ++i) m_rayCaster->SetVolumeSampleScale(i, sampleScales[i]);
+	m_rayCaster->SetMaxSamples(m_maxRaySamples, m_maxLightSamples);
+	m_rayCaster->SetLightMapUpdates(m_lightMapUpdates);
+
+	// Path costs of the profile, if any; a time budget is converted by the direct-path cost
+	m_costModel.Load(m_costProfileFile.c_str());
+	const auto& pathCosts = m_costModel.GetWeights();
+	m_rayCaster->SetPathCosts(pathCosts);
+	if (m_sampleBudgetMs > 0.0f)
+		m_sampleBudget = SampleBudget::GetBudgetForTime(m_sampleBudgetMs, 1.0e6f / (max)(pathCosts.RayCast, 1.0e-6f));
+	m_rayCaster->SetSampleBudget(m_sampleBudget);
+	if (m_calibrateCost) CreateCostTimer();
+
+	if (!hasVolumeFiles) m_rayCaster->InitVolumeData(pCommandList, 0);
 	else
 	{
-		for (auto i = 0u; i < numVolumeSrcs; ++i)
-			m_rayCaster->LoadVolumeData(pCommandList, i, m_volumeFiles[i].c_str(), uploaders);
+		// The procedural placeholder stays visible until the sources of the instances are resident
+		m_rayCaster->InitVolumeData(pCommandList, m_placeholderSlot);
+
+		// Sources are paged in asynchronously as they come into view
+		m_copyCommandList = CommandList::MakeUnique();
+		XUSG_N_RETURN(m_copyCommandList->Create(m_device.get(), 0, CommandListType::COPY,
+			m_copyAllocator.get(), nullptr), ThrowIfFailed(E_FAIL));
+		XUSG_N_RETURN(m_copyCommandList->Close(), ThrowIfFailed(E_FAIL));
+
+		m_copyFence = Fence::MakeUnique();
+		XUSG_N_RETURN(m_copyFence->Create(m_device.get(), m_copyFenceValue, FenceFlag::NONE, L"CopyFence"), ThrowIfFailed(E_FAIL));
+
+		m_volumeLoader = make_unique<VolumeLoader>();
+		XUSG_N_RETURN(m_volumeLoader->Start(nullptr, 0, 0, m_rayCaster->GetMacroCellMargin(),
+			m_rayCaster->GetGridSize(), m_rayCaster->GetGridDensityScale()), ThrowIfFailed(E_FAIL));
+
+		// Each sequence decodes a few frames ahead on workers of its own
+		VolumeSequence::Desc sequenceDesc = {};
+		sequenceDesc.RingSize = 4;
+		sequenceDesc.Loop = true;
+		sequenceDesc.NumThreads = 2;
+		sequenceDesc.MacroCellMargin = m_rayCaster->GetMacroCellMargin();
+		sequenceDesc.MipGridSize = m_rayCaster->GetGridSize();
+		sequenceDesc.MipDensityScale = m_rayCaster->GetGridDensityScale();
+		for (auto& sequence : m_sequences)
+		{
+			sequence.Player = make_unique<VolumeSequence>();
+			XUSG_N_RETURN(sequence.Player->Start(sequence.FrameFiles.data(),
+				static_cast<uint32_t>(sequence.FrameFiles.size()), sequenceDesc), ThrowIfFailed(E_FAIL));
+		}
+
+		if (m_syncLoad)
+		{
+			// Load the sources of the instances up front, as many as the slots hold
+			const auto numVolumes = m_rayCaster->GetNumVolumes();
+			auto hasLoads = true;
+			while (hasLoads)
+			{
+				m_residency->BeginFrame();
+				for (auto i = 0u; i < numVolumes; ++i)
+				{
+					const auto source = m_instanceSources[i];
+					if (m_sourceSequences[source] == NoSequence) m_residency->Touch(source, 0.0f);
+				}
+
+				m_residencyEvents.clear();
+				m_residency->Update(m_residencyEvents);
+				hasLoads = false;
+				for (const auto& e : m_residencyEvents)
+				{
+					if (e.Type != ResidencyManager::EVENT_LOAD) continue;
+					if (m_rayCaster->LoadVolumeData(pCommandList, e.Slot, ResolveVolumeFile(e.Source).c_str(), uploaders))
+						m_residency->MarkLoaded(e.Source);
+					hasLoads = true;
+				}
+			}
+		}
+
+		UpdateVolumeTexIds(pCommandList, uploaders);
 	}
 
 	// Close the command list and execute it to begin the initial GPU setup.
@@ -318,11 +458,13 @@ void MultiVolumes::OnUpdate()
 	static auto time = 0.0, pauseTime = 0.0;
 
 	m_timer.Tick();
+	if (m_calibrateCost) UpdateCostCalibration();
 	float timeStep;
 	const auto totalTime = CalculateFrameStats(&timeStep);
 	pauseTime = m_isPaused ? totalTime - time : pauseTime;
 	timeStep = m_isPaused ? 0.0f : timeStep;
 	time = totalTime - pauseTime;
+	m_playbackTime = time;
 
 	// Auto camera animation
 	if (m_animate)
@@ -336,14 +478,13 @@ void MultiVolumes::OnUpdate()
 		XMStoreFloat4x4(&m_view, view);
 	}
 
-	const XMFLOAT3 lightPt(75.0f, 75.0f, -75.0f);
-	const XMFLOAT3 lightColor(1.0f, 0.7f, 0.3f);
-	const XMFLOAT3 ambientColor(0.4f, 0.6f, 1.0f);
-	const auto lightIntensity = 3.0f * XM_PI, ambientIntensity = 2.0f * XM_PI;
-	m_objectRenderer->SetLight(lightPt, lightColor, lightIntensity);
-	m_objectRenderer->SetAmbient(ambientColor, ambientIntensity);
-	m_rayCaster->SetLight(lightPt, lightColor, lightIntensity);
-	m_rayCaster->SetAmbient(ambientColor, ambientIntensity);
+	const XMFLOAT3 lightColor(m_lightColor.x, m_lightColor.y, m_lightColor.z);
+	const XMFLOAT3 ambientColor(m_ambientColor.x, m_ambientColor.y, m_ambientColor.z);
+	m_objectRenderer->SetLight(m_lightPt, lightColor, m_lightColor.w);
+	m_objectRenderer->SetAmbient(ambientColor, m_ambientColor.w);
+	m_rayCaster->SetLight(m_lightPt, lightColor, m_lightColor.w);
+	m_rayCaster->SetLights(m_lights.data(), static_cast<uint32_t>(m_lights.size()));
+	m_rayCaster->SetAmbient(ambientColor, m_ambientColor.w);
 
 	// View
 	//const auto eyePt = XMLoadFloat3(&m_eyePt);
@@ -353,6 +494,13 @@ void MultiVolumes::OnUpdate()
 	m_objectRenderer->UpdateFrame(m_frameIndex, viewProj, m_eyePt);
 	if (m_lightProbe) m_lightProbe->UpdateFrame(m_frameIndex, viewProj, m_eyePt);
 	m_rayCaster->UpdateFrame(m_frameIndex, viewProj, m_objectRenderer->GetShadowVP(), m_eyePt);
+
+	// Work of the paths in this frame, against its GPU time once the slot comes back
+	if (m_calibrateCost)
+	{
+		m_frameWorks[m_frameIndex] = m_rayCaster->GetPathWork();
+		m_isFrameTimed[m_frameIndex] = true;
+	}
 }
 
 // Render the scene.
@@ -374,6 +522,13 @@ void MultiVolumes::OnDestroy()
 {
 	// Ensure that the GPU is no longer referencing resources that are about to be
 	// cleaned up by the destructor.
+	if (m_volumeLoader) m_volumeLoader->Stop();
+	for (auto& sequence : m_sequences) if (sequence.Player) sequence.Player->Stop();
+	if (m_copyFence && m_copyFence->GetCompletedValue() < m_copyFenceValue)
+	{
+		XUSG_N_RETURN(m_copyFence->SetEventOnCompletion(m_copyFenceValue, m_fenceEvent), ThrowIfFailed(E_FAIL));
+		WaitForSingleObject(m_fenceEvent, INFINITE);
+	}
 	WaitForGpu();
 
 	CloseHandle(m_fenceEvent);
@@ -589,16 +744,62 @@ void MultiVolumes::ParseCommandLineArgs(wchar_t* argv[], int argc)
 			if (i + 1 < argc) m_volPosScale.z = stof(argv[++i]);
 			if (i + 1 < argc) m_volPosScale.w = stof(argv[++i]);
 		}
+		else if (wcsncmp(argv[i], L"-volumeList", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/volumeList", wcslen(argv[i])) == 0)
+		{
+			if (i + 1 < argc) m_volumeListFile = argv[++i];
+		}
+		else if (wcsncmp(argv[i], L"-scene", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/scene", wcslen(argv[i])) == 0)
+		{
+			if (i + 1 < argc) m_sceneFile = argv[++i];
+		}
+		else if (wcsncmp(argv[i], L"-residencyBudget", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/residencyBudget", wcslen(argv[i])) == 0)
+		{
+			if (i + 1 < argc) m_residencyBudget = stoull(argv[++i]) * 1024 * 1024;
+		}
 		else if (wcsncmp(argv[i], L"-maxRaySamples", wcslen(argv[i])) == 0 ||
 			wcsncmp(argv[i], L"/maxRaySamples", wcslen(argv[i])) == 0)
 		{
 			if (i + 1 < argc) m_maxRaySamples = stoul(argv[++i]);
 		}
+		else if (wcsncmp(argv[i], L"-sampleBudget", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/sampleBudget", wcslen(argv[i])) == 0)
+		{
+			if (i + 1 < argc) m_sampleBudget = static_cast<uint64_t>(stod(argv[++i]) * 1.0e6);
+		}
+		else if (wcsncmp(argv[i], L"-sampleBudgetMs", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/sampleBudgetMs", wcslen(argv[i])) == 0)
+		{
+			if (i + 1 < argc) m_sampleBudgetMs = stof(argv[++i]);
+		}
+		else if (wcsncmp(argv[i], L"-costProfile", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/costProfile", wcslen(argv[i])) == 0)
+		{
+			if (i + 1 < argc)
+			{
+				m_costProfileFile.resize(wcslen(argv[++i]));
+				for (size_t j = 0; j < m_costProfileFile.size(); ++j)
+					m_costProfileFile[j] = static_cast<char>(argv[i][j]);
+			}
+		}
+		else if (wcsncmp(argv[i], L"-calibrateCost", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/calibrateCost", wcslen(argv[i])) == 0)
+		{
+			m_calibrateCost = true;
+			m_animate = true;
+		}
 		else if (wcsncmp(argv[i], L"-maxLightSamples", wcslen(argv[i])) == 0 ||
 			wcsncmp(argv[i], L"/maxLightSamples", wcslen(argv[i])) == 0)
 		{
 			if (i + 1 < argc) m_maxLightSamples = stoul(argv[++i]);
 		}
+		else if (wcsncmp(argv[i], L"-lightMapUpdates", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/lightMapUpdates", wcslen(argv[i])) == 0)
+		{
+			if (i + 1 < argc) m_lightMapUpdates = stoul(argv[++i]);
+		}
 		else if (wcsncmp(argv[i], L"-numVolumes", wcslen(argv[i])) == 0 ||
 			wcsncmp(argv[i], L"/numVolumes", wcslen(argv[i])) == 0)
 		{
@@ -609,6 +810,9 @@ void MultiVolumes::ParseCommandLineArgs(wchar_t* argv[], int argc)
 		{
 			if (i + 1 < argc) m_radianceFile = argv[++i];
 		}
+		else if (wcsncmp(argv[i], L"-syncLoad", wcslen(argv[i])) == 0 ||
+			wcsncmp(argv[i], L"/syncLoad", wcslen(argv[i])) == 0)
+			m_syncLoad = true;
 	}
 }
 
@@ -626,7 +830,11 @@ void MultiVolumes::PopulateCommandList()
 	const auto pCommandList = m_commandList.get();
 	XUSG_N_RETURN(pCommandList->Reset(pCommandAllocator, nullptr), ThrowIfFailed(E_FAIL));
 
+	// Uploaders of the last use of this frame slot have retired
+	m_frameUploaders[m_frameIndex].clear();
+
 	// Record commands.
+	UpdateVolumeLoading(pCommandList);
 	const auto descriptorHeap = m_descriptorTableLib->GetDescriptorHeap(CBV_SRV_UAV_HEAP);
 	pCommandList->SetDescriptorHeaps(1, &descriptorHeap);
 
@@ -671,7 +879,16 @@ void MultiVolumes::PopulateCommandList()
 
 	m_objectRenderer->Render(pCommandList, m_frameIndex, m_showMesh);
 	if (m_lightProbe) m_lightProbe->RenderEnvironment(pCommandList, m_frameIndex);
+	// Volume rendering between 2 timestamps when calibrating the path costs
+	const auto isTimed = m_isFrameTimed[m_frameIndex];
+	if (isTimed) pCommandList->EndQuery(m_timestampHeap.get(), QueryType::TIMESTAMP, 2 * m_frameIndex);
 	m_rayCaster->Render(pCommandList, m_frameIndex, pColor, m_oitMethod, m_useWorkGraph);
+	if (isTimed)
+	{
+		pCommandList->EndQuery(m_timestampHeap.get(), QueryType::TIMESTAMP, 2 * m_frameIndex + 1);
+		pCommandList->ResolveQueryData(m_timestampHeap.get(), QueryType::TIMESTAMP, 2 * m_frameIndex, 2,
+			m_timestamps.get(), sizeof(uint64_t) * 2 * m_frameIndex);
+	}
 
 	const auto pRenderTarget = m_renderTargets[m_frameIndex].get();
 	m_objectRenderer->Postprocess(pCommandList, pRenderTarget);
@@ -691,6 +908,257 @@ void MultiVolumes::PopulateCommandList()
 	XUSG_N_RETURN(pCommandList->Close(), ThrowIfFailed(E_FAIL));
 }
 
+void MultiVolumes::UpdateVolumeLoading(CommandList* pCommandList)
+{
+	static const auto maxVolumesPerBatch = 2u;
+	if (!m_volumeLoader) return;
+
+	auto& uploaders = m_frameUploaders[m_frameIndex];
+	auto isRemapped = false;
+
+	// The sequences decode ahead of their playheads
+	for (auto& sequence : m_sequences)
+		sequence.Player->Update(VolumeSequence::GetFrameAt(m_playbackTime, sequence.FrameRate));
+
+	// Hand the volumes whose copies have completed over to the direct queue for expansion
+	if (!m_copyingVolumes.empty() && m_copyFence->GetCompletedValue() >= m_copyFenceValue)
+	{
+		for (const auto& i : m_copyingVolumes)
+		{
+			XUSG_N_RETURN(m_rayCaster->ExpandVolumeData(pCommandList, i, uploaders), ThrowIfFailed(E_FAIL));
+			if (i > m_placeholderSlot)
+			{
+				// A sequence shows its new frame from this frame on, after the expansion
+				auto& sequence = m_sequences[(i - m_placeholderSlot - 1) / 2];
+				sequence.Back ^= 1;
+				sequence.HasFrame = true;
+			}
+			else m_residency->MarkLoaded(m_residency->GetSource(i));
+		}
+		m_copyingVolumes.clear();
+		m_copyUploaders.clear();
+		isRemapped = true;
+	}
+
+	// Record the uploads of the newly decoded volumes on the copy queue, one batch in flight at a time
+	if (m_copyingVolumes.empty())
+	{
+		const auto pCopyList = m_copyCommandList.get();
+		auto isRecording = false;
+		const auto beginRecording = [&]()
+		{
+			if (isRecording) return;
+			XUSG_N_RETURN(m_copyAllocator->Reset(), ThrowIfFailed(E_FAIL));
+			XUSG_N_RETURN(pCopyList->Reset(m_copyAllocator.get(), nullptr), ThrowIfFailed(E_FAIL));
+			isRecording = true;
+		};
+
+		unique_ptr<LoadedVolume> volume;
+		while (m_copyingVolumes.size() < maxVolumesPerBatch && m_volumeLoader->TryPop(volume))
+		{
+			if (volume->Succeeded)
+			{
+				beginRecording();
+
+				// Resources are left in the common state, promoted implicitly on the direct queue
+				if (m_rayCaster->UploadVolumeData(pCopyList, *volume, m_copyUploaders, ResourceState::COMMON))
+					m_copyingVolumes.emplace_back(volume->Index);
+			}
+			else
+			{
+				// Unsupported layouts go through the synchronous DDS loader on the direct queue
+				const auto source = m_residency->GetSource(volume->Index);
+				if (m_rayCaster->LoadVolumeData(pCommandList, volume->Index, ResolveVolumeFile(source).c_str(), uploaders))
+				{
+					m_residency->MarkLoaded(source);
+					isRemapped = true;
+				}
+			}
+		}
+
+		// The next frames of the sequences go to their back slots, which no frame in flight
+		// draws; a frame that fails to decode is skipped, and the shown one holds
+		for (auto& sequence : m_sequences)
+		{
+			if (!sequence.Player->TryTake(volume) || !volume->Succeeded) continue;
+
+			beginRecording();
+			volume->Index = sequence.Slots[sequence.Back];
+			if (m_rayCaster->UploadVolumeData(pCopyList, *volume, m_copyUploaders, ResourceState::COMMON))
+				m_copyingVolumes.emplace_back(volume->Index);
+		}
+
+		if (isRecording)
+		{
+			XUSG_N_RETURN(pCopyList->Close(), ThrowIfFailed(E_FAIL));
+			m_copyQueue->ExecuteCommandList(pCopyList);
+			XUSG_N_RETURN(m_copyQueue->Signal(m_copyFence.get(), ++m_copyFenceValue), ThrowIfFailed(E_FAIL));
+		}
+	}
+
+	// Page in the sources of the instances in view, the largest on screen first; a source
+	// that fails to load keeps its slot, and its instances keep drawing the placeholder
+	const auto numVolumes = m_rayCaster->GetNumVolumes();
+	m_residency->BeginFrame();
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		const auto source = m_instanceSources[i];
+		const auto coverage = m_rayCaster->GetVolumeCoverage(i);
+		if (coverage > 0.0f && m_sourceSequences[source] == NoSequence) m_residency->Touch(source, coverage);
+	}
+
+	m_residencyEvents.clear();
+	m_residency->Update(m_residencyEvents);
+	for (const auto& e : m_residencyEvents)
+	{
+		if (e.Type == ResidencyManager::EVENT_LOAD) m_volumeLoader->Request(ResolveVolumeFile(e.Source), e.Slot);
+		else isRemapped = true;
+	}
+
+	if (isRemapped) UpdateVolumeTexIds(pCommandList, uploaders);
+}
+
+void MultiVolumes::UpdateVolumeTexIds(CommandList* pCommandList, vector<Resource::uptr>& uploaders)
+{
+	// Instances of the sources that are not resident draw the placeholder
+	m_volTexIds.resize(m_rayCaster->GetNumVolumes());
+	for (auto i = 0u; i < m_volTexIds.size(); ++i)
+	{
+		const auto source = m_instanceSources[i];
+		auto slot = ResidencyManager::InvalidSlot;
+		if (m_sourceSequences[source] == NoSequence) slot = m_residency->GetSlot(source);
+		else
+		{
+			const auto& sequence = m_sequences[m_sourceSequences[source]];
+			if (sequence.HasFrame) slot = sequence.Slots[sequence.Back ^ 1];
+		}
+		m_volTexIds[i] = slot != ResidencyManager::InvalidSlot ? slot : m_placeholderSlot;
+	}
+
+	XUSG_N_RETURN(m_rayCaster->SetVolumeTexIds(pCommandList, m_volTexIds.data(), uploaders), ThrowIfFailed(E_FAIL));
+}
+
+void MultiVolumes::LoadVolumeList()
+{
+	if (m_volumeListFile.empty()) return;
+
+	ifstream fileStream(m_volumeListFile);
+	if (!fileStream) ThrowIfFailed(E_FAIL);
+
+	// One file per line; blank lines and lines starting with '#' are skipped
+	m_volumeFiles.clear();
+	string line;
+	while (getline(fileStream, line))
+	{
+		const auto first = line.find_first_not_of(" \t\r");
+		if (first == string::npos || line[first] == '#') continue;
+
+		const auto last = line.find_last_not_of(" \t\r");
+		m_volumeFiles.emplace_back(line.cbegin() + first, line.cbegin() + last + 1);
+	}
+}
+
+void MultiVolumes::LoadScene(vector<XMFLOAT3X4>& volumeWorlds, vector<float>& sampleScales)
+{
+	if (m_sceneFile.empty()) return;
+
+	SceneManifest scene;
+	if (!scene.Read(m_sceneFile.c_str()) || scene.GetNumInstances() == 0) ThrowIfFailed(E_FAIL);
+
+	m_volumeFiles.resize(scene.GetNumSources());
+	for (auto i = 0u; i < scene.GetNumSources(); ++i)
+	{
+		const string path = scene.GetSourcePath(i);
+		m_volumeFiles[i].assign(path.cbegin(), path.cend());
+	}
+
+	const auto numInstances = scene.GetNumInstances();
+	const auto pInstances = scene.GetInstances();
+	m_numVolumes = numInstances;
+	m_instanceSources.resize(numInstances);
+	volumeWorlds.resize(numInstances);
+	sampleScales.resize(numInstances);
+	for (auto i = 0u; i < numInstances; ++i)
+	{
+		const auto& instance = pInstances[i];
+		m_instanceSources[i] = instance.Source;
+		volumeWorlds[i] = MultiRayCaster::GetVolumeWorld(instance.Size,
+			XMFLOAT3(instance.Position), XMFLOAT4(instance.Rotation));
+		sampleScales[i] = instance.SampleScale;
+	}
+
+	// The first point light is the key light, which casts the shadows, toward its position;
+	// the other point and directional lights light the volumes of their reach. The first
+	// ambient light applies
+	auto hasLight = false, hasAmbient = false;
+	const auto pLights = scene.GetLights();
+	m_lights.clear();
+	for (auto i = 0u; i < scene.GetNumLights(); ++i)
+	{
+		const auto& light = pLights[i];
+		const XMFLOAT4 color(light.Color[0], light.Color[1], light.Color[2], light.Intensity);
+		if (light.Type == SceneManifest::LIGHT_POINT && !hasLight)
+		{
+			m_lightPt = XMFLOAT3(light.Position);
+			m_lightColor = color;
+			hasLight = true;
+		}
+		else if (light.Type == SceneManifest::LIGHT_AMBIENT)
+		{
+			if (!hasAmbient) m_ambientColor = color;
+			hasAmbient = true;
+		}
+		else
+		{
+			LightClusterer::Light listed = {};
+			listed.IsPoint = light.Type == SceneManifest::LIGHT_POINT;
+			for (uint8_t j = 0; j < 3; ++j)
+			{
+				listed.Position[j] = light.Position[j];
+				listed.Radiance[j] = light.Color[j] * light.Intensity;
+			}
+			m_lights.emplace_back(listed);
+		}
+	}
+}
+
+void MultiVolumes::LoadSequences()
+{
+	// Sources listed as .vseq files are sequences, one volume file per frame
+	m_sourceSequences.assign(m_volumeFiles.size(), NoSequence);
+	for (auto i = 0u; i < m_volumeFiles.size(); ++i)
+	{
+		const auto& fileName = m_volumeFiles[i];
+		const auto extPos = fileName.rfind(L'.');
+		if (extPos == wstring::npos || fileName.substr(extPos) != L".vseq") continue;
+
+		SequenceSource sequence = {};
+		sequence.FrameRate = 24.0f;
+		if (!VolumeSequence::ReadList(fileName, sequence.FrameFiles, sequence.FrameRate)) ThrowIfFailed(E_FAIL);
+
+		m_sourceSequences[i] = static_cast<uint32_t>(m_sequences.size());
+		m_sequences.emplace_back(move(sequence));
+	}
+}
+
+wstring MultiVolumes::ResolveVolumeFile(uint32_t source) const
+{
+	// Prefer the versions converted offline, if present: bricked sparse (.vbk) first,
+	// then block-compressed (.vbc)
+	const auto& fileName = m_volumeFiles[source];
+	const auto extPos = fileName.rfind(L'.');
+	if (extPos != wstring::npos && fileName.substr(extPos) == L".dds")
+	{
+		for (const auto ext : { L".vbk", L".vbc" })
+		{
+			const auto convertedFileName = fileName.substr(0, extPos) + ext;
+			if (GetFileAttributesW(convertedFileName.c_str()) != INVALID_FILE_ATTRIBUTES) return convertedFileName;
+		}
+	}
+
+	return fileName;
+}
+
 // Wait for pending GPU work to complete.
 void MultiVolumes::WaitForGpu()
 {
@@ -741,6 +1209,73 @@ void MultiVolumes::MoveToNextFrame()
 	}
 }
 
+void MultiVolumes::CreateCostTimer()
+{
+	const auto pDevice = static_cast<ID3D12Device*>(m_device->GetHandle());
+	const auto pCommandQueue = static_cast<ID3D12CommandQueue*>(m_commandQueue->GetHandle());
+
+	D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+	queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	queryHeapDesc.Count = 2 * FrameCount;
+	ThrowIfFailed(pDevice->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&m_timestampHeap)));
+	ThrowIfFailed(pCommandQueue->GetTimestampFrequency(&m_timestampFreq));
+
+	m_timestamps = Buffer::MakeUnique();
+	XUSG_N_RETURN(m_timestamps->Create(m_device.get(), sizeof(uint64_t) * 2 * FrameCount, ResourceFlag::DENY_SHADER_RESOURCE,
+		MemoryType::READBACK, 0, nullptr, 0, nullptr, MemoryFlag::NONE, L"Timestamps"), ThrowIfFailed(E_FAIL));
+}
+
+void MultiVolumes::UpdateCostCalibration()
+{
+	// Weights under which the cube-map path, or else the direct path, costs nothing
+	static const CostModel::Weights forcedCubeMap = { 0.0f, 0.0f, 1.0f, 0.0f };
+	static const CostModel::Weights forcedDirect = { 1.0f, 1.0f, 0.0f, 0.0f };
+	static auto frameCnt = 0u;
+
+	// The last use of this frame slot has completed on the GPU
+	if (m_isFrameTimed[m_frameIndex])
+	{
+		const auto pTimestamps = static_cast<const uint64_t*>(m_timestamps->Map(nullptr));
+		const auto ticks = pTimestamps[2 * m_frameIndex + 1] - pTimestamps[2 * m_frameIndex];
+		m_timestamps->Unmap();
+
+		CostModel::Measurement measurement;
+		measurement.FrameWork = m_frameWorks[m_frameIndex];
+		measurement.Milliseconds = 1000.0 * ticks / m_timestampFreq;
+		m_costMeasurements.push_back(measurement);
+		m_isFrameTimed[m_frameIndex] = false;
+	}
+
+	if (m_costMeasurements.size() >= g_numCostMeasurements)
+	{
+		// Fit the weights, and report the predicted against the measured costs
+		const auto numMeasurements = static_cast<uint32_t>(m_costMeasurements.size());
+		if (m_costModel.Calibrate(m_costMeasurements.data(), numMeasurements))
+		{
+			m_costModel.Save(m_costProfileFile.c_str());
+			CostModel::SaveMeasurements("CostReport.txt", m_costMeasurements.data(), numMeasurements, &m_costModel);
+		}
+		m_rayCaster->SetPathCosts(m_costModel.GetWeights());
+		m_costMeasurements.clear();
+		m_calibrateCost = false;
+
+		return;
+	}
+
+	// Cycle through the forced paths and the model, so that every weight has work to fit
+	switch (frameCnt++ % 3)
+	{
+	case 0:
+		m_rayCaster->SetPathCosts(forcedCubeMap);
+		break;
+	case 1:
+		m_rayCaster->SetPathCosts(forcedDirect);
+		break;
+	default:
+		m_rayCaster->SetPathCosts(m_costModel.GetWeights());
+	}
+}
+
 void MultiVolumes::SaveImage(char const* fileName, Buffer* pImageBuffer, uint32_t w, uint32_t h, uint32_t rowPitch, uint8_t comp)
 {
 	assert(comp == 3 || comp == 4);
@@ -803,6 +1338,29 @@ double MultiVolumes::CalculateFrameStats(float* pTimeStep)
 
 		windowText << L"    [W] " << (m_useWorkGraph ? "Work graph" : "Execute indirect");
 
+		// Share of the CPU culling reused from the last frame
+		const auto& culler = m_rayCaster->GetVolumeCuller();
+		const auto numCulled = culler.GetNumReused() + culler.GetNumRecomputed();
+		if (numCulled > 0) windowText << L"    Culling reused: " << setprecision(1) << fixed <<
+			100.0f * culler.GetNumReused() / numCulled << L"%";
+
+		// 8x8 tiles of the cube-map ray marching by face and mip bin, and the dispatch of
+		// full-size cubes they replace, with those of both off the cube-map faces
+		const auto& groups = m_rayCaster->GetCubeMapGroupCounts();
+		if (!m_useWorkGraph && groups.UnbinnedLaunched > 0)
+			windowText << L"    Cube-map tiles: " << groups.Launched << L" (" << groups.Wasted << L" idle), unbinned " <<
+			groups.UnbinnedLaunched << L" (" << groups.UnbinnedWasted << L" idle)";
+
+		if (m_sampleBudget > 0)
+		{
+			const auto& budget = m_rayCaster->GetSampleBudget();
+			windowText << L"    Ray samples: " << setprecision(1) << fixed << budget.GetTotalCost() / 1.0e6 <<
+				L"M of " << budget.GetMaxCost() / 1.0e6 << L"M";
+		}
+
+		if (m_calibrateCost) windowText << L"    Calibrating path costs: " <<
+			m_costMeasurements.size() << L"/" << g_numCostMeasurements;
+
 		SetCustomWindowText(windowText.str().c_str());
 	}
 
@@ -14,6 +14,9 @@
 #include "DXFramework.h"
 #include "StepTimer.h"
 #include "MultiRayCaster.h"
+#include "ResidencyManager.h"
+#include "SceneManifest.h"
+#include "VolumeSequence.h"
 #include "LightProbe.h"
 #include "ObjectRenderer.h"
 
@@ -88,6 +91,52 @@ private:
 	XUSG::Fence::uptr m_fence;
 	uint64_t	m_fenceValues[FrameCount];
 
+	// Asynchronous volume loading: files are decoded on worker threads, uploaded on the
+	// copy queue, and expanded on the direct queue once the copy fence has passed
+	std::unique_ptr<VolumeLoader>	m_volumeLoader;
+	XUSG::CommandQueue::uptr		m_copyQueue;
+	XUSG::CommandAllocator::uptr	m_copyAllocator;
+	XUSG::CommandList::uptr			m_copyCommandList;
+	XUSG::Fence::uptr				m_copyFence;
+	uint64_t						m_copyFenceValue;
+	std::vector<uint32_t>			m_copyingVolumes;
+	std::vector<XUSG::Resource::uptr> m_copyUploaders;
+	std::vector<XUSG::Resource::uptr> m_frameUploaders[FrameCount];
+
+	// Source residency: the sources are paged through a pool of GPU slots within the budget,
+	// and the instances of the sources that are not resident draw the placeholder slot
+	std::unique_ptr<ResidencyManager> m_residency;
+	std::vector<ResidencyManager::Event> m_residencyEvents;
+	std::vector<uint32_t>			m_volTexIds;
+	std::vector<uint32_t>			m_instanceSources;
+	uint32_t						m_placeholderSlot;
+
+	// Animated sources (.vseq): each plays its frames through two GPU slots of its own; the
+	// next frame is uploaded and expanded into the back slot, and the slots swap once it is
+	static const uint32_t NoSequence = UINT32_MAX;
+	struct SequenceSource
+	{
+		std::unique_ptr<VolumeSequence> Player;
+		std::vector<VolumeSequence::Path> FrameFiles;
+		float FrameRate;
+		uint32_t Slots[2];
+		uint8_t Back;
+		bool HasFrame;
+	};
+	std::vector<SequenceSource>		m_sequences;
+	std::vector<uint32_t>			m_sourceSequences;	// Per source, NoSequence for static ones
+	double							m_playbackTime;
+
+	// Path-cost calibration: the volume rendering of each frame is timed by GPU timestamps,
+	// cycling through the forced cube-map path, the forced direct path and the model
+	CostModel						m_costModel;
+	std::vector<CostModel::Measurement> m_costMeasurements;
+	CostModel::Work					m_frameWorks[FrameCount];
+	bool							m_isFrameTimed[FrameCount];
+	XUSG::com_ptr<ID3D12QueryHeap>	m_timestampHeap;
+	XUSG::Buffer::uptr				m_timestamps;	// Read-back, 2 per frame slot
+	uint64_t						m_timestampFreq;
+
 	// Application state
 	DeviceType	m_deviceType;
 	StepTimer	m_timer;
@@ -97,6 +146,8 @@ private:
 	bool		m_showMesh;
 	bool		m_showFPS;
 	bool		m_isPaused;
+	bool		m_syncLoad;
+	bool		m_calibrateCost;
 
 	// User camera interactions
 	bool m_tracking;
@@ -107,12 +158,23 @@ private:
 	uint32_t m_lightGridSize;
 	uint32_t m_maxRaySamples;
 	uint32_t m_maxLightSamples;
+	uint32_t m_lightMapUpdates;	// Light maps refreshed per frame
 	uint32_t m_numVolumes;
-	std::wstring m_volumeFiles[10];
+	std::vector<std::wstring> m_volumeFiles;
+	std::wstring m_volumeListFile;
+	std::wstring m_sceneFile;
+	uint64_t m_residencyBudget;	// In bytes; 0 keeps every source resident
+	uint64_t m_sampleBudget;	// Ray samples per frame; 0 for none
+	float m_sampleBudgetMs;		// Converted to m_sampleBudget by the path costs; 0 for none
+	std::string m_costProfileFile;
 	std::wstring m_radianceFile;
 	std::string m_meshFileName;
 	XMFLOAT4 m_volPosScale;
 	XMFLOAT4 m_meshPosScale;
+	XMFLOAT3 m_lightPt;
+	XMFLOAT4 m_lightColor;		// Intensity in w
+	XMFLOAT4 m_ambientColor;	// Intensity in w
+	std::vector<LightClusterer::Light> m_lights;	// Besides the key light, from a scene manifest
 	XMVECTORF32 m_clearColor;
 
 	// Screen-shot helpers and state
@@ -125,6 +187,14 @@ private:
 	void CreateSwapchain();
 	void CreateResources();
 	void PopulateCommandList();
+	void UpdateVolumeLoading(XUSG::CommandList* pCommandList);
+	void UpdateVolumeTexIds(XUSG::CommandList* pCommandList, std::vector<XUSG::Resource::uptr>& uploaders);
+	void LoadVolumeList();
+	void LoadScene(std::vector<XMFLOAT3X4>& volumeWorlds, std::vector<float>& sampleScales);
+	void LoadSequences();
+	void CreateCostTimer();
+	void UpdateCostCalibration();
+	std::wstring ResolveVolumeFile(uint32_t source) const;
 	void WaitForGpu();
 	void MoveToNextFrame();
 	void SaveImage(char const* fileName, XUSG::Buffer* pImageBuffer,
@@ -0,0 +1,333 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "BrickedVolume.h"
+#include "SharedConsts.h"
+#include "ToolCheck.h"
+
+using namespace std;
+
+ToolArgs::ToolArgs()
+{
+}
+
+ToolArgs::~ToolArgs()
+{
+}
+
+void ToolArgs::Add(const char* name, uint32_t& value, uint32_t minValue)
+{
+	Add(name, [&value, minValue](const char* arg) { value = (max)(static_cast<uint32_t>(stoul(arg)), minValue); });
+}
+
+void ToolArgs::Add(const char* name, float& value)
+{
+	Add(name, [&value](const char* arg) { value = stof(arg); });
+}
+
+void ToolArgs::Add(const char* name, double& value)
+{
+	Add(name, [&value](const char* arg) { value = stod(arg); });
+}
+
+void ToolArgs::Add(const char* name, string& value)
+{
+	Add(name, [&value](const char* arg) { value = arg; });
+}
+
+void ToolArgs::Add(const char* name, const function<void(const char*)>& parse)
+{
+	m_options.push_back({ name, parse, nullptr });
+}
+
+void ToolArgs::AddFlag(const char* name, bool& value)
+{
+	m_options.push_back({ name, nullptr, &value });
+}
+
+bool ToolArgs::Parse(int argc, char* argv[], vector<const char*>* pPositionals,
+	uint32_t minPositionals, uint32_t maxPositionals) const
+{
+	auto numPositionals = 0u;
+	for (auto i = 2; i < argc; ++i)
+	{
+		auto pOption = static_cast<const Option*>(nullptr);
+		for (const auto& option : m_options)
+			if (option.Name == argv[i]) pOption = &option;
+
+		if (pOption && pOption->pFlag) *pOption->pFlag = true;
+		else if (pOption && i + 1 < argc) pOption->Parse(argv[++i]);
+		else if (!pOption && pPositionals && argv[i][0] != '-')
+		{
+			pPositionals->emplace_back(argv[i]);
+			++numPositionals;
+		}
+		else
+		{
+			PrintUsage();
+
+			return false;
+		}
+	}
+
+	if (numPositionals < minPositionals || numPositionals > maxPositionals)
+	{
+		PrintUsage();
+
+		return false;
+	}
+
+	return true;
+}
+
+CheckReport::CheckReport() :
+	m_hasPassed(true)
+{
+}
+
+CheckReport::~CheckReport()
+{
+}
+
+bool CheckReport::Expect(const char* name, bool isMet)
+{
+	printf("%s: %s\n", name, isMet ? "yes" : "no");
+	m_hasPassed = m_hasPassed && isMet;
+
+	return isMet;
+}
+
+bool CheckReport::ExpectNone(const char* name, uint64_t count)
+{
+	printf("%s: %llu\n", name, static_cast<unsigned long long>(count));
+	m_hasPassed = m_hasPassed && count == 0;
+
+	return count == 0;
+}
+
+bool CheckReport::HasPassed() const
+{
+	return m_hasPassed;
+}
+
+int CheckReport::Finish() const
+{
+	printf("%s\n", m_hasPassed ? "PASSED" : "FAILED");
+
+	return m_hasPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void PrintBrickStats(const BrickedVolume& volume, size_t srcByteSize)
+{
+	const auto& header = volume.GetHeader();
+	const auto numBricks = volume.GetNumBricks();
+	const auto numEmpty = volume.GetNumBricks(BrickedVolume::BRICK_EMPTY);
+	const auto numConstant = volume.GetNumBricks(BrickedVolume::BRICK_CONSTANT);
+	const auto numData = volume.GetNumBricks(BrickedVolume::BRICK_DATA);
+	const auto denseByteSize = static_cast<size_t>(header.Width) * header.Height * header.Depth * sizeof(uint16_t);
+
+	printf("Volume: %ux%ux%u, brick size %u (%ux%ux%u bricks)\n", header.Width, header.Height, header.Depth,
+		header.BrickSize, header.NumBricksX, header.NumBricksY, header.NumBricksZ);
+	printf("Bricks: %u empty (%.1f%%), %u constant (%.1f%%), %u data (%.1f%%)\n",
+		numEmpty, 100.0 * numEmpty / numBricks, numConstant, 100.0 * numConstant / numBricks,
+		numData, 100.0 * numData / numBricks);
+	printf("Bytes: %zu file, %zu pool, %zu dense R16F", volume.GetFileByteSize(),
+		volume.GetBrickPoolByteSize(), denseByteSize);
+	if (srcByteSize) printf(", %zu source", srcByteSize);
+	printf("\n");
+}
+
+void PrintCompressionStats(const CompressedVolume& volume, const CompressedVolume::Metrics& metrics)
+{
+	const auto& header = volume.GetHeader();
+	const auto denseByteSize = static_cast<size_t>(header.Width) * header.Height * header.Depth * sizeof(uint16_t);
+
+	printf("Volume: %ux%ux%u, %ux%u BC4 blocks per slice, scale %g\n", header.Width, header.Height, header.Depth,
+		header.NumBlocksX, header.NumBlocksY, header.Scale);
+	printf("Bytes: %zu file, %zu blocks, %zu dense R16F (%.2f:1)\n", volume.GetFileByteSize(),
+		volume.GetBlockDataByteSize(), denseByteSize, static_cast<double>(denseByteSize) / volume.GetBlockDataByteSize());
+	printf("Error: PSNR %.2f dB, RMSE %g, max abs error %g (%.3f%% of peak %g)\n", metrics.PSNR, metrics.RMSE,
+		metrics.MaxError, metrics.Peak > 0.0f ? 100.0 * metrics.MaxError / metrics.Peak : 0.0, metrics.Peak);
+}
+
+// Slab entry of a ray into the [-1, 1] cube, as ComputeRayOrigin
+bool ComputeRayOrigin(float rayOrigin[3], const float rayDir[3])
+{
+	auto tMin = 0.0f, tMax = FLT_MAX;
+	for (auto i = 0u; i < 3; ++i)
+	{
+		if (rayDir[i] == 0.0f)
+		{
+			if (fabsf(rayOrigin[i]) > 1.0f) return false;
+			continue;
+		}
+
+		const auto t0 = (-1.0f - rayOrigin[i]) / rayDir[i], t1 = (1.0f - rayOrigin[i]) / rayDir[i];
+		tMin = (max)((min)(t0, t1), tMin);
+		tMax = (min)((max)(t0, t1), tMax);
+	}
+	if (tMin > tMax) return false;
+
+	for (auto i = 0u; i < 3; ++i) rayOrigin[i] = (min)((max)(rayOrigin[i] + rayDir[i] * tMin, -1.0f), 1.0f);
+
+	return true;
+}
+
+// CPU reference of CastLightRay in RayMarch.hlsli, with fixed steps: level mipLevel of the
+// grid is marched with 2^mipLevel times longer steps and as many times fewer samples
+float CastLightRay(const VolumeGrid& level, const float rayOrigin[3], const float rayDir[3],
+	uint32_t numSamples, uint32_t mipLevel)
+{
+	const auto mipScale = static_cast<float>(1u << mipLevel);
+	const auto step = 2.0f * sqrtf(3.0f) / numSamples * mipScale;
+	numSamples = (max)(numSamples >> mipLevel, 1u);
+
+	auto transm = 1.0f;
+	auto t = step;
+	for (auto i = 0u; i < numSamples; ++i)
+	{
+		float pos[3];
+		for (auto j = 0u; j < 3; ++j) pos[j] = rayOrigin[j] + rayDir[j] * t;
+		if (fabsf(pos[0]) > 1.0f || fabsf(pos[1]) > 1.0f || fabsf(pos[2]) > 1.0f) break;
+
+		const auto density = level.Sample(pos[0] * 0.5f + 0.5f, pos[1] * 0.5f + 0.5f, pos[2] * 0.5f + 0.5f) * g_gridDensityScale;
+		transm *= powf((min)((max)(1.0f - density * g_absorption, 0.0f), 1.0f), mipScale);
+		if (transm < g_zeroThreshold) break;
+
+		t += step;
+	}
+
+	return transm;
+}
+
+bool HasExtension(const char* fileName, const char* ext)
+{
+	const auto length = strlen(fileName), extLength = strlen(ext);
+
+	return length >= extLength && strcmp(fileName + length - extLength, ext) == 0;
+}
+
+Matrix4 Multiply(const Matrix4& a, const Matrix4& b)
+{
+	Matrix4 r;
+	for (auto i = 0u; i < 4; ++i)
+		for (auto j = 0u; j < 4; ++j)
+			r.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j];
+
+	return r;
+}
+
+// XMMatrixLookAtLH() * XMMatrixPerspectiveFovLH()
+Matrix4 GetViewProj(const float eye[3], const float at[3], float fovY, float aspect, float zNear, float zFar)
+{
+	const auto normalize = [](float v[3])
+	{
+		const auto len = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		for (auto i = 0u; i < 3; ++i) v[i] /= len;
+	};
+
+	float z[3] = { at[0] - eye[0], at[1] - eye[1], at[2] - eye[2] };
+	normalize(z);
+	float x[3] = { z[2], 0.0f, -z[0] };	// cross((0, 1, 0), z)
+	normalize(x);
+	const float y[3] = { z[1] * x[2] - z[2] * x[1], z[2] * x[0] - z[0] * x[2], z[0] * x[1] - z[1] * x[0] };
+
+	Matrix4 view = {};
+	for (auto i = 0u; i < 3; ++i)
+	{
+		view.m[i][0] = x[i];
+		view.m[i][1] = y[i];
+		view.m[i][2] = z[i];
+	}
+
+	view.m[3][0] = -(x[0] * eye[0] + x[1] * eye[1] + x[2] * eye[2]);
+	view.m[3][1] = -(y[0] * eye[0] + y[1] * eye[1] + y[2] * eye[2]);
+	view.m[3][2] = -(z[0] * eye[0] + z[1] * eye[1] + z[2] * eye[2]);
+	view.m[3][3] = 1.0f;
+
+	const auto h = 1.0f / tanf(fovY * 0.5f), range = zFar / (zFar - zNear);
+	Matrix4 proj = {};
+	proj.m[0][0] = h / aspect;
+	proj.m[1][1] = h;
+	proj.m[2][2] = range;
+	proj.m[2][3] = 1.0f;
+	proj.m[3][2] = -range * zNear;
+
+	return Multiply(view, proj);
+}
+
+// The world matrix of a volume cube as MultiRayCaster::GetVolumeWorld() builds it, and its
+// inverse in the XMFLOAT3X4 layout
+Matrix4 GetVolumeWorld(float size, const float pos[3], const float rotation[4], float worldI[12])
+{
+	const auto x = rotation[0], y = rotation[1], z = rotation[2], w = rotation[3];
+	const float rot[3][3] =
+	{
+		{ 1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + z * w), 2.0f * (x * z - y * w) },
+		{ 2.0f * (x * y - z * w), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + x * w) },
+		{ 2.0f * (x * z + y * w), 2.0f * (y * z - x * w), 1.0f - 2.0f * (x * x + y * y) }
+	};
+
+	const auto scale = size * 0.5f;
+	Matrix4 world = {};
+	for (auto i = 0u; i < 3; ++i)
+	{
+		for (auto j = 0u; j < 3; ++j) world.m[i][j] = rot[i][j] * scale;
+		world.m[3][i] = pos[i];
+
+		// Row i of XMFLOAT3X4 holds column i of the inverse
+		for (auto j = 0u; j < 3; ++j) worldI[i * 4 + j] = rot[i][j] / scale;
+		worldI[i * 4 + 3] = -(pos[0] * rot[i][0] + pos[1] * rot[i][1] + pos[2] * rot[i][2]) / scale;
+	}
+
+	world.m[3][3] = 1.0f;
+
+	return world;
+}
+
+// Volumes of random sizes and orientations scattered over a field, with their inverse
+// worlds in the XMFLOAT3X4 layout and their sample scales; returns the field extent
+float ScatterVolumes(uint32_t numVolumes, uint32_t seed, vector<Matrix4>& worlds,
+	vector<float>& worldIs, vector<float>& sampleScales)
+{
+	auto state = seed;
+	const auto random = [&state]()
+	{
+		state = state * 1664525u + 1013904223u;
+
+		return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+	};
+
+	worlds.resize(numVolumes);
+	worldIs.resize(12 * numVolumes);
+	sampleScales.resize(numVolumes);
+	const auto extent = (min)(40.0f * sqrtf(static_cast<float>(numVolumes)), 2.0f * g_zFar);
+	for (auto i = 0u; i < numVolumes; ++i)
+	{
+		const float pos[] = { (random() - 0.5f) * extent, (random() - 0.5f) * 40.0f, (random() - 0.5f) * extent };
+		float rotation[] = { random() - 0.5f, random() - 0.5f, random() - 0.5f, random() - 0.5f };
+		const auto len = sqrtf(rotation[0] * rotation[0] + rotation[1] * rotation[1] +
+			rotation[2] * rotation[2] + rotation[3] * rotation[3]);
+		for (auto& q : rotation) q /= len;
+
+		worlds[i] = GetVolumeWorld(2.0f + random() * 30.0f, pos, rotation, &worldIs[12 * i]);
+		sampleScales[i] = i % 3 ? 1.0f : 0.25f + random() * 1.5f;
+	}
+
+	return extent;
+}
+
+// Stored as XMFLOAT3X4: row c holds column c of the world matrix
+void GetWorld3x4(const Matrix4& world, float world3x4[12])
+{
+	for (auto c = 0u; c < 3; ++c)
+		for (auto j = 0u; j < 4; ++j) world3x4[4 * c + j] = world.m[j][c];
+}
@@ -0,0 +1,127 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "CompressedVolume.h"
+
+class BrickedVolume;
+
+//--------------------------------------------------------------------------------------
+// Options of a volumetool subcommand by name, each followed by its value unless it is a
+// flag, among positional arguments. Parse() prints the usage on an unknown option, a
+// missing value or a number of positional arguments out of range.
+//--------------------------------------------------------------------------------------
+class ToolArgs
+{
+public:
+	ToolArgs();
+	virtual ~ToolArgs();
+
+	void Add(const char* name, uint32_t& value, uint32_t minValue = 0);
+	void Add(const char* name, float& value);
+	void Add(const char* name, double& value);
+	void Add(const char* name, std::string& value);
+	void Add(const char* name, const std::function<void(const char*)>& parse);
+	void AddFlag(const char* name, bool& value);
+
+	// Parses the arguments after the subcommand
+	bool Parse(int argc, char* argv[], std::vector<const char*>* pPositionals = nullptr,
+		uint32_t minPositionals = 0, uint32_t maxPositionals = UINT32_MAX) const;
+
+protected:
+	struct Option
+	{
+		std::string Name;
+		std::function<void(const char*)> Parse;	// nullptr for flags
+		bool* pFlag;
+	};
+
+	std::vector<Option> m_options;
+};
+
+//--------------------------------------------------------------------------------------
+// Pass/fail reporting of a check: each condition or error count is printed as it is
+// added, and Finish() prints PASSED or FAILED and returns the exit code.
+//--------------------------------------------------------------------------------------
+class CheckReport
+{
+public:
+	CheckReport();
+	virtual ~CheckReport();
+
+	bool Expect(const char* name, bool isMet);				// Prints "name: yes|no"
+	bool ExpectNone(const char* name, uint64_t count);		// Prints "name: count"
+	bool HasPassed() const;
+	int Finish() const;
+
+protected:
+	bool m_hasPassed;
+};
+
+//--------------------------------------------------------------------------------------
+// Row-major matrices for row vectors, as DirectXMath builds them
+//--------------------------------------------------------------------------------------
+struct Matrix4
+{
+	float m[4][4];
+};
+
+// Constants of the ray marchers in RayMarch.hlsli
+static const float g_absorption = 0.8f;
+static const float g_zeroThreshold = 0.01f;
+static const float g_gridDensityScale = 0.25f;	// Grids store a quarter of the source density
+
+// The usage of volumetool, in VolumeTool.cpp
+void PrintUsage();
+
+// Shared by the tools and the checks
+void PrintBrickStats(const BrickedVolume& volume, size_t srcByteSize);
+void PrintCompressionStats(const CompressedVolume& volume, const CompressedVolume::Metrics& metrics);
+bool HasExtension(const char* fileName, const char* ext);
+
+// Scenes of the culling checks
+Matrix4 Multiply(const Matrix4& a, const Matrix4& b);
+Matrix4 GetViewProj(const float eye[3], const float at[3], float fovY, float aspect, float zNear, float zFar);
+Matrix4 GetVolumeWorld(float size, const float pos[3], const float rotation[4], float worldI[12]);
+float ScatterVolumes(uint32_t numVolumes, uint32_t seed, std::vector<Matrix4>& worlds,
+	std::vector<float>& worldIs, std::vector<float>& sampleScales);
+void GetWorld3x4(const Matrix4& world, float world3x4[12]);
+
+// Slab entry of a ray into the [-1, 1] cube, as ComputeRayOrigin
+bool ComputeRayOrigin(float rayOrigin[3], const float rayDir[3]);
+
+// CPU reference of CastLightRay in RayMarch.hlsli, with fixed steps through level mipLevel
+float CastLightRay(const VolumeGrid& level, const float rayOrigin[3], const float rayDir[3],
+	uint32_t numSamples, uint32_t mipLevel);
+
+// Subcommands, in the check sources next to the modules they cover
+int Verify(int argc, char* argv[]);				// BrickedVolumeCheck.cpp
+int VerifyBC(int argc, char* argv[]);			// CompressedVolumeCheck.cpp
+int SkipStats(int argc, char* argv[]);			// MacroCellGridCheck.cpp
+int MipStats(int argc, char* argv[]);			// VolumeMipChainCheck.cpp
+int BenchIngest(int argc, char* argv[]);		// MappedFileCheck.cpp
+int BenchLoad(int argc, char* argv[]);			// VolumeLoaderCheck.cpp
+int ResidencySim(int argc, char* argv[]);		// ResidencyManagerCheck.cpp
+int BenchSequence(int argc, char* argv[]);		// VolumeSequenceCheck.cpp
+int BenchScene(int argc, char* argv[]);			// SceneManifestCheck.cpp
+int CullCheck(int argc, char* argv[]);			// VolumeCullerCheck.cpp
+int BVHCheck(int argc, char* argv[]);			// VolumeBVHCheck.cpp
+int HiZCheck(int argc, char* argv[]);			// HiZPyramidCheck.cpp
+int FrustumCheck(int argc, char* argv[]);		// VolumeCullerCheck.cpp
+int TemporalCheck(int argc, char* argv[]);		// VolumeCullerCheck.cpp
+int BudgetCheck(int argc, char* argv[]);		// SampleBudgetCheck.cpp
+int CostCheck(int argc, char* argv[]);			// CostModelCheck.cpp
+int FaceEdgeCheck(int argc, char* argv[]);		// VolumeCullerCheck.cpp
+int FaceCheck(int argc, char* argv[]);			// VolumeCullerCheck.cpp
+int DispatchCheck(int argc, char* argv[]);		// VolumeCullerCheck.cpp
+int LightMapCheck(int argc, char* argv[]);		// LightMapSchedulerCheck.cpp
+int AOCheck(int argc, char* argv[]);			// VolumeBVHCheck.cpp
+int DeepShadowCheck(int argc, char* argv[]);	// DeepShadowMapCheck.cpp
+int LightCheck(int argc, char* argv[]);			// LightClustererCheck.cpp
+int LightResCheck(int argc, char* argv[]);		// LightMapAllocatorCheck.cpp
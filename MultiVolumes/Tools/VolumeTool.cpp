@@ -0,0 +1,368 @@
+//--------------------------------------------------------------------------------------
+// Copyright (c) XU, Tianchen. All rights reserved.
+//--------------------------------------------------------------------------------------
+
+// Portable command-line tool for the volume assets; it has no D3D dependency.
+// Build on Linux from the repository root, for example (one line):
+//   g++ -std=c++17 -O2 -pthread -IMultiVolumes/Content -IMultiVolumes/Tools MultiVolumes/Tools/*.cpp
+//     MultiVolumes/Content/*Check.cpp MultiVolumes/Content/DDSVolume.cpp MultiVolumes/Content/BrickedVolume.cpp
+//     MultiVolumes/Content/CompressedVolume.cpp MultiVolumes/Content/MacroCellGrid.cpp
+//     MultiVolumes/Content/MappedFile.cpp MultiVolumes/Content/VolumeLoader.cpp
+//     MultiVolumes/Content/VolumeMipChain.cpp MultiVolumes/Content/ResidencyManager.cpp
+//     MultiVolumes/Content/SceneManifest.cpp MultiVolumes/Content/VolumeSequence.cpp
+//     MultiVolumes/Content/ProceduralVolume.cpp MultiVolumes/Content/VolumeCuller.cpp
+//     MultiVolumes/Content/VolumeBVH.cpp MultiVolumes/Content/HiZPyramid.cpp
+//     MultiVolumes/Content/SampleBudget.cpp MultiVolumes/Content/CostModel.cpp
+//     MultiVolumes/Content/LightMapScheduler.cpp MultiVolumes/Content/DeepShadowMap.cpp
+//     MultiVolumes/Content/LightClusterer.cpp MultiVolumes/Content/LightMapAllocator.cpp
+//     -o volumetool
+// Add -mavx2 to build the AVX2 culling kernels instead of SSE2; AArch64 builds use NEON.
+// The checks live next to the modules they cover, in MultiVolumes/Content/*Check.cpp.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "DDSVolume.h"
+#include "BrickedVolume.h"
+#include "CompressedVolume.h"
+#include "ProceduralVolume.h"
+#include "SceneManifest.h"
+#include "ToolCheck.h"
+
+using namespace std;
+
+void PrintUsage()
+{
+	printf("Usage:\n");
+	printf("  volumetool convert <in.dds> <out.vbk> [-brickSize n] [-emptyThreshold t] [-constantTolerance t]\n");
+	printf("  volumetool info <in.vbk>\n");
+	printf("  volumetool verify <in.dds> <in.vbk>\n");
+	printf("  volumetool compress <in.dds> <out.vbc> [-threads n]\n");
+	printf("  volumetool verify-bc <in.dds> <in.vbc> [-minPSNR db] [-threads n]\n");
+	printf("  volumetool skip-stats <in.dds|in.vbk|in.vbc> [-samples n] [-rays n] [-margin m]\n");
+	printf("  volumetool mip-stats <in.dds|in.vbk|in.vbc> [-size n] [-samples n] [-rays n] [-threads n]\n");
+	printf("  volumetool bench-ingest <in.dds> [-iterations n]\n");
+	printf("  volumetool bench-load <in.dds|in.vbk|in.vbc>... [-repeat n] [-maxThreads n]\n");
+	printf("  volumetool residency-sim [-sources n] [-instances n] [-view n] [-frames n] [-slotMB n] [-budgetMB n]\n");
+	printf("                           [-maxLoads n] [-latency n] [-turn n] [-weight w] [-seed n]\n");
+	printf("  volumetool bench-sequence <in.vseq|frame files...> [-frames n] [-ring n] [-threads n] [-size n]\n");
+	printf("                            [-fps f] [-renderHz f]\n");
+	printf("  volumetool scene-convert <in.txt|in.vscn> <out.txt|out.vscn>\n");
+	printf("  volumetool bench-scene [-instances n] [-sources n] [-iterations n] [-out prefix]\n");
+	printf("  volumetool cull-check [-volumes n] [-views n] [-threads n] [-seed n]\n");
+	printf("  volumetool bvh-check [-volumes n] [-views n] [-rays n] [-k n] [-seed n]\n");
+	printf("  volumetool hiz-check [-volumes n] [-views n] [-seed n]\n");
+	printf("  volumetool frustum-check [-volumes n] [-views n] [-seed n]\n");
+	printf("  volumetool temporal-check [-volumes n] [-frames n] [-threshold px] [-moving f] [-seed n]\n");
+	printf("  volumetool budget-check [-sets n] [-volumes n] [-seed n]\n");
+	printf("  volumetool cost-check [-measurements file] [-report file] [-seed n]\n");
+	printf("  volumetool face-edge-check [-volumes n] [-seed n]\n");
+	printf("  volumetool face-check [-volumes n] [-views n] [-seed n]\n");
+	printf("  volumetool dispatch-check [-volumes n] [-views n] [-grid n] [-seed n]\n");
+	printf("  volumetool lightmap-check [-volumes n] [-frames n] [-updates n] [-seed n]\n");
+	printf("  volumetool ao-check [-volumes n] [-voxels n] [-seed n]\n");
+	printf("  volumetool deepshadow-check [-volumes n] [-receivers n] [-samples n] [-size n] [-seed n]\n");
+	printf("  volumetool light-check [-volumes n] [-lights n] [-max n] [-cutoff f] [-seed n]\n");
+	printf("  volumetool lightres-check [-volumes n] [-frames n] [-updates n] [-size n] [-seed n]\n");
+	printf("  volumetool generate <in.vgen|sphere|cloud|shell|noise> <out.dds|out.vbk|out.vbc|out.vgen> [-size n]\n");
+	printf("                      [-seed n] [-octaves n] [-frequency f] [-empty f] [-density d] [-half] [-threads n]\n");
+}
+
+static int convert(int argc, char* argv[])
+{
+	BrickedVolume::BuildDesc desc;
+	ToolArgs args;
+	args.Add("-brickSize", desc.BrickSize);
+	args.Add("-emptyThreshold", desc.EmptyThreshold);
+	args.Add("-constantTolerance", desc.ConstantTolerance);
+	vector<const char*> files;
+	if (!args.Parse(argc, argv, &files, 2, 2)) return EXIT_FAILURE;
+
+	VolumeGrid grid;
+	DDSVolume::Info info;
+	if (!DDSVolume::Read(files[0], grid, &info))
+	{
+		fprintf(stderr, "Failed to read DDS volume %s\n", files[0]);
+
+		return EXIT_FAILURE;
+	}
+
+	BrickedVolume volume;
+	if (!volume.Build(grid, desc) || !volume.Write(files[1]))
+	{
+		fprintf(stderr, "Failed to write bricked volume %s\n", files[1]);
+
+		return EXIT_FAILURE;
+	}
+
+	PrintBrickStats(volume, grid.GetNumVoxels() * DDSVolume::GetBytesPerVoxel(info.VoxelFormat));
+
+	return EXIT_SUCCESS;
+}
+
+static int info(int argc, char* argv[])
+{
+	vector<const char*> files;
+	if (!ToolArgs().Parse(argc, argv, &files, 1, 1)) return EXIT_FAILURE;
+
+	BrickedVolume volume;
+	if (!volume.Read(files[0]))
+	{
+		fprintf(stderr, "Failed to read bricked volume %s\n", files[0]);
+
+		return EXIT_FAILURE;
+	}
+
+	PrintBrickStats(volume, 0);
+
+	return EXIT_SUCCESS;
+}
+
+static int compress(int argc, char* argv[])
+{
+	auto numThreads = 0u;
+	ToolArgs args;
+	args.Add("-threads", numThreads);
+	vector<const char*> files;
+	if (!args.Parse(argc, argv, &files, 2, 2)) return EXIT_FAILURE;
+
+	VolumeGrid grid, decoded;
+	if (!DDSVolume::Read(files[0], grid))
+	{
+		fprintf(stderr, "Failed to read DDS volume %s\n", files[0]);
+
+		return EXIT_FAILURE;
+	}
+
+	CompressedVolume volume;
+	auto start = chrono::steady_clock::now();
+	const auto encoded = volume.Encode(grid, numThreads);
+	const auto encodeSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	if (!encoded || !volume.Write(files[1]))
+	{
+		fprintf(stderr, "Failed to write compressed volume %s\n", files[1]);
+
+		return EXIT_FAILURE;
+	}
+
+	start = chrono::steady_clock::now();
+	volume.Decode(decoded, numThreads);
+	const auto decodeSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	PrintCompressionStats(volume, CompressedVolume::Compare(grid, decoded));
+	printf("Encode: %.2f ms, decode: %.2f ms\n", encodeSeconds * 1000.0, decodeSeconds * 1000.0);
+
+	return EXIT_SUCCESS;
+}
+
+static int sceneConvert(int argc, char* argv[])
+{
+	vector<const char*> files;
+	if (!ToolArgs().Parse(argc, argv, &files, 2, 2)) return EXIT_FAILURE;
+
+	SceneManifest scene;
+	if (!scene.Read(files[0]))
+	{
+		if (scene.GetErrorLine() > 0) fprintf(stderr, "%s(%u): invalid record.\n", files[0], scene.GetErrorLine());
+		else fprintf(stderr, "Failed to read %s.\n", files[0]);
+
+		return EXIT_FAILURE;
+	}
+
+	const auto succeeded = HasExtension(files[1], ".vscn") ? scene.WriteBinary(files[1]) : scene.WriteText(files[1]);
+	if (!succeeded)
+	{
+		fprintf(stderr, "Failed to write %s.\n", files[1]);
+
+		return EXIT_FAILURE;
+	}
+
+	printf("%u sources, %u instances, %u lights\n", scene.GetNumSources(), scene.GetNumInstances(), scene.GetNumLights());
+
+	return EXIT_SUCCESS;
+}
+
+static uint64_t hashVoxels(const float* pVoxels, size_t numVoxels, uint64_t hash = 0xcbf29ce484222325)
+{
+	const auto pBytes = reinterpret_cast<const uint8_t*>(pVoxels);
+	for (size_t i = 0; i < sizeof(float) * numVoxels; ++i) hash = (hash ^ pBytes[i]) * 0x100000001b3;
+
+	return hash;
+}
+
+static double getEmptyFraction(const float* pVoxels, size_t numVoxels)
+{
+	return static_cast<double>(count(pVoxels, pVoxels + numVoxels, 0.0f)) / numVoxels;
+}
+
+// Generates a procedural volume into any of the volume formats, or writes its desc for
+// the app to generate at load time. The middle slices are regenerated on one thread by a
+// fresh generator, and must match bit for bit.
+static int generate(int argc, char* argv[])
+{
+	ProceduralVolume::Desc desc;
+	auto format = DDSVolume::FORMAT_R32_FLOAT;
+	auto numThreads = 0u;
+	auto isHalf = false;
+	ToolArgs args;
+	args.Add("-size", [&desc](const char* arg) { desc.Width = desc.Height = desc.Depth = stoul(arg); });
+	args.Add("-seed", desc.Seed);
+	args.Add("-octaves", desc.Octaves);
+	args.Add("-frequency", desc.Frequency);
+	args.Add("-empty", desc.EmptyFraction);
+	args.Add("-density", desc.Density);
+	args.AddFlag("-half", isHalf);
+	args.Add("-threads", numThreads);
+	vector<const char*> files;
+	if (!args.Parse(argc, argv, &files, 2, 2)) return EXIT_FAILURE;
+	if (isHalf) format = DDSVolume::FORMAT_R16_FLOAT;
+
+	if (HasExtension(files[0], ".vgen"))
+	{
+		ifstream descFile(files[0]);
+		if (!descFile || !ProceduralVolume::ReadDesc(descFile, desc))
+		{
+			fprintf(stderr, "Failed to read procedural volume desc %s\n", files[0]);
+
+			return EXIT_FAILURE;
+		}
+
+		// The options override the desc file
+		files.clear();
+		args.Parse(argc, argv, &files);
+	}
+	else if (!ProceduralVolume::ParseShape(files[0], desc.VolumeShape))
+	{
+		fprintf(stderr, "Unknown shape %s\n", files[0]);
+
+		return EXIT_FAILURE;
+	}
+
+	ProceduralVolume generator;
+	if (!generator.Init(desc, numThreads))
+	{
+		fprintf(stderr, "Invalid procedural volume desc\n");
+
+		return EXIT_FAILURE;
+	}
+
+	const auto outFile = files[1];
+	if (HasExtension(outFile, ".vgen"))
+	{
+		ofstream descFile(outFile);
+		if (!descFile || !ProceduralVolume::WriteDesc(descFile, desc))
+		{
+			fprintf(stderr, "Failed to write %s\n", outFile);
+
+			return EXIT_FAILURE;
+		}
+
+		return EXIT_SUCCESS;
+	}
+
+	printf("Volume: %s %ux%ux%u, seed %u, cut-off %.4f\n", ProceduralVolume::GetShapeName(desc.VolumeShape),
+		desc.Width, desc.Height, desc.Depth, desc.Seed, generator.GetCutoff());
+
+	// DDS is streamed a slab at a time; the other formats are built from the whole grid
+	const auto numVoxels = static_cast<size_t>(desc.Width) * desc.Height * desc.Depth;
+	auto succeeded = false;
+	auto start = chrono::steady_clock::now();
+	if (HasExtension(outFile, ".dds")) succeeded = generator.WriteDDS(outFile, format, numThreads);
+	else
+	{
+		VolumeGrid grid;
+		generator.Generate(grid, numThreads);
+		const auto generateSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		printf("Generate: %.2f ms, %.1f Mvoxels/s, %.1f%% empty, hash %016llx\n", generateSeconds * 1000.0,
+			numVoxels / generateSeconds * 1.0e-6, getEmptyFraction(grid.Voxels.data(), numVoxels) * 100.0,
+			static_cast<unsigned long long>(hashVoxels(grid.Voxels.data(), numVoxels)));
+
+		if (HasExtension(outFile, ".vbk"))
+		{
+			BrickedVolume volume;
+			succeeded = volume.Build(grid, BrickedVolume::BuildDesc()) && volume.Write(outFile);
+			if (succeeded) PrintBrickStats(volume, 0);
+		}
+		else if (HasExtension(outFile, ".vbc"))
+		{
+			CompressedVolume volume;
+			succeeded = volume.Encode(grid, numThreads) && volume.Write(outFile);
+		}
+		else fprintf(stderr, "Unknown output format %s\n", outFile);
+	}
+
+	const auto seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	if (!succeeded)
+	{
+		fprintf(stderr, "Failed to write %s\n", outFile);
+
+		return EXIT_FAILURE;
+	}
+
+	printf("Total: %.2f ms, %.1f Mvoxels/s\n", seconds * 1000.0, numVoxels / seconds * 1.0e-6);
+
+	// Determinism: the same slices from another generator on one thread
+	const auto numSlices = (min)(desc.Depth, 4u);
+	const auto firstSlice = (desc.Depth - numSlices) / 2;
+	const auto sliceVoxels = static_cast<size_t>(desc.Width) * desc.Height * numSlices;
+	vector<float> slices(sliceVoxels), reference(sliceVoxels);
+	generator.GenerateSlices(firstSlice, numSlices, slices.data(), numThreads);
+
+	ProceduralVolume referenceGenerator;
+	referenceGenerator.Init(desc, 1);
+	referenceGenerator.GenerateSlices(firstSlice, numSlices, reference.data(), 1);
+
+	CheckReport report;
+	report.Expect("Deterministic", memcmp(slices.data(), reference.data(), sizeof(float) * sliceVoxels) == 0);
+
+	return report.Finish();
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		PrintUsage();
+
+		return EXIT_FAILURE;
+	}
+
+	if (strcmp(argv[1], "convert") == 0) return convert(argc, argv);
+	if (strcmp(argv[1], "info") == 0) return info(argc, argv);
+	if (strcmp(argv[1], "verify") == 0) return Verify(argc, argv);
+	if (strcmp(argv[1], "compress") == 0) return compress(argc, argv);
+	if (strcmp(argv[1], "verify-bc") == 0) return VerifyBC(argc, argv);
+	if (strcmp(argv[1], "skip-stats") == 0) return SkipStats(argc, argv);
+	if (strcmp(argv[1], "mip-stats") == 0) return MipStats(argc, argv);
+	if (strcmp(argv[1], "bench-ingest") == 0) return BenchIngest(argc, argv);
+	if (strcmp(argv[1], "bench-load") == 0) return BenchLoad(argc, argv);
+	if (strcmp(argv[1], "residency-sim") == 0) return ResidencySim(argc, argv);
+	if (strcmp(argv[1], "bench-sequence") == 0) return BenchSequence(argc, argv);
+	if (strcmp(argv[1], "scene-convert") == 0) return sceneConvert(argc, argv);
+	if (strcmp(argv[1], "bench-scene") == 0) return BenchScene(argc, argv);
+	if (strcmp(argv[1], "generate") == 0) return generate(argc, argv);
+	if (strcmp(argv[1], "cull-check") == 0) return CullCheck(argc, argv);
+	if (strcmp(argv[1], "bvh-check") == 0) return BVHCheck(argc, argv);
+	if (strcmp(argv[1], "hiz-check") == 0) return HiZCheck(argc, argv);
+	if (strcmp(argv[1], "frustum-check") == 0) return FrustumCheck(argc, argv);
+	if (strcmp(argv[1], "temporal-check") == 0) return TemporalCheck(argc, argv);
+	if (strcmp(argv[1], "budget-check") == 0) return BudgetCheck(argc, argv);
+	if (strcmp(argv[1], "cost-check") == 0) return CostCheck(argc, argv);
+	if (strcmp(argv[1], "face-edge-check") == 0) return FaceEdgeCheck(argc, argv);
+	if (strcmp(argv[1], "face-check") == 0) return FaceCheck(argc, argv);
+	if (strcmp(argv[1], "dispatch-check") == 0) return DispatchCheck(argc, argv);
+	if (strcmp(argv[1], "lightmap-check") == 0) return LightMapCheck(argc, argv);
+	if (strcmp(argv[1], "ao-check") == 0) return AOCheck(argc, argv);
+	if (strcmp(argv[1], "deepshadow-check") == 0) return DeepShadowCheck(argc, argv);
+	if (strcmp(argv[1], "light-check") == 0) return LightCheck(argc, argv);
+	if (strcmp(argv[1], "lightres-check") == 0) return LightResCheck(argc, argv);
+
+	PrintUsage();
+
+	return EXIT_FAILURE;
+}